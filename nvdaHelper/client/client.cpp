@@ -14,12 +14,202 @@ http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html
 
 #include <string>
 #include <sstream>
+#include <deque>
+#include <vector>
 #include <rpc.h>
 #include "nvdaController.h"
 #include <common/winIPCUtils.h>
+#include <common/lock.h>
 
 using namespace std;
 
+/**
+ * The most requests which may be waiting to be sent before the async functions start failing.
+ */
+const size_t MAX_QUEUED_REQUESTS=256;
+
+/**
+ * How long (in ms) the sender thread waits for a new request before exiting.
+ */
+const DWORD SENDER_IDLE_TIMEOUT=5000;
+
+typedef struct {
+	nvdaController_requestType_t type;
+	wstring text;
+	unsigned long ID;
+} queuedRequest_t;
+
+LockableObject requestQueueLock;
+deque<queuedRequest_t> requestQueue;
+//IDs of the last request queued and the last request known to be sent (or dropped).
+unsigned long lastQueuedRequestID=0;
+unsigned long lastSentRequestID=0;
+//The first error encountered by the sender since the last flush.
+error_status_t sendError=0;
+bool senderThreadRunning=false;
+bool processRequestsUnsupported=false;
+HANDLE requestQueuedEvent=NULL;
+//Set each time the sender thread finishes sending a batch.
+HANDLE batchSentEvent=NULL;
+
+error_status_t sendRequestsIndividually(const vector<queuedRequest_t>& batch) {
+	error_status_t firstError=0;
+	for(vector<queuedRequest_t>::const_iterator i=batch.begin();i!=batch.end();++i) {
+		error_status_t res=0;
+		switch(i->type) {
+			case nvdaController_requestType_speakText:
+			res=nvdaController_speakText(i->text.c_str());
+			break;
+			case nvdaController_requestType_cancelSpeech:
+			res=nvdaController_cancelSpeech();
+			break;
+			case nvdaController_requestType_brailleMessage:
+			res=nvdaController_brailleMessage(i->text.c_str());
+			break;
+		}
+		if(res!=0&&firstError==0) firstError=res;
+	}
+	return firstError;
+}
+
+error_status_t sendRequests(const vector<queuedRequest_t>& batch) {
+	if(!processRequestsUnsupported) {
+		vector<nvdaController_request_t> requests(batch.size());
+		for(size_t i=0;i<batch.size();++i) {
+			requests[i].type=batch[i].type;
+			requests[i].text=const_cast<wchar_t*>(batch[i].text.c_str());
+		}
+		error_status_t res=nvdaController_processRequests(static_cast<long>(requests.size()),&requests[0]);
+		if(res!=RPC_S_PROCNUM_OUT_OF_RANGE) return res;
+		//This NVDA is too old to know about processRequests.
+		processRequestsUnsupported=true;
+	}
+	return sendRequestsIndividually(batch);
+}
+
+DWORD WINAPI senderThreadFunc(LPVOID param) {
+	//Keep this dll loaded for as long as the thread is running.
+	HMODULE moduleHandle=(HMODULE)param;
+	vector<queuedRequest_t> batch;
+	for(;;) {
+		requestQueueLock.acquire();
+		if(requestQueue.empty()) {
+			requestQueueLock.release();
+			if(WaitForSingleObject(requestQueuedEvent,SENDER_IDLE_TIMEOUT)!=WAIT_OBJECT_0) {
+				requestQueueLock.acquire();
+				if(requestQueue.empty()) {
+					senderThreadRunning=false;
+					requestQueueLock.release();
+					break;
+				}
+				requestQueueLock.release();
+			}
+			continue;
+		}
+		batch.assign(requestQueue.begin(),requestQueue.end());
+		requestQueue.clear();
+		ResetEvent(batchSentEvent);
+		requestQueueLock.release();
+		error_status_t res=sendRequests(batch);
+		requestQueueLock.acquire();
+		if(res!=0&&sendError==0) sendError=res;
+		lastSentRequestID=batch.back().ID;
+		SetEvent(batchSentEvent);
+		requestQueueLock.release();
+		batch.clear();
+	}
+	FreeLibraryAndExitThread(moduleHandle,0);
+	return 0;
+}
+
+/**
+ * Adds a request to the queue, dropping any queued requests it makes redundant, and makes sure the sender thread is running.
+ * Must be called with requestQueueLock held.
+ */
+error_status_t queueRequest(nvdaController_requestType_t type, const wchar_t* text) {
+	for(deque<queuedRequest_t>::iterator i=requestQueue.begin();i!=requestQueue.end();) {
+		bool redundant=false;
+		if(type==nvdaController_requestType_cancelSpeech) {
+			//Speech queued before a cancel would be silenced straight away.
+			redundant=(i->type==nvdaController_requestType_speakText||i->type==nvdaController_requestType_cancelSpeech);
+		} else if(type==nvdaController_requestType_brailleMessage) {
+			//Only the latest message would be seen.
+			redundant=(i->type==nvdaController_requestType_brailleMessage);
+		}
+		if(redundant) {
+			i=requestQueue.erase(i);
+		} else {
+			++i;
+		}
+	}
+	if(requestQueue.size()>=MAX_QUEUED_REQUESTS) {
+		return RPC_S_SERVER_TOO_BUSY;
+	}
+	if(!senderThreadRunning) {
+		HMODULE moduleHandle=NULL;
+		if(!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,(LPCWSTR)senderThreadFunc,&moduleHandle)) {
+			return GetLastError();
+		}
+		HANDLE threadHandle=CreateThread(NULL,0,senderThreadFunc,moduleHandle,0,NULL);
+		if(threadHandle==NULL) {
+			DWORD res=GetLastError();
+			FreeLibrary(moduleHandle);
+			return res;
+		}
+		CloseHandle(threadHandle);
+		senderThreadRunning=true;
+	}
+	queuedRequest_t request;
+	request.type=type;
+	if(text) request.text=text;
+	request.ID=++lastQueuedRequestID;
+	requestQueue.push_back(request);
+	SetEvent(requestQueuedEvent);
+	return 0;
+}
+
+extern "C" {
+
+error_status_t __stdcall nvdaController_speakTextAsync(const wchar_t* text) {
+	if(!text) return ERROR_INVALID_PARAMETER;
+	requestQueueLock.acquire();
+	error_status_t res=queueRequest(nvdaController_requestType_speakText,text);
+	requestQueueLock.release();
+	return res;
+}
+
+error_status_t __stdcall nvdaController_cancelSpeechAsync() {
+	requestQueueLock.acquire();
+	error_status_t res=queueRequest(nvdaController_requestType_cancelSpeech,NULL);
+	requestQueueLock.release();
+	return res;
+}
+
+error_status_t __stdcall nvdaController_brailleMessageAsync(const wchar_t* message) {
+	if(!message) return ERROR_INVALID_PARAMETER;
+	requestQueueLock.acquire();
+	error_status_t res=queueRequest(nvdaController_requestType_brailleMessage,message);
+	requestQueueLock.release();
+	return res;
+}
+
+error_status_t __stdcall nvdaController_flush() {
+	requestQueueLock.acquire();
+	unsigned long targetID=lastQueuedRequestID;
+	//Requests dropped from the queue are covered by the later request which replaced them.
+	while(lastSentRequestID<targetID) {
+		requestQueueLock.release();
+		WaitForSingleObject(batchSentEvent,INFINITE);
+		requestQueueLock.acquire();
+	}
+	error_status_t res=sendError;
+	sendError=0;
+	requestQueueLock.release();
+	return res;
+}
+
+}
+
 void* __RPC_USER midl_user_allocate(size_t size) {
 	return malloc(size);
 }
@@ -35,7 +225,12 @@ BOOL WINAPI DllMain(HINSTANCE hModule,DWORD reason,LPVOID lpReserved) {
 		wstringstream s;
 		s<<L"ncalrpc:[NvdaCtlr."<<desktopSpecificNamespace<<L"]";
 		RpcBindingFromStringBinding((RPC_WSTR)(s.str().c_str()),&nvdaControllerBindingHandle);
+		requestQueuedEvent=CreateEvent(NULL,FALSE,FALSE,NULL);
+		batchSentEvent=CreateEvent(NULL,TRUE,FALSE,NULL);
 	} else if(reason==DLL_PROCESS_DETACH) {
+		//The sender thread holds a reference to this dll, so it is no longer running here.
+		CloseHandle(batchSentEvent);
+		CloseHandle(requestQueuedEvent);
 		RpcBindingFree(&nvdaControllerBindingHandle);
 	}
 	return TRUE;
@@ -102,6 +102,13 @@ IAccessibleHyperlinkPtr Ht2HyperlinkGetter::get(const unsigned long index) {
 
 Ht2HyperlinkGetter::~Ht2HyperlinkGetter() {
 	if (this->rawLinks) {
+		// get_hyperlinks gave us a reference to every link,
+		// but only those handed out by get() have been released.
+		for (long i = this->index; i < this->count; ++i) {
+			if (this->rawLinks[i]) {
+				this->rawLinks[i]->Release();
+			}
+		}
 		CoTaskMemFree(this->rawLinks);
 	}
 }
@@ -0,0 +1,229 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <cwctype>
+#include <vector>
+#include "textScan.h"
+
+#if defined(_M_IX86)||defined(_M_X64)||defined(__SSE2__)
+#define TEXTSCAN_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+#ifdef TEXTSCAN_SSE2
+
+//Each block is one 128 bit register of characters. wchar_t is 16 bits on Windows, but may be 32 bits elsewhere.
+const int blockLength=16/sizeof(wchar_t);
+const unsigned int fullBlockMask=(1u<<blockLength)-1;
+
+/**
+ * @return the index of the lowest set bit in a non-zero mask.
+ */
+inline int lowestBitIndex(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index,mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/**
+ * @return the index of the highest set bit in a non-zero mask.
+ */
+inline int highestBitIndex(unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index,mask);
+	return static_cast<int>(index);
+#else
+	return 31-__builtin_clz(mask);
+#endif
+}
+
+inline __m128i setChars(int c) {
+	return (sizeof(wchar_t)==2)?_mm_set1_epi16(static_cast<short>(c)):_mm_set1_epi32(c);
+}
+
+inline __m128i compareEqual(__m128i a, __m128i b) {
+	return (sizeof(wchar_t)==2)?_mm_cmpeq_epi16(a,b):_mm_cmpeq_epi32(a,b);
+}
+
+/**
+ * A signed comparison, so when wchar_t is 16 bits, characters from 0x8000 compare less than any ASCII character.
+ */
+inline __m128i compareGreater(__m128i a, __m128i b) {
+	return (sizeof(wchar_t)==2)?_mm_cmpgt_epi16(a,b):_mm_cmpgt_epi32(a,b);
+}
+
+/**
+ * Converts the result of a comparison to a mask with one bit per character, the first character being the lowest bit.
+ */
+inline unsigned int charMask(__m128i comparison) {
+	const __m128i zero=_mm_setzero_si128();
+	if(sizeof(wchar_t)==2) return _mm_movemask_epi8(_mm_packs_epi16(comparison,zero));
+	return _mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(comparison,zero),zero));
+}
+
+/**
+ * @return a mask of the carriage returns and line feeds in the block of characters starting at text.
+ */
+inline unsigned int lineBreakCharMask(const wchar_t* text) {
+	__m128i chars=_mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+	return charMask(_mm_or_si128(compareEqual(chars,setChars(L'\r')),compareEqual(chars,setChars(L'\n'))));
+}
+
+/**
+ * @return a mask of the whitespace characters in the block of characters starting at text.
+ */
+inline unsigned int whitespaceCharMask(const wchar_t* text) {
+	__m128i chars=_mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+	//ASCII whitespace is tab through carriage return, and space.
+	__m128i asciiWhitespace=_mm_or_si128(
+		_mm_and_si128(compareGreater(chars,setChars(L'\t'-1)),compareGreater(setChars(L'\r'+1),chars)),
+		compareEqual(chars,setChars(L' '))
+	);
+	unsigned int mask=charMask(asciiWhitespace);
+	//Characters outside ASCII are rare, so iswspace is asked about each one.
+	unsigned int nonAscii=charMask(compareEqual(_mm_and_si128(chars,setChars(~0x7f)),_mm_setzero_si128()))^fullBlockMask;
+	for(;nonAscii!=0;nonAscii&=nonAscii-1) {
+		int index=lowestBitIndex(nonAscii);
+		if(iswspace(text[index])) mask|=1u<<index;
+	}
+	return mask;
+}
+
+#endif
+
+/**
+ * @return true if the carriage return or line feed at offset is a hard line break.
+ */
+inline bool isHardLineBreakAt(const wchar_t* text, int length, wchar_t following, int offset) {
+	if(text[offset]==L'\n') return true;
+	wchar_t next=(offset+1<length)?text[offset+1]:following;
+	return next!=L'\n';
+}
+
+int findHardLineBreak(const wchar_t* text, int length, wchar_t following) {
+	int i=0;
+#ifdef TEXTSCAN_SSE2
+	for(;i+blockLength<=length;i+=blockLength) {
+		for(unsigned int mask=lineBreakCharMask(text+i);mask!=0;mask&=mask-1) {
+			int offset=i+lowestBitIndex(mask);
+			if(isHardLineBreakAt(text,length,following,offset)) return offset;
+		}
+	}
+#endif
+	for(;i<length;++i) {
+		if((text[i]==L'\r'||text[i]==L'\n')&&isHardLineBreakAt(text,length,following,i)) return i;
+	}
+	return length;
+}
+
+int findLastHardLineBreak(const wchar_t* text, int length, wchar_t following) {
+	int i=length;
+#ifdef TEXTSCAN_SSE2
+	for(;i-blockLength>=0;i-=blockLength) {
+		for(unsigned int mask=lineBreakCharMask(text+i-blockLength);mask!=0;) {
+			int index=highestBitIndex(mask);
+			int offset=i-blockLength+index;
+			if(isHardLineBreakAt(text,length,following,offset)) return offset;
+			mask&=~(1u<<index);
+		}
+	}
+#endif
+	for(--i;i>=0;--i) {
+		if((text[i]==L'\r'||text[i]==L'\n')&&isHardLineBreakAt(text,length,following,i)) return i;
+	}
+	return -1;
+}
+
+bool findWhitespaceRunEnds(const wchar_t* text, int length, bool precededByWhitespace, int base, vector<int>& runEnds) {
+	int i=0;
+#ifdef TEXTSCAN_SSE2
+	for(;i+blockLength<=length;i+=blockLength) {
+		unsigned int whitespace=whitespaceCharMask(text+i);
+		//A run ends at each character which is not whitespace but whose previous character is.
+		unsigned int ends=((whitespace<<1)|(precededByWhitespace?1u:0u))&~whitespace&fullBlockMask;
+		for(;ends!=0;ends&=ends-1) {
+			runEnds.push_back(base+i+lowestBitIndex(ends));
+		}
+		precededByWhitespace=(whitespace>>(blockLength-1))!=0;
+	}
+#endif
+	for(;i<length;++i) {
+		bool whitespace=isWhitespaceChar(text[i]);
+		if(precededByWhitespace&&!whitespace) runEnds.push_back(base+i);
+		precededByWhitespace=whitespace;
+	}
+	return precededByWhitespace;
+}
+
+/**
+ * Finds the first character which is, or is not, whitespace.
+ */
+inline int findFirst(const wchar_t* text, int length, bool whitespace) {
+	int i=0;
+#ifdef TEXTSCAN_SSE2
+	for(;i+blockLength<=length;i+=blockLength) {
+		unsigned int mask=whitespaceCharMask(text+i);
+		if(!whitespace) mask^=fullBlockMask;
+		if(mask!=0) return i+lowestBitIndex(mask);
+	}
+#endif
+	for(;i<length;++i) {
+		if(isWhitespaceChar(text[i])==whitespace) return i;
+	}
+	return length;
+}
+
+/**
+ * Finds the last character which is, or is not, whitespace.
+ */
+inline int findLast(const wchar_t* text, int length, bool whitespace) {
+	int i=length;
+#ifdef TEXTSCAN_SSE2
+	for(;i-blockLength>=0;i-=blockLength) {
+		unsigned int mask=whitespaceCharMask(text+i-blockLength);
+		if(!whitespace) mask^=fullBlockMask;
+		if(mask!=0) return i-blockLength+highestBitIndex(mask);
+	}
+#endif
+	for(--i;i>=0;--i) {
+		if(isWhitespaceChar(text[i])==whitespace) return i;
+	}
+	return -1;
+}
+
+int findWhitespaceChar(const wchar_t* text, int length) {
+	return findFirst(text,length,true);
+}
+
+int findNonWhitespaceChar(const wchar_t* text, int length) {
+	return findFirst(text,length,false);
+}
+
+int findLastWhitespaceChar(const wchar_t* text, int length) {
+	return findLast(text,length,true);
+}
+
+int findLastNonWhitespaceChar(const wchar_t* text, int length) {
+	return findLast(text,length,false);
+}
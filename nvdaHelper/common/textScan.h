@@ -0,0 +1,86 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef NVDAHELPER_COMMON_TEXTSCAN_H
+#define NVDAHELPER_COMMON_TEXTSCAN_H
+
+#include <cwctype>
+#include <vector>
+
+/**
+ * Functions for finding hard line breaks and whitespace in text.
+ * Where SSE2 is available, text is scanned a block of characters at a time.
+ * Whitespace is anything iswspace accepts; characters outside ASCII are passed to iswspace, so results are exactly those of a character by character scan.
+ * All offsets are in characters, relative to the text pointer given.
+ */
+
+/**
+ * @return true if the character is whitespace according to iswspace.
+ */
+inline bool isWhitespaceChar(wchar_t c) {
+	if(c<0x80) return c==L' '||(c>=L'\t'&&c<=L'\r');
+	return iswspace(c)!=0;
+}
+
+/**
+ * Finds the first hard line break in some text.
+ * A hard line break is a line feed, or a carriage return not followed by a line feed (the line feed of a CR LF pair is the break).
+ * @param text the text to scan.
+ * @param length the number of characters to scan.
+ * @param following the character after the scanned text, or 0 if there is none.
+ * @return the offset of the line break, or length if there is none.
+ */
+int findHardLineBreak(const wchar_t* text, int length, wchar_t following);
+
+/**
+ * Finds the last hard line break in some text, as findHardLineBreak but scanning backwards.
+ * @param text the text to scan.
+ * @param length the number of characters to scan.
+ * @param following the character after the scanned text, or 0 if there is none.
+ * @return the offset of the line break, or -1 if there is none.
+ */
+int findLastHardLineBreak(const wchar_t* text, int length, wchar_t following);
+
+/**
+ * Finds where runs of whitespace end in some text: the offsets of non-whitespace characters which follow whitespace.
+ * @param text the text to scan.
+ * @param length the number of characters to scan.
+ * @param precededByWhitespace true if the character before the text is whitespace and so the first character can end a run.
+ * @param base added to each offset before it is appended.
+ * @param runEnds the vector to which the offsets are appended, in ascending order.
+ * @return true if the text ends with whitespace (or is empty and precededByWhitespace is true), so that it can be passed as precededByWhitespace when scanning text that directly follows.
+ */
+bool findWhitespaceRunEnds(const wchar_t* text, int length, bool precededByWhitespace, int base, std::vector<int>& runEnds);
+
+/**
+ * @return the offset of the first whitespace character in the text, or length if there is none.
+ */
+int findWhitespaceChar(const wchar_t* text, int length);
+
+/**
+ * @return the offset of the first character in the text which is not whitespace, or length if there is none.
+ */
+int findNonWhitespaceChar(const wchar_t* text, int length);
+
+/**
+ * @return the offset of the last whitespace character in the text, or -1 if there is none.
+ */
+int findLastWhitespaceChar(const wchar_t* text, int length);
+
+/**
+ * @return the offset of the last character in the text which is not whitespace, or -1 if there is none.
+ */
+int findLastNonWhitespaceChar(const wchar_t* text, int length);
+
+#endif
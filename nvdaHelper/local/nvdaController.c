@@ -29,6 +29,11 @@ error_status_t __stdcall nvdaController_brailleMessage(const wchar_t* text) {
 	return _nvdaController_brailleMessage(text);
 }
 
+error_status_t(__stdcall *_nvdaController_processRequests)(long,const nvdaController_request_t*);
+error_status_t __stdcall nvdaController_processRequests(long count, const nvdaController_request_t* requests) {
+	return _nvdaController_processRequests(count,requests);
+}
+
 error_status_t __stdcall nvdaController_testIfRunning() {
 	return 0;
 }
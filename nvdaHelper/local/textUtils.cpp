@@ -1,5 +1,6 @@
 #include <windows.h>
 #include <usp10.h>
+#include <common/textScan.h>
 
 bool calculateWordOffsets(wchar_t* text, int textLength, int offset, int* startOffset, int* endOffset) {
 	if(textLength<=0) return false;
@@ -34,20 +35,16 @@ bool calculateWordOffsets(wchar_t* text, int textLength, int offset, int* startO
 		}
 	}
 	// #1656: fWordStop doesn't seem to stop on whitespace where punctuation follows the whitespace.
-	bool skipWhitespace=true;
-	for(int i=offset;i>=*startOffset;--i) {
-		if(iswspace(text[i])) {
-			if(skipWhitespace) {
-				// If we start in a block of whitespace, the word must start before this,
-				// as whitespace is included at the end of a word.
-				// Therefore, skip the whitespace and keep searching.
-				continue;
-			}
-			// This is whitespace. The word starts after it.
-			*startOffset=i+1;
-			break;
-		} else
-			skipWhitespace=false;
+	// If we start in a block of whitespace, the word must start before this,
+	// as whitespace is included at the end of a word.
+	// Therefore, skip the whitespace and keep searching.
+	int lastNonWhitespace=*startOffset+findLastNonWhitespaceChar(text+*startOffset,offset+1-*startOffset);
+	if(lastNonWhitespace>=*startOffset) {
+		// Any whitespace before this ends the previous word, so the word starts after it.
+		int lastWhitespace=*startOffset+findLastWhitespaceChar(text+*startOffset,lastNonWhitespace-*startOffset);
+		if(lastWhitespace>=*startOffset) {
+			*startOffset=lastWhitespace+1;
+		}
 	}
 	*endOffset=textLength;
 	for(int i=offset+1;i<textLength;++i) {
@@ -57,19 +54,11 @@ bool calculateWordOffsets(wchar_t* text, int textLength, int offset, int* startO
 		}
 	}
 	// #1656: fWordStop doesn't seem to stop on whitespace where punctuation follows the whitespace.
-	for(int i=offset;i<*endOffset;++i) {
-		if(iswspace(text[i])) {
-			// This begins a block of whitespace. The word ends after it.
-			// Find the end of the whitespace.
-			for(;i<*endOffset;++i) {
-				if(!iswspace(text[i]))
-					break;
-			}
-			// We're now positioned on the first non-whitespace character,
-			// so the word ends here.
-			*endOffset=i;
-			break;
-		}
+	int whitespaceStart=offset+findWhitespaceChar(text+offset,*endOffset-offset);
+	if(whitespaceStart<*endOffset) {
+		// This begins a block of whitespace. The word ends after it,
+		// on the first non-whitespace character.
+		*endOffset=whitespaceStart+findNonWhitespaceChar(text+whitespaceStart,*endOffset-whitespaceStart);
 	}
 	delete[] logAttrArray;
 	return true;
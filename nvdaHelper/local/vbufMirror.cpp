@@ -0,0 +1,362 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include "vbuf.h"
+#include <common/lock.h>
+#include <common/log.h>
+#include <vbufBase/storage.h>
+#include <vbufBase/changeLog.h>
+
+using namespace std;
+
+/**
+ * The number of bytes available for records in a mirror's change log channel.
+ * This is room for the changes of many typical updates. An update too big to fit makes the replica take a new snapshot instead.
+ */
+#define VBUFMIRROR_CHANNELCAPACITY (4*1024*1024)
+
+/**
+ * A replica of a buffer in the application, kept up to date from the change log channel the application writes to after each update.
+ * Queries are answered from the replica without a call in to the application, apart from asking it to render deferred content.
+ * Selection and pinned offsets belong to the replica, as NVDA only ever uses them through these queries.
+ */
+class VBufMirror_t: public LockableObject {
+	private:
+
+	VBufRemote_bufferHandle_t remoteBuffer;
+
+	/**
+	 * The handle to the file mapping duplicated in to the application, until it is handed over by the first sync.
+	 */
+	HANDLE remoteMapping;
+
+	HANDLE mapping;
+
+	void* view;
+
+	VBufStorage_changeLogChannel_t* channel;
+
+	public:
+
+	VBufStorage_buffer_t replica;
+
+	VBufMirror_t(VBufRemote_bufferHandle_t remoteBuffer, HANDLE remoteMapping, HANDLE mapping, void* view, size_t size, size_t memoryLimit): remoteBuffer(remoteBuffer), remoteMapping(remoteMapping), mapping(mapping), view(view), channel(new VBufStorage_changeLogChannel_t(view,size,true)), replica() {
+		this->replica.setMemoryLimit(memoryLimit);
+	}
+
+	~VBufMirror_t() {
+		// Stop the application recording changes no one will read.
+		this->channel->desync();
+		delete this->channel;
+		UnmapViewOfFile(this->view);
+		CloseHandle(this->mapping);
+	}
+
+/**
+ * Replaces the replica's content with a snapshot taken by the application, which brings it back in sync.
+ * @return true if successful, false otherwise.
+ */
+	bool sync() {
+		int snapshotSize=0;
+		unsigned char* snapshot=NULL;
+		int res=false;
+		RpcTryExcept {
+			res=VBufClient_syncMirror(this->remoteBuffer,HandleToUlong(this->remoteMapping),&snapshotSize,&snapshot);
+			// The application owns the handle once the call has reached it.
+			this->remoteMapping=NULL;
+		} RpcExcept(1) {
+			LOG_DEBUGWARNING(L"RPC exception "<<RpcExceptionCode()<<L" syncing mirror");
+			res=false;
+		} RpcEndExcept;
+		bool applied=res&&snapshot&&VBufStorage_changeLog_t::apply(&this->replica,snapshot,snapshotSize);
+		if(snapshot) midl_user_free(snapshot);
+		if(!applied) {
+			LOG_DEBUGWARNING(L"Could not sync mirror of buffer at "<<this->remoteBuffer);
+			this->channel->desync();
+		}
+		return applied;
+	}
+
+/**
+ * Applies the records waiting in the channel to the replica, taking a new snapshot if any were dropped or could not be applied.
+ * @return true if the replica is up to date and within its memory limit, false otherwise.
+ */
+	bool update() {
+		vector<unsigned char> record;
+		while(this->channel->read(record)) {
+			if(this->channel->isInSync()&&!VBufStorage_changeLog_t::apply(&this->replica,record.data(),record.size())) {
+				LOG_DEBUGWARNING(L"Could not apply change to mirror of buffer at "<<this->remoteBuffer);
+				this->channel->desync();
+			}
+		}
+		if(!this->channel->isInSync()) {
+			LOG_DEBUG(L"Mirror of buffer at "<<this->remoteBuffer<<L" out of sync");
+			if(!this->sync()) return false;
+		}
+		// The replica is neither compressed nor trimmed, and lives in NVDA's own address space.
+		if(this->replica.isOverMemoryLimit()) {
+			LOG_DEBUGWARNING(L"Mirror of buffer at "<<this->remoteBuffer<<L" is over the memory limit");
+			return false;
+		}
+		return true;
+	}
+
+};
+
+map<VBufRemote_bufferHandle_t,VBufMirror_t*> mirrors;
+LockableObject mirrorsLock;
+
+/**
+ * Stops mirroring a buffer, waiting for any query still using its mirror.
+ * @param buffer the handle of the buffer in the application.
+ * @param mirror the mirror to remove, or NULL for whichever mirror the buffer has. Nothing is removed if the buffer has a different one.
+ */
+void removeMirror(VBufRemote_bufferHandle_t buffer, VBufMirror_t* mirror) {
+	mirrorsLock.acquire();
+	map<VBufRemote_bufferHandle_t,VBufMirror_t*>::iterator i=mirrors.find(buffer);
+	if(i==mirrors.end()||(mirror&&i->second!=mirror)) {
+		mirrorsLock.release();
+		return;
+	}
+	mirror=i->second;
+	mirrors.erase(i);
+	mirrorsLock.release();
+	mirror->acquire();
+	mirror->release();
+	delete mirror;
+}
+
+/**
+ * Finds the mirror of a buffer, locks it and brings it up to date.
+ * A mirror which can not be brought up to date, or has grown over the memory limit, is removed, so that queries go to the application from then on.
+ * @param buffer the handle of the buffer in the application.
+ * @return the mirror, which the caller must release, or NULL if the buffer is not mirrored.
+ */
+VBufMirror_t* acquireMirror(VBufRemote_bufferHandle_t buffer) {
+	mirrorsLock.acquire();
+	map<VBufRemote_bufferHandle_t,VBufMirror_t*>::iterator i=mirrors.find(buffer);
+	VBufMirror_t* mirror=(i!=mirrors.end())?i->second:NULL;
+	if(mirror) mirror->acquire();
+	mirrorsLock.release();
+	if(!mirror) return NULL;
+	if(mirror->update()) return mirror;
+	LOG_DEBUGWARNING(L"Stopped mirroring buffer at "<<buffer<<L", querying the application instead");
+	mirror->release();
+	removeMirror(buffer,mirror);
+	return NULL;
+}
+
+extern "C" {
+
+/**
+ * Starts answering queries about a buffer from a replica in this process, kept up to date through shared memory, rather than calling in to the application for each one.
+ * The shared memory has no name, and is only handed to the application's process, so that no other process can write to the replica.
+ * @param buffer the handle of the buffer returned by VBuf_createBuffer.
+ * @param processID the ID of the application's process.
+ * @param memoryLimit the most memory in KB the replica may use before queries go back to the application, or 0 for no limit.
+ * @return true if successful, false if the buffer could not be mirrored (such as when the application can not map the shared memory), in which case queries keep going to the application.
+ */
+int VBuf_enableMirror(VBufRemote_bufferHandle_t buffer, int processID, int memoryLimit) {
+	size_t size=VBufStorage_changeLogChannel_t::getMemorySize(VBUFMIRROR_CHANNELCAPACITY);
+	HANDLE mapping=CreateFileMapping(INVALID_HANDLE_VALUE,NULL,PAGE_READWRITE,0,static_cast<DWORD>(size),NULL);
+	if(mapping==NULL) {
+		LOG_DEBUGWARNING(L"Could not create file mapping, error "<<GetLastError());
+		return false;
+	}
+	void* view=MapViewOfFile(mapping,FILE_MAP_READ|FILE_MAP_WRITE,0,0,size);
+	if(view==NULL) {
+		LOG_DEBUGWARNING(L"Could not map file mapping, error "<<GetLastError());
+		CloseHandle(mapping);
+		return false;
+	}
+	HANDLE process=OpenProcess(PROCESS_DUP_HANDLE,FALSE,processID);
+	HANDLE remoteMapping=NULL;
+	if(process==NULL||!DuplicateHandle(GetCurrentProcess(),mapping,process,&remoteMapping,FILE_MAP_READ|FILE_MAP_WRITE,FALSE,0)) {
+		LOG_DEBUGWARNING(L"Could not duplicate file mapping in to process "<<processID<<L", error "<<GetLastError());
+		if(process) CloseHandle(process);
+		UnmapViewOfFile(view);
+		CloseHandle(mapping);
+		return false;
+	}
+	CloseHandle(process);
+	VBufMirror_t* mirror=new VBufMirror_t(buffer,remoteMapping,mapping,view,size,(memoryLimit>0)?static_cast<size_t>(memoryLimit)*1024:0);
+	if(!mirror->sync()||mirror->replica.isOverMemoryLimit()) {
+		delete mirror;
+		return false;
+	}
+	mirrorsLock.acquire();
+	bool added=mirrors.insert(make_pair(buffer,mirror)).second;
+	mirrorsLock.release();
+	if(!added) {
+		LOG_DEBUGWARNING(L"Buffer at "<<buffer<<L" is already mirrored");
+		delete mirror;
+	}
+	return true;
+}
+
+VBufRemote_bufferHandle_t VBuf_createBuffer(handle_t bindingHandle, int docHandle, int ID, const wchar_t* backendName, int memoryLimit) {
+	return VBufClient_createBuffer(bindingHandle,docHandle,ID,backendName,memoryLimit);
+}
+
+void VBuf_destroyBuffer(VBufRemote_bufferHandle_t* buffer) {
+	removeMirror(*buffer,NULL);
+	VBufClient_destroyBuffer(buffer);
+}
+
+int VBuf_getFieldNodeOffsets(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int *startOffset, int *endOffset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getFieldNodeOffsets(buffer,node,startOffset,endOffset);
+	int res=mirror->replica.getFieldNodeOffsets((VBufStorage_fieldNode_t*)node,startOffset,endOffset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_isFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int offset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_isFieldNodeAtOffset(buffer,node,offset);
+	int res=mirror->replica.isFieldNodeAtOffset((VBufStorage_fieldNode_t*)node,offset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_locateTextFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, VBufRemote_nodeHandle_t* foundNode) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_locateTextFieldNodeAtOffset(buffer,offset,nodeStartOffset,nodeEndOffset,foundNode);
+	*foundNode=(VBufRemote_nodeHandle_t)(mirror->replica.locateTextFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset));
+	mirror->release();
+	return (*foundNode)!=0;
+}
+
+int VBuf_locateControlFieldNodeAtOffset(VBufRemote_bufferHandle_t buffer, int offset, int *nodeStartOffset, int *nodeEndOffset, int *docHandle, int *ID, VBufRemote_nodeHandle_t* foundNode) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_locateControlFieldNodeAtOffset(buffer,offset,nodeStartOffset,nodeEndOffset,docHandle,ID,foundNode);
+	*foundNode=(VBufRemote_nodeHandle_t)(mirror->replica.locateControlFieldNodeAtOffset(offset,nodeStartOffset,nodeEndOffset,docHandle,ID));
+	mirror->release();
+	return (*foundNode)!=0;
+}
+
+int VBuf_getControlFieldNodeWithIdentifier(VBufRemote_bufferHandle_t buffer, int docHandle, int ID, VBufRemote_nodeHandle_t* foundNode) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getControlFieldNodeWithIdentifier(buffer,docHandle,ID,foundNode);
+	*foundNode=(VBufRemote_nodeHandle_t)(mirror->replica.getControlFieldNodeWithIdentifier(docHandle,ID));
+	mirror->release();
+	return (*foundNode)!=0;
+}
+
+int VBuf_getIdentifierFromControlFieldNode(VBufRemote_bufferHandle_t buffer, VBufRemote_nodeHandle_t node, int* docHandle, int* ID) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getIdentifierFromControlFieldNode(buffer,node,docHandle,ID);
+	int res=mirror->replica.getIdentifierFromControlFieldNode((VBufStorage_controlFieldNode_t*)node,docHandle,ID);
+	mirror->release();
+	return res;
+}
+
+int VBuf_findNodeByAttributes(VBufRemote_bufferHandle_t buffer, int offset, int direction, const wchar_t* attribs, const wchar_t* regexp, int *startOffset, int *endOffset, VBufRemote_nodeHandle_t* foundNode) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_findNodeByAttributes(buffer,offset,direction,attribs,regexp,startOffset,endOffset,foundNode);
+	*foundNode=(VBufRemote_nodeHandle_t)(mirror->replica.findNodeByAttributes(offset,(VBufStorage_findDirection_t)direction,attribs,regexp,startOffset,endOffset));
+	mirror->release();
+	return (*foundNode)!=0;
+}
+
+int VBuf_getSelectionOffsets(VBufRemote_bufferHandle_t buffer, int *startOffset, int *endOffset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getSelectionOffsets(buffer,startOffset,endOffset);
+	int res=mirror->replica.getSelectionOffsets(startOffset,endOffset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_setSelectionOffsets(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_setSelectionOffsets(buffer,startOffset,endOffset);
+	int res=mirror->replica.setSelectionOffsets(startOffset,endOffset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_pinOffset(VBufRemote_bufferHandle_t buffer, int offset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_pinOffset(buffer,offset);
+	int res=mirror->replica.pinOffset(offset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_getPinnedOffset(VBufRemote_bufferHandle_t buffer, int pinID, int *offset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getPinnedOffset(buffer,pinID,offset);
+	int res=mirror->replica.getPinnedOffset(pinID,offset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_unpinOffset(VBufRemote_bufferHandle_t buffer, int pinID) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_unpinOffset(buffer,pinID);
+	int res=mirror->replica.unpinOffset(pinID);
+	mirror->release();
+	return res;
+}
+
+int VBuf_getTextLength(VBufRemote_bufferHandle_t buffer) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getTextLength(buffer);
+	int res=mirror->replica.getTextLength();
+	mirror->release();
+	return res;
+}
+
+int VBuf_getTextInRange(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset, BSTR* text, boolean useMarkup) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getTextInRange(buffer,startOffset,endOffset,text,useMarkup);
+	VBufStorage_textContainer_t* textContainer=mirror->replica.getTextInRange(startOffset,endOffset,useMarkup!=false);
+	vector<VBufStorage_deferredFieldNode_t*> deferredNodes;
+	mirror->replica.getDeferredFieldNodesInRange(startOffset,endOffset,deferredNodes);
+	mirror->release();
+	if(textContainer==NULL) {
+		return false;
+	}
+	*text=SysAllocString(textContainer->getString().c_str());
+	textContainer->destroy();
+	// The user is reading this text, so have the application render any content which was deferred within it, as it would if it had been asked for the text.
+	if(!deferredNodes.empty()) {
+		RpcTryExcept {
+			VBufClient_renderDeferredContentInRange(buffer,startOffset,endOffset);
+		} RpcExcept(1) {
+			LOG_DEBUGWARNING(L"RPC exception "<<RpcExceptionCode()<<L" rendering deferred content");
+		} RpcEndExcept;
+	}
+	return true;
+}
+
+int VBuf_getLineOffsets(VBufRemote_bufferHandle_t buffer, int offset, int maxLineLength, boolean useScreenLayout, int *startOffset, int *endOffset) {
+	VBufMirror_t* mirror=acquireMirror(buffer);
+	if(!mirror) return VBufClient_getLineOffsets(buffer,offset,maxLineLength,useScreenLayout,startOffset,endOffset);
+	int res=mirror->replica.getLineOffsets(offset,maxLineLength,useScreenLayout!=false,startOffset,endOffset);
+	mirror->release();
+	return res;
+}
+
+int VBuf_getMemoryStats(VBufRemote_bufferHandle_t buffer, VBufRemote_memoryStats_t* stats) {
+	// The memory that matters is the application's, so this always goes to the buffer itself.
+	return VBufClient_getMemoryStats(buffer,stats);
+}
+
+}
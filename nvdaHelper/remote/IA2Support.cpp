@@ -14,12 +14,15 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <cstdio>
 #include <cwchar>
+#include <map>
+#include <tuple>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <objbase.h>
 #include <ia2.h>
 #include "nvdaControllerInternal.h"
 #include <common/log.h>
+#include <common/lock.h>
 #include "nvdaHelperRemote.h"
 #include "dllmain.h"
 #include "inProcess.h"
@@ -43,6 +46,61 @@ UINT wm_uninstallIA2Support=0;
 bool isIA2Initialized=FALSE;
 bool isIA2SupportDisabled=false;
 
+const long FINDCONTENTDESCENDANT_FIRST=0;
+const long FINDCONTENTDESCENDANT_CARET=1;
+const long FINDCONTENTDESCENDANT_LAST=2;
+const long FINDCONTENTDESCENDANT_SELECTIONSTART=3;
+const long FINDCONTENTDESCENDANT_SELECTIONEND=4;
+
+/**
+ * Descendants previously found by nvdaInProcUtils_IA2Text_findContentDescendant, keyed by window, parent ID and what was searched for.
+ * Finding a descendant walks down through every embedded object with several COM calls at each level,
+ * but the result only changes when the hypertext structure changes, or for the caret and selection when they move.
+ * So the results are kept until an event says they may be out of date.
+ */
+typedef std::tuple<HWND,long,long> findContentDescendantCacheKey_t;
+map<findContentDescendantCacheKey_t,pair<long,long> > findContentDescendantCache;
+LockableObject findContentDescendantCacheLock;
+// Enough for a few editors in a few windows.
+const size_t FINDCONTENTDESCENDANT_CACHE_MAXSIZE=256;
+
+void CALLBACK findContentDescendantCache_winEventProcHook(HWINEVENTHOOK hookID, DWORD eventID, HWND hwnd, long objectID, long childID, DWORD threadID, DWORD time) {
+	bool structureChanged=false;
+	switch(eventID) {
+		case IA2_EVENT_TEXT_INSERTED:
+		case IA2_EVENT_TEXT_REMOVED:
+		case IA2_EVENT_TEXT_UPDATED:
+		case IA2_EVENT_TEXT_CHANGED:
+		case EVENT_OBJECT_REORDER:
+		case EVENT_OBJECT_SHOW:
+		case EVENT_OBJECT_HIDE:
+		case EVENT_OBJECT_DESTROY:
+		structureChanged=true;
+		break;
+		case IA2_EVENT_TEXT_CARET_MOVED:
+		case IA2_EVENT_TEXT_SELECTION_CHANGED:
+		case EVENT_OBJECT_FOCUS:
+		break;
+		default:
+		return;
+	}
+	findContentDescendantCacheLock.acquire();
+	if(structureChanged) {
+		findContentDescendantCache.clear();
+	} else {
+		// Only the caret and selection have moved, so first and last are still valid.
+		for(auto i=findContentDescendantCache.begin();i!=findContentDescendantCache.end();) {
+			const long what=std::get<2>(i->first);
+			if(what==FINDCONTENTDESCENDANT_FIRST||what==FINDCONTENTDESCENDANT_LAST) {
+				++i;
+			} else {
+				i=findContentDescendantCache.erase(i);
+			}
+		}
+	}
+	findContentDescendantCacheLock.release();
+}
+
 bool installIA2Support() {
 	if(isIA2Installed) return FALSE;
 	APTTYPE appType;
@@ -126,14 +184,19 @@ void IA2Support_inProcess_initialize() {
 	}
 	FreeLibrary(kernel32Handle);
 	if(isIA2SupportDisabled) return;
+	registerWinEventHook(findContentDescendantCache_winEventProcHook);
 	// Try to install IA2 support on focus/foreground changes.
 	// This hook will be unregistered by the callback once IA2 support is successfully installed.
 	registerWinEventHook(IA2Support_winEventProcHook);
 }
 
 void IA2Support_inProcess_terminate() {
-	// This will do nothing if the hook isn't registered.
+	// These will do nothing if the hooks aren't registered.
 	unregisterWinEventHook(IA2Support_winEventProcHook);
+	unregisterWinEventHook(findContentDescendantCache_winEventProcHook);
+	findContentDescendantCacheLock.acquire();
+	findContentDescendantCache.clear();
+	findContentDescendantCacheLock.release();
 	if(!isIA2Installed||!IA2UIThreadHandle) {
 		return;
 	}
@@ -156,12 +219,6 @@ void IA2Support_inProcess_terminate() {
 	CloseHandle(IA2UIThreadHandle);
 }
 
-const long FINDCONTENTDESCENDANT_FIRST=0;
-const long FINDCONTENTDESCENDANT_CARET=1;
-const long FINDCONTENTDESCENDANT_LAST=2;
-const long FINDCONTENTDESCENDANT_SELECTIONSTART=3;
-const long FINDCONTENTDESCENDANT_SELECTIONEND=4;
-
 bool findContentDescendant(IAccessible2* pacc2, long what, long* descendantID, long* descendantOffset) {
 	bool foundDescendant=false;
 	IAccessibleText* paccText=NULL;
@@ -249,6 +306,16 @@ bool findContentDescendant(IAccessible2* pacc2, long what, long* descendantID, l
 
 error_status_t nvdaInProcUtils_IA2Text_findContentDescendant(handle_t bindingHandle, const unsigned long windowHandle, long parentID, long what, long* descendantID, long* descendantOffset) {
 	HWND hwnd=(HWND)UlongToHandle(windowHandle);
+	const findContentDescendantCacheKey_t cacheKey(hwnd,parentID,what);
+	findContentDescendantCacheLock.acquire();
+	auto cached=findContentDescendantCache.find(cacheKey);
+	if(cached!=findContentDescendantCache.end()) {
+		*descendantID=cached->second.first;
+		*descendantOffset=cached->second.second;
+		findContentDescendantCacheLock.release();
+		return 0;
+	}
+	findContentDescendantCacheLock.release();
 	auto func=[&] {
 		IAccessible* pacc=NULL;
 		VARIANT varChild;
@@ -262,7 +329,14 @@ error_status_t nvdaInProcUtils_IA2Text_findContentDescendant(handle_t bindingHan
 		pserv->QueryService(IID_IAccessible,IID_IAccessible2,(void**)&pacc2);
 		pserv->Release();
 		if(!pacc2) return;
-		findContentDescendant(pacc2,what,descendantID,descendantOffset);
+		if(findContentDescendant(pacc2,what,descendantID,descendantOffset)) {
+			findContentDescendantCacheLock.acquire();
+			if(findContentDescendantCache.size()>=FINDCONTENTDESCENDANT_CACHE_MAXSIZE) {
+				findContentDescendantCache.clear();
+			}
+			findContentDescendantCache[cacheKey]=make_pair(*descendantID,*descendantOffset);
+			findContentDescendantCacheLock.release();
+		}
 		pacc2->Release();
 	};
 	if(!execInThread(GetWindowThreadProcessId(hwnd,NULL),func)) {
@@ -14,144 +14,142 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #pragma once
 
+#include <remote/WinWord/Dispatch.h>
+
 // See https://github.com/nvaccess/nvda/wiki/Using-COM-with-NVDA-and-Microsoft-Word
-constexpr int wdDISPID_APPLICATION_ISSANDBOX = 492;
-constexpr int wdDISPID_APPLICATION_SCREENUPDATING = 26;
-constexpr int wdDISPID_APPLICATION_PIXELSTOPOINTS = 388;
-constexpr int wdDISPID_BORDERS_ENABLE = 2;
-constexpr int wdDISPID_CELL_COLUMNINDEX = 5;
-constexpr int wdDISPID_CELL_RANGE = 0;
-constexpr int wdDISPID_CELL_ROWINDEX = 4;
-constexpr int wdDISPID_CELLS_ITEM = 0;
-constexpr int wdDISPID_COLUMNS_COUNT = 2;
-constexpr int wdDISPID_COMMENT_SCOPE = 1005;
-constexpr int wdDISPID_COMMENTS_COUNT = 2;
-constexpr int wdDISPID_COMMENTS_ITEM = 0;
-constexpr int wdDISPID_CONTENTCONTROL_CHECKED = 28;
-constexpr int wdDISPID_CONTENTCONTROL_RANGE = 1;
-constexpr int wdDISPID_CONTENTCONTROL_TITLE = 12;
-constexpr int wdDISPID_CONTENTCONTROL_TYPE = 5;
-constexpr int wdDISPID_CONTENTCONTROLS_ITEM = 0;
-constexpr int wdDISPID_DOCUMENT_RANGE = 2000;
-constexpr int wdDISPID_DOCUMENT_STYLES = 22;
-constexpr int wdDISPID_ENDNOTE_INDEX = 6;
-constexpr int wdDISPID_ENDNOTES_COUNT = 2;
-constexpr int wdDISPID_ENDNOTES_ITEM = 0;
-constexpr int wdDISPID_FIELDS_COUNT = 1;
-constexpr int wdDISPID_FIELDS_ITEM = 0;
-constexpr int wdDISPID_FIELDS_ITEM_RESULT = 4;
-constexpr int wdDISPID_FIELDS_ITEM_TYPE = 1;
-constexpr int wdDISPID_FONT_BOLD = 130;
-constexpr int wdDISPID_FONT_COLOR = 159;
-constexpr int wdDISPID_FONT_DOUBLESTRIKETHROUGH = 136;
-constexpr int wdDISPID_FONT_ITALIC = 131;
-constexpr int wdDISPID_FONT_NAME = 142;
-constexpr int wdDISPID_FONT_SIZE = 141;
-constexpr int wdDISPID_FONT_STRIKETHROUGH = 135;
-constexpr int wdDISPID_FONT_SUBSCRIPT = 138;
-constexpr int wdDISPID_FONT_SUPERSCRIPT = 139;
-constexpr int wdDISPID_FONT_UNDERLINE = 140;
-constexpr int wdDISPID_FOOTNOTE_INDEX = 6;
-constexpr int wdDISPID_FOOTNOTES_COUNT = 2;
-constexpr int wdDISPID_FOOTNOTES_ITEM = 0;
-constexpr int wdDISPID_FORMFIELD_RANGE = 17;
-constexpr int wdDISPID_FORMFIELD_RESULT = 10;
-constexpr int wdDISPID_FORMFIELD_STATUSTEXT = 8;
-constexpr int wdDISPID_FORMFIELD_TYPE = 0;
-constexpr int wdDISPID_FORMFIELDS_ITEM = 0;
-constexpr int wdDISPID_HYPERLINKS_COUNT = 1;
-constexpr int wdDISPID_INLINESHAPE_ALTERNATIVETEXT = 131;
-constexpr int wdDISPID_INLINESHAPE_OLEFORMAT = 5;
-constexpr int wdDISPID_INLINESHAPE_TITLE = 158;
-constexpr int wdDISPID_INLINESHAPE_TYPE = 6;
-constexpr int wdDISPID_INLINESHAPES_COUNT = 1;
-constexpr int wdDISPID_INLINESHAPES_ITEM = 0;
-constexpr int wdDISPID_LISTFORMAT_LISTSTRING = 75;
-constexpr int wdDISPID_OLEFORMAT_PROGID = 22;
-constexpr int wdDISPID_PAGESETUP_GUTTER = 104;
-constexpr int wdDISPID_PAGESETUP_GUTTERPOS = 1222;
-constexpr int wdDISPID_PAGESETUP_GUTTERSTYLE = 129;
-constexpr int wdDISPID_PAGESETUP_LEFTMARGIN = 102;
-constexpr int wdDISPID_PAGESETUP_RIGHTMARGIN = 103;
-constexpr int wdDISPID_PAGESETUP_MIRRORMARGINS = 111;
-constexpr int wdDISPID_PAGESETUP_PAGEWIDTH = 105;
-constexpr int wdDISPID_PAGESETUP_SECTIONSTART = 114;
-constexpr int wdDISPID_PAGESETUP_TEXTCOLUMNS = 119;
-constexpr int wdDISPID_PARAGRAPH_OUTLINELEVEL = 202;
-constexpr int wdDISPID_PARAGRAPH_RANGE = 0;
-constexpr int wdDISPID_PARAGRAPH_STYLE = 100;
-constexpr int wdDISPID_PARAGRAPHFORMAT_ALIGNMENT = 101;
-constexpr int wdDISPID_PARAGRAPHFORMAT_FIRSTLINEINDENT = 108;
-constexpr int wdDISPID_PARAGRAPHFORMAT_LEFTINDENT = 107;
-constexpr int wdDISPID_PARAGRAPHFORMAT_LINESPACING = 109;
-constexpr int wdDISPID_PARAGRAPHFORMAT_LINESPACINGRULE = 110;
-constexpr int wdDISPID_PARAGRAPHFORMAT_RIGHTINDENT = 106;
-constexpr int wdDISPID_PARAGRAPHS_ITEM = 0;
-constexpr int wdDISPID_RANGE_APPLICATION = 1000;
-constexpr int wdDISPID_RANGE_CELLS = 57;
-constexpr int wdDISPID_RANGE_COLLAPSE = 101;
-constexpr int wdDISPID_RANGE_COMMENTS = 56;
-constexpr int wdDISPID_RANGE_CONTENTCONTROLS = 424;
-constexpr int wdDISPID_RANGE_DUPLICATE = 6;
-constexpr int wdDISPID_RANGE_END = 4;
-constexpr int wdDISPID_RANGE_ENDNOTES = 55;
-constexpr int wdDISPID_RANGE_EXPAND = 129;
-constexpr int wdDISPID_RANGE_FIELDS = 64;
-constexpr int wdDISPID_RANGE_FONT = 5;
-constexpr int wdDISPID_RANGE_FOOTNOTES = 54;
-constexpr int wdDISPID_RANGE_FORMFIELDS = 65;
-constexpr int wdDISPID_RANGE_HYPERLINKS = 156;
-constexpr int wdDISPID_RANGE_INFORMATION = 313;
-constexpr int wdDISPID_RANGE_INLINESHAPES = 319;
-constexpr int wdDISPID_RANGE_INRANGE = 126;
-constexpr int wdDISPID_RANGE_LANGUAGEID = 153;
-constexpr int wdDISPID_RANGE_LISTFORMAT = 68;
-constexpr int wdDISPID_RANGE_MOVE = 109;
-constexpr int wdDISPID_RANGE_MOVEEND = 111;
-constexpr int wdDISPID_RANGE_PAGESETUP = 1101;
-constexpr int wdDISPID_RANGE_PARAGRAPHFORMAT = 1102;
-constexpr int wdDISPID_RANGE_PARAGRAPHS = 59;
-constexpr int wdDISPID_RANGE_REVISIONS = 150;
-constexpr int wdDISPID_RANGE_SECTIONS = 58;
-constexpr int wdDISPID_RANGE_SELECT = 65535;
-constexpr int wdDISPID_RANGE_SETRANGE = 100;
-constexpr int wdDISPID_RANGE_SPELLINGERRORS = 316;
-constexpr int wdDISPID_RANGE_START = 3;
-constexpr int wdDISPID_RANGE_STORYTYPE = 7;
-constexpr int wdDISPID_RANGE_STYLE = 151;
-constexpr int wdDISPID_RANGE_TABLES = 50;
-constexpr int wdDISPID_RANGE_TEXT = 0;
-constexpr int wdDISPID_REVISION_TYPE = 4;
-constexpr int wdDISPID_REVISIONS_ITEM = 0;
-constexpr int wdDISPID_ROWS_COUNT = 2;
-constexpr int wdDISPID_SECTIONS_COUNT = 2;
-constexpr int wdDISPID_SECTIONS_ITEM = 0;
-constexpr int wdDISPID_SECTION_PAGESETUP = 1101;
-constexpr int wdDISPID_SELECTION_ENDOF = 108;
-constexpr int wdDISPID_SELECTION_RANGE = 400;
-constexpr int wdDISPID_SELECTION_SETRANGE = 100;
-constexpr int wdDISPID_SELECTION_STARTISACTIVE = 404;
-constexpr int wdDISPID_SELECTION_STARTOF = 107;
-constexpr int wdDISPID_SPELLINGERRORS_COUNT = 1;
-constexpr int wdDISPID_SPELLINGERRORS_ITEM = 0;
-constexpr int wdDISPID_STYLE_NAMELOCAL = 0;
-constexpr int wdDISPID_STYLE_PARENT = 1002;
-constexpr int wdDISPID_STYLES_ITEM = 0;
-constexpr int wdDISPID_TABLE_BORDERS = 1100;
-constexpr int wdDISPID_TABLE_COLUMNS = 100;
-constexpr int wdDISPID_TABLE_DESCR = 210;
-constexpr int wdDISPID_TABLE_NESTINGLEVEL = 108;
-constexpr int wdDISPID_TABLE_RANGE = 0;
-constexpr int wdDISPID_TABLE_ROWS = 101;
-constexpr int wdDISPID_TABLE_TITLE = 209;
-constexpr int wdDISPID_TABLES_ITEM = 0;
-constexpr int wdDISPID_TEXTCOLUMN_WIDTH = 100;
-constexpr int wdDISPID_TEXTCOLUMNS_COUNT = 2;
-constexpr int wdDISPID_TEXTCOLUMNS_ITEM = 0;
-constexpr int wdDISPID_TEXTCOLUMN_SPACEAFTER = 101;
-constexpr int wdDISPID_WINDOW_APPLICATION = 1000;
-constexpr int wdDISPID_WINDOW_DOCUMENT = 2;
-constexpr int wdDISPID_WINDOW_SELECTION = 4;
+constexpr WinWord::DispatchMember wdDISPID_APPLICATION_SCREENUPDATING = {26, L"APPLICATION_SCREENUPDATING"};
+constexpr WinWord::DispatchMember wdDISPID_APPLICATION_PIXELSTOPOINTS = {388, L"APPLICATION_PIXELSTOPOINTS"};
+constexpr WinWord::DispatchMember wdDISPID_BORDERS_ENABLE = {2, L"BORDERS_ENABLE"};
+constexpr WinWord::DispatchMember wdDISPID_CELL_COLUMNINDEX = {5, L"CELL_COLUMNINDEX"};
+constexpr WinWord::DispatchMember wdDISPID_CELL_RANGE = {0, L"CELL_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_CELL_ROWINDEX = {4, L"CELL_ROWINDEX"};
+constexpr WinWord::DispatchMember wdDISPID_CELLS_ITEM = {0, L"CELLS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_COLUMNS_COUNT = {2, L"COLUMNS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_COMMENT_SCOPE = {1005, L"COMMENT_SCOPE"};
+constexpr WinWord::DispatchMember wdDISPID_COMMENTS_COUNT = {2, L"COMMENTS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_COMMENTS_ITEM = {0, L"COMMENTS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_CONTENTCONTROL_CHECKED = {28, L"CONTENTCONTROL_CHECKED"};
+constexpr WinWord::DispatchMember wdDISPID_CONTENTCONTROL_RANGE = {1, L"CONTENTCONTROL_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_CONTENTCONTROL_TITLE = {12, L"CONTENTCONTROL_TITLE"};
+constexpr WinWord::DispatchMember wdDISPID_CONTENTCONTROL_TYPE = {5, L"CONTENTCONTROL_TYPE"};
+constexpr WinWord::DispatchMember wdDISPID_CONTENTCONTROLS_ITEM = {0, L"CONTENTCONTROLS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_DOCUMENT_RANGE = {2000, L"DOCUMENT_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_DOCUMENT_STYLES = {22, L"DOCUMENT_STYLES"};
+constexpr WinWord::DispatchMember wdDISPID_ENDNOTE_INDEX = {6, L"ENDNOTE_INDEX"};
+constexpr WinWord::DispatchMember wdDISPID_ENDNOTES_COUNT = {2, L"ENDNOTES_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_ENDNOTES_ITEM = {0, L"ENDNOTES_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_FIELDS_COUNT = {1, L"FIELDS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_FIELDS_ITEM = {0, L"FIELDS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_FIELDS_ITEM_RESULT = {4, L"FIELDS_ITEM_RESULT"};
+constexpr WinWord::DispatchMember wdDISPID_FIELDS_ITEM_TYPE = {1, L"FIELDS_ITEM_TYPE"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_BOLD = {130, L"FONT_BOLD"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_COLOR = {159, L"FONT_COLOR"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_DOUBLESTRIKETHROUGH = {136, L"FONT_DOUBLESTRIKETHROUGH"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_ITALIC = {131, L"FONT_ITALIC"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_NAME = {142, L"FONT_NAME"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_SIZE = {141, L"FONT_SIZE"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_STRIKETHROUGH = {135, L"FONT_STRIKETHROUGH"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_SUBSCRIPT = {138, L"FONT_SUBSCRIPT"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_SUPERSCRIPT = {139, L"FONT_SUPERSCRIPT"};
+constexpr WinWord::DispatchMember wdDISPID_FONT_UNDERLINE = {140, L"FONT_UNDERLINE"};
+constexpr WinWord::DispatchMember wdDISPID_FOOTNOTE_INDEX = {6, L"FOOTNOTE_INDEX"};
+constexpr WinWord::DispatchMember wdDISPID_FOOTNOTES_COUNT = {2, L"FOOTNOTES_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_FOOTNOTES_ITEM = {0, L"FOOTNOTES_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_FORMFIELD_RANGE = {17, L"FORMFIELD_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_FORMFIELD_RESULT = {10, L"FORMFIELD_RESULT"};
+constexpr WinWord::DispatchMember wdDISPID_FORMFIELD_STATUSTEXT = {8, L"FORMFIELD_STATUSTEXT"};
+constexpr WinWord::DispatchMember wdDISPID_FORMFIELD_TYPE = {0, L"FORMFIELD_TYPE"};
+constexpr WinWord::DispatchMember wdDISPID_FORMFIELDS_ITEM = {0, L"FORMFIELDS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_HYPERLINKS_COUNT = {1, L"HYPERLINKS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPE_ALTERNATIVETEXT = {131, L"INLINESHAPE_ALTERNATIVETEXT"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPE_OLEFORMAT = {5, L"INLINESHAPE_OLEFORMAT"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPE_TYPE = {6, L"INLINESHAPE_TYPE"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPES_COUNT = {1, L"INLINESHAPES_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPES_ITEM = {0, L"INLINESHAPES_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_LISTFORMAT_LISTSTRING = {75, L"LISTFORMAT_LISTSTRING"};
+constexpr WinWord::DispatchMember wdDISPID_OLEFORMAT_PROGID = {22, L"OLEFORMAT_PROGID"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_GUTTER = {104, L"PAGESETUP_GUTTER"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_GUTTERPOS = {1222, L"PAGESETUP_GUTTERPOS"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_GUTTERSTYLE = {129, L"PAGESETUP_GUTTERSTYLE"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_LEFTMARGIN = {102, L"PAGESETUP_LEFTMARGIN"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_RIGHTMARGIN = {103, L"PAGESETUP_RIGHTMARGIN"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_MIRRORMARGINS = {111, L"PAGESETUP_MIRRORMARGINS"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_PAGEWIDTH = {105, L"PAGESETUP_PAGEWIDTH"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_SECTIONSTART = {114, L"PAGESETUP_SECTIONSTART"};
+constexpr WinWord::DispatchMember wdDISPID_PAGESETUP_TEXTCOLUMNS = {119, L"PAGESETUP_TEXTCOLUMNS"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPH_OUTLINELEVEL = {202, L"PARAGRAPH_OUTLINELEVEL"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPH_RANGE = {0, L"PARAGRAPH_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPH_STYLE = {100, L"PARAGRAPH_STYLE"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_ALIGNMENT = {101, L"PARAGRAPHFORMAT_ALIGNMENT"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_FIRSTLINEINDENT = {108, L"PARAGRAPHFORMAT_FIRSTLINEINDENT"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_LEFTINDENT = {107, L"PARAGRAPHFORMAT_LEFTINDENT"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_LINESPACING = {109, L"PARAGRAPHFORMAT_LINESPACING"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_LINESPACINGRULE = {110, L"PARAGRAPHFORMAT_LINESPACINGRULE"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHFORMAT_RIGHTINDENT = {106, L"PARAGRAPHFORMAT_RIGHTINDENT"};
+constexpr WinWord::DispatchMember wdDISPID_PARAGRAPHS_ITEM = {0, L"PARAGRAPHS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_APPLICATION = {1000, L"RANGE_APPLICATION"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_CELLS = {57, L"RANGE_CELLS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_COLLAPSE = {101, L"RANGE_COLLAPSE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_COMMENTS = {56, L"RANGE_COMMENTS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_CONTENTCONTROLS = {424, L"RANGE_CONTENTCONTROLS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_DUPLICATE = {6, L"RANGE_DUPLICATE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_END = {4, L"RANGE_END"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_ENDNOTES = {55, L"RANGE_ENDNOTES"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_EXPAND = {129, L"RANGE_EXPAND"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_FIELDS = {64, L"RANGE_FIELDS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_FONT = {5, L"RANGE_FONT"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_FOOTNOTES = {54, L"RANGE_FOOTNOTES"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_FORMFIELDS = {65, L"RANGE_FORMFIELDS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_HYPERLINKS = {156, L"RANGE_HYPERLINKS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_INFORMATION = {313, L"RANGE_INFORMATION"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_INLINESHAPES = {319, L"RANGE_INLINESHAPES"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_INRANGE = {126, L"RANGE_INRANGE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_LANGUAGEID = {153, L"RANGE_LANGUAGEID"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_LISTFORMAT = {68, L"RANGE_LISTFORMAT"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_MOVE = {109, L"RANGE_MOVE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_MOVEEND = {111, L"RANGE_MOVEEND"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_PAGESETUP = {1101, L"RANGE_PAGESETUP"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_PARAGRAPHFORMAT = {1102, L"RANGE_PARAGRAPHFORMAT"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_PARAGRAPHS = {59, L"RANGE_PARAGRAPHS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_REVISIONS = {150, L"RANGE_REVISIONS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_SECTIONS = {58, L"RANGE_SECTIONS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_SELECT = {65535, L"RANGE_SELECT"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_SETRANGE = {100, L"RANGE_SETRANGE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_SPELLINGERRORS = {316, L"RANGE_SPELLINGERRORS"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_START = {3, L"RANGE_START"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_STORYTYPE = {7, L"RANGE_STORYTYPE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_STYLE = {151, L"RANGE_STYLE"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_TABLES = {50, L"RANGE_TABLES"};
+constexpr WinWord::DispatchMember wdDISPID_RANGE_TEXT = {0, L"RANGE_TEXT"};
+constexpr WinWord::DispatchMember wdDISPID_REVISION_TYPE = {4, L"REVISION_TYPE"};
+constexpr WinWord::DispatchMember wdDISPID_REVISIONS_ITEM = {0, L"REVISIONS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_ROWS_COUNT = {2, L"ROWS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_SECTIONS_COUNT = {2, L"SECTIONS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_SECTIONS_ITEM = {0, L"SECTIONS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_SECTION_PAGESETUP = {1101, L"SECTION_PAGESETUP"};
+constexpr WinWord::DispatchMember wdDISPID_SELECTION_ENDOF = {108, L"SELECTION_ENDOF"};
+constexpr WinWord::DispatchMember wdDISPID_SELECTION_RANGE = {400, L"SELECTION_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_SELECTION_SETRANGE = {100, L"SELECTION_SETRANGE"};
+constexpr WinWord::DispatchMember wdDISPID_SELECTION_STARTISACTIVE = {404, L"SELECTION_STARTISACTIVE"};
+constexpr WinWord::DispatchMember wdDISPID_SELECTION_STARTOF = {107, L"SELECTION_STARTOF"};
+constexpr WinWord::DispatchMember wdDISPID_SPELLINGERRORS_COUNT = {1, L"SPELLINGERRORS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_SPELLINGERRORS_ITEM = {0, L"SPELLINGERRORS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_STYLE_NAMELOCAL = {0, L"STYLE_NAMELOCAL"};
+constexpr WinWord::DispatchMember wdDISPID_STYLE_PARENT = {1002, L"STYLE_PARENT"};
+constexpr WinWord::DispatchMember wdDISPID_STYLES_ITEM = {0, L"STYLES_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_TABLE_BORDERS = {1100, L"TABLE_BORDERS"};
+constexpr WinWord::DispatchMember wdDISPID_TABLE_COLUMNS = {100, L"TABLE_COLUMNS"};
+constexpr WinWord::DispatchMember wdDISPID_TABLE_NESTINGLEVEL = {108, L"TABLE_NESTINGLEVEL"};
+constexpr WinWord::DispatchMember wdDISPID_TABLE_RANGE = {0, L"TABLE_RANGE"};
+constexpr WinWord::DispatchMember wdDISPID_TABLE_ROWS = {101, L"TABLE_ROWS"};
+constexpr WinWord::DispatchMember wdDISPID_TABLES_ITEM = {0, L"TABLES_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_TEXTCOLUMN_WIDTH = {100, L"TEXTCOLUMN_WIDTH"};
+constexpr WinWord::DispatchMember wdDISPID_TEXTCOLUMNS_COUNT = {2, L"TEXTCOLUMNS_COUNT"};
+constexpr WinWord::DispatchMember wdDISPID_TEXTCOLUMNS_ITEM = {0, L"TEXTCOLUMNS_ITEM"};
+constexpr WinWord::DispatchMember wdDISPID_TEXTCOLUMN_SPACEAFTER = {101, L"TEXTCOLUMN_SPACEAFTER"};
+constexpr WinWord::DispatchMember wdDISPID_WINDOW_APPLICATION = {1000, L"WINDOW_APPLICATION"};
+constexpr WinWord::DispatchMember wdDISPID_WINDOW_DOCUMENT = {2, L"WINDOW_DOCUMENT"};
+constexpr WinWord::DispatchMember wdDISPID_WINDOW_SELECTION = {4, L"WINDOW_SELECTION"};
 
 // WdConstants Enumeration
 constexpr int wdUndefined = 9999999;
@@ -162,6 +160,7 @@ constexpr int wdCommentsStory = 4;
 // WdUnits Enumeration
 constexpr int wdCharacter = 1;
 constexpr int wdWord = 2;
+constexpr int wdSentence = 3;
 constexpr int wdParagraph = 4;
 constexpr int wdLine = 5;
 constexpr int wdStory = 6;
@@ -205,8 +204,8 @@ constexpr int wdGutterPosRight = 2;
 constexpr int wdGutterPosTop = 1;
 
 // chart constants
-constexpr int wdDISPID_INLINESHAPE_HASCHART = 148;
-constexpr int wdDISPID_INLINESHAPE_CHART = 149;
-constexpr int wdDISPID_CHART_CHARTTITLE = 1610743811;
-constexpr int wdDISPID_CHART_HASTITLE = 1610743809;
-constexpr int wdDISPID_CHARTTITLE_TEXT = 1610743820;
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPE_HASCHART = {148, L"INLINESHAPE_HASCHART"};
+constexpr WinWord::DispatchMember wdDISPID_INLINESHAPE_CHART = {149, L"INLINESHAPE_CHART"};
+constexpr WinWord::DispatchMember wdDISPID_CHART_CHARTTITLE = {1610743811, L"CHART_CHARTTITLE"};
+constexpr WinWord::DispatchMember wdDISPID_CHART_HASTITLE = {1610743809, L"CHART_HASTITLE"};
+constexpr WinWord::DispatchMember wdDISPID_CHARTTITLE_TEXT = {1610743820, L"CHARTTITLE_TEXT"};
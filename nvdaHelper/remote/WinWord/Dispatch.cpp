@@ -0,0 +1,142 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+#define WIN32_LEAN_AND_MEAN 
+
+#include <string>
+#include <sstream>
+#include <map>
+#include <cwchar>
+#include <vector>
+#include <algorithm>
+#include <comdef.h>
+#include <windows.h>
+#include <common/log.h>
+#include <common/lock.h>
+
+#include "Dispatch.h"
+
+namespace WinWord {
+
+namespace {
+
+	LockableObject dispIDCacheLock;
+	std::map<std::wstring, DISPID> dispIDCache; ///< DISPIDs keyed by "interface.member". Entries are never removed, so keys can name members in call statistics.
+
+}
+
+DispatchMember getDispatchMember(IDispatch* pDispatch, const wchar_t* interfaceName, const wchar_t* memberName) {
+	std::wstring key(interfaceName);
+	key += L'.';
+	key += memberName;
+	dispIDCacheLock.acquire();
+	auto i = dispIDCache.find(key);
+	if (i != dispIDCache.end()) {
+		DispatchMember member = {i->second, i->first.c_str()};
+		dispIDCacheLock.release();
+		return member;
+	}
+	dispIDCacheLock.release();
+	if (!pDispatch) return {DISPID_UNKNOWN, memberName};
+	DISPID dispID = DISPID_UNKNOWN;
+	LPOLESTR name = const_cast<LPOLESTR>(memberName);
+	HRESULT res = pDispatch->GetIDsOfNames(IID_NULL, &name, 1, LOCALE_USER_DEFAULT, &dispID);
+	if (res != S_OK) {
+		LOG_DEBUGWARNING(L"GetIDsOfNames failed for " << key << L", code " << res);
+		// Only a missing member is permanent, e.g. one added in a later version of Word.
+		if (res != DISP_E_UNKNOWNNAME) return {DISPID_UNKNOWN, memberName};
+		dispID = DISPID_UNKNOWN;
+	}
+	dispIDCacheLock.acquire();
+	auto inserted = dispIDCache.insert(std::make_pair(key, dispID)).first;
+	DispatchMember member = {inserted->second, inserted->first.c_str()};
+	dispIDCacheLock.release();
+	return member;
+}
+
+#if LOGLEVEL <= LOGLEVEL_DEBUG
+namespace {
+
+	struct DispatchCallStats {
+		long callCount;
+		long long totalTicks;
+	};
+
+	struct DispatchMemberNameLess {
+		bool operator()(const wchar_t* a, const wchar_t* b) const {
+			return wcscmp(a, b) < 0;
+		}
+	};
+
+	LockableObject dispatchStatsLock;
+	std::map<const wchar_t*, DispatchCallStats, DispatchMemberNameLess> dispatchStats; ///< Keyed by member name, as names are static strings
+
+	long long getPerformanceFrequency() {
+		static LARGE_INTEGER frequency = {0};
+		if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+	}
+
+}
+
+DispatchCallRecorder::DispatchCallRecorder(const DispatchMember& member) : m_name(member.name) {
+	QueryPerformanceCounter(&m_start);
+}
+
+DispatchCallRecorder::~DispatchCallRecorder() {
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	dispatchStatsLock.acquire();
+	DispatchCallStats& stats = dispatchStats[m_name];
+	stats.callCount += 1;
+	stats.totalTicks += end.QuadPart - m_start.QuadPart;
+	dispatchStatsLock.release();
+}
+#endif
+
+HRESULT getIntProperties(IDispatch* pDispatch, std::initializer_list<std::pair<DispatchMember, int*>> properties) {
+	for (auto& property : properties) {
+		HRESULT res = propGet(pDispatch, property.first, VT_I4, property.second);
+		if (res != S_OK) return res;
+	}
+	return S_OK;
+}
+
+void logDispatchStats() {
+#if LOGLEVEL <= LOGLEVEL_DEBUG
+	dispatchStatsLock.acquire();
+	std::vector<std::pair<const wchar_t*, DispatchCallStats>> sortedStats(dispatchStats.begin(), dispatchStats.end());
+	dispatchStatsLock.release();
+	if (sortedStats.empty()) return;
+	std::sort(sortedStats.begin(), sortedStats.end(), [](const std::pair<const wchar_t*, DispatchCallStats>& a, const std::pair<const wchar_t*, DispatchCallStats>& b) {
+		return a.second.totalTicks > b.second.totalTicks;
+	});
+	const long long frequency = getPerformanceFrequency();
+	std::wostringstream message;
+	message << L"Word automation calls by member (calls, total us):";
+	for (auto& entry : sortedStats) {
+		message << L" " << entry.first << L"=" << entry.second.callCount << L"/" << ((frequency > 0) ? (entry.second.totalTicks * 1000000) / frequency : 0);
+	}
+	LOG_DEBUG(message.str());
+#endif
+}
+
+void resetDispatchStats() {
+#if LOGLEVEL <= LOGLEVEL_DEBUG
+	dispatchStatsLock.acquire();
+	dispatchStats.clear();
+	dispatchStatsLock.release();
+#endif
+}
+
+}
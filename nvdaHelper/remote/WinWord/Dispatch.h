@@ -0,0 +1,123 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+#ifndef WINWORD_DISPATCH_H
+#define WINWORD_DISPATCH_H
+
+#define WIN32_LEAN_AND_MEAN 
+#include <initializer_list>
+#include <utility>
+#include <comdef.h>
+#include <windows.h>
+#include <common/log.h>
+
+namespace WinWord {
+
+	/**
+	* A member of a Word automation interface.
+	* Word reuses DISPIDs across interfaces (e.g. item 0 of every collection), so the name, such as L"RANGE_END", identifies the member in call statistics.
+	*/
+	struct DispatchMember {
+		DISPID id;
+		const wchar_t* name;
+	};
+
+	/**
+	* Looks up a member of a Word automation interface by name, asking Word only the first time a given member is used.
+	* This is for members that are not in Constants.h, such as those that only exist in some versions of Word.
+	* Members of Word's interfaces have fixed DISPIDs, so results are shared between all objects implementing the interface.
+	* Only successes and DISP_E_UNKNOWNNAME are cached, as other failures (e.g. a busy Word rejecting the call) may not happen again.
+	* @param pDispatch an object implementing the interface, used on a cache miss.
+	* @param interfaceName the name of the interface, e.g. L"Table", which keys the cache along with the member name.
+	* @param memberName the name of the property or method, e.g. L"Title".
+	* @returns the member, whose id is DISPID_UNKNOWN if it could not be found.
+	*/
+	DispatchMember getDispatchMember(IDispatch* pDispatch, const wchar_t* interfaceName, const wchar_t* memberName);
+
+#if LOGLEVEL <= LOGLEVEL_DEBUG
+	/**
+	* Measures one automation call, adding it to the per-member call statistics when destroyed.
+	*/
+	class DispatchCallRecorder {
+	public:
+		DispatchCallRecorder(const DispatchMember& member);
+		~DispatchCallRecorder();
+
+		DispatchCallRecorder(const DispatchCallRecorder&) = delete; // Copy constructor disabled, no implementation.
+		DispatchCallRecorder& operator=(const DispatchCallRecorder&) = delete; // Assignment disabled, no implementation.
+	private:
+		const wchar_t* m_name;
+		LARGE_INTEGER m_start;
+	};
+#else
+	// Call statistics are only logged at debug level, so don't pay for them otherwise.
+	class DispatchCallRecorder {
+	public:
+		DispatchCallRecorder(const DispatchMember&) {}
+	};
+#endif
+
+	/**
+	* Gets a property, as _com_dispatch_raw_propget, recording the call.
+	*/
+	inline HRESULT propGet(IDispatch* pDispatch, const DispatchMember& member, VARTYPE vtProp, void* pvProp) {
+		DispatchCallRecorder recorder(member);
+		return _com_dispatch_raw_propget(pDispatch, member.id, vtProp, pvProp);
+	}
+
+	/**
+	* Gets a property looked up by name with getDispatchMember, recording the call.
+	* @returns DISP_E_MEMBERNOTFOUND without calling Word if the interface has no such member.
+	*/
+	inline HRESULT propGet(IDispatch* pDispatch, const wchar_t* interfaceName, const wchar_t* memberName, VARTYPE vtProp, void* pvProp) {
+		DispatchMember member = getDispatchMember(pDispatch, interfaceName, memberName);
+		if (member.id == DISPID_UNKNOWN) return DISP_E_MEMBERNOTFOUND;
+		return propGet(pDispatch, member, vtProp, pvProp);
+	}
+
+	/**
+	* Sets a property, as _com_dispatch_raw_propput, recording the call.
+	*/
+	template<typename... Args> HRESULT propPut(IDispatch* pDispatch, const DispatchMember& member, VARTYPE vtProp, Args... args) {
+		DispatchCallRecorder recorder(member);
+		return _com_dispatch_raw_propput(pDispatch, member.id, vtProp, args...);
+	}
+
+	/**
+	* Calls a method, as _com_dispatch_raw_method, recording the call.
+	*/
+	template<typename... Args> HRESULT callMethod(IDispatch* pDispatch, const DispatchMember& member, WORD wFlags, VARTYPE vtRet, void* pvRet, const wchar_t* pwParamInfo, Args... args) {
+		DispatchCallRecorder recorder(member);
+		return _com_dispatch_raw_method(pDispatch, member.id, wFlags, vtRet, pvRet, pwParamInfo, args...);
+	}
+
+	/**
+	* Gets several integer properties of one object, e.g. the start and end of a range.
+	* IDispatch has no way to get more than one property per call, so this issues one call per property, stopping at the first failure.
+	* @param properties pairs of the member to get and where to put its value.
+	* @returns S_OK if all properties were fetched, otherwise the error from the first failed call.
+	*/
+	HRESULT getIntProperties(IDispatch* pDispatch, std::initializer_list<std::pair<DispatchMember, int*>> properties);
+
+	/**
+	* Logs the number of calls and total time per member since the last reset, slowest first, at debug level.
+	*/
+	void logDispatchStats();
+
+	/**
+	* Forgets all recorded call statistics.
+	*/
+	void resetDispatchStats();
+}
+
+#endif
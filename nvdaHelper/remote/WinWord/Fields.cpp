@@ -24,6 +24,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include "Fields.h"
 #include <remote/WinWord/Constants.h>
+#include <remote/WinWord/Dispatch.h>
 
 namespace WinWord {
 
@@ -39,21 +40,21 @@ namespace WinWord {
 */
 Fields::Fields(IDispatch* pRange) {
 	IDispatchPtr pDispatchFields = nullptr;
-	auto res = _com_dispatch_raw_propget( pRange, wdDISPID_RANGE_FIELDS, VT_DISPATCH, &pDispatchFields);
+	auto res = propGet( pRange, wdDISPID_RANGE_FIELDS, VT_DISPATCH, &pDispatchFields);
 	if( res != S_OK || !pDispatchFields ) {
 		LOG_DEBUGWARNING(L"error getting fields from range");
 		return;
 	}
 
 	int count = 0;
-	res = _com_dispatch_raw_propget( pDispatchFields, wdDISPID_FIELDS_COUNT, VT_I4, &count);
+	res = propGet( pDispatchFields, wdDISPID_FIELDS_COUNT, VT_I4, &count);
 	if( res != S_OK || count <= 0 ) {
 		return;
 	}
 
 	for(int i = 1; i <= count; ++i) {
 		IDispatchPtr pDispatchItem = nullptr;
-		res = _com_dispatch_raw_method( pDispatchFields, wdDISPID_FIELDS_ITEM, DISPATCH_METHOD, VT_DISPATCH, &pDispatchItem, L"\x0003", i);
+		res = callMethod( pDispatchFields, wdDISPID_FIELDS_ITEM, DISPATCH_METHOD, VT_DISPATCH, &pDispatchItem, L"\x0003", i);
 		if( res != S_OK || !pDispatchItem){
 			LOG_DEBUGWARNING(L"error getting field item");
 			continue;
@@ -69,21 +70,21 @@ Fields::Fields(IDispatch* pRange) {
 		const int HYPERLINK_TYPE_VALUE = 88; // wdFieldHyperlink
 		const int PAGE_NUMBER_TYPE_VALUE = 33; // wdFieldPage
 		int type = -1;
-		res = _com_dispatch_raw_propget( pDispatchItem, wdDISPID_FIELDS_ITEM_TYPE, VT_I4, &type);
+		res = propGet( pDispatchItem, wdDISPID_FIELDS_ITEM_TYPE, VT_I4, &type);
 		if( res != S_OK || !(type == CROSS_REFERENCE_TYPE_VALUE || type == HYPERLINK_TYPE_VALUE || type == PAGE_NUMBER_TYPE_VALUE) ){
 			continue;
 		}
 
 		IDispatchPtr pDispatchFieldResult = nullptr;
-		res = _com_dispatch_raw_propget( pDispatchItem, wdDISPID_FIELDS_ITEM_RESULT, VT_DISPATCH, &pDispatchFieldResult);
+		res = propGet( pDispatchItem, wdDISPID_FIELDS_ITEM_RESULT, VT_DISPATCH, &pDispatchFieldResult);
 		if( res != S_OK || !pDispatchFieldResult){
 			LOG_DEBUGWARNING(L"error getting the result from the field item.");
 			continue;
 		}
 
 		long resultStart = 0, resultEnd = 0;
-		auto ok = S_OK == _com_dispatch_raw_propget( pDispatchFieldResult, wdDISPID_RANGE_START, VT_I4, &resultStart)
-		       && S_OK == _com_dispatch_raw_propget( pDispatchFieldResult, wdDISPID_RANGE_END, VT_I4, &resultEnd);
+		auto ok = S_OK == propGet( pDispatchFieldResult, wdDISPID_RANGE_START, VT_I4, &resultStart)
+		       && S_OK == propGet( pDispatchFieldResult, wdDISPID_RANGE_END, VT_I4, &resultEnd);
 		if(!ok){
 			LOG_DEBUGWARNING(L"error getting range start and end points");
 			continue;
@@ -0,0 +1,58 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include "Tables.h"
+
+namespace WinWord {
+
+// Large enough for moving around a few big tables, small enough that a huge document does not grow the cache forever.
+const size_t MAX_CACHED_CELLS = 10000;
+
+const TableInfo* TableCache::getTable(const int startOffset, const int endOffset) const {
+	auto i = m_tables.find(std::make_pair(startOffset, endOffset));
+	if(i == m_tables.end()) {
+		return nullptr;
+	}
+	return &(i->second);
+}
+
+void TableCache::addTable(const TableInfo& table) {
+	m_tables[std::make_pair(table.startOffset, table.endOffset)] = table;
+}
+
+const TableCellInfo* TableCache::getCellAtOffset(const int offset) const {
+	auto i = m_cells.upper_bound(offset);
+	if(i == m_cells.begin()) {
+		return nullptr;
+	}
+	--i;
+	if(offset >= i->second.endOffset) {
+		return nullptr;
+	}
+	return &(i->second);
+}
+
+void TableCache::addCell(const TableCellInfo& cell) {
+	if(m_cells.size() >= MAX_CACHED_CELLS) {
+		m_cells.clear();
+	}
+	m_cells[cell.startOffset] = cell;
+}
+
+void TableCache::clear() {
+	m_tables.clear();
+	m_cells.clear();
+}
+
+} // end namespace WinWord
@@ -0,0 +1,85 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+#ifndef WINWORD_TABLES_H
+#define WINWORD_TABLES_H
+
+#include <string>
+#include <map>
+#include <utility>
+
+namespace WinWord {
+
+	/**
+	* The parts of a table needed to generate table xml, which only change if the document is edited.
+	*/
+	struct TableInfo {
+		int startOffset; ///< start of the table's range
+		int endOffset; ///< end of the table's range
+		int rowCount;
+		int columnCount;
+		int nestingLevel;
+		bool bordersEnabled; ///< false for layout tables
+		std::wstring name; ///< the table title, already escaped for use as an xml attribute value
+		bool hasDescription;
+		std::wstring description; ///< the table description, already escaped for use as an xml attribute value
+	};
+
+	/**
+	* A cell that contains no nested tables, so that any offset with in its range belongs to it.
+	*/
+	struct TableCellInfo {
+		int startOffset;
+		int endOffset;
+		int rowNumber;
+		int columnNumber;
+		int tableStartOffset; ///< start of the containing table's range
+		int tableEndOffset; ///< end of the containing table's range
+	};
+
+	/**
+	* Caches table and cell information for one document, so that moving around with in a table does not need to ask Word for the same details on every move.
+	* Tables are keyed by the start and end of their range (a nested table may start at the same offset as its containing table).
+	* Cells are keyed by their start offset, and are only added if they contain no nested tables, so cells never overlap.
+	* Offsets become invalid as soon as the document is edited, at which point the cache must be cleared.
+	*/
+	class TableCache {
+	public:
+		/**
+		* Fetches a cached table.
+		* @returns the table with the given range, or NULL if it is not cached.
+		*/
+		const TableInfo* getTable(const int startOffset, const int endOffset) const;
+
+		void addTable(const TableInfo& table);
+
+		/**
+		* Fetches the cached cell containing the given offset.
+		* @returns the cell, or NULL if there is no cached cell at this offset.
+		*/
+		const TableCellInfo* getCellAtOffset(const int offset) const;
+
+		/**
+		* Caches a cell. If too many cells are cached, all cells are dropped first.
+		*/
+		void addCell(const TableCellInfo& cell);
+
+		void clear();
+
+	private:
+		std::map<std::pair<int,int>,TableInfo> m_tables;
+		std::map<int,TableCellInfo> m_cells; ///< keyed by cell start offset
+	};
+}
+
+#endif
@@ -14,6 +14,9 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <iostream>
 #include <set>
+#include <map>
+#include <string>
+#include <cstring>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <delayimp.h>
@@ -25,11 +28,15 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 using namespace std;
 
-typedef multiset<HMODULE> moduleSet_t;
+typedef map<string,HMODULE> moduleMap_t;
 typedef set<void*> functionSet_t;
 
-moduleSet_t g_hookedModules;
+//Modules containing hooked functions, each loaded once and freed on terminate
+moduleMap_t g_hookedModules;
 functionSet_t g_hookedFunctions;
+volatile long apiHook_inFlightCallCount=0;
+//How long apiHook_terminate waits for calls in hook functions to return before giving up
+const DWORD APIHOOK_INFLIGHTCALLS_TIMEOUT=5000;
 HMODULE minhookLibHandle=NULL;
 bool error_setNHFP=false;
 
@@ -86,20 +93,24 @@ defMHFP(MH_DisableHook);
 	else return true;
 }
 
-void* apiHook_hookFunction(const char* moduleName, const char* functionName, void* newHookProc) {
-	if(!minhookLibHandle) {
-		LOG_ERROR(L"apiHooks not initialized");
-		return NULL;
+HMODULE loadHookedModule(const char* moduleName) {
+	moduleMap_t::iterator i=g_hookedModules.find(moduleName);
+	if(i!=g_hookedModules.end()) {
+		return i->second;
 	}
 	HMODULE moduleHandle=LoadLibraryA(moduleName);
 	if(!moduleHandle) {
 		LOG_ERROR("module " << moduleName << " not loaded");
 		return NULL;
 	}
+	g_hookedModules[moduleName]=moduleHandle;
+	return moduleHandle;
+}
+
+void* hookFunctionInModule(HMODULE moduleHandle, const char* moduleName, const char* functionName, void* newHookProc) {
 	void* realFunc=GetProcAddress(moduleHandle,functionName);
 	if(!realFunc) {
 		LOG_ERROR("function " << functionName << " does not exist in module " << moduleName);
-		FreeLibrary(moduleHandle);
 		return NULL;
 	}
 	LOG_DEBUG("requesting to hook function " << functionName << " at address 0X" << std::hex << realFunc << " in module " << moduleName << " at address 0X" << moduleHandle << " with  new function at address 0X" << newHookProc);
@@ -107,15 +118,49 @@ void* apiHook_hookFunction(const char* moduleName, const char* functionName, voi
 	MH_STATUS res = MH_CreateHook_fp(realFunc,newHookProc,&origFunc);
 	if(res!=MH_OK) {
 		LOG_ERROR("MH_CreateHook for function " << functionName << " in module " << moduleName << " failed with " << res);
-		FreeLibrary(moduleHandle);
 		return NULL;
 	}
-	g_hookedModules.insert(moduleHandle);
 	g_hookedFunctions.insert(realFunc);
 	LOG_DEBUG("successfully hooked function " << functionName << " in module " << moduleName << " with hook procedure at address 0X" << std::hex << newHookProc << ", returning true");
 	return origFunc;
 }
 
+void* apiHook_hookFunction(const char* moduleName, const char* functionName, void* newHookProc) {
+	if(!minhookLibHandle) {
+		LOG_ERROR(L"apiHooks not initialized");
+		return NULL;
+	}
+	HMODULE moduleHandle=loadHookedModule(moduleName);
+	if(!moduleHandle) {
+		return NULL;
+	}
+	return hookFunctionInModule(moduleHandle,moduleName,functionName,newHookProc);
+}
+
+size_t apiHook_hookFunctions(const apiHook_hookTableEntry_t* hookTable, size_t count) {
+	if(!minhookLibHandle) {
+		LOG_ERROR(L"apiHooks not initialized");
+		return 0;
+	}
+	size_t hookedCount=0;
+	// Tables usually list many functions from the same module in a row.
+	const char* lastModuleName=NULL;
+	HMODULE moduleHandle=NULL;
+	for(size_t i=0;i<count;++i) {
+		const apiHook_hookTableEntry_t& entry=hookTable[i];
+		*(entry.realFunction)=NULL;
+		if(!lastModuleName||strcmp(lastModuleName,entry.moduleName)!=0) {
+			moduleHandle=loadHookedModule(entry.moduleName);
+			lastModuleName=entry.moduleName;
+		}
+		if(!moduleHandle) continue;
+		*(entry.realFunction)=hookFunctionInModule(moduleHandle,entry.moduleName,entry.functionName,entry.newHookProc);
+		if(*(entry.realFunction)) ++hookedCount;
+	}
+	LOG_DEBUG("hooked "<<hookedCount<<" of "<<count<<" functions");
+	return hookedCount;
+}
+
 bool apiHook_enableHooks() {
 	if(!minhookLibHandle) {
 		LOG_ERROR(L"apiHooks not initialized");
@@ -136,12 +181,19 @@ bool apiHook_terminate() {
 	MH_STATUS res=MH_DisableHook_fp(MH_ALL_HOOKS);
 	nhAssert(res==MH_OK);
 	g_hookedFunctions.clear();
-	//Give enough time for all hook functions to complete.
-	Sleep(250);
+	//Wait for all calls already in hook functions to complete.
+	//The first sleep also covers a call that has just jumped to a hook function but not yet counted itself.
+	DWORD startTime=GetTickCount();
+	do {
+		Sleep(10);
+	} while(apiHook_inFlightCallCount>0&&(GetTickCount()-startTime)<APIHOOK_INFLIGHTCALLS_TIMEOUT);
+	if(apiHook_inFlightCallCount>0) {
+		LOG_ERROR(L"Timed out waiting for "<<apiHook_inFlightCallCount<<L" calls in hook functions to return");
+	}
 	res=MH_Uninitialize_fp();
 	nhAssert(res==MH_OK);
-	for(moduleSet_t::iterator i=g_hookedModules.begin();i!=g_hookedModules.end();++i) {
-		FreeLibrary(*i);
+	for(moduleMap_t::iterator i=g_hookedModules.begin();i!=g_hookedModules.end();++i) {
+		FreeLibrary(i->second);
 	}
 	g_hookedModules.clear();
 	FreeLibrary(minhookLibHandle);
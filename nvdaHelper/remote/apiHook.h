@@ -15,6 +15,10 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #ifndef _APIHOOK_H
 #define _APIHOOK_H
 
+#include <cstddef>
+#define WIN32_LEAN_AND_MEAN 
+#include <windows.h>
+
 /**
  * Initializes API hooking subsystem.
  * @return success flag
@@ -43,6 +47,62 @@ template<typename funcType> funcType _apiHook_hookFunction_tpl(const char* modul
  * @param fakeFunction the replacement function.
  */ 
 #define apiHook_hookFunction_safe(moduleName,realFunction,fakeFunction) _apiHook_hookFunction_tpl(moduleName,#realFunction,realFunction,fakeFunction)
+
+/**
+ * One function to be hooked by apiHook_hookFunctions.
+ */
+typedef struct {
+	const char* moduleName;
+	const char* functionName;
+	void* newHookProc;
+	void** realFunction;
+} apiHook_hookTableEntry_t;
+
+/**
+ * Requests that all the functions in the given table should be hooked.
+ * Each module is only loaded once, no matter how many of its functions are hooked.
+ * The hooks are not enabled until apiHook_enableHooks is called, which enables them all at once.
+ * @param hookTable the functions to hook. The address of each original function is placed in the entry's realFunction, or NULL if it could not be hooked.
+ * @param count the number of entries in hookTable.
+ * @return the number of functions successfully hooked.
+ */
+size_t apiHook_hookFunctions(const apiHook_hookTableEntry_t* hookTable, size_t count);
+
+ /**
+ * a helper template used internally by apiHook_hookTableEntry_safe
+ */
+template<typename funcType> apiHook_hookTableEntry_t _apiHook_hookTableEntry_tpl(const char* moduleName, const char* functionName, funcType funcSyg, funcType fakeFunction, funcType* realFunction) {
+	apiHook_hookTableEntry_t entry={moduleName,functionName,(void*)fakeFunction,(void**)realFunction};
+	return entry;
+}
+
+/**
+ * Safely builds an entry for apiHook_hookFunctions.
+ * @param moduleName a string containing the name of the module the function lives in
+ * @param the name/symbol of the function that should be hooked, as for apiHook_hookFunction_safe.
+ * @param fakeFunction the replacement function.
+ * @param realFunction the address of a variable which will receive the original function.
+ */ 
+#define apiHook_hookTableEntry_safe(moduleName,realFunction,fakeFunction,realFunctionVar) _apiHook_hookTableEntry_tpl(moduleName,#realFunction,realFunction,fakeFunction,realFunctionVar)
+
+/**
+ * The number of calls currently executing in hook functions. See apiHook_callGuard_t.
+ */
+extern volatile long apiHook_inFlightCallCount;
+
+/**
+ * Counts a call as in flight for as long as it is in scope, so that apiHook_terminate can wait for hook functions to return before unloading them.
+ * Every hook function should declare one as its very first statement.
+ */
+class apiHook_callGuard_t {
+	public:
+	apiHook_callGuard_t() {
+		InterlockedIncrement(&apiHook_inFlightCallCount);
+	}
+	~apiHook_callGuard_t() {
+		InterlockedDecrement(&apiHook_inFlightCallCount);
+	}
+};
  
 /**
  * Actually hooks all requested hook functions.
@@ -50,7 +110,7 @@ template<typename funcType> funcType _apiHook_hookFunction_tpl(const char* modul
 	bool apiHook_enableHooks();
 
 /**
- * unhooks all functions previously hooked with apiHook_hookFunction and terminates API hooking subsystem.
+ * unhooks all functions previously hooked with apiHook_hookFunction or apiHook_hookFunctions, waits for any calls still in hook functions to return, and terminates API hooking subsystem.
  */
 bool apiHook_terminate();
 
@@ -302,7 +302,137 @@ void displayModel_t::generateWhitespaceXML(HWND hwnd, long baseline, wstring& te
 	text.append(L"</text>");
 }
 
+/**
+ * Walks all the chunks of one model in y,x order.
+ */
+class displayModelChunkSource_t {
+	private:
+	displayModelChunksByPointMap_t::const_iterator current;
+	displayModelChunksByPointMap_t::const_iterator end;
+
+	public:
+
+	displayModelChunkSource_t(const displayModelChunksByPointMap_t& chunksByYX): current(chunksByYX.begin()), end(chunksByYX.end()) {
+	}
+
+	bool atEnd() const { return current==end; }
+
+	displayModelChunk_t* getChunk() const { return current->second; }
+
+	int getBaseline() const { return current->first.first; }
+
+	void next() { ++current; }
+
+};
+
+/**
+ * Walks the chunks of several models together in y,x order, as though they were all in one model.
+ * Only chunks intersecting the rectangle are visited, as only those would have been copied in to one model.
+ * The models are merged with a heap holding the next chunk of each model, so nothing is copied.
+ */
+class mergedChunkSource_t {
+	private:
+
+	struct cursor_t {
+		displayModelChunksByPointMap_t::const_iterator current;
+		displayModelChunksByPointMap_t::const_iterator end;
+		size_t index;
+	};
+
+	//Orders cursors so that the front of the heap is the one with the lowest y,x, then the earliest model.
+	static bool isAfter(const cursor_t& a, const cursor_t& b) {
+		if(a.current->first!=b.current->first) return a.current->first>b.current->first;
+		return a.index>b.index;
+	}
+
+	const RECT& rect;
+	vector<cursor_t> heap;
+
+	//Moves the cursor on to the next chunk intersecting the rectangle, returning false if there are no more.
+	bool skipToIntersectingChunk(cursor_t& cursor) const {
+		RECT tempRect;
+		while(cursor.current!=cursor.end&&!IntersectRect(&tempRect,&rect,&(cursor.current->second->rect))) ++cursor.current;
+		return cursor.current!=cursor.end;
+	}
+
+	public:
+
+	mergedChunkSource_t(const vector<const displayModelChunksByPointMap_t*>& chunkMaps, const RECT& rect): rect(rect) {
+		heap.reserve(chunkMaps.size());
+		for(size_t i=0;i<chunkMaps.size();++i) {
+			cursor_t cursor={chunkMaps[i]->begin(),chunkMaps[i]->end(),i};
+			if(skipToIntersectingChunk(cursor)) heap.push_back(cursor);
+		}
+		make_heap(heap.begin(),heap.end(),isAfter);
+	}
+
+	bool atEnd() const { return heap.empty(); }
+
+	displayModelChunk_t* getChunk() const { return heap.front().current->second; }
+
+	int getBaseline() const { return heap.front().current->first.first; }
+
+	void next() {
+		pop_heap(heap.begin(),heap.end(),isAfter);
+		cursor_t& cursor=heap.back();
+		++cursor.current;
+		if(skipToIntersectingChunk(cursor)) {
+			push_heap(heap.begin(),heap.end(),isAfter);
+		} else {
+			heap.pop_back();
+		}
+	}
+
+};
+
+/**
+ * Finds out if any chunk of one map overlaps a chunk of another map within the rectangle.
+ * The bounds of each map's chunks are collected first, so that a chunk is only compared with the chunks of maps whose bounds it overlaps.
+ */
+bool chunkMapsOverlap(const vector<const displayModelChunksByPointMap_t*>& chunkMaps, const RECT& rect) {
+	RECT tempRect;
+	RECT clippedRect;
+	vector<RECT> bounds(chunkMaps.size());
+	for(size_t i=0;i<chunkMaps.size();++i) {
+		SetRectEmpty(&bounds[i]);
+		for(displayModelChunksByPointMap_t::const_iterator j=chunkMaps[i]->begin();j!=chunkMaps[i]->end();++j) {
+			if(IntersectRect(&clippedRect,&rect,&(j->second->rect))) UnionRect(&bounds[i],&bounds[i],&clippedRect);
+		}
+	}
+	for(size_t i=0;i<chunkMaps.size();++i) {
+		if(IsRectEmpty(&bounds[i])) continue;
+		for(displayModelChunksByPointMap_t::const_iterator j=chunkMaps[i]->begin();j!=chunkMaps[i]->end();++j) {
+			if(!IntersectRect(&clippedRect,&rect,&(j->second->rect))) continue;
+			for(size_t k=i+1;k<chunkMaps.size();++k) {
+				if(!IntersectRect(&tempRect,&clippedRect,&bounds[k])) continue;
+				for(displayModelChunksByPointMap_t::const_iterator l=chunkMaps[k]->begin();l!=chunkMaps[k]->end();++l) {
+					if(IntersectRect(&tempRect,&clippedRect,&(l->second->rect))) return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
 void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, wstring& text, deque<RECT>& characterLocations) {
+	displayModelChunkSource_t chunks(chunksByYX);
+	renderChunks(hwnd,chunks,rect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace,text,characterLocations);
+}
+
+bool displayModel_t::renderMergedText(HWND hwnd, const vector<displayModel_t*>& models, const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, wstring& text, deque<RECT>& characterLocations) {
+	vector<const displayModelChunksByPointMap_t*> chunkMaps;
+	chunkMaps.reserve(models.size());
+	for(vector<displayModel_t*>::const_iterator i=models.begin();i!=models.end();++i) {
+		chunkMaps.push_back(&((*i)->chunksByYX));
+	}
+	//Overlapping chunks would have been cleared or truncated when copied in to one model, which a merged walk can not reproduce.
+	if(chunkMapsOverlap(chunkMaps,rect)) return false;
+	mergedChunkSource_t chunks(chunkMaps,rect);
+	renderChunks(hwnd,chunks,rect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace,text,characterLocations);
+	return true;
+}
+
+template<class chunkSource_t> void displayModel_t::renderChunks(HWND hwnd, chunkSource_t& chunks, const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, wstring& text, deque<RECT>& characterLocations) {
 	RECT tempCharLocation;
 	RECT tempRect;
 	wstring curLineText;
@@ -314,12 +444,11 @@ void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitesp
 	HWND lastChunkHwnd=NULL;
 	int lastLineBottom=rect.top;
 	//Walk through all the chunks looking for any that intersect the rectangle
-	displayModelChunksByPointMap_t::iterator chunkIt=chunksByYX.begin();
-	while(chunkIt!=chunksByYX.end()) {
+	while(!chunks.atEnd()) {
 		displayModelChunk_t* chunk=NULL;
 		BOOL isTempChunk=FALSE;
-		if(IntersectRect(&tempRect,&rect,&(chunkIt->second->rect))) {
-			chunk=chunkIt->second;
+		if(IntersectRect(&tempRect,&rect,&(chunks.getChunk()->rect))) {
+			chunk=chunks.getChunk();
 			//If this chunk is not fully covered by the rectangle
 			//Copy it and truncate it so that it is fully covered
 			if(chunk->rect.left<tempRect.left||chunk->rect.right>tempRect.right) {
@@ -330,9 +459,9 @@ void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitesp
 			}
 		}
 		//Find out the current line's baseline
-		curLineBaseline=chunkIt->first.first;
+		curLineBaseline=chunks.getBaseline();
 		//Iterate to the next possible chunk
-		++chunkIt;
+		chunks.next();
 		//If we have a valid chunk then add it to the current line
 		if(chunk&&chunk->text.length()>0) {
 			//Update the maximum height of the line
@@ -368,7 +497,8 @@ void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitesp
 			lastChunkRight=chunk->rect.right;
 			lastChunkHwnd=chunk->hwnd;
 		}
-		if((chunkIt==chunksByYX.end()||chunkIt->first.first>curLineBaseline)&&curLineText.length()>0) {
+		if(isTempChunk) delete chunk;
+		if((chunks.atEnd()||chunks.getBaseline()>curLineBaseline)&&curLineText.length()>0) {
 			//This is the end of the line
 			if(((curLineMinTop-lastLineBottom)>=minVerticalWhitespace)&&(lastLineBottom>rect.top||!stripOuterWhitespace)) {
 				//There is space between this line and the last,
@@ -398,7 +528,6 @@ void displayModel_t::renderText(const RECT& rect, const int minHorizontalWhitesp
 			lastChunkRight=rect.left;
 			lastChunkHwnd=NULL;
 			lastLineBottom=curLineMaxBottom;
-			if(chunk&&isTempChunk) delete chunk;
 		}
 	}
 	if(!stripOuterWhitespace&&(rect.bottom-lastLineBottom)>=minVerticalWhitespace) {
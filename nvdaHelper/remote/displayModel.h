@@ -17,6 +17,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <map>
 #include <deque>
+#include <vector>
 #include <windows.h>
 #include <common/lock.h>
 
@@ -61,6 +62,13 @@ class displayModel_t: public LockableAutoFreeObject  {
 	displayModelChunksByPointMap_t chunksByYX; //indexes the chunks by y,x
 	RECT* focusRect;
 
+/**
+ * Renders the chunks produced by the given chunk source, which must produce them in y,x order.
+ * @param hwnd the window to use for whitespace between chunks of different windows.
+ * @param chunks the source of chunks, providing atEnd, getChunk, getBaseline and next.
+ */
+	template<class chunkSource_t> static void renderChunks(HWND hwnd, chunkSource_t& chunks, const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, std::wstring& text, std::deque<RECT>& characterLocations);
+
 	protected:
 
 /**
@@ -136,7 +144,7 @@ class displayModel_t: public LockableAutoFreeObject  {
 /**
  * Generates xml representing whitespace between chunks 
  */
-	void generateWhitespaceXML(HWND hwnd, long baseline, std::wstring& text);
+	static void generateWhitespaceXML(HWND hwnd, long baseline, std::wstring& text);
 
 /**
  * Fetches the text contained in all chunks intersecting the given rectangle if provided, otherwize the text from all chunks in the model.
@@ -147,6 +155,16 @@ class displayModel_t: public LockableAutoFreeObject  {
  */
 	void renderText(const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, std::wstring& text, std::deque<RECT>& characterLocations);
 
+/**
+ * Renders the text of several models as though their chunks within the rectangle had first been copied in to one model, without copying any chunks.
+ * Nothing is rendered if chunks of different models overlap within the rectangle, as copying would have let the later model's chunks cover the earlier ones.
+ * All the models must already be acquired.
+ * @param hwnd the window the text is being rendered for.
+ * @param models the models to render, in the order they would have been copied.
+ * @return true if the text was rendered, false if the models overlap and must be copied in to one model instead.
+ */
+	static bool renderMergedText(HWND hwnd, const std::vector<displayModel_t*>& models, const RECT& rect, const int minHorizontalWhitespace, const int minVerticalWhitespace, const bool stripOuterWhitespace, std::wstring& text, std::deque<RECT>& characterLocations);
+
 };
 
 #endif
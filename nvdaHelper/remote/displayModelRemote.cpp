@@ -14,16 +14,29 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <string>
 #include <map>
+#include <vector>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <ole2.h>
 #include <rpc.h>
 #include "displayModelRemote.h"
 #include "gdiHooks.h"
+#include "inProcess.h"
 #include <common/log.h>
 
 using namespace std;
 
+/**
+ * Makes sure the GDI hooks are running before a display model is queried.
+ * Windows painted before the hooks were installed have no display model yet, so on first activation they are repainted before the query reads them.
+ */
+void activateGdiHooksForWindow(HWND hwnd) {
+	if(inProcess_isSubsystemActive(inProcessSubsystem_gdiHooks)) return;
+	if(inProcess_activateSubsystem(inProcessSubsystem_gdiHooks)&&hwnd) {
+		gdiHooks_repaintWindow(hwnd);
+	}
+}
+
 BOOL CALLBACK EnumChildWindowsProc(HWND hwnd, LPARAM lParam) {
 	((deque<HWND>*)lParam)->push_back(hwnd);
 	return TRUE;
@@ -31,6 +44,7 @@ BOOL CALLBACK EnumChildWindowsProc(HWND hwnd, LPARAM lParam) {
 
 error_status_t displayModelRemote_getWindowTextInRect(handle_t bindingHandle, const unsigned long windowHandle, const boolean includeDescendantWindows, const int left, const int top, const int right, const int bottom, const int minHorizontalWhitespace, const int minVerticalWhitespace, const boolean stripOuterWhitespace, BSTR* textBuf, BSTR* characterLocationsBuf) {
 	HWND hwnd=(HWND)UlongToHandle(windowHandle);
+	activateGdiHooksForWindow(GetAncestor(hwnd,GA_ROOT));
 	deque<HWND> windowDeque;
 	bool hasDescendantWindows=false;
 	if(includeDescendantWindows) {
@@ -39,41 +53,54 @@ error_status_t displayModelRemote_getWindowTextInRect(handle_t bindingHandle, co
 		hasDescendantWindows=(windowDeque.size()>1);
 	}
 	RECT textRect={left,top,right,bottom};
-	displayModel_t* tempModel=NULL;
+	wstring text;
+	deque<RECT> characterLocations;
+	bool hasText=false;
 	if(hasDescendantWindows) {
-		tempModel=new displayModel_t;
+		//Acquire the models of the visible windows in the order they are composited, this window first so that its descendants cover it.
+		vector<displayModel_t*> models;
+		displayModelsByWindow.acquire();
 		for(deque<HWND>::reverse_iterator i=windowDeque.rbegin();i!=windowDeque.rend();++i) {
 			if(!IsWindowVisible(*i)) continue;
-			displayModelsByWindow.acquire();
 			displayModelsMap_t<HWND>::iterator j=displayModelsByWindow.find(*i);
 			if(j!=displayModelsByWindow.end()) {
 				j->second->acquire();
-				j->second->copyRectangle(textRect,FALSE,FALSE,false,textRect,NULL,tempModel);
-				j->second->release();
+				models.push_back(j->second);
+			}
+		}
+		displayModelsByWindow.release();
+		//Render straight from the windows' own models where their text does not overlap.
+		//Otherwise copy them in to a temporary model so that the text of later windows clears what it covers.
+		if(!displayModel_t::renderMergedText(hwnd,models,textRect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace!=0,text,characterLocations)) {
+			displayModel_t* tempModel=new displayModel_t;
+			for(vector<displayModel_t*>::iterator i=models.begin();i!=models.end();++i) {
+				(*i)->copyRectangle(textRect,FALSE,FALSE,false,textRect,NULL,tempModel);
 			}
-			displayModelsByWindow.release();
+			//The windowHandle was not set at construction time as we did not want the inserted chunks to inherit this handle but instead keep their own.
+			tempModel->hwnd=hwnd;
+			tempModel->renderText(textRect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace!=0,text,characterLocations);
+			tempModel->requestDelete();
+		}
+		for(vector<displayModel_t*>::iterator i=models.begin();i!=models.end();++i) {
+			(*i)->release();
 		}
+		hasText=true;
 	} else { //hasDescendantWindows is False
+		displayModel_t* model=NULL;
 		displayModelsByWindow.acquire();
 		displayModelsMap_t<HWND>::iterator i=displayModelsByWindow.find(hwnd);
 		if(i!=displayModelsByWindow.end()) {
 			i->second->acquire();
-			tempModel=i->second;
+			model=i->second;
 		}
 		displayModelsByWindow.release();
-	}
-	if(tempModel) {
-		wstring text;
-		deque<RECT> characterLocations;
-		//if this is a temporary model, now correctly set its windowHandle before rendering the text.
-		//The windowHandle was not set at construction time as we did not want the inserted chunks to inherit this handle but instead keep their own.
-		if(hasDescendantWindows) tempModel->hwnd=(HWND)UlongToHandle(windowHandle);
-		tempModel->renderText(textRect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace!=0,text,characterLocations);
-		if(hasDescendantWindows) {
-			tempModel->requestDelete();
-		} else {
-			tempModel->release();
+		if(model) {
+			model->renderText(textRect,minHorizontalWhitespace,minVerticalWhitespace,stripOuterWhitespace!=0,text,characterLocations);
+			model->release();
+			hasText=true;
 		}
+	}
+	if(hasText) {
 		*textBuf=SysAllocStringLen(text.c_str(),static_cast<UINT>(text.size()));
 		size_t cpBufSize=characterLocations.size()*4;
 		// Hackishly use a BSTR to contain points.
@@ -93,6 +120,7 @@ error_status_t displayModelRemote_getWindowTextInRect(handle_t bindingHandle, co
 
 error_status_t displayModelRemote_getFocusRect(handle_t bindingHandle, const unsigned long windowHandle, long* left, long* top, long* right, long* bottom) {
 	HWND hwnd=(HWND)UlongToHandle(windowHandle);
+	activateGdiHooksForWindow(GetAncestor(hwnd,GA_ROOT));
 	displayModelsByWindow.acquire();
 	displayModelsMap_t<HWND>::iterator i=displayModelsByWindow.find(hwnd);
 	RECT focusRect;
@@ -128,6 +156,7 @@ error_status_t displayModelRemote_getCaretRect(handle_t bindingHandle, const lon
 }
 
 error_status_t displayModelRemote_requestTextChangeNotificationsForWindow(handle_t bindingHandle, const unsigned long windowHandle, const BOOL enable) {
+	if(enable) activateGdiHooksForWindow(GetAncestor((HWND)UlongToHandle(windowHandle),GA_ROOT));
 	if(enable) windowsForTextChangeNotifications[(HWND)UlongToHandle(windowHandle)]+=1; else windowsForTextChangeNotifications[(HWND)UlongToHandle(windowHandle)]-=1;
 	return 0;
 }
@@ -0,0 +1,221 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2010 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#define WIN32_LEAN_AND_MEAN 
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <windows.h>
+#include <richedit.h>
+#include <richole.h>
+#include <tom.h>
+#include <common/log.h>
+#include "nvdaInProcUtils.h"
+#include "inProcess.h"
+
+using namespace std;
+
+//Values for the flags parameter of edit_getTextInRange
+const long EDITTEXT_RICHEDIT=0x1;
+const long EDITTEXT_FORMATTING=0x2;
+
+//Separates the fields of a formatting run.
+const wchar_t FIELD_SEPARATOR=L'\x1f';
+//Ends each formatting run.
+const wchar_t RECORD_SEPARATOR=L'\x1e';
+
+/**
+ * A run of text with the same character formatting.
+ * effects uses the CFE_* flags of CHARFORMAT2 so that NVDA can treat it like the result of EM_GETCHARFORMAT.
+ */
+typedef struct {
+	long start;
+	long end;
+	wstring fontName;
+	long size;
+	DWORD effects;
+	COLORREF textColor;
+	COLORREF backColor;
+} formatRun_t;
+
+long getStoryLength(HWND hwnd, bool isRichEdit) {
+	if(isRichEdit) {
+		//Rich edit offsets count a single \r for each paragraph end, whereas WM_GETTEXTLENGTH counts \r\n.
+		GETTEXTLENGTHEX lengthEx={GTL_NUMCHARS|GTL_PRECISE,1200};
+		return (long)SendMessage(hwnd,EM_GETTEXTLENGTHEX,(WPARAM)&lengthEx,0);
+	}
+	return (long)SendMessage(hwnd,WM_GETTEXTLENGTH,0,0);
+}
+
+/**
+ * Fetches the text between two offsets, which must lie within the story, without copying the rest of the control's text.
+ */
+wstring getEditText(HWND hwnd, bool isRichEdit, long start, long end) {
+	wstring text;
+	if(end<=start) return text;
+	if(isRichEdit) {
+		text.resize(end-start+1);
+		TEXTRANGE range={{start,end},&text[0]};
+		long length=(long)SendMessage(hwnd,EM_GETTEXTRANGE,0,(LPARAM)&range);
+		text.resize(length>0?length:0);
+		return text;
+	}
+	//Multiline edit controls hand out their buffer, which can be read directly as we are on the control's thread.
+	//It holds ANSI text for ANSI windows.
+	HLOCAL hText=IsWindowUnicode(hwnd)?(HLOCAL)SendMessage(hwnd,EM_GETHANDLE,0,0):NULL;
+	const wchar_t* buf=hText?static_cast<const wchar_t*>(LocalLock(hText)):NULL;
+	if(buf) {
+		text.assign(buf+start,end-start);
+		LocalUnlock(hText);
+		return text;
+	}
+	//Single line edit controls have no buffer handle, but their text is short.
+	long length=(long)SendMessage(hwnd,WM_GETTEXTLENGTH,0,0);
+	if(length<=0) return text;
+	text.resize(length+1);
+	length=(long)SendMessage(hwnd,WM_GETTEXT,(WPARAM)(length+1),(LPARAM)&text[0]);
+	text.resize(length>0?length:0);
+	return (start<static_cast<long>(text.length()))?text.substr(start,end-start):wstring();
+}
+
+/**
+ * Fetches the formatting runs covering the given range using the text object model, which unlike EM_GETCHARFORMAT does not need the selection to be moved.
+ */
+bool fetchFormatRuns(HWND hwnd, long start, long end, vector<formatRun_t>& runs) {
+	IRichEditOle* pRichEditOle=NULL;
+	if(!SendMessage(hwnd,EM_GETOLEINTERFACE,0,(LPARAM)&pRichEditOle)||!pRichEditOle) {
+		LOG_DEBUGWARNING(L"EM_GETOLEINTERFACE failed");
+		return false;
+	}
+	ITextDocument* pTextDocument=NULL;
+	HRESULT res=pRichEditOle->QueryInterface(__uuidof(ITextDocument),(void**)&pTextDocument);
+	pRichEditOle->Release();
+	if(res!=S_OK||!pTextDocument) {
+		LOG_DEBUGWARNING(L"QueryInterface to ITextDocument failed with "<<res);
+		return false;
+	}
+	ITextRange* pRange=NULL;
+	if(pTextDocument->Range(start,start,&pRange)!=S_OK||!pRange) {
+		LOG_DEBUGWARNING(L"ITextDocument::Range failed");
+		pTextDocument->Release();
+		return false;
+	}
+	//Expand to the whole run the start offset is in, then walk forward run by run.
+	pRange->Expand(tomCharFormat,NULL);
+	for(;;) {
+		formatRun_t run;
+		pRange->GetStart(&run.start);
+		pRange->GetEnd(&run.end);
+		if(run.end<=run.start) break;
+		ITextFont* pFont=NULL;
+		if(pRange->GetFont(&pFont)!=S_OK||!pFont) break;
+		BSTR name=NULL;
+		pFont->GetName(&name);
+		if(name) {
+			run.fontName=name;
+			SysFreeString(name);
+		}
+		float size=0;
+		pFont->GetSize(&size);
+		//Twips, like CHARFORMAT's yHeight.
+		run.size=static_cast<long>(size*20);
+		run.effects=0;
+		long value=0;
+		if(pFont->GetBold(&value)==S_OK&&value==tomTrue) run.effects|=CFE_BOLD;
+		if(pFont->GetItalic(&value)==S_OK&&value==tomTrue) run.effects|=CFE_ITALIC;
+		if(pFont->GetUnderline(&value)==S_OK&&value!=tomNone&&value!=tomFalse) run.effects|=CFE_UNDERLINE;
+		if(pFont->GetStrikeThrough(&value)==S_OK&&value==tomTrue) run.effects|=CFE_STRIKEOUT;
+		if(pFont->GetSubscript(&value)==S_OK&&value==tomTrue) run.effects|=CFE_SUBSCRIPT;
+		if(pFont->GetSuperscript(&value)==S_OK&&value==tomTrue) run.effects|=CFE_SUPERSCRIPT;
+		run.textColor=0;
+		if(pFont->GetForeColor(&value)==S_OK) {
+			if(value==tomAutoColor) run.effects|=CFE_AUTOCOLOR; else run.textColor=static_cast<COLORREF>(value);
+		}
+		run.backColor=0;
+		if(pFont->GetBackColor(&value)==S_OK) {
+			if(value==tomAutoColor) run.effects|=CFE_AUTOBACKCOLOR; else run.backColor=static_cast<COLORREF>(value);
+		}
+		pFont->Release();
+		//Fonts do not say whether text is a link, but a link unit can only be expanded to from within one.
+		ITextRange* pLinkRange=NULL;
+		if(pRange->GetDuplicate(&pLinkRange)==S_OK&&pLinkRange) {
+			long delta=0;
+			pLinkRange->Collapse(tomStart);
+			if(pLinkRange->Expand(tomLink,&delta)==S_OK&&delta>0) run.effects|=CFE_LINK;
+			pLinkRange->Release();
+		}
+		runs.push_back(run);
+		if(run.end>=end) break;
+		long moved=0;
+		if(pRange->Move(tomCharFormat,1,&moved)!=S_OK||moved==0) break;
+		pRange->Expand(tomCharFormat,NULL);
+	}
+	pRange->Release();
+	pTextDocument->Release();
+	return true;
+}
+
+error_status_t nvdaInProcUtils_edit_getTextInRange(handle_t bindingHandle, const unsigned long windowHandle, int startOffset, int endOffset, long flags, int maxLineStarts, BSTR* text, int* lineStartCount, int* lineStarts, BSTR* formatRuns) {
+	HWND hwnd=(HWND)UlongToHandle(windowHandle);
+	long threadID=GetWindowThreadProcessId(hwnd,NULL);
+	bool isRichEdit=(flags&EDITTEXT_RICHEDIT)!=0;
+	error_status_t res=RPC_S_OK;
+	*lineStartCount=0;
+	//Messages and the text object model are far cheaper from the control's own thread.
+	bool executed=execInThread(threadID,[&](){
+		long storyLength=getStoryLength(hwnd,isRichEdit);
+		if(storyLength<0) storyLength=0;
+		if(endOffset<0||endOffset>storyLength) endOffset=storyLength;
+		if(startOffset<0||startOffset>endOffset) {
+			res=ERROR_INVALID_PARAMETER;
+			return;
+		}
+		wstring rangeText=getEditText(hwnd,isRichEdit,startOffset,endOffset);
+		if(GetWindowLong(hwnd,GWL_STYLE)&ES_PASSWORD) {
+			rangeText.assign(rangeText.length(),L'*');
+		}
+		*text=SysAllocStringLen(rangeText.c_str(),static_cast<UINT>(rangeText.length()));
+		//The start of every line overlapping the range, followed by the start of the line after it.
+		int lineIndex=(int)SendMessage(hwnd,isRichEdit?EM_EXLINEFROMCHAR:EM_LINEFROMCHAR,isRichEdit?0:startOffset,isRichEdit?startOffset:0);
+		int lineCount=(int)SendMessage(hwnd,EM_GETLINECOUNT,0,0);
+		while(*lineStartCount<maxLineStarts) {
+			int lineStart=(lineIndex<lineCount)?(int)SendMessage(hwnd,EM_LINEINDEX,lineIndex,0):-1;
+			if(lineStart<0) lineStart=storyLength;
+			lineStarts[(*lineStartCount)++]=lineStart;
+			if(lineStart>endOffset||lineStart>=storyLength) break;
+			if(lineStart==endOffset&&endOffset>startOffset) break;
+			++lineIndex;
+		}
+		if(isRichEdit&&(flags&EDITTEXT_FORMATTING)) {
+			vector<formatRun_t> runs;
+			//Not cached, as applying formatting leaves the text untouched and rich edit controls report no formatting changes.
+			if(fetchFormatRuns(hwnd,startOffset,(endOffset>startOffset)?endOffset:startOffset+1,runs)) {
+				wstringstream s;
+				for(vector<formatRun_t>::const_iterator i=runs.begin();i!=runs.end();++i) {
+					if(i->end<=startOffset&&i->start!=startOffset) continue;
+					if(i->start>=endOffset&&endOffset>startOffset) break;
+					s<<i->start<<FIELD_SEPARATOR<<i->end<<FIELD_SEPARATOR<<i->fontName<<FIELD_SEPARATOR<<i->size<<FIELD_SEPARATOR<<i->effects<<FIELD_SEPARATOR<<i->textColor<<FIELD_SEPARATOR<<i->backColor<<FIELD_SEPARATOR<<RECORD_SEPARATOR;
+				}
+				wstring runsText=s.str();
+				*formatRuns=SysAllocStringLen(runsText.c_str(),static_cast<UINT>(runsText.length()));
+			}
+		}
+	});
+	if(!executed) {
+		LOG_DEBUGWARNING(L"Could not execute in thread "<<threadID);
+		return 1;
+	}
+	return res;
+}
@@ -15,6 +15,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <map>
 #include <set>
 #include <list>
+#include <cmath>
 #include <windows.h>
 #include <usp10.h>
 #include "nvdaHelperRemote.h"
@@ -49,6 +50,12 @@ map<HWND,RECT> textChangeNotifications;
 UINT_PTR textChangeNotifyTimerID=0;
 DWORD tls_index_textInsertionsCount=TLS_OUT_OF_INDEXES;
 DWORD tls_index_curScriptTextOutScriptAnalysis=TLS_OUT_OF_INDEXES;
+UINT wm_gdiHooks_repaintWindow=0;
+
+/**
+ * How long a query waits for a window to repaint before reading its display model anyway.
+ */
+const UINT REPAINT_TIMEOUT=500;
 
 class TextInsertionTracker {
 	private:
@@ -144,6 +151,89 @@ inline displayModel_t* acquireDisplayModel(HDC hdc, BOOL noCreate=FALSE) {
 	return model;
 }
 
+//The most device contexts whose transforms are cached at once, so that DCs that are never deleted through a hooked function can not grow the cache forever.
+#define MAX_CACHED_DC_TRANSFORMS 256
+
+/**
+ * How points in a device context map to screen points.
+ */
+typedef struct {
+	//True if logical points map to device points by adding offset: MM_TEXT mapping, no mirroring, and a world transform that only translates by whole units.
+	bool isTranslation;
+	POINT offset;
+	//True if the DC has no window, so its origin can not move and dcOrigin is always valid.
+	bool hasFixedOrigin;
+	POINT dcOrigin;
+} dcTransform_t;
+
+/**
+ * Caches the transforms of device contexts, so that points drawn to a DC can usually be converted with arithmetic instead of several GDI calls each time.
+ * The hooks of functions which change a DC's mapping, or which hand a DC back to the system for reuse, remove its transform.
+ */
+class dcTransformCache_t: public LockableObject {
+	private:
+	map<HDC,dcTransform_t> transforms;
+
+	public:
+
+/**
+ * Fetches the transform for a DC, querying and caching it if it is not already cached.
+ * @param hdc the device context.
+ */
+	dcTransform_t get(HDC hdc) {
+		this->acquire();
+		map<HDC,dcTransform_t>::iterator i=this->transforms.find(hdc);
+		if(i!=this->transforms.end()) {
+			dcTransform_t transform=i->second;
+			this->release();
+			return transform;
+		}
+		dcTransform_t transform={false,{0,0},false,{0,0}};
+		XFORM xform={1,0,0,1,0,0};
+		if(GetMapMode(hdc)==MM_TEXT&&GetLayout(hdc)==0&&(GetGraphicsMode(hdc)!=GM_ADVANCED||GetWorldTransform(hdc,&xform))
+			&&xform.eM11==1&&xform.eM12==0&&xform.eM21==0&&xform.eM22==1&&xform.eDx==floor(xform.eDx)&&xform.eDy==floor(xform.eDy)
+		) {
+			POINT windowOrg, viewportOrg;
+			if(GetWindowOrgEx(hdc,&windowOrg)&&GetViewportOrgEx(hdc,&viewportOrg)) {
+				transform.isTranslation=true;
+				transform.offset.x=static_cast<LONG>(xform.eDx)-windowOrg.x+viewportOrg.x;
+				transform.offset.y=static_cast<LONG>(xform.eDy)-windowOrg.y+viewportOrg.y;
+			}
+		}
+		if(WindowFromDC(hdc)==NULL&&GetDCOrgEx(hdc,&transform.dcOrigin)) {
+			transform.hasFixedOrigin=true;
+		}
+		if(this->transforms.size()>=MAX_CACHED_DC_TRANSFORMS) {
+			this->transforms.clear();
+		}
+		this->transforms.insert(make_pair(hdc,transform));
+		this->release();
+		return transform;
+	}
+
+/**
+ * Removes the cached transform for a DC, if there is one.
+ * @param hdc the device context.
+ */
+	void invalidate(HDC hdc) {
+		this->acquire();
+		this->transforms.erase(hdc);
+		this->release();
+	}
+
+/**
+ * Removes all cached transforms.
+ */
+	void clear() {
+		this->acquire();
+		this->transforms.clear();
+		this->release();
+	}
+
+};
+
+dcTransformCache_t dcTransformCache;
+
 /**
  * converts given points from dc coordinates to screen coordinates. 
  * @param hdc a handle to a device context
@@ -151,6 +241,18 @@ inline displayModel_t* acquireDisplayModel(HDC hdc, BOOL noCreate=FALSE) {
  * @param count the number of points you want to convert.
  */
 void dcPointsToScreenPoints(HDC hdc, POINT* points, int count,bool relative) {
+	dcTransform_t transform=dcTransformCache.get(hdc);
+	if(transform.isTranslation) {
+		//A translation does not change relative points at all.
+		if(relative) return;
+		POINT dcOrgPoint=transform.dcOrigin;
+		if(!transform.hasFixedOrigin) GetDCOrgEx(hdc,&dcOrgPoint);
+		for(int i=0;i<count;++i) {
+			points[i].x+=transform.offset.x+dcOrgPoint.x;
+			points[i].y+=transform.offset.y+dcOrgPoint.y;
+		}
+		return;
+	}
 	//Convert to logical points to device points 
 	//Includes origins and scaling for window and viewport, and also world transformation 
 	LPtoDP(hdc,points,count);
@@ -538,6 +640,7 @@ template<typename charType> class hookClass_TextOut {
 template<typename charType> typename hookClass_TextOut<charType>::funcType hookClass_TextOut<charType>::realFunction=NULL;
 
 template<typename charType> int  WINAPI hookClass_TextOut<charType>::fakeFunction(HDC hdc, int x, int y, const charType* lpString, int cbCount) {
+	apiHook_callGuard_t callGuard;
 	UINT textAlign=GetTextAlign(hdc);
 	POINT pos={x,y};
 	if(textAlign&TA_UPDATECP) GetCurrentPositionEx(hdc,&pos);
@@ -571,6 +674,7 @@ template<typename WA_POLYTEXT> class hookClass_PolyTextOut {
 template<typename WA_POLYTEXT> typename hookClass_PolyTextOut<WA_POLYTEXT>::funcType hookClass_PolyTextOut<WA_POLYTEXT>::realFunction=NULL;
 
 template<typename WA_POLYTEXT> BOOL WINAPI hookClass_PolyTextOut<WA_POLYTEXT>::fakeFunction(HDC hdc,const WA_POLYTEXT* pptxt,int cStrings) {
+	apiHook_callGuard_t callGuard;
 	//Collect text alignment and possibly current position
 	UINT textAlign=GetTextAlign(hdc);
 	POINT curPos;
@@ -616,6 +720,7 @@ template<typename WA_POLYTEXT> BOOL WINAPI hookClass_PolyTextOut<WA_POLYTEXT>::f
 typedef int(WINAPI *FillRect_funcType)(HDC,const RECT*,HBRUSH);
 FillRect_funcType real_FillRect=NULL;
 int WINAPI fake_FillRect(HDC hdc, const RECT* lprc, HBRUSH hBrush) {
+	apiHook_callGuard_t callGuard;
 	//Call the real FillRectangle
 	int res=real_FillRect(hdc,lprc,hBrush);
 	//IfThe fill was successull we can go on.
@@ -634,6 +739,7 @@ int WINAPI fake_FillRect(HDC hdc, const RECT* lprc, HBRUSH hBrush) {
 typedef BOOL(WINAPI *DrawFocusRect_funcType)(HDC,const RECT*);
 DrawFocusRect_funcType real_DrawFocusRect=NULL;
 BOOL WINAPI fake_DrawFocusRect(HDC hdc, const RECT* lprc) {
+	apiHook_callGuard_t callGuard;
 	//Call the real DrawFocusRect
 	BOOL res=real_DrawFocusRect(hdc,lprc);
 	//If the draw was successfull we can go on.
@@ -676,6 +782,7 @@ BOOL WINAPI fake_DrawFocusRect(HDC hdc, const RECT* lprc) {
 typedef BOOL(WINAPI *PatBlt_funcType)(HDC,int,int,int,int,DWORD);
 PatBlt_funcType real_PatBlt=NULL;
 BOOL WINAPI fake_PatBlt(HDC hdc, int nxLeft, int nxTop, int nWidth, int nHeight, DWORD dwRop) {
+	apiHook_callGuard_t callGuard;
 	//Call the real PatBlt
 	BOOL res=real_PatBlt(hdc,nxLeft,nxTop,nWidth,nHeight,dwRop);
 	//IfPatBlt was successfull we can go on
@@ -694,10 +801,13 @@ BOOL WINAPI fake_PatBlt(HDC hdc, int nxLeft, int nxTop, int nWidth, int nHeight,
 typedef HDC(WINAPI *BeginPaint_funcType)(HWND,LPPAINTSTRUCT);
 BeginPaint_funcType real_BeginPaint=NULL;
 HDC WINAPI fake_BeginPaint(HWND hwnd, LPPAINTSTRUCT lpPaint) {
+	apiHook_callGuard_t callGuard;
 	//Call the real BeginPaint
 	HDC res=real_BeginPaint(hwnd,lpPaint);
 	//If beginPaint was successfull we can go on
 	if(res==0||!hwnd) return res;
+	//The DC may have been used for a different window before, with a different mapping.
+	dcTransformCache.invalidate(res);
 	//Try and get a displayModel for this DC, and if we can, then record the original text for these glyphs
 	displayModel_t* model=acquireDisplayModel(lpPaint->hdc,TRUE);
 	if(!model) return res;
@@ -709,6 +819,58 @@ HDC WINAPI fake_BeginPaint(HWND hwnd, LPPAINTSTRUCT lpPaint) {
 	return res;
 }
 
+//EndPaint hook function
+//Hooked so that the cached transform for the DC is removed when the DC is given back for reuse.
+typedef BOOL(WINAPI *EndPaint_funcType)(HWND,const PAINTSTRUCT*);
+EndPaint_funcType real_EndPaint=NULL;
+BOOL WINAPI fake_EndPaint(HWND hwnd, const PAINTSTRUCT* lpPaint) {
+	apiHook_callGuard_t callGuard;
+	if(lpPaint) dcTransformCache.invalidate(lpPaint->hdc);
+	return real_EndPaint(hwnd,lpPaint);
+}
+
+//ReleaseDC hook function
+//Hooked so that the cached transform for the DC is removed when the DC is given back for reuse.
+typedef int(WINAPI *ReleaseDC_funcType)(HWND,HDC);
+ReleaseDC_funcType real_ReleaseDC=NULL;
+int WINAPI fake_ReleaseDC(HWND hwnd, HDC hdc) {
+	apiHook_callGuard_t callGuard;
+	dcTransformCache.invalidate(hdc);
+	return real_ReleaseDC(hwnd,hdc);
+}
+
+//Hook class template for functions which change how a DC maps logical points to device points.
+//The DC is always the first argument, and its cached transform is removed once the real function has been called.
+//id only distinguishes hooked functions which have the same type.
+template<int id, typename resType, typename... argTypes> class hookClass_changeDCTransform {
+	public:
+	typedef resType(WINAPI *funcType)(HDC,argTypes...);
+	static funcType realFunction;
+	static resType WINAPI fakeFunction(HDC hdc, argTypes... args) {
+		apiHook_callGuard_t callGuard;
+		resType res=realFunction(hdc,args...);
+		dcTransformCache.invalidate(hdc);
+		return res;
+	}
+};
+
+template<int id, typename resType, typename... argTypes> typename hookClass_changeDCTransform<id,resType,argTypes...>::funcType hookClass_changeDCTransform<id,resType,argTypes...>::realFunction=NULL;
+
+typedef hookClass_changeDCTransform<1,int,int> hookClass_SetMapMode;
+typedef hookClass_changeDCTransform<2,int,int> hookClass_SetGraphicsMode;
+typedef hookClass_changeDCTransform<3,BOOL,int> hookClass_RestoreDC;
+typedef hookClass_changeDCTransform<4,DWORD,DWORD> hookClass_SetLayout;
+typedef hookClass_changeDCTransform<5,BOOL,const XFORM*> hookClass_SetWorldTransform;
+typedef hookClass_changeDCTransform<6,BOOL,const XFORM*,DWORD> hookClass_ModifyWorldTransform;
+typedef hookClass_changeDCTransform<7,BOOL,int,int,LPPOINT> hookClass_SetWindowOrgEx;
+typedef hookClass_changeDCTransform<8,BOOL,int,int,LPPOINT> hookClass_OffsetWindowOrgEx;
+typedef hookClass_changeDCTransform<9,BOOL,int,int,LPPOINT> hookClass_SetViewportOrgEx;
+typedef hookClass_changeDCTransform<10,BOOL,int,int,LPPOINT> hookClass_OffsetViewportOrgEx;
+typedef hookClass_changeDCTransform<11,BOOL,int,int,LPSIZE> hookClass_SetWindowExtEx;
+typedef hookClass_changeDCTransform<12,BOOL,int,int,LPSIZE> hookClass_SetViewportExtEx;
+typedef hookClass_changeDCTransform<13,BOOL,int,int,int,int,LPSIZE> hookClass_ScaleWindowExtEx;
+typedef hookClass_changeDCTransform<14,BOOL,int,int,int,int,LPSIZE> hookClass_ScaleViewportExtEx;
+
 //ExtTextOut hook class template
 //Handles char or wchar_t
 template<typename charType> class hookClass_ExtTextOut {
@@ -721,6 +883,7 @@ template<typename charType> class hookClass_ExtTextOut {
 template<typename charType> typename hookClass_ExtTextOut<charType>::funcType hookClass_ExtTextOut<charType>::realFunction=NULL;
 
 template<typename charType> BOOL __stdcall hookClass_ExtTextOut<charType>::fakeFunction(HDC hdc, int x, int y, UINT fuOptions, const RECT* lprc, const charType* lpString, UINT cbCount, const INT* lpDx) {
+	apiHook_callGuard_t callGuard;
 	UINT textAlign=GetTextAlign(hdc);
 	POINT pos={x,y};
 	if(textAlign&TA_UPDATECP) GetCurrentPositionEx(hdc,&pos);
@@ -755,6 +918,7 @@ template<typename charType> BOOL __stdcall hookClass_ExtTextOut<charType>::fakeF
 typedef HDC(WINAPI *CreateCompatibleDC_funcType)(HDC);
 CreateCompatibleDC_funcType real_CreateCompatibleDC=NULL;
 HDC WINAPI fake_CreateCompatibleDC(HDC hdc) {
+	apiHook_callGuard_t callGuard;
 	//Call the real CreateCompatibleDC
 	HDC newHdc=real_CreateCompatibleDC(hdc);
 	//If the creation was successful, and the DC that was used in the creation process is a window DC, 
@@ -770,13 +934,16 @@ HDC WINAPI fake_CreateCompatibleDC(HDC hdc) {
 
 //SelectObject hook function
 //If a bitmap is being selected, then  we fully clear the display model for this DC if it exists.
+//The size of the bitmap is used when mirroring, so the cached transform for the DC is also removed.
 typedef HGDIOBJ(WINAPI *SelectObject_funcType)(HDC,HGDIOBJ);
 SelectObject_funcType real_SelectObject=NULL;
 HGDIOBJ WINAPI fake_SelectObject(HDC hdc, HGDIOBJ hGdiObj) {
+	apiHook_callGuard_t callGuard;
 	//Call the real SelectObject
 	HGDIOBJ res=real_SelectObject(hdc,hGdiObj);
 	//If The select was successfull, and the object is a bitmap,  we can go on.
 	if(res==0||hGdiObj==NULL||GetObjectType(hGdiObj)!=OBJ_BITMAP) return res;
+	dcTransformCache.invalidate(hdc);
 	//Try and get a displayModel for this DC
 	displayModel_t* model=acquireDisplayModel(hdc,TRUE);
 	if(!model) return res;
@@ -790,9 +957,11 @@ HGDIOBJ WINAPI fake_SelectObject(HDC hdc, HGDIOBJ hGdiObj) {
 typedef BOOL(WINAPI *DeleteDC_funcType)(HDC);
 DeleteDC_funcType real_DeleteDC=NULL;
 BOOL WINAPI fake_DeleteDC(HDC hdc) {
+	apiHook_callGuard_t callGuard;
 	//Call the real DeleteDC
 	BOOL res=real_DeleteDC(hdc);
 	if(res==0) return res;
+	dcTransformCache.invalidate(hdc);
 	//If the DC was successfully deleted, we should remove  the displayModel we have for it, if it exists.
 	displayModelsByMemoryDC.acquire();
 	displayModelsMap_t<HDC>::iterator i=displayModelsByMemoryDC.find(hdc);
@@ -858,6 +1027,7 @@ void StretchBlt_helper(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int
 typedef BOOL(WINAPI *BitBlt_funcType)(HDC,int,int,int,int,HDC,int,int,DWORD);
 BitBlt_funcType real_BitBlt=NULL;
 BOOL WINAPI fake_BitBlt(HDC hdcDest, int nXDest, int nYDest, int nWidth, int nHeight, HDC hdcSrc, int nXSrc, int nYSrc, DWORD dwRop) {
+	apiHook_callGuard_t callGuard;
 	//Call the real BitBlt
 	BOOL res=real_BitBlt(hdcDest,nXDest,nYDest,nWidth,nHeight,hdcSrc,nXSrc,nYSrc,dwRop);
 	//If bit blit didn't work, or its not a simple copy, we don't want to know about it
@@ -870,6 +1040,7 @@ BOOL WINAPI fake_BitBlt(HDC hdcDest, int nXDest, int nYDest, int nWidth, int nHe
 typedef BOOL(WINAPI *StretchBlt_funcType)(HDC,int,int,int,int,HDC,int,int,int,int,DWORD);
 StretchBlt_funcType real_StretchBlt=NULL;
 BOOL WINAPI fake_StretchBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int nHeightDest, HDC hdcSrc, int nXSrc, int nYSrc, int nWidthSrc, int nHeightSrc, DWORD dwRop) {
+	apiHook_callGuard_t callGuard;
 	//Call the real StretchBlt
 	BOOL res=real_StretchBlt(hdcDest,nXDest,nYDest,nWidthDest,nHeightDest,hdcSrc,nXSrc,nYSrc,nWidthSrc,nHeightSrc,dwRop);
 	if(!res) return res;
@@ -888,6 +1059,7 @@ BOOL WINAPI fake_StretchBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest,
 typedef BOOL(WINAPI *GdiTransparentBlt_funcType)(HDC,int,int,int,int,HDC,int,int,int,int,UINT);
 GdiTransparentBlt_funcType real_GdiTransparentBlt=NULL;
 BOOL WINAPI fake_GdiTransparentBlt(HDC hdcDest, int nXDest, int nYDest, int nWidthDest, int nHeightDest, HDC hdcSrc, int nXSrc, int nYSrc, int nWidthSrc, int nHeightSrc, UINT crTransparent) {
+	apiHook_callGuard_t callGuard;
 	//Call the real StretchBlt
 	BOOL res=real_GdiTransparentBlt(hdcDest,nXDest,nYDest,nWidthDest,nHeightDest,hdcSrc,nXSrc,nYSrc,nWidthSrc,nHeightSrc,crTransparent);
 	if(!res) return res;
@@ -954,6 +1126,7 @@ BOOL allow_ScriptStringAnalyseArgsByAnalysis=FALSE;
 typedef HRESULT(WINAPI *ScriptStringAnalyse_funcType)(HDC,const void*,int,int,int,DWORD,int,SCRIPT_CONTROL*,SCRIPT_STATE*,const int*,SCRIPT_TABDEF*,const BYTE*,SCRIPT_STRING_ANALYSIS*);
 ScriptStringAnalyse_funcType real_ScriptStringAnalyse=NULL;
 HRESULT WINAPI fake_ScriptStringAnalyse(HDC hdc,const void* pString, int cString, int cGlyphs, int iCharset, DWORD dwFlags, int iRectWidth, SCRIPT_CONTROL* psControl, SCRIPT_STATE* psState, const int* piDx, SCRIPT_TABDEF* pTabdef, const BYTE* pbInClass, SCRIPT_STRING_ANALYSIS* pssa) {
+	apiHook_callGuard_t callGuard;
 	//Call the real ScriptStringAnalyse
 	HRESULT res=real_ScriptStringAnalyse(hdc,pString,cString,cGlyphs,iCharset,dwFlags,iRectWidth,psControl,psState,piDx,pTabdef,pbInClass,pssa);
 	//We only want to go on if  there's safe arguments
@@ -976,6 +1149,7 @@ HRESULT WINAPI fake_ScriptStringAnalyse(HDC hdc,const void* pString, int cString
 typedef HRESULT(WINAPI *ScriptStringFree_funcType)(SCRIPT_STRING_ANALYSIS*);
 ScriptStringFree_funcType real_ScriptStringFree=NULL;
 HRESULT WINAPI fake_ScriptStringFree(SCRIPT_STRING_ANALYSIS* pssa) {
+	apiHook_callGuard_t callGuard;
 	//Call the real ScriptStringFree
 	HRESULT res=real_ScriptStringFree(pssa);
 	//If it worked, and arguments seem sane, we go on.
@@ -997,6 +1171,7 @@ HRESULT WINAPI fake_ScriptStringFree(SCRIPT_STRING_ANALYSIS* pssa) {
 typedef HRESULT(WINAPI *ScriptStringOut_funcType)(SCRIPT_STRING_ANALYSIS,int,int,UINT,const RECT*,int,int,BOOL);
 ScriptStringOut_funcType real_ScriptStringOut=NULL;
 HRESULT WINAPI fake_ScriptStringOut(SCRIPT_STRING_ANALYSIS ssa,int iX,int iY,UINT uOptions,const RECT *prc,int iMinSel,int iMaxSel,BOOL fDisabled) {
+	apiHook_callGuard_t callGuard;
 	//Call the real ScriptStringOut
 	HRESULT res;
 	{
@@ -1043,6 +1218,7 @@ HRESULT WINAPI fake_ScriptStringOut(SCRIPT_STRING_ANALYSIS ssa,int iX,int iY,UIN
 typedef HRESULT(WINAPI *ScriptTextOut_funcType)(const HDC,SCRIPT_CACHE*,int,int,UINT,const RECT*,const SCRIPT_ANALYSIS*,const WCHAR*,int,const WORD*,int,const int*,const int*,const GOFFSET*);
 ScriptTextOut_funcType real_ScriptTextOut=NULL;
 HRESULT WINAPI fake_ScriptTextOut(const HDC hdc, SCRIPT_CACHE* psc, int x, int y, UINT fuOptions, const RECT* lprc, const SCRIPT_ANALYSIS* psa, const WCHAR* pwcReserved, int iReserved, const WORD* pwGlyphs, int cGlyphs, const int* piAdvanced, const int* piJustify, const GOFFSET* pGoffset) {
+	apiHook_callGuard_t callGuard;
 	TlsSetValue(tls_index_curScriptTextOutScriptAnalysis,(LPVOID)psa);
 	HRESULT res=real_ScriptTextOut(hdc, psc, x, y, fuOptions, lprc, psa, pwcReserved, iReserved, pwGlyphs, cGlyphs, piAdvanced, piJustify, pGoffset);
 	TlsSetValue(tls_index_curScriptTextOutScriptAnalysis,NULL);
@@ -1053,6 +1229,7 @@ HRESULT WINAPI fake_ScriptTextOut(const HDC hdc, SCRIPT_CACHE* psc, int x, int y
 typedef BOOL(WINAPI *ScrollWindow_funcType)(HWND,int,int,const RECT*, const RECT*);
 ScrollWindow_funcType real_ScrollWindow=NULL;
 BOOL WINAPI fake_ScrollWindow(HWND hwnd, int XAmount, int YAmount, const RECT* lpRect, const RECT* lpClipRect) {
+	apiHook_callGuard_t callGuard;
 	BOOL res=real_ScrollWindow(hwnd,XAmount,YAmount,lpRect,lpClipRect);
 	if(!res) return res;
 	displayModel_t* model=NULL;
@@ -1082,6 +1259,7 @@ BOOL WINAPI fake_ScrollWindow(HWND hwnd, int XAmount, int YAmount, const RECT* l
 typedef BOOL(WINAPI *ScrollWindowEx_funcType)(HWND,int,int,const RECT*, const RECT*, HRGN, LPRECT,UINT);
 ScrollWindowEx_funcType real_ScrollWindowEx=NULL;
 BOOL WINAPI fake_ScrollWindowEx(HWND hwnd, int dx, int dy, const RECT* prcScroll, const RECT* prcClip, HRGN hrgnUpdate, LPRECT prcUpdate, UINT flags) {
+	apiHook_callGuard_t callGuard;
 	BOOL res=real_ScrollWindowEx(hwnd,dx,dy,prcScroll,prcClip,hrgnUpdate,prcUpdate,flags);
 	if(!res) return res;
 	displayModel_t* model=NULL;
@@ -1112,9 +1290,12 @@ BOOL WINAPI fake_ScrollWindowEx(HWND hwnd, int dx, int dy, const RECT* prcScroll
 typedef BOOL(WINAPI *DestroyWindow_funcType)(HWND);
 DestroyWindow_funcType real_DestroyWindow=NULL;
 BOOL WINAPI fake_DestroyWindow(HWND hwnd) {
+	apiHook_callGuard_t callGuard;
 	//Call the real DestroyWindow
 	BOOL res=real_DestroyWindow(hwnd);
 	if(res==0) return res;
+	//A class or private DC of the window may have been destroyed with it, and its handle could be reused for a new DC.
+	dcTransformCache.clear();
 	//If successful, acquire access to the display model maps and remove the displayModel for this window if it exists.
 	displayModelsByWindow.acquire();
 	displayModelsMap_t<HWND>::iterator i=displayModelsByWindow.find(hwnd);
@@ -1126,6 +1307,30 @@ BOOL WINAPI fake_DestroyWindow(HWND hwnd) {
 	return res;
 }
 
+LRESULT CALLBACK gdiHooks_callWndProcHook(int code, WPARAM wParam, LPARAM lParam) {
+	CWPSTRUCT* pcwp=(CWPSTRUCT*)lParam;
+	if(pcwp->message==wm_gdiHooks_repaintWindow) {
+		//On the window's own thread, so the paint happens before the sender is released.
+		RedrawWindow(pcwp->hwnd,NULL,NULL,RDW_INVALIDATE|RDW_ERASE|RDW_FRAME|RDW_ALLCHILDREN|RDW_UPDATENOW);
+	}
+	return 0;
+}
+
+bool gdiHooks_repaintWindow(HWND hwnd) {
+	if(GetWindowThreadProcessId(hwnd,NULL)==GetCurrentThreadId()) {
+		return RedrawWindow(hwnd,NULL,NULL,RDW_INVALIDATE|RDW_ERASE|RDW_FRAME|RDW_ALLCHILDREN|RDW_UPDATENOW)!=FALSE;
+	}
+	//RDW_UPDATENOW only paints straight away on the window's own thread, so have that thread do the redraw.
+	DWORD_PTR res=0;
+	if(!SendMessageTimeout(hwnd,wm_gdiHooks_repaintWindow,0,0,SMTO_ABORTIFHUNG|SMTO_BLOCK,REPAINT_TIMEOUT,&res)) {
+		LOG_DEBUGWARNING(L"Window "<<hwnd<<L" did not repaint in time, GetLastError returned "<<GetLastError());
+		//At least make sure it paints when it next gets the chance.
+		RedrawWindow(hwnd,NULL,NULL,RDW_INVALIDATE|RDW_ERASE|RDW_FRAME|RDW_ALLCHILDREN);
+		return false;
+	}
+	return true;
+}
+
 void gdiHooks_inProcess_initialize() {
 	tls_index_textInsertionsCount=TlsAlloc();
 	tls_index_curScriptTextOutScriptAnalysis=TlsAlloc();
@@ -1136,36 +1341,59 @@ void gdiHooks_inProcess_initialize() {
 	InitializeCriticalSection(&criticalSection_ScriptStringAnalyseArgsByAnalysis);
 	allow_ScriptStringAnalyseArgsByAnalysis=TRUE;
 	//Hook needed functions
-	hookClass_TextOut<char>::realFunction=apiHook_hookFunction_safe("GDI32.dll",TextOutA,hookClass_TextOut<char>::fakeFunction);
-	hookClass_TextOut<wchar_t>::realFunction=apiHook_hookFunction_safe("GDI32.dll",TextOutW,hookClass_TextOut<wchar_t>::fakeFunction);
-	hookClass_PolyTextOut<POLYTEXTA>::realFunction=apiHook_hookFunction_safe("GDI32.dll",PolyTextOutA,hookClass_PolyTextOut<POLYTEXTA>::fakeFunction);
-	hookClass_PolyTextOut<POLYTEXTW>::realFunction=apiHook_hookFunction_safe("GDI32.dll",PolyTextOutW,hookClass_PolyTextOut<POLYTEXTW>::fakeFunction);
-	hookClass_ExtTextOut<char>::realFunction=apiHook_hookFunction_safe("GDI32.dll",ExtTextOutA,hookClass_ExtTextOut<char>::fakeFunction);
-	hookClass_ExtTextOut<wchar_t>::realFunction=apiHook_hookFunction_safe("GDI32.dll",ExtTextOutW,hookClass_ExtTextOut<wchar_t>::fakeFunction);
-	real_CreateCompatibleDC=apiHook_hookFunction_safe("GDI32.dll",CreateCompatibleDC,fake_CreateCompatibleDC);
-	real_SelectObject=apiHook_hookFunction_safe("GDI32.dll",SelectObject,fake_SelectObject);
-	real_DeleteDC=apiHook_hookFunction_safe("GDI32.dll",DeleteDC,fake_DeleteDC);
-	real_FillRect=apiHook_hookFunction_safe("USER32.dll",FillRect,fake_FillRect);
-	real_DrawFocusRect=apiHook_hookFunction_safe("USER32.dll",DrawFocusRect,fake_DrawFocusRect);
-	real_BeginPaint=apiHook_hookFunction_safe("USER32.dll",BeginPaint,fake_BeginPaint);
-	real_BitBlt=apiHook_hookFunction_safe("GDI32.dll",BitBlt,fake_BitBlt);
-	real_StretchBlt=apiHook_hookFunction_safe("GDI32.dll",StretchBlt,fake_StretchBlt);
-	real_GdiTransparentBlt=apiHook_hookFunction_safe("GDI32.dll",GdiTransparentBlt,fake_GdiTransparentBlt);
-	real_PatBlt=apiHook_hookFunction_safe("GDI32.dll",PatBlt,fake_PatBlt);
-	real_ScrollWindow=apiHook_hookFunction_safe("USER32.dll",ScrollWindow,fake_ScrollWindow);
-	real_ScrollWindowEx=apiHook_hookFunction_safe("USER32.dll",ScrollWindowEx,fake_ScrollWindowEx);
-	real_DestroyWindow=apiHook_hookFunction_safe("USER32.dll",DestroyWindow,fake_DestroyWindow);
-	real_ScriptStringAnalyse=apiHook_hookFunction_safe("USP10.dll",ScriptStringAnalyse,fake_ScriptStringAnalyse);
-	real_ScriptStringFree=apiHook_hookFunction_safe("USP10.dll",ScriptStringFree,fake_ScriptStringFree);
-	real_ScriptStringOut=apiHook_hookFunction_safe("USP10.dll",ScriptStringOut,fake_ScriptStringOut);
-	real_ScriptTextOut=apiHook_hookFunction_safe("USP10.dll",ScriptTextOut,fake_ScriptTextOut);
+	apiHook_hookTableEntry_t hookTable[]={
+		apiHook_hookTableEntry_safe("GDI32.dll",TextOutA,hookClass_TextOut<char>::fakeFunction,&hookClass_TextOut<char>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",TextOutW,hookClass_TextOut<wchar_t>::fakeFunction,&hookClass_TextOut<wchar_t>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",PolyTextOutA,hookClass_PolyTextOut<POLYTEXTA>::fakeFunction,&hookClass_PolyTextOut<POLYTEXTA>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",PolyTextOutW,hookClass_PolyTextOut<POLYTEXTW>::fakeFunction,&hookClass_PolyTextOut<POLYTEXTW>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",ExtTextOutA,hookClass_ExtTextOut<char>::fakeFunction,&hookClass_ExtTextOut<char>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",ExtTextOutW,hookClass_ExtTextOut<wchar_t>::fakeFunction,&hookClass_ExtTextOut<wchar_t>::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",CreateCompatibleDC,fake_CreateCompatibleDC,&real_CreateCompatibleDC),
+		apiHook_hookTableEntry_safe("GDI32.dll",SelectObject,fake_SelectObject,&real_SelectObject),
+		apiHook_hookTableEntry_safe("GDI32.dll",DeleteDC,fake_DeleteDC,&real_DeleteDC),
+		apiHook_hookTableEntry_safe("USER32.dll",FillRect,fake_FillRect,&real_FillRect),
+		apiHook_hookTableEntry_safe("USER32.dll",DrawFocusRect,fake_DrawFocusRect,&real_DrawFocusRect),
+		apiHook_hookTableEntry_safe("USER32.dll",BeginPaint,fake_BeginPaint,&real_BeginPaint),
+		apiHook_hookTableEntry_safe("USER32.dll",EndPaint,fake_EndPaint,&real_EndPaint),
+		apiHook_hookTableEntry_safe("USER32.dll",ReleaseDC,fake_ReleaseDC,&real_ReleaseDC),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetMapMode,hookClass_SetMapMode::fakeFunction,&hookClass_SetMapMode::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetGraphicsMode,hookClass_SetGraphicsMode::fakeFunction,&hookClass_SetGraphicsMode::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",RestoreDC,hookClass_RestoreDC::fakeFunction,&hookClass_RestoreDC::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetLayout,hookClass_SetLayout::fakeFunction,&hookClass_SetLayout::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetWorldTransform,hookClass_SetWorldTransform::fakeFunction,&hookClass_SetWorldTransform::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",ModifyWorldTransform,hookClass_ModifyWorldTransform::fakeFunction,&hookClass_ModifyWorldTransform::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetWindowOrgEx,hookClass_SetWindowOrgEx::fakeFunction,&hookClass_SetWindowOrgEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",OffsetWindowOrgEx,hookClass_OffsetWindowOrgEx::fakeFunction,&hookClass_OffsetWindowOrgEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetViewportOrgEx,hookClass_SetViewportOrgEx::fakeFunction,&hookClass_SetViewportOrgEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",OffsetViewportOrgEx,hookClass_OffsetViewportOrgEx::fakeFunction,&hookClass_OffsetViewportOrgEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetWindowExtEx,hookClass_SetWindowExtEx::fakeFunction,&hookClass_SetWindowExtEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",SetViewportExtEx,hookClass_SetViewportExtEx::fakeFunction,&hookClass_SetViewportExtEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",ScaleWindowExtEx,hookClass_ScaleWindowExtEx::fakeFunction,&hookClass_ScaleWindowExtEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",ScaleViewportExtEx,hookClass_ScaleViewportExtEx::fakeFunction,&hookClass_ScaleViewportExtEx::realFunction),
+		apiHook_hookTableEntry_safe("GDI32.dll",BitBlt,fake_BitBlt,&real_BitBlt),
+		apiHook_hookTableEntry_safe("GDI32.dll",StretchBlt,fake_StretchBlt,&real_StretchBlt),
+		apiHook_hookTableEntry_safe("GDI32.dll",GdiTransparentBlt,fake_GdiTransparentBlt,&real_GdiTransparentBlt),
+		apiHook_hookTableEntry_safe("GDI32.dll",PatBlt,fake_PatBlt,&real_PatBlt),
+		apiHook_hookTableEntry_safe("USER32.dll",ScrollWindow,fake_ScrollWindow,&real_ScrollWindow),
+		apiHook_hookTableEntry_safe("USER32.dll",ScrollWindowEx,fake_ScrollWindowEx,&real_ScrollWindowEx),
+		apiHook_hookTableEntry_safe("USER32.dll",DestroyWindow,fake_DestroyWindow,&real_DestroyWindow),
+		apiHook_hookTableEntry_safe("USP10.dll",ScriptStringAnalyse,fake_ScriptStringAnalyse,&real_ScriptStringAnalyse),
+		apiHook_hookTableEntry_safe("USP10.dll",ScriptStringFree,fake_ScriptStringFree,&real_ScriptStringFree),
+		apiHook_hookTableEntry_safe("USP10.dll",ScriptStringOut,fake_ScriptStringOut,&real_ScriptStringOut),
+		apiHook_hookTableEntry_safe("USP10.dll",ScriptTextOut,fake_ScriptTextOut,&real_ScriptTextOut)
+	};
+	apiHook_hookFunctions(hookTable,ARRAYSIZE(hookTable));
+	wm_gdiHooks_repaintWindow=RegisterWindowMessage(L"wm_gdiHooks_repaintWindow");
+	registerWindowsHook(WH_CALLWNDPROC,gdiHooks_callWndProcHook);
 }
 
 void gdiHooks_inProcess_terminate() {
+	unregisterWindowsHook(WH_CALLWNDPROC,gdiHooks_callWndProcHook);
 	//Kill the text change notification timer
 	KillTimer(0,textChangeNotifyTimerID);
 	//Cleanup glyph mapping.
 	glyphTranslatorCache.cleanup();
+	dcTransformCache.clear();
 	//Acquire access to the maps and clean them up
 	displayModelsByWindow.acquire();
 	displayModelsMap_t<HWND>::iterator i=displayModelsByWindow.begin();
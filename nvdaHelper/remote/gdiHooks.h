@@ -32,6 +32,13 @@ extern displayModelsMap_t<HWND> displayModelsByWindow;
 void gdiHooks_inProcess_initialize();
 void gdiHooks_inProcess_terminate();
 
+/**
+ * Repaints a window and its descendants so that their display models are filled in, waiting (with a timeout) for the paint to finish.
+ * @param hwnd the window to repaint.
+ * @return true if the window has repainted, false if it did not respond in time and will only repaint later.
+ */
+bool gdiHooks_repaintWindow(HWND hwnd);
+
 //These structures were taken from http://www.microsoft.com/typography/OTSPEC/cmap.htm
 //All TTF structures must be byte-aligned.
 #pragma pack(push,1)
@@ -12,8 +12,10 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#include <vector>
 #include <windows.h>
 #include <wchar.h>
+#include <common/lock.h>
 #include "nvdaHelperRemote.h"
 #include "nvdaControllerInternal.h"
 #include "typedCharacter.h"
@@ -155,6 +157,75 @@ bool getTIPFilename(REFCLSID clsid, WCHAR* filename, DWORD len) {
 
 typedef UINT (WINAPI* GetReadingString_funcType)(HIMC, UINT, LPWSTR, PINT, BOOL*, PUINT);
 
+/**
+ * How to fetch the reading string for one IME or TIP.
+ * Finding this means reading the registry or version resources and loading the IME's module,
+ * so it is done once per keyboard layout or TIP rather than on every reading string update.
+ */
+typedef struct {
+	// The TIP this is for, or the keyboard layout if isTIP is false.
+	bool isTIP;
+	CLSID clsid;
+	HKL kbdLayout;
+	// The loaded IME module, kept loaded while its GetReadingString function may be used.
+	HMODULE IMEFile;
+	GetReadingString_funcType GetReadingString;
+	// The IME version, used to find the reading string in the IME's private data if it has no GetReadingString function.
+	DWORD version;
+} readingStringSource_t;
+
+static std::vector<readingStringSource_t> readingStringSources;
+static LockableObject readingStringSourcesLock;
+
+/**
+ * Finds how to fetch the reading string for the current IME or TIP, looking it up the first time it is needed.
+ * readingStringSourcesLock must be held, and the result is only valid until it is released.
+ */
+static const readingStringSource_t& getReadingStringSource() {
+	bool isTIP=isTSFThread(true);
+	HKL kbd_layout = GetKeyboardLayout(0);
+	for(auto& source: readingStringSources) {
+		if(source.isTIP==isTIP&&(isTIP?IsEqualCLSID(source.clsid,curTSFClsID):source.kbdLayout==kbd_layout)) {
+			return source;
+		}
+	}
+	readingStringSource_t source={isTIP,curTSFClsID,kbd_layout,NULL,NULL,0};
+	WCHAR filename[MAX_PATH + 1];
+	if (isTIP) {
+		// Look up filename of active TIP
+		if(getTIPFilename(curTSFClsID, filename, MAX_PATH)) {
+			source.IMEFile=LoadLibrary(filename);
+			if(source.IMEFile) {
+				source.GetReadingString=(GetReadingString_funcType)GetProcAddress(source.IMEFile, "GetReadingString");
+			}
+		}
+	}
+	else if(ImmGetIMEFileNameW(kbd_layout, filename, MAX_PATH)>0) {
+		source.IMEFile=LoadLibrary(filename);
+		if(source.IMEFile) {
+			source.GetReadingString=(GetReadingString_funcType)GetProcAddress(source.IMEFile, "GetReadingString");
+		}
+		if(!source.GetReadingString) {
+			source.version=getIMEVersion(kbd_layout,filename);
+		}
+	}
+	LOG_DEBUG(L"Reading string source for "<<(isTIP?L"TIP":L"keyboard layout")<<L": GetReadingString "<<(source.GetReadingString?L"found":L"not found")<<L", version "<<source.version);
+	readingStringSources.push_back(source);
+	return readingStringSources.back();
+}
+
+/**
+ * Forgets all reading string sources and unloads their IME modules, E.g. because the input language has changed.
+ */
+static void clearReadingStringSources() {
+	readingStringSourcesLock.acquire();
+	for(auto& source: readingStringSources) {
+		if(source.IMEFile) FreeLibrary(source.IMEFile);
+	}
+	readingStringSources.clear();
+	readingStringSourcesLock.release();
+}
+
 void handleOpenStatus(HWND hwnd) {
 	//Only reported for japanese
 	if((HandleToUlong(GetKeyboardLayout(0))&0xff)!=0x11) return;
@@ -174,29 +245,11 @@ void handleReadingStringUpdate(HWND hwnd) {
 	HIMC imc = ImmGetContext(hwnd);
 	if (!imc)  return;
 	wchar_t* read_str=NULL;
-	HKL kbd_layout = GetKeyboardLayout(0);
-	WCHAR filename[MAX_PATH + 1];
-	DWORD version=0;
-	HMODULE IMEFile=NULL;
-	GetReadingString_funcType GetReadingString=NULL;
-	if (isTSFThread(true)) {
-		// Look up filename of active TIP
-		if(getTIPFilename(curTSFClsID, filename, MAX_PATH)) {
-			IMEFile=LoadLibrary(filename);
-			if(IMEFile) {
-				GetReadingString=(GetReadingString_funcType)GetProcAddress(IMEFile, "GetReadingString");
-			}
-		}
-	}
-	else if(ImmGetIMEFileNameW(kbd_layout, filename, MAX_PATH)>0) {
-		IMEFile=LoadLibrary(filename);
-		if(IMEFile) {
-			GetReadingString=(GetReadingString_funcType)GetProcAddress(IMEFile, "GetReadingString");
-		}
-		if(!GetReadingString) {
-			version=getIMEVersion(kbd_layout,filename);
-		}
-	}
+	// The lock is held while the reading string is fetched so that the IME module can not be unloaded meanwhile.
+	readingStringSourcesLock.acquire();
+	const readingStringSource_t& source=getReadingStringSource();
+	GetReadingString_funcType GetReadingString=source.GetReadingString;
+	DWORD version=source.version;
 	if(GetReadingString) {
 		// Use GetReadingString() API if available
 		UINT   len = 0;
@@ -254,7 +307,7 @@ void handleReadingStringUpdate(HWND hwnd) {
 		immUnlockIMCC(ctx->hPrivate);
 		immUnlockIMC(imc);
 	}
-	if(IMEFile) FreeLibrary(IMEFile);
+	readingStringSourcesLock.release();
 	ImmReleaseContext(hwnd, imc);
 	if(read_str) {
 		long len=(long)wcslen(read_str);
@@ -472,6 +525,10 @@ static LRESULT handleIMEWindowMessage(HWND hwnd, UINT message, WPARAM wParam, LP
 			}
 			break;
 
+		case WM_INPUTLANGCHANGE:
+			clearReadingStringSources();
+			break;
+
 		case WM_ACTIVATE:
 		case WM_SETFOCUS:
 			if(!hasValidIMEContext(hwnd)) return 0;
@@ -538,5 +595,6 @@ void IME_inProcess_initialize() {
 void IME_inProcess_terminate() {
 	unregisterWindowsHook(WH_CALLWNDPROC, IME_callWndProcHook);
 	unregisterWindowsHook(WH_GETMESSAGE, IME_getMessageHook);
+	clearReadingStringSources();
 	if (gImm32Module)  FreeLibrary(gImm32Module);
 }
@@ -18,6 +18,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <map>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
+#include <ia2.h>
 #include "winword.h"
 #include "inputLangChange.h"
 #include "typedCharacter.h"
@@ -26,6 +27,8 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include "IA2Support.h"
 #include "ia2LiveRegions.h"
 #include <common/log.h>
+#include <common/lock.h>
+#include "apiHook.h"
 #include "gdiHooks.h"
 #include "nvdaHelperRemote.h"
 #include "inProcess.h"
@@ -38,46 +41,251 @@ typedef map<HOOKPROC,size_t> windowsHookRegistry_t;
 winEventHookRegistry_t inProcess_registeredWinEventHooks;
 windowsHookRegistry_t inProcess_registeredCallWndProcWindowsHooks;
 windowsHookRegistry_t inProcess_registeredGetMessageWindowsHooks;
+//Subsystems now register hooks whenever they are activated, possibly on any thread, so the registries need a lock.
+LockableObject inProcess_hookRegistryLock;
 
 UINT wm_execInThread;
+UINT wm_activateSubsystem;
+
+/**
+ * How long a thread waits for another thread to finish activating a subsystem it needs.
+ */
+const DWORD SUBSYSTEM_ACTIVATION_TIMEOUT=2000;
+
+enum subsystemState_t {
+	subsystemState_inactive,
+	subsystemState_activating,
+	subsystemState_active
+};
+
+/**
+ * Everything known about one in-process subsystem.
+ * Subsystems are started on their first trigger rather than when NVDA is injected.
+ */
+struct subsystem_t {
+	const wchar_t* name;
+	void(*initialize)();
+	void(*terminate)();
+	//True if the subsystem must be initialized on the inproc manager thread, e.g. because it creates thread timers.
+	bool needsManagerThread;
+	volatile subsystemState_t state;
+	DWORD activatingThreadID;
+	//Signalled once an activation attempt completes.
+	HANDLE activatedEvent;
+	//Number of times the subsystem was requested, and how long its initialization took in microseconds.
+	long triggerCount;
+	long long initTime;
+};
+
+//gdiHooks installs API hooks which must be enabled after they are registered.
+void gdiHooks_inProcess_activate() {
+	gdiHooks_inProcess_initialize();
+	apiHook_enableHooks();
+}
+
+//Entries are in initialization order and are terminated in the reverse order.
+subsystem_t inProcess_subsystems[inProcessSubsystem_count]={
+	{L"IA2Support",IA2Support_inProcess_initialize,IA2Support_inProcess_terminate,false},
+	{L"ia2LiveRegions",ia2LiveRegions_inProcess_initialize,ia2LiveRegions_inProcess_terminate,false},
+	{L"typedCharacter",typedCharacter_inProcess_initialize,typedCharacter_inProcess_terminate,false},
+	{L"inputLangChange",inputLangChange_inProcess_initialize,inputLangChange_inProcess_terminate,false},
+	{L"TSF",TSF_inProcess_initialize,TSF_inProcess_terminate,false},
+	{L"IME",IME_inProcess_initialize,IME_inProcess_terminate,false},
+	{L"winword",winword_inProcess_initialize,winword_inProcess_terminate,false},
+	{L"gdiHooks",gdiHooks_inProcess_activate,gdiHooks_inProcess_terminate,true}
+};
+
+LockableObject inProcess_subsystemsLock;
+DWORD inProcess_managerThreadID=0;
+bool inProcess_isTerminating=false;
+LARGE_INTEGER inProcess_perfFrequency={0};
+LARGE_INTEGER inProcess_startTime={0};
+
+long long microsecondsSince(const LARGE_INTEGER& start) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	if(inProcess_perfFrequency.QuadPart==0) return 0;
+	return ((now.QuadPart-start.QuadPart)*1000000)/inProcess_perfFrequency.QuadPart;
+}
+
+/**
+ * Runs the initialization of a subsystem already marked as activating, and wakes any threads waiting for it.
+ */
+void runSubsystemInitialization(inProcess_subsystemID_t ID) {
+	subsystem_t& subsystem=inProcess_subsystems[ID];
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+	subsystem.initialize();
+	long long initTime=microsecondsSince(start);
+	inProcess_subsystemsLock.acquire();
+	subsystem.initTime=initTime;
+	subsystem.state=subsystemState_active;
+	subsystem.activatingThreadID=0;
+	inProcess_subsystemsLock.release();
+	SetEvent(subsystem.activatedEvent);
+	LOG_DEBUG(L"Activated subsystem "<<subsystem.name<<L" in "<<initTime<<L" us, "<<microsecondsSince(inProcess_startTime)<<L" us after injection");
+}
+
+bool inProcess_activateSubsystem(inProcess_subsystemID_t ID, bool wait) {
+	nhAssert(ID>=0&&ID<inProcessSubsystem_count);
+	subsystem_t& subsystem=inProcess_subsystems[ID];
+	//Fast path: most triggers arrive long after the subsystem has started.
+	if(subsystem.state==subsystemState_active) return true;
+	inProcess_subsystemsLock.acquire();
+	if(inProcess_isTerminating||!subsystem.activatedEvent) {
+		inProcess_subsystemsLock.release();
+		return false;
+	}
+	subsystem.triggerCount+=1;
+	if(subsystem.state==subsystemState_active) {
+		inProcess_subsystemsLock.release();
+		return true;
+	}
+	DWORD curThreadID=GetCurrentThreadId();
+	if(subsystem.state==subsystemState_activating) {
+		//Another thread is already starting it, or we are being re-entered from its own initialization.
+		bool isReentrant=(subsystem.activatingThreadID==curThreadID);
+		inProcess_subsystemsLock.release();
+		if(isReentrant||!wait) return false;
+		return WaitForSingleObject(subsystem.activatedEvent,SUBSYSTEM_ACTIVATION_TIMEOUT)==WAIT_OBJECT_0;
+	}
+	subsystem.state=subsystemState_activating;
+	if(!subsystem.needsManagerThread||curThreadID==inProcess_managerThreadID) {
+		subsystem.activatingThreadID=curThreadID;
+		inProcess_subsystemsLock.release();
+		runSubsystemInitialization(ID);
+		return true;
+	}
+	subsystem.activatingThreadID=inProcess_managerThreadID;
+	inProcess_subsystemsLock.release();
+	if(!PostThreadMessage(inProcess_managerThreadID,wm_activateSubsystem,(WPARAM)ID,0)) {
+		LOG_DEBUGWARNING(L"Could not post activation of subsystem "<<subsystem.name<<L" to the inproc manager thread, GetLastError returned "<<GetLastError());
+		inProcess_subsystemsLock.acquire();
+		subsystem.state=subsystemState_inactive;
+		subsystem.activatingThreadID=0;
+		inProcess_subsystemsLock.release();
+		return false;
+	}
+	if(!wait) return false;
+	if(WaitForSingleObject(subsystem.activatedEvent,SUBSYSTEM_ACTIVATION_TIMEOUT)!=WAIT_OBJECT_0) {
+		LOG_DEBUGWARNING(L"Timed out waiting for subsystem "<<subsystem.name<<L" to activate");
+		return false;
+	}
+	return true;
+}
+
+bool inProcess_isSubsystemActive(inProcess_subsystemID_t ID) {
+	return inProcess_subsystems[ID].state==subsystemState_active;
+}
+
+bool inProcess_handleManagerThreadMessage(const MSG& msg) {
+	if(msg.hwnd!=NULL||msg.message!=wm_activateSubsystem) return false;
+	inProcess_subsystemID_t ID=(inProcess_subsystemID_t)(msg.wParam);
+	if(ID<0||ID>=inProcessSubsystem_count) return true;
+	inProcess_subsystemsLock.acquire();
+	bool shouldRun=(inProcess_subsystems[ID].state==subsystemState_activating&&!inProcess_isTerminating);
+	inProcess_subsystemsLock.release();
+	if(shouldRun) runSubsystemInitialization(ID);
+	return true;
+}
+
+/**
+ * Activates subsystems whose first relevant trigger is the given winEvent.
+ * Called on the thread that fired the event, before the event is dispatched to registered hooks so that newly activated subsystems also see it.
+ * Never waits for an activation under way on another thread, so as not to hold up the application's thread.
+ */
+void activateSubsystemsForWinEvent(DWORD eventID, HWND hwnd) {
+	if(eventID==EVENT_OBJECT_FOCUS||eventID==EVENT_SYSTEM_FOREGROUND) {
+		//Focus is the first point at which accessibility, typing and input method support can matter.
+		inProcess_activateSubsystem(inProcessSubsystem_IA2Support,false);
+		inProcess_activateSubsystem(inProcessSubsystem_typedCharacter,false);
+		inProcess_activateSubsystem(inProcessSubsystem_inputLangChange,false);
+		inProcess_activateSubsystem(inProcessSubsystem_TSF,false);
+		inProcess_activateSubsystem(inProcessSubsystem_IME,false);
+		if(hwnd&&!inProcess_isSubsystemActive(inProcessSubsystem_winword)) {
+			wchar_t className[8]={0};
+			if(GetClassName(hwnd,className,ARRAYSIZE(className))>0&&wcscmp(className,L"_WwG")==0) {
+				inProcess_activateSubsystem(inProcessSubsystem_winword,false);
+			}
+		}
+	} else if(eventID>=IA2_EVENT_ACTION_CHANGED&&eventID<=IA2_EVENT_ACTION_CHANGED+0xfe) {
+		//IAccessible2 event IDs are allocated from 0x101, so only IAccessible2 applications fire these.
+		inProcess_activateSubsystem(inProcessSubsystem_ia2LiveRegions,false);
+	}
+}
 
 void inProcess_initialize() {
+	QueryPerformanceFrequency(&inProcess_perfFrequency);
+	QueryPerformanceCounter(&inProcess_startTime);
 	wm_execInThread=RegisterWindowMessage(L"nvdaHelper_execInThread");
-	IA2Support_inProcess_initialize();
-	ia2LiveRegions_inProcess_initialize();
-	typedCharacter_inProcess_initialize();
-	inputLangChange_inProcess_initialize();
-	TSF_inProcess_initialize();
-	IME_inProcess_initialize();
-	winword_inProcess_initialize();
-	gdiHooks_inProcess_initialize();
+	wm_activateSubsystem=RegisterWindowMessage(L"nvdaHelper_activateSubsystem");
+	inProcess_managerThreadID=GetCurrentThreadId();
+	//Make sure this thread has a message queue so that activation requests can be posted to it straight away.
+	MSG msg;
+	PeekMessage(&msg,NULL,WM_USER,WM_USER,PM_NOREMOVE);
+	inProcess_subsystemsLock.acquire();
+	inProcess_isTerminating=false;
+	for(int i=0;i<inProcessSubsystem_count;++i) {
+		subsystem_t& subsystem=inProcess_subsystems[i];
+		subsystem.state=subsystemState_inactive;
+		subsystem.activatingThreadID=0;
+		subsystem.triggerCount=0;
+		subsystem.initTime=0;
+		subsystem.activatedEvent=CreateEvent(NULL,TRUE,FALSE,NULL);
+		if(!subsystem.activatedEvent) {
+			LOG_ERROR(L"Could not create activation event for subsystem "<<subsystem.name);
+		}
+	}
+	inProcess_subsystemsLock.release();
+	LOG_DEBUG(L"In-process initialization took "<<microsecondsSince(inProcess_startTime)<<L" us");
 }
 
 void inProcess_terminate() {
-	gdiHooks_inProcess_terminate();
-	IME_inProcess_terminate();
-	TSF_inProcess_terminate();
-	winword_inProcess_terminate();
-	inputLangChange_inProcess_terminate();
-	typedCharacter_inProcess_terminate();
-	ia2LiveRegions_inProcess_terminate();
-	IA2Support_inProcess_terminate();
+	inProcess_subsystemsLock.acquire();
+	inProcess_isTerminating=true;
+	inProcess_subsystemsLock.release();
+	for(int i=inProcessSubsystem_count-1;i>=0;--i) {
+		subsystem_t& subsystem=inProcess_subsystems[i];
+		if(subsystem.activatedEvent&&subsystem.state==subsystemState_activating&&subsystem.activatingThreadID!=GetCurrentThreadId()) {
+			//Let an activation already under way on another thread finish before tearing it down.
+			//Requests still queued for this (the manager) thread are simply dropped.
+			WaitForSingleObject(subsystem.activatedEvent,SUBSYSTEM_ACTIVATION_TIMEOUT);
+		}
+		LOG_DEBUG(L"Subsystem "<<subsystem.name<<L": "<<subsystem.triggerCount<<L" triggers, "<<((subsystem.state==subsystemState_active)?L"active":L"never activated")<<L", initialization took "<<subsystem.initTime<<L" us");
+		if(subsystem.state==subsystemState_active) {
+			subsystem.terminate();
+		}
+		subsystem.state=subsystemState_inactive;
+		if(subsystem.activatedEvent) {
+			//Release anyone still waiting for a dropped activation.
+			SetEvent(subsystem.activatedEvent);
+			CloseHandle(subsystem.activatedEvent);
+			subsystem.activatedEvent=NULL;
+		}
+	}
 }
 
 bool registerWinEventHook(WINEVENTPROC hookProc) {
+	inProcess_hookRegistryLock.acquire();
 	inProcess_registeredWinEventHooks[hookProc]+=1;
+	inProcess_hookRegistryLock.release();
 	return true;
 }
 
 bool unregisterWinEventHook(WINEVENTPROC hookProc) {
+	inProcess_hookRegistryLock.acquire();
 	winEventHookRegistry_t::iterator i=inProcess_registeredWinEventHooks.find(hookProc);
-	if(i==inProcess_registeredWinEventHooks.end()) return false;
+	if(i==inProcess_registeredWinEventHooks.end()) {
+		inProcess_hookRegistryLock.release();
+		return false;
+	}
 	if(i->second>1) {
 		i->second-=1;
 	} else {
 		nhAssert(i->second==1);
 		inProcess_registeredWinEventHooks.erase(i);
 	}
+	inProcess_hookRegistryLock.release();
 	return true;
 }
 
@@ -89,7 +297,9 @@ bool registerWindowsHook(int hookType, HOOKPROC hookProc) {
 		r=&inProcess_registeredCallWndProcWindowsHooks;
 	}
 	if(r==NULL) return false;
+	inProcess_hookRegistryLock.acquire();
 	(*r)[hookProc]+=1;
+	inProcess_hookRegistryLock.release();
 	return true;
 }
 
@@ -101,14 +311,19 @@ bool unregisterWindowsHook(int hookType, HOOKPROC hookProc) {
 		r=&inProcess_registeredCallWndProcWindowsHooks;
 	}
 	if(r==NULL) return false;
+	inProcess_hookRegistryLock.acquire();
 	windowsHookRegistry_t::iterator i=r->find(hookProc);
-	if(i==r->end()) return false;
+	if(i==r->end()) {
+		inProcess_hookRegistryLock.release();
+		return false;
+	}
 	if(i->second>1) {
 		i->second-=1;
 	} else {
 		nhAssert(i->second==1);
 		r->erase(i);
 	}
+	inProcess_hookRegistryLock.release();
 	return true;
 }
 
@@ -126,7 +341,9 @@ LRESULT CALLBACK inProcess_getMessageHook(int code, WPARAM wParam, LPARAM lParam
 		return 0;
 	}
 	//Hookprocs may unregister or register hooks themselves, so we must copy the hookprocs before executing
+	inProcess_hookRegistryLock.acquire();
 	windowsHookRegistry_t hookProcs=inProcess_registeredGetMessageWindowsHooks;
+	inProcess_hookRegistryLock.release();
 	for(windowsHookRegistry_t::iterator i=hookProcs.begin();i!=hookProcs.end();++i) {
 		i->first(code,wParam,lParam);
 	}
@@ -139,7 +356,9 @@ LRESULT CALLBACK inProcess_callWndProcHook(int code, WPARAM wParam,LPARAM lParam
 		return CallNextHookEx(0,code,wParam,lParam);
 	}
 	//Hookprocs may unregister or register hooks themselves, so we must copy the hookprocs before executing
+	inProcess_hookRegistryLock.acquire();
 	windowsHookRegistry_t hookProcs=inProcess_registeredCallWndProcWindowsHooks;
+	inProcess_hookRegistryLock.release();
 	for(windowsHookRegistry_t::iterator i=hookProcs.begin();i!=hookProcs.end();++i) {
 		i->first(code,wParam,lParam);
 	}
@@ -150,8 +369,11 @@ LRESULT CALLBACK inProcess_callWndProcHook(int code, WPARAM wParam,LPARAM lParam
 void CALLBACK inProcess_winEventCallback(HWINEVENTHOOK hookID, DWORD eventID, HWND hwnd, long objectID, long childID, DWORD threadID, DWORD time) {
 	//We are not at all interested in out-of-context winEvents, even if they were accidental.
 	if(threadID!=GetCurrentThreadId()) return;
+	activateSubsystemsForWinEvent(eventID,hwnd);
 	//Hookprocs may unregister or register hooks themselves, so we must copy the hookprocs before executing
+	inProcess_hookRegistryLock.acquire();
 	winEventHookRegistry_t hookProcs=inProcess_registeredWinEventHooks;
+	inProcess_hookRegistryLock.release();
 	for(winEventHookRegistry_t::iterator i=hookProcs.begin();i!=hookProcs.end();++i) {
 		i->first(hookID, eventID, hwnd, objectID, childID, threadID, time);
 	}
@@ -10,6 +10,38 @@ LRESULT CALLBACK inProcess_callWndProcHook(int code, WPARAM wParam,LPARAM lParam
 void inProcess_initialize();
 void inProcess_terminate();
 
+/**
+ * The in-process subsystems, which are each started on demand by their first relevant trigger.
+ */
+enum inProcess_subsystemID_t {
+	inProcessSubsystem_IA2Support,
+	inProcessSubsystem_ia2LiveRegions,
+	inProcessSubsystem_typedCharacter,
+	inProcessSubsystem_inputLangChange,
+	inProcessSubsystem_TSF,
+	inProcessSubsystem_IME,
+	inProcessSubsystem_winword,
+	inProcessSubsystem_gdiHooks,
+	inProcessSubsystem_count
+};
+
+/**
+ * Makes sure the given subsystem is initialized, starting it if this is its first trigger.
+ * Subsystems that must run on the inproc manager thread are started there.
+ * @param ID the subsystem to activate.
+ * @param wait if true, waits (with a timeout) for an activation under way on another thread to complete.
+ * @return true if the subsystem is active on return.
+ */
+bool inProcess_activateSubsystem(inProcess_subsystemID_t ID, bool wait=true);
+
+bool inProcess_isSubsystemActive(inProcess_subsystemID_t ID);
+
+/**
+ * Handles subsystem activation requests posted to the inproc manager thread.
+ * @return true if the message was handled and should not be dispatched.
+ */
+bool inProcess_handleManagerThreadMessage(const MSG& msg);
+
 #include <functional>
 typedef std::function<void()> execInThread_funcType;
 bool execInThread(long threadID, execInThread_funcType func);
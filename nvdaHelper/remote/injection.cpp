@@ -76,6 +76,7 @@ void CALLBACK inproc_winEventCallback(HWINEVENTHOOK hookID, DWORD eventID, HWND
 
 //An implementation of SetWindowsHookExA that ensures that our W hooks always happen before other peoples' A hooks
 HHOOK WINAPI fake_SetWindowsHookExA(int IdHook, HOOKPROC lpfn, HINSTANCE hMod, DWORD dwThreadId) {
+	apiHook_callGuard_t callGuard;
 	//Call the real SetWindowsHookExA
 	HHOOK res=real_SetWindowsHookExA(IdHook,lpfn,hMod,dwThreadId);
 	//We only go on if the real call did not fail and this is a thread-specific hook
@@ -133,6 +134,7 @@ void killRunningWindowsHooks() {
 typedef BOOL(WINAPI *OpenClipboard_funcType)(HWND);
 OpenClipboard_funcType real_OpenClipboard=NULL;
 BOOL WINAPI fake_OpenClipboard(HWND hwndOwner) {
+	apiHook_callGuard_t callGuard;
 	return false;
 }
 
@@ -171,10 +173,13 @@ DWORD WINAPI inprocMgrThreadFunc(LPVOID data) {
 	apiHook_initialize();
 	//Hook SetWindowsHookExA so that we can juggle hooks around a bit.
 	//Fixes #2411
-	real_SetWindowsHookExA=apiHook_hookFunction_safe("USER32.dll",SetWindowsHookExA,fake_SetWindowsHookExA);
-	//Fore secure mode NVDA process, hook OpenClipboard to disable usage of the clipboard
-if(isSecureModeNVDAProcess) real_OpenClipboard=apiHook_hookFunction_safe("USER32.dll",OpenClipboard,fake_OpenClipboard);
-	//Initialize in-process subsystems
+	//Fore secure mode NVDA process, also hook OpenClipboard to disable usage of the clipboard
+	apiHook_hookTableEntry_t hookTable[]={
+		apiHook_hookTableEntry_safe("USER32.dll",SetWindowsHookExA,fake_SetWindowsHookExA,&real_SetWindowsHookExA),
+		apiHook_hookTableEntry_safe("USER32.dll",OpenClipboard,fake_OpenClipboard,&real_OpenClipboard)
+	};
+	apiHook_hookFunctions(hookTable,isSecureModeNVDAProcess?2:1);
+	//Prepare in-process subsystems. Each is only started on its first relevant trigger.
 	inProcess_initialize();
 	//Enable all registered API hooks
 	apiHook_enableHooks();
@@ -193,6 +198,8 @@ if(isSecureModeNVDAProcess) real_OpenClipboard=apiHook_hookFunction_safe("USER32
 		// Consume and handle all pending messages.
 		MSG msg;
 		while(PeekMessage(&msg,NULL,0,0,PM_REMOVE)) {
+			// Subsystems needing this thread are started here on demand.
+			if(inProcess_handleManagerThreadMessage(msg)) continue;
 			TranslateMessage(&msg);
 			DispatchMessage(&msg);
 		}
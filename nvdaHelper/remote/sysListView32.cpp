@@ -14,11 +14,83 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #define WIN32_LEAN_AND_MEAN 
 
+#include <string>
+#include <sstream>
 #include <windows.h>
 #include <commctrl.h>
 #include <common/log.h>
 #include "nvdaInProcUtils.h"
 
+using namespace std;
+
+//Separates the fields of a row or group in the strings returned by sysListView32_getRows.
+const wchar_t FIELD_SEPARATOR=L'\x1f';
+//Ends each row or group in the strings returned by sysListView32_getRows.
+const wchar_t RECORD_SEPARATOR=L'\x1e';
+
+//The size of the buffer used to fetch item text, matching NVDA's CBEMAXSTRLEN.
+const int MAX_ITEM_TEXT_LENGTH=512;
+
+/**
+ * Strips any separator characters from text so that it can be placed in a field.
+ */
+void appendField(wstringstream& s, const wchar_t* text) {
+	for(const wchar_t* c=text;*c;++c) {
+		if(*c!=FIELD_SEPARATOR&&*c!=RECORD_SEPARATOR) s<<*c;
+	}
+	s<<FIELD_SEPARATOR;
+}
+
+/**
+ * Updates a 32 bit FNV-1a hash with the given text.
+ */
+unsigned long hashText(unsigned long hash, const wstring& text) {
+	for(wstring::const_iterator c=text.begin();c!=text.end();++c) {
+		hash^=static_cast<unsigned long>(*c);
+		hash*=16777619UL;
+	}
+	return hash;
+}
+
+void appendRow(wstringstream& s, HWND hwnd, int index, int columnCount) {
+	wchar_t textBuf[MAX_ITEM_TEXT_LENGTH];
+	LVITEM item={0};
+	item.mask=LVIF_GROUPID;
+	item.iItem=index;
+	SendMessage(hwnd,LVM_GETITEM,0,(LPARAM)&item);
+	UINT state=(UINT)SendMessage(hwnd,LVM_GETITEMSTATE,(WPARAM)index,LVIS_FOCUSED|LVIS_SELECTED|LVIS_STATEIMAGEMASK);
+	s<<index<<FIELD_SEPARATOR<<state<<FIELD_SEPARATOR<<item.iGroupId<<FIELD_SEPARATOR;
+	for(int subItem=0;subItem<columnCount;++subItem) {
+		textBuf[0]=L'\0';
+		LVITEM textItem={0};
+		textItem.iSubItem=subItem;
+		textItem.pszText=textBuf;
+		textItem.cchTextMax=MAX_ITEM_TEXT_LENGTH;
+		SendMessage(hwnd,LVM_GETITEMTEXT,(WPARAM)index,(LPARAM)&textItem);
+		appendField(s,textBuf);
+	}
+	s<<RECORD_SEPARATOR;
+}
+
+void appendGroups(wstringstream& s, HWND hwnd) {
+	if(!SendMessage(hwnd,LVM_ISGROUPVIEWENABLED,0,0)) return;
+	int groupCount=(int)SendMessage(hwnd,LVM_GETGROUPCOUNT,0,0);
+	for(int groupIndex=0;groupIndex<groupCount;++groupIndex) {
+		LVGROUP group={0};
+		group.cbSize=sizeof(group);
+		group.mask=LVGF_HEADER|LVGF_FOOTER|LVGF_STATE|LVGF_GROUPID;
+		group.stateMask=0xffffffff;
+		if(!SendMessage(hwnd,LVM_GETGROUPINFOBYINDEX,(WPARAM)groupIndex,(LPARAM)&group)) {
+			LOG_DEBUGWARNING(L"LVM_GETGROUPINFOBYINDEX failed for group "<<groupIndex);
+			continue;
+		}
+		s<<groupIndex<<FIELD_SEPARATOR<<group.iGroupId<<FIELD_SEPARATOR<<group.state<<FIELD_SEPARATOR;
+		appendField(s,group.pszHeader?group.pszHeader:L"");
+		appendField(s,group.pszFooter?group.pszFooter:L"");
+		s<<RECORD_SEPARATOR;
+	}
+}
+
 error_status_t nvdaInProcUtils_sysListView32_getGroupInfo(handle_t bindingHandle, const unsigned long windowHandle, int groupIndex, BSTR* header, BSTR* footer, int* state) {
 	LVGROUP group={0};
 	group.cbSize=sizeof(group);
@@ -33,3 +105,43 @@ error_status_t nvdaInProcUtils_sysListView32_getGroupInfo(handle_t bindingHandle
 	*state=group.state;
 	return 0;
 }
+
+error_status_t nvdaInProcUtils_sysListView32_getRows(handle_t bindingHandle, const unsigned long windowHandle, int firstRow, int maxRows, long lastChangeStamp, int* itemCount, long* changeStamp, BSTR* rows, BSTR* groups) {
+	HWND hwnd=(HWND)UlongToHandle(windowHandle);
+	*itemCount=(int)SendMessage(hwnd,LVM_GETITEMCOUNT,0,0);
+	//Groups are only wanted along with the visible page, not when reading a single row.
+	bool includeGroups=(firstRow<0);
+	if(firstRow<0) {
+		firstRow=(int)SendMessage(hwnd,LVM_GETTOPINDEX,0,0);
+		if(maxRows<=0) {
+			//One more than fits, as the last row may be partially visible.
+			maxRows=(int)SendMessage(hwnd,LVM_GETCOUNTPERPAGE,0,0)+1;
+		}
+	}
+	int endRow=(maxRows>0&&maxRows<*itemCount-firstRow)?firstRow+maxRows:*itemCount;
+	int columnCount=1;
+	HWND headerHwnd=(HWND)SendMessage(hwnd,LVM_GETHEADER,0,0);
+	if(headerHwnd) {
+		int headerCount=(int)SendMessage(headerHwnd,HDM_GETITEMCOUNT,0,0);
+		if(headerCount>0) columnCount=headerCount;
+	}
+	wstringstream rowsStream;
+	for(int index=firstRow;index<endRow;++index) {
+		appendRow(rowsStream,hwnd,index,columnCount);
+	}
+	wstringstream groupsStream;
+	if(includeGroups) appendGroups(groupsStream,hwnd);
+	wstring rowsText=rowsStream.str();
+	wstring groupsText=groupsStream.str();
+	unsigned long hash=hashText(2166136261UL,rowsText);
+	hash=hashText(hash,groupsText);
+	//0 means the caller has no previous snapshot, so never hand it out as a stamp.
+	*changeStamp=(hash!=0)?static_cast<long>(hash):1;
+	if(lastChangeStamp!=0&&*changeStamp==lastChangeStamp) {
+		//The caller already has this content.
+		return 0;
+	}
+	*rows=SysAllocStringLen(rowsText.c_str(),static_cast<UINT>(rowsText.length()));
+	*groups=SysAllocStringLen(groupsText.c_str(),static_cast<UINT>(groupsText.length()));
+	return 0;
+}
@@ -12,18 +12,81 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#include <cstring>
 #include <map>
 #include "vbufRemote.h"
+#include <common/lock.h>
+#include <common/log.h>
 #include <vbufBase/backend.h>
+#include <vbufBase/changeLog.h>
 #include "dllmain.h"
 
 using namespace std;
 
 map<VBufBackend_t*,HINSTANCE> backendLibHandles;
 
+/**
+ * A change log channel in a file mapping set up by NVDA, through which the changes to a mirrored buffer reach its replica.
+ */
+class VBufRemote_mirrorChannel_t: public VBufStorage_changeLogChannel_t {
+	private:
+
+	HANDLE mapping;
+
+	void* view;
+
+	VBufRemote_mirrorChannel_t(HANDLE mapping, void* view, size_t size): VBufStorage_changeLogChannel_t(view,size,false), mapping(mapping), view(view) {}
+
+	public:
+
+/**
+ * Opens the channel in a file mapping NVDA has duplicated in to this process.
+ * The mapping has no name, so only this process and NVDA can write to it.
+ * @param mapping the file mapping, which the channel owns from now on and closes if it can not be opened.
+ * @return the channel, or NULL if the file mapping could not be mapped or does not hold a channel.
+ */
+	static VBufRemote_mirrorChannel_t* open(HANDLE mapping) {
+		void* view=MapViewOfFile(mapping,FILE_MAP_READ|FILE_MAP_WRITE,0,0,0);
+		MEMORY_BASIC_INFORMATION info;
+		if(view==NULL||VirtualQuery(view,&info,sizeof(info))==0) {
+			LOG_DEBUGWARNING(L"Could not map file mapping "<<mapping<<L", error "<<GetLastError());
+			if(view) UnmapViewOfFile(view);
+			CloseHandle(mapping);
+			return NULL;
+		}
+		VBufRemote_mirrorChannel_t* channel=new VBufRemote_mirrorChannel_t(mapping,view,info.RegionSize);
+		if(!channel->isValid()) {
+			LOG_DEBUGWARNING(L"File mapping "<<mapping<<L" does not hold a change log channel");
+			delete channel;
+			return NULL;
+		}
+		return channel;
+	}
+
+	~VBufRemote_mirrorChannel_t() {
+		UnmapViewOfFile(this->view);
+		CloseHandle(this->mapping);
+	}
+
+};
+
+/**
+ * The channels of mirrored buffers. Each entry is only added or removed while its backend is locked.
+ */
+map<VBufBackend_t*,VBufRemote_mirrorChannel_t*> mirrorChannels;
+LockableObject mirrorChannelsLock;
+
+VBufRemote_mirrorChannel_t* getMirrorChannel(VBufBackend_t* backend) {
+	mirrorChannelsLock.acquire();
+	map<VBufBackend_t*,VBufRemote_mirrorChannel_t*>::iterator i=mirrorChannels.find(backend);
+	VBufRemote_mirrorChannel_t* channel=(i!=mirrorChannels.end())?i->second:NULL;
+	mirrorChannelsLock.release();
+	return channel;
+}
+
 extern "C" {
 
-VBufRemote_bufferHandle_t VBufRemote_createBuffer(handle_t bindingHandle, int docHandle, int ID, const wchar_t* backendName) {
+VBufRemote_bufferHandle_t VBufRemote_createBuffer(handle_t bindingHandle, int docHandle, int ID, const wchar_t* backendName, int memoryLimit) {
 	wchar_t backendPath[MAX_PATH];
 	wsprintf(backendPath,L"%s\\VBufBackend_%s.dll",dllDirectory,backendName);
 	HINSTANCE backendLibHandle=LoadLibrary(backendPath);
@@ -39,6 +102,9 @@ VBufRemote_bufferHandle_t VBufRemote_createBuffer(handle_t bindingHandle, int do
 		return NULL;
 	}
 	backendLibHandles[backend]=backendLibHandle;
+	backend->setMemoryLimit((memoryLimit>0)?static_cast<size_t>(memoryLimit)*1024:0);
+	//Start compressing cold subtrees well before the limit is reached, so that large documents rarely reach it.
+	backend->setCompressionBudget((memoryLimit>0)?static_cast<size_t>(memoryLimit)*1024/4:0);
 	backend->initialize();
 	return (VBufRemote_bufferHandle_t)backend;
 }
@@ -54,6 +120,14 @@ void VBufRemote_destroyBuffer(VBufRemote_bufferHandle_t* buffer) {
 	HINSTANCE backendLibHandle=i->second;
 	backendLibHandles.erase(i); 
 	backend->lock.acquire();
+	VBufRemote_mirrorChannel_t* channel=getMirrorChannel(backend);
+	if(channel) {
+		backend->setChangeLog(NULL);
+		mirrorChannelsLock.acquire();
+		mirrorChannels.erase(backend);
+		mirrorChannelsLock.release();
+		delete channel;
+	}
 	backend->destroy();
 	FreeLibrary(backendLibHandle);
 	*buffer=NULL;
@@ -133,6 +207,30 @@ int VBufRemote_setSelectionOffsets(VBufRemote_bufferHandle_t buffer, int startOf
 	return res;
 }
 
+int VBufRemote_pinOffset(VBufRemote_bufferHandle_t buffer, int offset) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquire();
+	int res=backend->pinOffset(offset);
+	backend->lock.release();
+	return res;
+}
+
+int VBufRemote_getPinnedOffset(VBufRemote_bufferHandle_t buffer, int pinID, int *offset) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquire();
+	int res=backend->getPinnedOffset(pinID,offset);
+	backend->lock.release();
+	return res;
+}
+
+int VBufRemote_unpinOffset(VBufRemote_bufferHandle_t buffer, int pinID) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->lock.acquire();
+	int res=backend->unpinOffset(pinID);
+	backend->lock.release();
+	return res;
+}
+
 int VBufRemote_getTextLength(VBufRemote_bufferHandle_t buffer) {
 	VBufBackend_t* backend=(VBufBackend_t*)buffer;
 	backend->lock.acquire();
@@ -151,6 +249,8 @@ int VBufRemote_getTextInRange(VBufRemote_bufferHandle_t buffer, int startOffset,
 	}
 	*text=SysAllocString(textContainer->getString().c_str());
 	textContainer->destroy();
+	// The user is reading this text, so render any content which was deferred within it.
+	backend->renderDeferredContentInRange(startOffset,endOffset);
 	return true;
 }
 
@@ -162,6 +262,72 @@ int VBufRemote_getLineOffsets(VBufRemote_bufferHandle_t buffer, int offset, int
 	return res;
 }
 
+int VBufRemote_getMemoryStats(VBufRemote_bufferHandle_t buffer, VBufRemote_memoryStats_t* stats) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	VBufStorage_memoryStats_t backendStats;
+	backend->lock.acquire();
+	backend->getMemoryStats(&backendStats);
+	backend->lock.release();
+	stats->controlFieldNodeCount=backendStats.controlFieldNodeCount;
+	stats->textFieldNodeCount=backendStats.textFieldNodeCount;
+	stats->nodeBytes=backendStats.nodeBytes;
+	stats->attributeBytes=backendStats.attributeBytes;
+	stats->textBytes=backendStats.textBytes;
+	stats->indexBytes=backendStats.indexBytes;
+	stats->totalBytes=backendStats.totalBytes;
+	stats->peakBytes=backendStats.peakBytes;
+	stats->compressedBytes=backendStats.compressedBytes;
+	stats->compressedSubtreeCount=backendStats.compressedSubtreeCount;
+	stats->compressedNodeCount=backendStats.compressedNodeCount;
+	return true;
+}
+
+int VBufRemote_syncMirror(VBufRemote_bufferHandle_t buffer, unsigned long channelMapping, int* snapshotSize, unsigned char** snapshot) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	*snapshotSize=0;
+	*snapshot=NULL;
+	VBufStorage_encoder_t encoder;
+	backend->lock.acquire();
+	VBufRemote_mirrorChannel_t* channel=getMirrorChannel(backend);
+	HANDLE mapping=UlongToHandle(channelMapping);
+	if(channel&&mapping) {
+		// This process owns the handle, but already has a channel.
+		CloseHandle(mapping);
+	} else if(!channel) {
+		channel=mapping?VBufRemote_mirrorChannel_t::open(mapping):NULL;
+		if(!channel) {
+			backend->lock.release();
+			return false;
+		}
+		mirrorChannelsLock.acquire();
+		mirrorChannels[backend]=channel;
+		mirrorChannelsLock.release();
+		backend->setChangeLog(channel);
+	}
+	if(!VBufStorage_changeLog_t::encodeReset(backend,encoder)) {
+		LOG_DEBUGWARNING(L"Could not take snapshot of buffer at "<<backend);
+		channel->desync();
+		backend->lock.release();
+		return false;
+	}
+	// NVDA waits for this call, so it reads nothing while the records older than the snapshot are discarded.
+	channel->reset();
+	backend->lock.release();
+	*snapshot=(unsigned char*)midl_user_allocate(encoder.bytes.size());
+	if(*snapshot==NULL) {
+		return false;
+	}
+	memcpy(*snapshot,encoder.bytes.data(),encoder.bytes.size());
+	*snapshotSize=static_cast<int>(encoder.bytes.size());
+	return true;
+}
+
+int VBufRemote_renderDeferredContentInRange(VBufRemote_bufferHandle_t buffer, int startOffset, int endOffset) {
+	VBufBackend_t* backend=(VBufBackend_t*)buffer;
+	backend->renderDeferredContentInRange(startOffset,endOffset);
+	return true;
+}
+
 //Special cleanup method for VBufRemote when client is lost
 void __RPC_USER VBufRemote_bufferHandle_t_rundown(VBufRemote_bufferHandle_t buffer) {
 	VBufRemote_destroyBuffer(&buffer);
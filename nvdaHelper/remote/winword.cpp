@@ -16,17 +16,23 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <sstream>
 #include <vector>
+#include <map>
+#include <algorithm>
 #include <comdef.h>
 #include <windows.h>
 #include <oleacc.h>
 #include <common/xml.h>
 #include <common/log.h>
+#include <common/lock.h>
 #include <boost/optional.hpp>
 #include "nvdaHelperRemote.h"
 #include "nvdaInProcUtils.h"
 #include "nvdaInProcUtils.h"
 #include <remote/WinWord/Constants.h>
 #include <remote/WinWord/Fields.h>
+#include <remote/WinWord/Tables.h>
+#include <remote/WinWord/Dispatch.h>
+#include "inProcess.h"
 #include "winword.h"
 
 using namespace std;
@@ -59,6 +65,51 @@ constexpr wchar_t PAGE_BREAK_VALUE = L'\x0c';
 constexpr wchar_t COLUMN_BREAK_VALUE = L'\x0e';
 
 UINT wm_winword_expandToLine=0;
+
+/**
+ * The text columns of a section, as needed to work out which column a position on the page is in.
+ */
+struct SectionColumnLayout {
+	int count = -1; ///< -1 if the count could not be fetched, E.g. in a comment
+	std::vector<float> columnStartPositions; ///< in points from the edge of the page, empty if they could not be calculated
+};
+
+/**
+ * Text xml generated ahead of time for the range NVDA is expected to ask for next.
+ */
+struct PrefetchedText {
+	int previousStartOffset = -1; ///< the start of the request this follows on from, whose units and length the prefetched range copies
+	int startOffset = -1;
+	int endOffset = -1; ///< -1 while the prefetch is only scheduled and the range is not yet known
+	long formatConfig = 0;
+	std::wstring xml;
+	bool isReady = false;
+};
+
+/**
+ * Information cached for a document window, cleared whenever the document may have been edited.
+ */
+struct DocumentCaches {
+	WinWord::TableCache tables;
+	map<int,SectionColumnLayout> columnLayoutsBySection;
+	int lastTextRequestEndOffset = -1; ///< used to notice sequential reading such as say all
+	PrefetchedText prefetchedText;
+};
+
+map<HWND,DocumentCaches> documentCachesByWindow;
+LockableObject documentCachesLock;
+
+void clearDocumentCaches() {
+	documentCachesLock.acquire();
+	for(auto& i: documentCachesByWindow) {
+		i.second.tables.clear();
+		i.second.columnLayoutsBySection.clear();
+		i.second.lastTextRequestEndOffset = -1;
+		i.second.prefetchedText = PrefetchedText();
+	}
+	documentCachesLock.release();
+}
+
 typedef struct {
 	int offset;
 	int lineStart;
@@ -72,119 +123,118 @@ void winword_expandToLine_helper(HWND hwnd, winword_expandToLine_args* args) {
 		return;
 	}
 	IDispatchPtr pDispatchApplication=NULL;
-	if(_com_dispatch_raw_propget(pDispatchWindow,wdDISPID_WINDOW_APPLICATION,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_APPLICATION,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
 		LOG_DEBUGWARNING(L"window.application failed");
 		return;
 	}
 	IDispatchPtr pDispatchSelection=NULL;
-	if(_com_dispatch_raw_propget(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
 		LOG_DEBUGWARNING(L"application.selection failed");
 		return;
 	}
 	BOOL startWasActive=false;
-	if(_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,&startWasActive)!=S_OK) {
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,&startWasActive)!=S_OK) {
 		LOG_DEBUGWARNING(L"selection.StartIsActive failed");
 	}
 	IDispatch* pDispatchOldSelRange=NULL;
-	if(_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchOldSelRange)!=S_OK||!pDispatchOldSelRange) {
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchOldSelRange)!=S_OK||!pDispatchOldSelRange) {
 		LOG_DEBUGWARNING(L"selection.range failed");
 		return;
 	}
 	//Disable screen updating as we will be moving the selection temporarily
-	_com_dispatch_raw_propput(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,false);
+	WinWord::propPut(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,false);
 	//Move the selection to the given range
-	_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
+	WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
 	//Expand the selection to the line
 	// #3421: Expand and or extending selection cannot be used due to MS Word bugs on the last line in a table cell, or the first/last line of a table of contents, selecting would select the entire object.
 	// Therefore do it in two steps
 	bool lineError=false;
-	if(_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_STARTOF,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",wdLine,0)!=S_OK) {
+	if(WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_STARTOF,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",wdLine,0)!=S_OK) {
 		lineError=true;
 	} else {
-		_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_RANGE_START,VT_I4,&(args->lineStart));
-		if(_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_ENDOF,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",wdLine,0)!=S_OK) {
+		WinWord::propGet(pDispatchSelection,wdDISPID_RANGE_START,VT_I4,&(args->lineStart));
+		if(WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_ENDOF,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",wdLine,0)!=S_OK) {
 			lineError=true;
 		} else {
-			_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_RANGE_END,VT_I4,&(args->lineEnd));
+			WinWord::propGet(pDispatchSelection,wdDISPID_RANGE_END,VT_I4,&(args->lineEnd));
 		}
 		// the endOf method has a bug where IPAtEndOfLine gets stuck as true on wrapped lines
 		// So reset the selection to the start of the document to force it to False
-		_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",0,0);
+		WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",0,0);
 	}
 	// Fall back to the older expand if there was an error getting line bounds
 	if(lineError) {
-		_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
-		_com_dispatch_raw_method(pDispatchSelection,wdDISPID_RANGE_EXPAND,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdLine);
-		_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_RANGE_START,VT_I4,&(args->lineStart));
-		_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_RANGE_END,VT_I4,&(args->lineEnd));
+		WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
+		WinWord::callMethod(pDispatchSelection,wdDISPID_RANGE_EXPAND,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdLine);
+		WinWord::getIntProperties(pDispatchSelection,{{wdDISPID_RANGE_START,&(args->lineStart)},{wdDISPID_RANGE_END,&(args->lineEnd)}});
 	}
 	if(args->lineStart>=args->lineEnd) {
 		args->lineStart=args->offset;
 		args->lineEnd=args->offset+1;
 	}
 	//Move the selection back to its original location
-	_com_dispatch_raw_method(pDispatchOldSelRange,wdDISPID_RANGE_SELECT,DISPATCH_METHOD,VT_EMPTY,NULL,NULL);
+	WinWord::callMethod(pDispatchOldSelRange,wdDISPID_RANGE_SELECT,DISPATCH_METHOD,VT_EMPTY,NULL,NULL);
 	//Restore the old selection direction
-	_com_dispatch_raw_propput(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,startWasActive);
+	WinWord::propPut(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,startWasActive);
 	//Reenable screen updating
-	_com_dispatch_raw_propput(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,true);
+	WinWord::propPut(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,true);
 }
 
 BOOL generateFormFieldXML(IDispatch* pDispatchRange, IDispatchPtr pDispatchRangeExpandedToParagraph, wostringstream& XMLStream, int& chunkEnd) {
 	IDispatchPtr pDispatchRange2=pDispatchRangeExpandedToParagraph;
 	BOOL foundFormField=false;
 	IDispatchPtr pDispatchFormFields=NULL;
-	_com_dispatch_raw_propget(pDispatchRange2,wdDISPID_RANGE_FORMFIELDS,VT_DISPATCH,&pDispatchFormFields);
+	WinWord::propGet(pDispatchRange2,wdDISPID_RANGE_FORMFIELDS,VT_DISPATCH,&pDispatchFormFields);
 	if(pDispatchFormFields) for(int count=1;!foundFormField&&count<100;++count) {
 		IDispatchPtr pDispatchFormField=NULL;
-		if(_com_dispatch_raw_method(pDispatchFormFields,wdDISPID_FORMFIELDS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchFormField,L"\x0003",count)!=S_OK||!pDispatchFormField) {
+		if(WinWord::callMethod(pDispatchFormFields,wdDISPID_FORMFIELDS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchFormField,L"\x0003",count)!=S_OK||!pDispatchFormField) {
 			break;
 		}
 		IDispatchPtr pDispatchFormFieldRange=NULL;
-		if(_com_dispatch_raw_propget(pDispatchFormField,wdDISPID_FORMFIELD_RANGE,VT_DISPATCH,&pDispatchFormFieldRange)!=S_OK||!pDispatchFormFieldRange) {
+		if(WinWord::propGet(pDispatchFormField,wdDISPID_FORMFIELD_RANGE,VT_DISPATCH,&pDispatchFormFieldRange)!=S_OK||!pDispatchFormFieldRange) {
 			break;
 		}
-		if(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INRANGE,DISPATCH_METHOD,VT_BOOL,&foundFormField,L"\x0009",pDispatchFormFieldRange)!=S_OK||!foundFormField) {
+		if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INRANGE,DISPATCH_METHOD,VT_BOOL,&foundFormField,L"\x0009",pDispatchFormFieldRange)!=S_OK||!foundFormField) {
 			continue;
 		}
 		long fieldType=-1;
-		_com_dispatch_raw_propget(pDispatchFormField,wdDISPID_FORMFIELD_TYPE,VT_I4,&fieldType);
+		WinWord::propGet(pDispatchFormField,wdDISPID_FORMFIELD_TYPE,VT_I4,&fieldType);
 		BSTR fieldResult=NULL;
-		_com_dispatch_raw_propget(pDispatchFormField,wdDISPID_FORMFIELD_RESULT,VT_BSTR,&fieldResult);
+		WinWord::propGet(pDispatchFormField,wdDISPID_FORMFIELD_RESULT,VT_BSTR,&fieldResult);
 		BSTR fieldStatusText=NULL;
-		_com_dispatch_raw_propget(pDispatchFormField,wdDISPID_FORMFIELD_STATUSTEXT,VT_BSTR,&fieldStatusText);
+		WinWord::propGet(pDispatchFormField,wdDISPID_FORMFIELD_STATUSTEXT,VT_BSTR,&fieldStatusText);
 		XMLStream<<L"<control wdFieldType=\""<<fieldType<<L"\" wdFieldResult=\""<<(fieldResult?fieldResult:L"")<<L"\" wdFieldStatusText=\""<<(fieldStatusText?fieldStatusText:L"")<<L"\">";
 		if(fieldResult) SysFreeString(fieldResult);
 		if(fieldStatusText) SysFreeString(fieldStatusText);
-		_com_dispatch_raw_propget(pDispatchFormFieldRange,wdDISPID_RANGE_END,VT_I4,&chunkEnd);
-		_com_dispatch_raw_propput(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEnd);
+		WinWord::propGet(pDispatchFormFieldRange,wdDISPID_RANGE_END,VT_I4,&chunkEnd);
+		WinWord::propPut(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEnd);
 		break;
 	}
 	if(foundFormField) return true;
 	IDispatchPtr pDispatchContentControls=NULL;
-	_com_dispatch_raw_propget(pDispatchRange2,wdDISPID_RANGE_CONTENTCONTROLS,VT_DISPATCH,&pDispatchContentControls);
+	WinWord::propGet(pDispatchRange2,wdDISPID_RANGE_CONTENTCONTROLS,VT_DISPATCH,&pDispatchContentControls);
 	if(pDispatchContentControls)for(int count=1;!foundFormField&&count<100;++count) {
 		IDispatchPtr pDispatchContentControl=NULL;
-		if(_com_dispatch_raw_method(pDispatchContentControls,wdDISPID_CONTENTCONTROLS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchContentControl,L"\x0003",count)!=S_OK||!pDispatchContentControl) {
+		if(WinWord::callMethod(pDispatchContentControls,wdDISPID_CONTENTCONTROLS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchContentControl,L"\x0003",count)!=S_OK||!pDispatchContentControl) {
 			break;
 		}
 		IDispatchPtr pDispatchContentControlRange=NULL;
-		if(_com_dispatch_raw_propget(pDispatchContentControl,wdDISPID_CONTENTCONTROL_RANGE,VT_DISPATCH,&pDispatchContentControlRange)!=S_OK||!pDispatchContentControlRange) {
+		if(WinWord::propGet(pDispatchContentControl,wdDISPID_CONTENTCONTROL_RANGE,VT_DISPATCH,&pDispatchContentControlRange)!=S_OK||!pDispatchContentControlRange) {
 			break;
 		}
-		if(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INRANGE,DISPATCH_METHOD,VT_BOOL,&foundFormField,L"\x0009",pDispatchContentControlRange)!=S_OK||!foundFormField) {
+		if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INRANGE,DISPATCH_METHOD,VT_BOOL,&foundFormField,L"\x0009",pDispatchContentControlRange)!=S_OK||!foundFormField) {
 			continue;
 		}
 		long fieldType=-1;
-		_com_dispatch_raw_propget(pDispatchContentControl,wdDISPID_CONTENTCONTROL_TYPE,VT_I4,&fieldType);
+		WinWord::propGet(pDispatchContentControl,wdDISPID_CONTENTCONTROL_TYPE,VT_I4,&fieldType);
 		BOOL fieldChecked=false;
-		_com_dispatch_raw_propget(pDispatchContentControl,wdDISPID_CONTENTCONTROL_CHECKED,VT_BOOL,&fieldChecked);
+		WinWord::propGet(pDispatchContentControl,wdDISPID_CONTENTCONTROL_CHECKED,VT_BOOL,&fieldChecked);
 		BSTR fieldTitle=NULL;
-		_com_dispatch_raw_propget(pDispatchContentControl,wdDISPID_CONTENTCONTROL_TITLE,VT_BSTR,&fieldTitle);
+		WinWord::propGet(pDispatchContentControl,wdDISPID_CONTENTCONTROL_TITLE,VT_BSTR,&fieldTitle);
 		XMLStream<<L"<control wdContentControlType=\""<<fieldType<<L"\" wdContentControlChecked=\""<<fieldChecked<<L"\" wdContentControlTitle=\""<<(fieldTitle?fieldTitle:L"")<<L"\">";
 		if(fieldTitle) SysFreeString(fieldTitle);
-		_com_dispatch_raw_propget(pDispatchContentControlRange,wdDISPID_RANGE_END,VT_I4,&chunkEnd);
-		_com_dispatch_raw_propput(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEnd);
+		WinWord::propGet(pDispatchContentControlRange,wdDISPID_RANGE_END,VT_I4,&chunkEnd);
+		WinWord::propPut(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEnd);
 		break;
 	}
 	return foundFormField;
@@ -192,32 +242,33 @@ BOOL generateFormFieldXML(IDispatch* pDispatchRange, IDispatchPtr pDispatchRange
 
 bool collectSpellingErrorOffsets(IDispatchPtr pDispatchRange, vector<pair<long,long>>& errorVector) {
 	IDispatchPtr pDispatchApplication=NULL;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_APPLICATION ,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_APPLICATION ,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
 		return false;
 	}
 	BOOL isSandbox = false;
 	// Don't go on if this is sandboxed as collecting spelling errors crashes word
-	_com_dispatch_raw_propget(pDispatchApplication,wdDISPID_APPLICATION_ISSANDBOX ,VT_BOOL,&isSandbox);
+	// IsSandbox, like table and shape titles, only exists in Word 2010 and later, so is looked up by name.
+	WinWord::propGet(pDispatchApplication,L"Application",L"IsSandbox",VT_BOOL,&isSandbox);
 	if(isSandbox ) {
 		return false;
 	}
 	IDispatchPtr pDispatchSpellingErrors=NULL;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_SPELLINGERRORS,VT_DISPATCH,&pDispatchSpellingErrors)!=S_OK||!pDispatchSpellingErrors) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_SPELLINGERRORS,VT_DISPATCH,&pDispatchSpellingErrors)!=S_OK||!pDispatchSpellingErrors) {
 		return false;
 	}
 	long iVal=0;
-	_com_dispatch_raw_propget(pDispatchSpellingErrors,wdDISPID_SPELLINGERRORS_COUNT,VT_I4,&iVal);
+	WinWord::propGet(pDispatchSpellingErrors,wdDISPID_SPELLINGERRORS_COUNT,VT_I4,&iVal);
 	for(int i=1;i<=iVal;++i) {
 		IDispatchPtr pDispatchErrorRange=NULL;
-		if(_com_dispatch_raw_method(pDispatchSpellingErrors,wdDISPID_SPELLINGERRORS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchErrorRange,L"\x0003",i)!=S_OK||!pDispatchErrorRange) {
+		if(WinWord::callMethod(pDispatchSpellingErrors,wdDISPID_SPELLINGERRORS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchErrorRange,L"\x0003",i)!=S_OK||!pDispatchErrorRange) {
 			return false;
 		}
 		long start=0;
-		if(_com_dispatch_raw_propget(pDispatchErrorRange,wdDISPID_RANGE_START,VT_I4,&start)!=S_OK) {
+		if(WinWord::propGet(pDispatchErrorRange,wdDISPID_RANGE_START,VT_I4,&start)!=S_OK) {
 			return false;
 		}
 		long end=0;
-		if(_com_dispatch_raw_propget(pDispatchErrorRange,wdDISPID_RANGE_END,VT_I4,&end)!=S_OK) {
+		if(WinWord::propGet(pDispatchErrorRange,wdDISPID_RANGE_END,VT_I4,&end)!=S_OK) {
 			return false;
 		}
 		errorVector.push_back(make_pair(start,end));
@@ -231,11 +282,11 @@ vector<wstring> headingStyleNames;
 int getHeadingLevelFromParagraph(IDispatch* pDispatchParagraph) {
 	IDispatchPtr pDispatchStyle=NULL;
 	// fetch the localized style name for the given paragraph
-	if(_com_dispatch_raw_propget(pDispatchParagraph,wdDISPID_PARAGRAPH_STYLE,VT_DISPATCH,&pDispatchStyle)!=S_OK||!pDispatchStyle) {
+	if(WinWord::propGet(pDispatchParagraph,wdDISPID_PARAGRAPH_STYLE,VT_DISPATCH,&pDispatchStyle)!=S_OK||!pDispatchStyle) {
 		return 0;
 	}
 	BSTR nameLocal=NULL;
-	_com_dispatch_raw_propget(pDispatchStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&nameLocal);
+	WinWord::propGet(pDispatchStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&nameLocal);
 	if(!nameLocal) {
 		return 0;
 	}
@@ -243,13 +294,13 @@ int getHeadingLevelFromParagraph(IDispatch* pDispatchParagraph) {
 	if(headingStyleNames.empty()) {
 		IDispatchPtr pDispatchDocument=NULL;
 		IDispatchPtr pDispatchStyles=NULL;
-		if(_com_dispatch_raw_propget(pDispatchStyle,wdDISPID_STYLE_PARENT,VT_DISPATCH,&pDispatchDocument)==S_OK&&pDispatchDocument&&_com_dispatch_raw_propget(pDispatchDocument,wdDISPID_DOCUMENT_STYLES,VT_DISPATCH,&pDispatchStyles)==S_OK&&pDispatchStyles) {
+		if(WinWord::propGet(pDispatchStyle,wdDISPID_STYLE_PARENT,VT_DISPATCH,&pDispatchDocument)==S_OK&&pDispatchDocument&&WinWord::propGet(pDispatchDocument,wdDISPID_DOCUMENT_STYLES,VT_DISPATCH,&pDispatchStyles)==S_OK&&pDispatchStyles) {
 			for(int i=-2;i>=-10;--i) {
 				IDispatchPtr pDispatchBuiltinStyle=NULL;
-				_com_dispatch_raw_method(pDispatchStyles,wdDISPID_STYLES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchBuiltinStyle,L"\x0003",i);
+				WinWord::callMethod(pDispatchStyles,wdDISPID_STYLES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchBuiltinStyle,L"\x0003",i);
 				if(pDispatchBuiltinStyle) {
 					BSTR builtinNameLocal=NULL;
-					_com_dispatch_raw_propget(pDispatchBuiltinStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&builtinNameLocal);
+					WinWord::propGet(pDispatchBuiltinStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&builtinNameLocal);
 					if(!builtinNameLocal) continue;
 					headingStyleNames.push_back(builtinNameLocal);
 					SysFreeString(builtinNameLocal);
@@ -277,10 +328,10 @@ int generateHeadingXML(IDispatch* pDispatchParagraph, IDispatch* pDispatchParagr
 	XMLStream<<L"<control role=\"heading\" level=\""<<headingLevel<<L"\" ";
 	if(pDispatchParagraphRange) {
 		long iVal=0;
-		if(_com_dispatch_raw_propget(pDispatchParagraphRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal>=startOffset) {
+		if(WinWord::propGet(pDispatchParagraphRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal>=startOffset) {
 			XMLStream<<L"_startOfNode=\"1\" ";
 		}
-		if(_com_dispatch_raw_propget(pDispatchParagraphRange,wdDISPID_RANGE_END,VT_I4,&iVal)==S_OK&&iVal<=endOffset) {
+		if(WinWord::propGet(pDispatchParagraphRange,wdDISPID_RANGE_END,VT_I4,&iVal)==S_OK&&iVal<=endOffset) {
 			XMLStream<<L"_endOfNode=\"1\" ";
 		}
 	}
@@ -291,30 +342,30 @@ int generateHeadingXML(IDispatch* pDispatchParagraph, IDispatch* pDispatchParagr
 int getRevisionType(IDispatch* pDispatchOrigRange) {
 	IDispatchPtr pDispatchRange=NULL;
 	//If range is not duplicated here, revisions collection represents revisions at the start of the range when it was first created
-	if(_com_dispatch_raw_propget(pDispatchOrigRange,wdDISPID_RANGE_DUPLICATE,VT_DISPATCH,&pDispatchRange)!=S_OK||!pDispatchRange) {
+	if(WinWord::propGet(pDispatchOrigRange,wdDISPID_RANGE_DUPLICATE,VT_DISPATCH,&pDispatchRange)!=S_OK||!pDispatchRange) {
 		return 0;
 	}
 	IDispatchPtr pDispatchRevisions=NULL;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_REVISIONS,VT_DISPATCH,&pDispatchRevisions)!=S_OK||!pDispatchRevisions) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_REVISIONS,VT_DISPATCH,&pDispatchRevisions)!=S_OK||!pDispatchRevisions) {
 		return 0;
 	}
 	IDispatchPtr pDispatchRevision=NULL;
-	if(_com_dispatch_raw_method(pDispatchRevisions,wdDISPID_REVISIONS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchRevision,L"\x0003",1)!=S_OK||!pDispatchRevision) {
+	if(WinWord::callMethod(pDispatchRevisions,wdDISPID_REVISIONS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchRevision,L"\x0003",1)!=S_OK||!pDispatchRevision) {
 		return 0;
 	}
 	long revisionType=0;
-	_com_dispatch_raw_propget(pDispatchRevision,wdDISPID_REVISION_TYPE,VT_I4,&revisionType);
+	WinWord::propGet(pDispatchRevision,wdDISPID_REVISION_TYPE,VT_I4,&revisionType);
 	return revisionType;
 }
 
 IDispatchPtr CreateExpandedDuplicate(IDispatch* pDispatchRange, const int expandTo) {
 	IDispatchPtr pDispatchRangeDup = nullptr;
-	auto res = _com_dispatch_raw_propget( pDispatchRange, wdDISPID_RANGE_DUPLICATE, VT_DISPATCH, &pDispatchRangeDup);
+	auto res = WinWord::propGet( pDispatchRange, wdDISPID_RANGE_DUPLICATE, VT_DISPATCH, &pDispatchRangeDup);
 	if( res != S_OK || !pDispatchRangeDup ) {
 		LOG_DEBUGWARNING(L"error duplicating the range.");
 	}
 	else {
-		res = _com_dispatch_raw_method( pDispatchRangeDup, wdDISPID_RANGE_EXPAND,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003", expandTo);
+		res = WinWord::callMethod( pDispatchRangeDup, wdDISPID_RANGE_EXPAND,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003", expandTo);
 		if( res != S_OK || !pDispatchRangeDup ) {
 			LOG_DEBUGWARNING(L"error expanding the range");
 		}
@@ -324,26 +375,26 @@ IDispatchPtr CreateExpandedDuplicate(IDispatch* pDispatchRange, const int expand
 
 bool collectCommentOffsets(IDispatchPtr pDispatchRange, vector<pair<long,long>>& commentVector) {
 	IDispatchPtr pDispatchComments=NULL;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_COMMENTS,VT_DISPATCH,&pDispatchComments)!=S_OK||!pDispatchComments) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_COMMENTS,VT_DISPATCH,&pDispatchComments)!=S_OK||!pDispatchComments) {
 		return false;
 	}
 	long iVal=0;
-	_com_dispatch_raw_propget(pDispatchComments,wdDISPID_COMMENTS_COUNT,VT_I4,&iVal);
+	WinWord::propGet(pDispatchComments,wdDISPID_COMMENTS_COUNT,VT_I4,&iVal);
 	for(int i=1;i<=iVal;++i) {
 		IDispatchPtr pDispatchComment=NULL;
-		if(_com_dispatch_raw_method(pDispatchComments,wdDISPID_COMMENTS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchComment,L"\x0003",i)!=S_OK||!pDispatchComment) {
+		if(WinWord::callMethod(pDispatchComments,wdDISPID_COMMENTS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchComment,L"\x0003",i)!=S_OK||!pDispatchComment) {
 			return false;
 		}
 		IDispatchPtr pDispatchCommentScope=NULL;
-		if(_com_dispatch_raw_propget(pDispatchComment,wdDISPID_COMMENT_SCOPE,VT_DISPATCH,&pDispatchCommentScope)!=S_OK||!pDispatchCommentScope) {
+		if(WinWord::propGet(pDispatchComment,wdDISPID_COMMENT_SCOPE,VT_DISPATCH,&pDispatchCommentScope)!=S_OK||!pDispatchCommentScope) {
 			return false;
 		}
 		long start=0;
-		if(_com_dispatch_raw_propget(pDispatchCommentScope,wdDISPID_RANGE_START,VT_I4,&start)!=S_OK) {
+		if(WinWord::propGet(pDispatchCommentScope,wdDISPID_RANGE_START,VT_I4,&start)!=S_OK) {
 			return false;
 		}
 		long end=0;
-		if(_com_dispatch_raw_propget(pDispatchCommentScope,wdDISPID_RANGE_END,VT_I4,&end)!=S_OK) {
+		if(WinWord::propGet(pDispatchCommentScope,wdDISPID_RANGE_END,VT_I4,&end)!=S_OK) {
 			return false;
 		}
 		commentVector.push_back(make_pair(start,end));
@@ -351,112 +402,171 @@ bool collectCommentOffsets(IDispatchPtr pDispatchRange, vector<pair<long,long>>&
 	return !commentVector.empty();
 }
 
-bool fetchTableInfo(IDispatch* pDispatchTable, bool includeLayoutTables, int* rowCount, int* columnCount, int* nestingLevel) {
+/**
+ * Fetches the table info for the given table, from the cache if possible, otherwise from Word, caching the result.
+ */
+void fetchTableInfo(IDispatch* pDispatchTable, WinWord::TableCache& tableCache, WinWord::TableInfo& tableInfo) {
+	tableInfo.startOffset=-1;
+	tableInfo.endOffset=-1;
+	IDispatchPtr pDispatchTableRange=NULL;
+	if(WinWord::propGet(pDispatchTable,wdDISPID_TABLE_RANGE,VT_DISPATCH,&pDispatchTableRange)==S_OK&&pDispatchTableRange) {
+		WinWord::getIntProperties(pDispatchTableRange,{{wdDISPID_RANGE_START,&tableInfo.startOffset},{wdDISPID_RANGE_END,&tableInfo.endOffset}});
+	}
+	const bool haveRange=(tableInfo.startOffset>=0&&tableInfo.endOffset>=0);
+	if(haveRange) {
+		const WinWord::TableInfo* cachedTableInfo=tableCache.getTable(tableInfo.startOffset,tableInfo.endOffset);
+		if(cachedTableInfo) {
+			tableInfo=*cachedTableInfo;
+			return;
+		}
+	}
+	tableInfo.rowCount=0;
+	tableInfo.columnCount=0;
+	tableInfo.nestingLevel=0;
+	tableInfo.bordersEnabled=true;
+	tableInfo.hasDescription=false;
 	IDispatchPtr pDispatchRows=NULL;
 	IDispatchPtr pDispatchColumns=NULL;
 	IDispatchPtr pDispatchBorders=NULL;
-	if(!includeLayoutTables&&_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_BORDERS,VT_DISPATCH,&pDispatchBorders)==S_OK&&pDispatchBorders) {
+	if(WinWord::propGet(pDispatchTable,wdDISPID_TABLE_BORDERS,VT_DISPATCH,&pDispatchBorders)==S_OK&&pDispatchBorders) {
 		BOOL isEnabled=true;
-		if(_com_dispatch_raw_propget(pDispatchBorders,wdDISPID_BORDERS_ENABLE,VT_BOOL,&isEnabled)==S_OK&&!isEnabled) {
-			return false;
+		if(WinWord::propGet(pDispatchBorders,wdDISPID_BORDERS_ENABLE,VT_BOOL,&isEnabled)==S_OK&&!isEnabled) {
+			tableInfo.bordersEnabled=false;
 		}
 	}
-	if(_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_ROWS,VT_DISPATCH,&pDispatchRows)==S_OK&&pDispatchRows) {
-		_com_dispatch_raw_propget(pDispatchRows,wdDISPID_ROWS_COUNT,VT_I4,rowCount);
+	if(WinWord::propGet(pDispatchTable,wdDISPID_TABLE_ROWS,VT_DISPATCH,&pDispatchRows)==S_OK&&pDispatchRows) {
+		WinWord::propGet(pDispatchRows,wdDISPID_ROWS_COUNT,VT_I4,&tableInfo.rowCount);
 	}
-	if(_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_COLUMNS,VT_DISPATCH,&pDispatchColumns)==S_OK&&pDispatchColumns) {
-		_com_dispatch_raw_propget(pDispatchColumns,wdDISPID_COLUMNS_COUNT,VT_I4,columnCount);
+	if(WinWord::propGet(pDispatchTable,wdDISPID_TABLE_COLUMNS,VT_DISPATCH,&pDispatchColumns)==S_OK&&pDispatchColumns) {
+		WinWord::propGet(pDispatchColumns,wdDISPID_COLUMNS_COUNT,VT_I4,&tableInfo.columnCount);
 	}
-	_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_NESTINGLEVEL,VT_I4,nestingLevel);
-	return true;
+	WinWord::propGet(pDispatchTable,wdDISPID_TABLE_NESTINGLEVEL,VT_I4,&tableInfo.nestingLevel);
+	BSTR altText=NULL;
+	if(WinWord::propGet(pDispatchTable,L"Table",L"Title",VT_BSTR,&altText)==S_OK&&altText) {
+		for(int i=0;altText[i]!='\0';++i) {
+			appendCharToXML(altText[i],tableInfo.name,true);
+		}
+		SysFreeString(altText);
+	}
+	altText=NULL;
+	if(WinWord::propGet(pDispatchTable,L"Table",L"Descr",VT_BSTR,&altText)==S_OK&&altText) {
+		for(int i=0;altText[i]!='\0';++i) {
+			appendCharToXML(altText[i],tableInfo.description,true);
+		}
+		tableInfo.hasDescription=true;
+		SysFreeString(altText);
+	}
+	if(haveRange) {
+		tableCache.addTable(tableInfo);
+	}
+}
+
+/**
+ * Checks whether the text of a cell contains any end of cell marks other than its own, I.e. it contains a nested table.
+ */
+bool cellContainsNestedTable(IDispatch* pDispatchCellRange) {
+	BSTR text=NULL;
+	if(WinWord::propGet(pDispatchCellRange,wdDISPID_RANGE_TEXT,VT_BSTR,&text)!=S_OK||!text) {
+		// Can't tell, so be safe
+		return true;
+	}
+	bool res=false;
+	const int textLength=SysStringLen(text);
+	for(int i=0;i<(textLength-1);++i) {
+		if(text[i]==L'\x0007') {
+			res=true;
+			break;
+		}
+	}
+	SysFreeString(text);
+	return res;
 }
 
-int generateTableXML(IDispatch* pDispatchRange, bool includeLayoutTables, int startOffset, int endOffset, wostringstream& XMLStream) {
+int generateTableXML(IDispatch* pDispatchRange, WinWord::TableCache& tableCache, bool includeLayoutTables, int startOffset, int endOffset, wostringstream& XMLStream) {
 	int numTags=0;
 	int iVal=0;
-	IDispatchPtr pDispatchTables=NULL;
-	IDispatchPtr pDispatchTable=NULL;
 	bool inTableCell=false;
-	int rowCount=0;
-	int columnCount=0;
-	int nestingLevel=0;
+	WinWord::TableInfo tableInfo;
 	int rowNumber=0;
 	int columnNumber=0;
-	bool startOfCell=false;
-	bool endOfCell=false;
-	if(
-		_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_TABLES,VT_DISPATCH,&pDispatchTables)!=S_OK||!pDispatchTables\
-		||_com_dispatch_raw_method(pDispatchTables,wdDISPID_TABLES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchTable,L"\x0003",1)!=S_OK||!pDispatchTable\
-		||!fetchTableInfo(pDispatchTable,includeLayoutTables,&rowCount,&columnCount,&nestingLevel)\
-	) {
-		return 0;
-	}
-	IDispatchPtr pDispatchCells=NULL;
-	IDispatchPtr pDispatchCell=NULL;
-	if(
-		_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_CELLS,VT_DISPATCH,&pDispatchCells)==S_OK&&pDispatchCells\
-		&&_com_dispatch_raw_method(pDispatchCells,wdDISPID_CELLS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchCell,L"\x0003",1)==S_OK&&pDispatchCell\
-	) {
-		_com_dispatch_raw_propget(pDispatchCell,wdDISPID_CELL_ROWINDEX,VT_I4,&rowNumber);
-		_com_dispatch_raw_propget(pDispatchCell,wdDISPID_CELL_COLUMNINDEX,VT_I4,&columnNumber);
-		IDispatchPtr pDispatchCellRange=NULL;
-		if(_com_dispatch_raw_propget(pDispatchCell,wdDISPID_CELL_RANGE,VT_DISPATCH,&pDispatchCellRange)==S_OK&&pDispatchCellRange) {
-			if(_com_dispatch_raw_propget(pDispatchCellRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal>=startOffset) {
-				startOfCell=true;
-			}
-			if(_com_dispatch_raw_propget(pDispatchCellRange,wdDISPID_RANGE_END,VT_I4,&iVal)==S_OK&&iVal<=endOffset) {
-				endOfCell=true;
-			}
+	int cellStartOffset=-1;
+	int cellEndOffset=-1;
+	// Moving with in a table usually lands in a cell we have already seen, in which case Word need not be asked anything.
+	const WinWord::TableCellInfo* cachedCellInfo=tableCache.getCellAtOffset(startOffset);
+	const WinWord::TableInfo* cachedTableInfo=cachedCellInfo?tableCache.getTable(cachedCellInfo->tableStartOffset,cachedCellInfo->tableEndOffset):NULL;
+	if(cachedTableInfo) {
+		tableInfo=*cachedTableInfo;
+		if(!includeLayoutTables&&!tableInfo.bordersEnabled) {
+			return 0;
 		}
+		rowNumber=cachedCellInfo->rowNumber;
+		columnNumber=cachedCellInfo->columnNumber;
+		cellStartOffset=cachedCellInfo->startOffset;
+		cellEndOffset=cachedCellInfo->endOffset;
 		inTableCell=true;
 	} else {
-		if((_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&rowNumber,L"\x0003",wdStartOfRangeRowNumber)==S_OK)&&rowNumber>0) {
-			inTableCell=true;
+		IDispatchPtr pDispatchTables=NULL;
+		IDispatchPtr pDispatchTable=NULL;
+		if(
+			WinWord::propGet(pDispatchRange,wdDISPID_RANGE_TABLES,VT_DISPATCH,&pDispatchTables)!=S_OK||!pDispatchTables\
+			||WinWord::callMethod(pDispatchTables,wdDISPID_TABLES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchTable,L"\x0003",1)!=S_OK||!pDispatchTable\
+		) {
+			return 0;
+		}
+		fetchTableInfo(pDispatchTable,tableCache,tableInfo);
+		if(!includeLayoutTables&&!tableInfo.bordersEnabled) {
+			return 0;
 		}
-		if((_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&columnNumber,L"\x0003",wdStartOfRangeColumnNumber)==S_OK)&&columnNumber>0) {
+		IDispatchPtr pDispatchCells=NULL;
+		IDispatchPtr pDispatchCell=NULL;
+		if(
+			WinWord::propGet(pDispatchRange,wdDISPID_RANGE_CELLS,VT_DISPATCH,&pDispatchCells)==S_OK&&pDispatchCells\
+			&&WinWord::callMethod(pDispatchCells,wdDISPID_CELLS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchCell,L"\x0003",1)==S_OK&&pDispatchCell\
+		) {
+			WinWord::propGet(pDispatchCell,wdDISPID_CELL_ROWINDEX,VT_I4,&rowNumber);
+			WinWord::propGet(pDispatchCell,wdDISPID_CELL_COLUMNINDEX,VT_I4,&columnNumber);
+			IDispatchPtr pDispatchCellRange=NULL;
+			if(WinWord::propGet(pDispatchCell,wdDISPID_CELL_RANGE,VT_DISPATCH,&pDispatchCellRange)==S_OK&&pDispatchCellRange) {
+				WinWord::getIntProperties(pDispatchCellRange,{{wdDISPID_RANGE_START,&cellStartOffset},{wdDISPID_RANGE_END,&cellEndOffset}});
+				// A cell containing a nested table can't be cached, as offsets with in the nested table belong to the nested table's cells.
+				if(tableInfo.startOffset>=0&&cellStartOffset>=0&&cellEndOffset>cellStartOffset&&!cellContainsNestedTable(pDispatchCellRange)) {
+					WinWord::TableCellInfo cellInfo={cellStartOffset,cellEndOffset,rowNumber,columnNumber,tableInfo.startOffset,tableInfo.endOffset};
+					tableCache.addCell(cellInfo);
+				}
+			}
 			inTableCell=true;
+		} else {
+			if((WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&rowNumber,L"\x0003",wdStartOfRangeRowNumber)==S_OK)&&rowNumber>0) {
+				inTableCell=true;
+			}
+			if((WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&columnNumber,L"\x0003",wdStartOfRangeColumnNumber)==S_OK)&&columnNumber>0) {
+				inTableCell=true;
+			}
 		}
 	}
 	if(!inTableCell) return numTags;
 	numTags+=2;
-	XMLStream<<L"<control role=\"table\" table-id=\"1\" table-rowcount=\""<<rowCount<<L"\" table-columncount=\""<<columnCount<<L"\" level=\""<<nestingLevel<<L"\" ";
-	wstring altTextStr=L"";
-	BSTR altText=NULL;
-	if(_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_TITLE,VT_BSTR,&altText)==S_OK&&altText) {
-		for(int i=0;altText[i]!='\0';++i) {
-			appendCharToXML(altText[i],altTextStr,true);
-		}
-		SysFreeString(altText);
+	XMLStream<<L"<control role=\"table\" table-id=\"1\" table-rowcount=\""<<tableInfo.rowCount<<L"\" table-columncount=\""<<tableInfo.columnCount<<L"\" level=\""<<tableInfo.nestingLevel<<L"\" ";
+	if(!tableInfo.name.empty()) {
+		XMLStream<<L"alwaysReportName=\"1\" name=\""<<tableInfo.name<<L"\" ";
 	}
-	if(!altTextStr.empty()) {
-		XMLStream<<L"alwaysReportName=\"1\" name=\""<<altTextStr<<L"\" ";
-		altTextStr=L"";
+	if(tableInfo.hasDescription) {
+		XMLStream<<L"longdescription=\""<<tableInfo.description<<L"\" ";
 	}
-	altText=NULL;
-	if(_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_DESCR,VT_BSTR,&altText)==S_OK&&altText) {
-		for(int i=0;altText[i]!='\0';++i) {
-			appendCharToXML(altText[i],altTextStr,true);
-		}
-		XMLStream<<L"longdescription=\""<<altTextStr<<L"\" ";
-		SysFreeString(altText);
+	if(tableInfo.startOffset>=0&&tableInfo.startOffset>=startOffset) {
+		XMLStream<<L"_startOfNode=\"1\" ";
 	}
-	IDispatchPtr pDispatchTableRange=NULL;
-	if(_com_dispatch_raw_propget(pDispatchTable,wdDISPID_TABLE_RANGE,VT_DISPATCH,&pDispatchTableRange)==S_OK&&pDispatchTableRange) {
-		if(_com_dispatch_raw_propget(pDispatchTableRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal>=startOffset) {
-			XMLStream<<L"_startOfNode=\"1\" ";
-		}
-		if(_com_dispatch_raw_propget(pDispatchTableRange,wdDISPID_RANGE_END,VT_I4,&iVal)==S_OK&&iVal<=endOffset) {
-			XMLStream<<L"_endOfNode=\"1\" ";
-		}
+	if(tableInfo.endOffset>=0&&tableInfo.endOffset<=endOffset) {
+		XMLStream<<L"_endOfNode=\"1\" ";
 	}
 	XMLStream<<L">";
 	XMLStream<<L"<control role=\"tableCell\" table-id=\"1\" ";
 	XMLStream<<L"table-rownumber=\""<<rowNumber<<L"\" ";
 	XMLStream<<L"table-columnnumber=\""<<columnNumber<<L"\" ";
-	if(startOfCell) {
+	if(cellStartOffset>=0&&cellStartOffset>=startOffset) {
 		XMLStream<<L"_startOfNode=\"1\" ";
 	}
-	if(endOfCell) {
+	if(cellEndOffset>=0&&cellEndOffset<=endOffset) {
 		XMLStream<<L"_endOfNode=\"1\" ";
 	}
 	XMLStream<<L">";
@@ -465,17 +575,17 @@ int generateTableXML(IDispatch* pDispatchRange, bool includeLayoutTables, int st
 
 void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset, int endOffset, int formatConfig, wostringstream& formatAttribsStream) {
 	int iVal=0;
-	if((formatConfig&formatConfig_reportPage)&&(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&iVal,L"\x0003",wdActiveEndAdjustedPageNumber)==S_OK)&&iVal>0) {
+	if((formatConfig&formatConfig_reportPage)&&(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&iVal,L"\x0003",wdActiveEndAdjustedPageNumber)==S_OK)&&iVal>0) {
 		formatAttribsStream<<L"page-number=\""<<iVal<<L"\" ";
 	}
-	if((formatConfig&formatConfig_reportLineNumber)&&(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&iVal,L"\x0003",wdFirstCharacterLineNumber)==S_OK)) {
+	if((formatConfig&formatConfig_reportLineNumber)&&(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_INFORMATION,DISPATCH_PROPERTYGET,VT_I4,&iVal,L"\x0003",wdFirstCharacterLineNumber)==S_OK)) {
 		formatAttribsStream<<L"line-number=\""<<iVal<<L"\" ";
 	}
 	if((formatConfig&formatConfig_reportAlignment)||(formatConfig&formatConfig_reportParagraphIndentation)||(formatConfig&formatConfig_reportLineSpacing)) {
 		IDispatchPtr pDispatchParagraphFormat=NULL;
-		if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_PARAGRAPHFORMAT,VT_DISPATCH,&pDispatchParagraphFormat)==S_OK&&pDispatchParagraphFormat) {
+		if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_PARAGRAPHFORMAT,VT_DISPATCH,&pDispatchParagraphFormat)==S_OK&&pDispatchParagraphFormat) {
 			if(formatConfig&formatConfig_reportAlignment) {
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_ALIGNMENT,VT_I4,&iVal)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_ALIGNMENT,VT_I4,&iVal)==S_OK) {
 					switch(iVal) {
 						case wdAlignParagraphLeft:
 						formatAttribsStream<<L"text-align=\"left\" ";
@@ -494,27 +604,27 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 			}
 			float fVal=0.0;
 			if(formatConfig&formatConfig_reportParagraphIndentation) {
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_RIGHTINDENT,VT_R4,&fVal)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_RIGHTINDENT,VT_R4,&fVal)==S_OK) {
 					formatAttribsStream<<L"right-indent=\"" << fVal <<L"\" ";
 				}
 				float firstLineIndent=0;
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_FIRSTLINEINDENT,VT_R4,&firstLineIndent)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_FIRSTLINEINDENT,VT_R4,&firstLineIndent)==S_OK) {
 					if(firstLineIndent<0) {
 						formatAttribsStream<<L"hanging-indent=\"" << (0-firstLineIndent) <<L"\" ";
 					} else {
 						formatAttribsStream<<L"first-line-indent=\"" << firstLineIndent <<L"\" ";
 					}
 				}
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LEFTINDENT,VT_R4,&fVal)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LEFTINDENT,VT_R4,&fVal)==S_OK) {
 					if(firstLineIndent<0) fVal+=firstLineIndent;
 					formatAttribsStream<<L"left-indent=\"" << fVal <<L"\" ";
 				}
 			}
 			if(formatConfig&formatConfig_reportLineSpacing) {
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LINESPACINGRULE,VT_I4,&iVal)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LINESPACINGRULE,VT_I4,&iVal)==S_OK) {
 					formatAttribsStream<<L"wdLineSpacingRule=\"" << iVal <<L"\" ";
 				}
-				if(_com_dispatch_raw_propget(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LINESPACING,VT_R4,&fVal)==S_OK) {
+				if(WinWord::propGet(pDispatchParagraphFormat,wdDISPID_PARAGRAPHFORMAT_LINESPACING,VT_R4,&fVal)==S_OK) {
 					formatAttribsStream<<L"wdLineSpacing=\"" << fVal <<L"\" ";
 				}
 			}
@@ -522,18 +632,18 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 	}
 	if(formatConfig&formatConfig_reportLists) {
 		IDispatchPtr pDispatchListFormat=NULL;
-		if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_LISTFORMAT,VT_DISPATCH,&pDispatchListFormat)==S_OK&&pDispatchListFormat) {
+		if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_LISTFORMAT,VT_DISPATCH,&pDispatchListFormat)==S_OK&&pDispatchListFormat) {
 			BSTR listString=NULL;
-			if(_com_dispatch_raw_propget(pDispatchListFormat,wdDISPID_LISTFORMAT_LISTSTRING,VT_BSTR,&listString)==S_OK&&listString) {
+			if(WinWord::propGet(pDispatchListFormat,wdDISPID_LISTFORMAT_LISTSTRING,VT_BSTR,&listString)==S_OK&&listString) {
 				if(SysStringLen(listString)>0) {
 					IDispatchPtr pDispatchParagraphs=NULL;
 					IDispatchPtr pDispatchParagraph=NULL;
 					IDispatchPtr pDispatchParagraphRange=NULL;
 					if(
-						_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_PARAGRAPHS,VT_DISPATCH,&pDispatchParagraphs)==S_OK&&pDispatchParagraphs\
-						&&_com_dispatch_raw_method(pDispatchParagraphs,wdDISPID_PARAGRAPHS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchParagraph,L"\x0003",1)==S_OK&&pDispatchParagraph\
-						&&_com_dispatch_raw_propget(pDispatchParagraph,wdDISPID_PARAGRAPH_RANGE,VT_DISPATCH,&pDispatchParagraphRange)==S_OK&&pDispatchParagraphRange\
-						&&_com_dispatch_raw_propget(pDispatchParagraphRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal==startOffset\
+						WinWord::propGet(pDispatchRange,wdDISPID_RANGE_PARAGRAPHS,VT_DISPATCH,&pDispatchParagraphs)==S_OK&&pDispatchParagraphs\
+						&&WinWord::callMethod(pDispatchParagraphs,wdDISPID_PARAGRAPHS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchParagraph,L"\x0003",1)==S_OK&&pDispatchParagraph\
+						&&WinWord::propGet(pDispatchParagraph,wdDISPID_PARAGRAPH_RANGE,VT_DISPATCH,&pDispatchParagraphRange)==S_OK&&pDispatchParagraphRange\
+						&&WinWord::propGet(pDispatchParagraphRange,wdDISPID_RANGE_START,VT_I4,&iVal)==S_OK&&iVal==startOffset\
 					) {
 						wstring tempText;
 						for(int i=0;listString[i]!=L'\0';++i) {
@@ -552,9 +662,9 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 	}
 	if(formatConfig&formatConfig_reportStyle) {
 		IDispatchPtr pDispatchStyle=NULL;
-		if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_STYLE,VT_DISPATCH,&pDispatchStyle)==S_OK&&pDispatchStyle) {
+		if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_STYLE,VT_DISPATCH,&pDispatchStyle)==S_OK&&pDispatchStyle) {
 			BSTR nameLocal=NULL;
-			_com_dispatch_raw_propget(pDispatchStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&nameLocal);
+			WinWord::propGet(pDispatchStyle,wdDISPID_STYLE_NAMELOCAL,VT_BSTR,&nameLocal);
 			if(nameLocal) {
 				formatAttribsStream<<L"style=\""<<nameLocal<<L"\" ";
 				SysFreeString(nameLocal);
@@ -563,37 +673,37 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 	}
 	if(formatConfig&formatConfig_fontFlags) {
 		IDispatchPtr pDispatchFont=NULL;
-		if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_FONT,VT_DISPATCH,&pDispatchFont)==S_OK&&pDispatchFont) {
+		if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_FONT,VT_DISPATCH,&pDispatchFont)==S_OK&&pDispatchFont) {
 			BSTR fontName=NULL;
-			if((formatConfig&formatConfig_reportFontName)&&(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_NAME,VT_BSTR,&fontName)==S_OK)&&fontName) {
+			if((formatConfig&formatConfig_reportFontName)&&(WinWord::propGet(pDispatchFont,wdDISPID_FONT_NAME,VT_BSTR,&fontName)==S_OK)&&fontName) {
 				formatAttribsStream<<L"font-name=\""<<fontName<<L"\" ";
 				SysFreeString(fontName);
 			}
 			float fVal=0.0;
-			if((formatConfig&formatConfig_reportFontSize)&&(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_SIZE,VT_R4,&fVal)==S_OK)) {
+			if((formatConfig&formatConfig_reportFontSize)&&(WinWord::propGet(pDispatchFont,wdDISPID_FONT_SIZE,VT_R4,&fVal)==S_OK)) {
 				formatAttribsStream<<L"font-size=\""<<fVal<<L"pt\" ";
 			}
-			if((formatConfig&formatConfig_reportColor)&&(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_COLOR,VT_I4,&iVal)==S_OK)) {
+			if((formatConfig&formatConfig_reportColor)&&(WinWord::propGet(pDispatchFont,wdDISPID_FONT_COLOR,VT_I4,&iVal)==S_OK)) {
 				formatAttribsStream<<L"color=\""<<iVal<<L"\" ";
 			}
 			if(formatConfig&formatConfig_reportFontAttributes) {
-				if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_BOLD,VT_I4,&iVal)==S_OK&&iVal) {
+				if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_BOLD,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"bold=\"1\" ";
 				}
-				if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_ITALIC,VT_I4,&iVal)==S_OK&&iVal) {
+				if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_ITALIC,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"italic=\"1\" ";
 				}
-				if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_UNDERLINE,VT_I4,&iVal)==S_OK&&iVal) {
+				if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_UNDERLINE,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"underline=\"1\" ";
 				}
-				if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_SUPERSCRIPT,VT_I4,&iVal)==S_OK&&iVal) {
+				if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_SUPERSCRIPT,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"text-position=\"super\" ";
-				} else if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_SUBSCRIPT,VT_I4,&iVal)==S_OK&&iVal) {
+				} else if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_SUBSCRIPT,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"text-position=\"sub\" ";
 				}
-				if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_STRIKETHROUGH,VT_I4,&iVal)==S_OK&&iVal) {
+				if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_STRIKETHROUGH,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"strikethrough=\"1\" ";
-				} else if(_com_dispatch_raw_propget(pDispatchFont,wdDISPID_FONT_DOUBLESTRIKETHROUGH,VT_I4,&iVal)==S_OK&&iVal) {
+				} else if(WinWord::propGet(pDispatchFont,wdDISPID_FONT_DOUBLESTRIKETHROUGH,VT_I4,&iVal)==S_OK&&iVal) {
 					formatAttribsStream<<L"strikethrough=\"double\" ";
 				}
 			}
@@ -601,7 +711,7 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 	}
 	if (formatConfig&formatConfig_reportLanguage) {
 		int languageId = 0;
-		if (_com_dispatch_raw_propget(pDispatchRange,	wdDISPID_RANGE_LANGUAGEID, VT_I4, &languageId)==S_OK) {
+		if (WinWord::propGet(pDispatchRange,	wdDISPID_RANGE_LANGUAGEID, VT_I4, &languageId)==S_OK) {
 			if (languageId != wdLanguageNone && languageId != wdNoProofing && languageId != wdLanguageUnknown) {
 				formatAttribsStream<<L"wdLanguageId=\""<<languageId<<L"\" ";
 			}
@@ -612,10 +722,10 @@ void generateXMLAttribsForFormatting(IDispatch* pDispatchRange, int startOffset,
 inline int getInlineShapesCount(IDispatch* pDispatchRange) {
 	IDispatchPtr pDispatchShapes=NULL;
 	int count=0;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_INLINESHAPES,VT_DISPATCH,&pDispatchShapes)!=S_OK||!pDispatchShapes) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_INLINESHAPES,VT_DISPATCH,&pDispatchShapes)!=S_OK||!pDispatchShapes) {
 		return 0;
 	}
-	if(_com_dispatch_raw_propget(pDispatchShapes,wdDISPID_INLINESHAPES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
+	if(WinWord::propGet(pDispatchShapes,wdDISPID_INLINESHAPES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
 		return 0;
 	}
 	return count;
@@ -635,27 +745,27 @@ inline int generateInlineShapeXML(IDispatch* pDispatchRange, int offset, wostrin
 	BSTR altText=NULL;
 	BOOL shapeHasChart=false;
 	BOOL chartHasTitle=false;
-	if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_INLINESHAPES,VT_DISPATCH,&pDispatchShapes)!=S_OK||!pDispatchShapes) {
+	if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_INLINESHAPES,VT_DISPATCH,&pDispatchShapes)!=S_OK||!pDispatchShapes) {
 		return 0;
 	}
-	if(_com_dispatch_raw_propget(pDispatchShapes,wdDISPID_INLINESHAPES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
+	if(WinWord::propGet(pDispatchShapes,wdDISPID_INLINESHAPES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
 		return 0;
 	}
-	if(_com_dispatch_raw_method(pDispatchShapes,wdDISPID_INLINESHAPES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchShape,L"\x0003",1)!=S_OK||!pDispatchShape) {
+	if(WinWord::callMethod(pDispatchShapes,wdDISPID_INLINESHAPES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchShape,L"\x0003",1)!=S_OK||!pDispatchShape) {
 		return 0;
 	}
-	if(_com_dispatch_raw_propget(pDispatchShape,wdDISPID_INLINESHAPE_TYPE,VT_I4,&shapeType)!=S_OK) {
+	if(WinWord::propGet(pDispatchShape,wdDISPID_INLINESHAPE_TYPE,VT_I4,&shapeType)!=S_OK) {
 		return 0;
 	}
 	wstring altTextStr=L"";
-	if(_com_dispatch_raw_propget(pDispatchShape,wdDISPID_INLINESHAPE_ALTERNATIVETEXT,VT_BSTR,&altText)==S_OK&&altText) {
+	if(WinWord::propGet(pDispatchShape,wdDISPID_INLINESHAPE_ALTERNATIVETEXT,VT_BSTR,&altText)==S_OK&&altText) {
 		for(int i=0;altText[i]!='\0';++i) {
 			appendCharToXML(altText[i],altTextStr,true);
 		}
 		SysFreeString(altText);
 	}
 	altText=NULL;
-	if(altTextStr.empty()&&_com_dispatch_raw_propget(pDispatchShape,wdDISPID_INLINESHAPE_TITLE,VT_BSTR,&altText)==S_OK&&altText) {
+	if(altTextStr.empty()&&WinWord::propGet(pDispatchShape,L"InlineShape",L"Title",VT_BSTR,&altText)==S_OK&&altText) {
 		for(int i=0;altText[i]!='\0';++i) {
 			appendCharToXML(altText[i],altTextStr,true);
 		}
@@ -666,9 +776,9 @@ inline int generateInlineShapeXML(IDispatch* pDispatchRange, int offset, wostrin
 	if(shapeType==wdInlineShapeEmbeddedOLEObject) {
 		XMLStream<<L" shapeoffset=\""<<offset<<L"\"";
 		IDispatchPtr pOLEFormat=NULL;
-		if(_com_dispatch_raw_propget(pDispatchShape,wdDISPID_INLINESHAPE_OLEFORMAT,VT_DISPATCH,&pOLEFormat)==S_OK) {
+		if(WinWord::propGet(pDispatchShape,wdDISPID_INLINESHAPE_OLEFORMAT,VT_DISPATCH,&pOLEFormat)==S_OK) {
 			BSTR progId=NULL;
-			if(_com_dispatch_raw_propget(pOLEFormat,wdDISPID_OLEFORMAT_PROGID,VT_BSTR,&progId)==S_OK&&progId) {
+			if(WinWord::propGet(pOLEFormat,wdDISPID_OLEFORMAT_PROGID,VT_BSTR,&progId)==S_OK&&progId) {
 				XMLStream<<L" progid=\""<<progId<<"\"";
 				SysFreeString(progId);
 			}
@@ -683,16 +793,16 @@ inline bool generateFootnoteEndnoteXML(IDispatch* pDispatchRange, wostringstream
 	IDispatchPtr pDispatchNote=NULL;
 	int count=0;
 	int index=0;
-	if(_com_dispatch_raw_propget(pDispatchRange,(footnote?wdDISPID_RANGE_FOOTNOTES:wdDISPID_RANGE_ENDNOTES),VT_DISPATCH,&pDispatchNotes)!=S_OK||!pDispatchNotes) {
+	if(WinWord::propGet(pDispatchRange,(footnote?wdDISPID_RANGE_FOOTNOTES:wdDISPID_RANGE_ENDNOTES),VT_DISPATCH,&pDispatchNotes)!=S_OK||!pDispatchNotes) {
 		return false;
 	}
-	if(_com_dispatch_raw_propget(pDispatchNotes,wdDISPID_FOOTNOTES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
+	if(WinWord::propGet(pDispatchNotes,wdDISPID_FOOTNOTES_COUNT,VT_I4,&count)!=S_OK||count<=0) {
 		return false;
 	}
-	if(_com_dispatch_raw_method(pDispatchNotes,wdDISPID_FOOTNOTES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchNote,L"\x0003",1)!=S_OK||!pDispatchNote) {
+	if(WinWord::callMethod(pDispatchNotes,wdDISPID_FOOTNOTES_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchNote,L"\x0003",1)!=S_OK||!pDispatchNote) {
 		return false;
 	}
-	if(_com_dispatch_raw_propget(pDispatchNote,wdDISPID_FOOTNOTE_INDEX,VT_I4,&index)!=S_OK) {
+	if(WinWord::propGet(pDispatchNote,wdDISPID_FOOTNOTE_INDEX,VT_I4,&index)!=S_OK) {
 		return false;
 	}
 	XMLStream<<L"<control _startOfNode=\"1\" role=\""<<(footnote?L"footnote":L"endnote")<<L"\" value=\""<<index<<L"\">";
@@ -708,7 +818,7 @@ std::experimental::optional<int> getSectionBreakType(IDispatchPtr pDispatchRange
 	// the range, get the section start type, remove the page break character, and insert an attribute
 	// for the break type.
 	IDispatchPtr pDispatchRangeDup = nullptr;
-	auto res = _com_dispatch_raw_propget( pDispatchRange, wdDISPID_RANGE_DUPLICATE, VT_DISPATCH, &pDispatchRangeDup);
+	auto res = WinWord::propGet( pDispatchRange, wdDISPID_RANGE_DUPLICATE, VT_DISPATCH, &pDispatchRangeDup);
 	if( res != S_OK || !pDispatchRangeDup ) {
 		LOG_DEBUGWARNING(L"error duplicating the range.");
 		return {};
@@ -717,21 +827,21 @@ std::experimental::optional<int> getSectionBreakType(IDispatchPtr pDispatchRange
 	// we assume that we are 1 character away from the next section, this should be the value for PAGE_BREAK_VALUE ("0x0c")
 	const int unitsToMove = 1;
 	int unitsMoved=-1;
-	res = _com_dispatch_raw_method(pDispatchRangeDup,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,unitsToMove);
+	res = WinWord::callMethod(pDispatchRangeDup,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,unitsToMove);
 	if( res !=S_OK || unitsMoved<=0 || !pDispatchRangeDup) {
 		LOG_DEBUGWARNING(L"error moving the end of the range");
 		return {};
 	}
 
 	IDispatchPtr pDispatchSections = nullptr;
-	res = _com_dispatch_raw_propget( pDispatchRangeDup, wdDISPID_RANGE_SECTIONS, VT_DISPATCH, &pDispatchSections);
+	res = WinWord::propGet( pDispatchRangeDup, wdDISPID_RANGE_SECTIONS, VT_DISPATCH, &pDispatchSections);
 	if( res != S_OK || !pDispatchSections ) {
 		LOG_DEBUGWARNING(L"error getting sections from range");
 		return {};
 	}
 
 	int count = -1;
-	res = _com_dispatch_raw_propget( pDispatchSections, wdDISPID_SECTIONS_COUNT, VT_I4, &count);
+	res = WinWord::propGet( pDispatchSections, wdDISPID_SECTIONS_COUNT, VT_I4, &count);
 	if( res != S_OK || count != 2 ) {
 		LOG_DEBUGWARNING(L"error getting section count. There should be exactly 2 sections, count: " << count);
 		return {};
@@ -741,21 +851,21 @@ std::experimental::optional<int> getSectionBreakType(IDispatchPtr pDispatchRange
 	// count was 1 before expanding the range.
 	const int sectionToGet = 2;
 	IDispatchPtr pDispatchItem = nullptr;
-	res = _com_dispatch_raw_method( pDispatchSections, wdDISPID_SECTIONS_ITEM, DISPATCH_METHOD, VT_DISPATCH, &pDispatchItem, L"\x0003", sectionToGet);
+	res = WinWord::callMethod( pDispatchSections, wdDISPID_SECTIONS_ITEM, DISPATCH_METHOD, VT_DISPATCH, &pDispatchItem, L"\x0003", sectionToGet);
 	if( res != S_OK || !pDispatchItem){
 		LOG_DEBUGWARNING(L"error getting section item");
 		return {};
 	}
 
 	IDispatchPtr pDispatchPageSetup = nullptr;
-	res = _com_dispatch_raw_propget( pDispatchItem, wdDISPID_SECTION_PAGESETUP,  VT_DISPATCH, &pDispatchPageSetup);
+	res = WinWord::propGet( pDispatchItem, wdDISPID_SECTION_PAGESETUP,  VT_DISPATCH, &pDispatchPageSetup);
 	if( res != S_OK || !pDispatchPageSetup){
 		LOG_DEBUGWARNING(L"error getting pageSetup");
 		return {};
 	}
 
 	int type = -1;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_SECTIONSTART, VT_I4, &type);
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_SECTIONSTART, VT_I4, &type);
 	if( res != S_OK || type < 0){
 		LOG_DEBUGWARNING(L"error getting section start");
 		return {};
@@ -768,7 +878,7 @@ std::experimental::optional<int> getSectionBreakType(IDispatchPtr pDispatchRange
 std::experimental::optional<float>
 getStartOfRangeDistanceFromEdgeOfDocument(IDispatchPtr pDispatchRange) {
 	float rangePos = -1.0f;
-	auto res = _com_dispatch_raw_method( pDispatchRange, wdDISPID_RANGE_INFORMATION,
+	auto res = WinWord::callMethod( pDispatchRange, wdDISPID_RANGE_INFORMATION,
 		DISPATCH_PROPERTYGET, VT_R4, &rangePos, L"\x0003", wdHorizontalPositionRelativeToPage);
 		if( S_OK != res && rangePos < 0) {
 			LOG_ERROR(L"error getting wdHorizontalPositionRelativeToPage."
@@ -782,7 +892,7 @@ getStartOfRangeDistanceFromEdgeOfDocument(IDispatchPtr pDispatchRange) {
 std::experimental::optional< std::pair<float, float> >
 calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	float leftMargin = -1.0f;
-	auto res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_LEFTMARGIN,
+	auto res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_LEFTMARGIN,
 		VT_R4, &leftMargin);
 	if( res != S_OK || leftMargin <0){
 		LOG_ERROR(L"error getting leftMargin. res: "<< res
@@ -793,7 +903,7 @@ calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	float rightMargin = -1.0f;
 	// right margin necessary to validate that the full width of the document has been
 	// taken into account.
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_RIGHTMARGIN,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_RIGHTMARGIN,
 		VT_R4, &rightMargin);
 	if( res != S_OK || rightMargin <0){
 		LOG_ERROR(L"error getting rightMargin. res: "<< res
@@ -802,7 +912,7 @@ calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	}
 
 	float gutter = -1.0f;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_GUTTER,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_GUTTER,
 		VT_R4, &gutter);
 	if( res != S_OK || gutter <0){
 		LOG_ERROR(L"error getting gutter. res: "<< res
@@ -811,7 +921,7 @@ calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	}
 
 	int gutterPos = -1;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_GUTTERPOS,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_GUTTERPOS,
 		VT_R4, &gutterPos);
 	if( res != S_OK || gutterPos <0){
 		LOG_ERROR(L"error getting gutterPos. res: "<< res
@@ -820,7 +930,7 @@ calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	}
 
 	int mirrorMargins = wdUndefined;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_MIRRORMARGINS,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_MIRRORMARGINS,
 		VT_R4, &mirrorMargins);
 	if( res != S_OK || mirrorMargins == wdUndefined){
 		LOG_ERROR(L"error getting mirrorMargins. res: "<< res
@@ -846,83 +956,72 @@ calculatePreAndPostColumnOffsets(IDispatchPtr pDispatchPageSetup) {
 	}
 }
 
-void detectAndGenerateColumnFormatXML(IDispatchPtr pDispatchRange, wostringstream& xmlStream) {
+/**
+ * Calculates the column layout of the section containing the given range.
+ * This only depends on the section's page setup, so can be cached per section.
+ */
+SectionColumnLayout fetchSectionColumnLayout(IDispatchPtr pDispatchRange) {
+	SectionColumnLayout layout;
 	// 1. Get the count of columns, its important we do this first so that in the event that
-	// calculating the column we are in fails, we are still able to report the overall count
+	// calculating the column boundaries fails, we are still able to report the overall count
 	IDispatchPtr pDispatchPageSetup = nullptr;
-	auto res = _com_dispatch_raw_propget( pDispatchRange, wdDISPID_RANGE_PAGESETUP,
+	auto res = WinWord::propGet( pDispatchRange, wdDISPID_RANGE_PAGESETUP,
 		VT_DISPATCH, &pDispatchPageSetup);
 	if( res != S_OK || !pDispatchPageSetup){
 		LOG_ERROR(L"error getting pageSetup. res: "<< res);
-		return;
+		return layout;
 	}
 
 	// Get columns collection
 	IDispatchPtr pDispatchTextColumns = nullptr;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_TEXTCOLUMNS,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_TEXTCOLUMNS,
 		VT_DISPATCH, &pDispatchTextColumns);
 	if( res != S_OK || !pDispatchTextColumns){
 		LOG_ERROR(L"error getting textColumns. res: "<< res);
-		return;
+		return layout;
 	}
 
 	// Count of columns
 	int count = -1;
-	res = _com_dispatch_raw_propget( pDispatchTextColumns, wdDISPID_TEXTCOLUMNS_COUNT,
+	res = WinWord::propGet( pDispatchTextColumns, wdDISPID_TEXTCOLUMNS_COUNT,
 		VT_I4, &count);
 	if( res != S_OK || count < 0){
 		LOG_DEBUG(L"Unable to get textColumn count. We may be in a 'comment'. res: "<< res
 			<< " count: " << count);
-		return;
-	}
-	xmlStream <<L"text-column-count=\"" << count << "\" ";
-
-	// 2. Get the start position (IN POINTS) of the range. This is relative to the start
-	// of the document.
-	auto rangeStart = getStartOfRangeDistanceFromEdgeOfDocument(pDispatchRange);
-	if(!rangeStart) {
-		return;
+		return layout;
 	}
+	layout.count = count;
 
-	// 3. Get the offsets that come before and after the columns, this is a combination
+	// 2. Get the offsets that come before and after the columns, this is a combination
 	// of left margin, gutter and right margin.
 	auto prePostColumnOffsets = calculatePreAndPostColumnOffsets(pDispatchPageSetup);
 	if(!prePostColumnOffsets){
-		return;
+		return layout;
 	}
 
-	// 4. Iterate through the columns, look for the final column where the range start
-	// position is greater or equal to the start position of the column
-	const float rangePos = *rangeStart;
+	// 3. Iterate through the columns, recording the start position of each.
 	float colStartPos = prePostColumnOffsets->first;
+	std::vector<float> columnStartPositions;
 	// assumption: the textcolumn furthest right is last in the collection
 	const int lastItemNumber = count;
-	int columnNumber = 0;
-	for(int itemNumber = 1; itemNumber <= lastItemNumber && S_OK == res; ++itemNumber){
-		LOG_DEBUG(L"ItemNumber: " << itemNumber
-			<< " rangePos: " << rangePos
-			<< " colStartPos: " << colStartPos);
-
-		constexpr float COL_START_TOLERENCE_POINTS = 1.0f;
-		if (rangePos - colStartPos + COL_START_TOLERENCE_POINTS > 0){
-			columnNumber = itemNumber;
-		}
+	for(int itemNumber = 1; itemNumber <= lastItemNumber; ++itemNumber){
+		columnStartPositions.push_back(colStartPos);
 		IDispatchPtr pDispatchTextColumnItem = nullptr;
-		res = _com_dispatch_raw_method( pDispatchTextColumns, wdDISPID_TEXTCOLUMNS_ITEM,
+		res = WinWord::callMethod( pDispatchTextColumns, wdDISPID_TEXTCOLUMNS_ITEM,
 			DISPATCH_METHOD, VT_DISPATCH, &pDispatchTextColumnItem, L"\x0003", itemNumber);
 		if( res != S_OK || !pDispatchTextColumnItem){
 			LOG_ERROR(L"error getting textColumn item number: "<< itemNumber
 				<< " res: "<< res);
-			return;
+			return layout;
 		}
 
 		float columnWidth = -1.0f;
-		res = _com_dispatch_raw_propget( pDispatchTextColumnItem, wdDISPID_TEXTCOLUMN_WIDTH,
+		res = WinWord::propGet( pDispatchTextColumnItem, wdDISPID_TEXTCOLUMN_WIDTH,
 			VT_R4, &columnWidth);
 		if( res != S_OK || columnWidth < 0){
 			LOG_ERROR(L"error getting textColumn width for item number: "<< itemNumber
 				<< " res: "<< res << " columnWidth: " << columnWidth);
-			return;
+			return layout;
 		} else {
 			colStartPos += columnWidth;
 		}
@@ -930,32 +1029,31 @@ void detectAndGenerateColumnFormatXML(IDispatchPtr pDispatchRange, wostringstrea
 		float spaceAfterColumn = -1.0f;
 		// the spaceAfter property is only valid between columns
 		if( itemNumber < lastItemNumber ) {
-			res = _com_dispatch_raw_propget( pDispatchTextColumnItem, wdDISPID_TEXTCOLUMN_SPACEAFTER,
+			res = WinWord::propGet( pDispatchTextColumnItem, wdDISPID_TEXTCOLUMN_SPACEAFTER,
 				VT_R4, &spaceAfterColumn);
 			if( res != S_OK || spaceAfterColumn < 0){
 				LOG_ERROR(L"error getting textColumn spaceAfterColumn"
 					<< "for item number: "<< itemNumber
 					<< " res: "<< res
 					<< " spaceAfterColumn: " << columnWidth);
-				return;
+				return layout;
 			} else {
 				colStartPos += spaceAfterColumn;
 			}
 		}
 	}
-	xmlStream <<L"text-column-number=\"" << columnNumber << "\" ";
+	layout.columnStartPositions.swap(columnStartPositions);
 
 	// Finally, double check that we calculated the full width of the document
 	float pageWidth = -1.0f;
-	res = _com_dispatch_raw_propget( pDispatchPageSetup, wdDISPID_PAGESETUP_PAGEWIDTH,
+	res = WinWord::propGet( pDispatchPageSetup, wdDISPID_PAGESETUP_PAGEWIDTH,
 		VT_R4, &pageWidth);
 	if( res != S_OK || pageWidth <0){
 		LOG_ERROR(L"error getting pageWidth. res: "<< res << " pageWidth: " << pageWidth);
-		return;
+		return layout;
 	}
 
 	colStartPos += prePostColumnOffsets->second;
-
 	// validation that some margin, gutter or offset was not missed.
 	// This does not check that they were added in the right order, only
 	// that they were added at all.
@@ -966,6 +1064,33 @@ void detectAndGenerateColumnFormatXML(IDispatchPtr pDispatchRange, wostringstrea
 			<< " that some column numbers reported were incorrect."
 			<< " pageWidth: " << pageWidth << " colStartPos: " << colStartPos);
 	}
+	return layout;
+}
+
+void detectAndGenerateColumnFormatXML(IDispatchPtr pDispatchRange, const SectionColumnLayout& layout, wostringstream& xmlStream) {
+	if(layout.count < 0) {
+		return;
+	}
+	xmlStream <<L"text-column-count=\"" << layout.count << "\" ";
+	if(layout.columnStartPositions.empty()) {
+		return;
+	}
+
+	// Get the start position (IN POINTS) of the range. This is relative to the start
+	// of the document.
+	auto rangeStart = getStartOfRangeDistanceFromEdgeOfDocument(pDispatchRange);
+	if(!rangeStart) {
+		return;
+	}
+
+	// Find the final column where the range start position is greater or equal to the start position of the column
+	// The start positions are in ascending order, so the column number is the count of start positions before the range.
+	constexpr float COL_START_TOLERENCE_POINTS = 1.0f;
+	const float rangePos = *rangeStart;
+	const auto& starts = layout.columnStartPositions;
+	const int columnNumber = static_cast<int>(std::lower_bound(starts.begin(), starts.end(), rangePos + COL_START_TOLERENCE_POINTS) - starts.begin());
+	LOG_DEBUG(L"rangePos: " << rangePos << " columnNumber: " << columnNumber);
+	xmlStream <<L"text-column-number=\"" << columnNumber << "\" ";
 }
 
 UINT wm_winword_getTextInRange=0;
@@ -975,7 +1100,7 @@ typedef struct {
 	long formatConfig;
 	BSTR text;
 } winword_getTextInRange_args;
-void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args) {
+void winword_generateTextInRangeXML(HWND hwnd, winword_getTextInRange_args* args) {
 	//Fetch all needed objects
 	//Get the window object
 	IDispatchPtr pDispatchWindow=NULL;
@@ -985,25 +1110,25 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 	}
 		//Get the current selection
 		IDispatchPtr pDispatchSelection=NULL;
-	if(_com_dispatch_raw_propget(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
 		LOG_DEBUGWARNING(L"application.selection failed");
 		return;
 	}
 	//Make a copy of the selection as an independent range
 	IDispatchPtr pDispatchRange=NULL;
-	if(_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchRange)!=S_OK||!pDispatchRange) {
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchRange)!=S_OK||!pDispatchRange) {
 		LOG_DEBUGWARNING(L"selection.range failed");
 		return;
 	}
 	//Move the range to the requested offsets
-	_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->startOffset,args->endOffset);
+	WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->startOffset,args->endOffset);
 	//A temporary stringstream for initial formatting
 	wostringstream initialFormatAttribsStream;
 	//Start writing the output xml to a stringstream
 	wostringstream XMLStream;
 	int neededClosingControlTagCount=0;
 	int storyType=0;
-	_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_STORYTYPE,VT_I4,&storyType);
+	WinWord::propGet(pDispatchRange,wdDISPID_RANGE_STORYTYPE,VT_I4,&storyType);
 	XMLStream<<L"<control wdStoryType=\""<<storyType<<L"\">";
 	neededClosingControlTagCount+=1;
 	//Collapse the range
@@ -1026,21 +1151,23 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 	if(formatConfig&formatConfig_reportSpellingErrors) {
 		collectSpellingErrorOffsets(pDispatchRange,errorVector);
 	}
-	_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
+	WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
 	int chunkStartOffset=args->startOffset;
 	int chunkEndOffset=chunkStartOffset;
 	int unitsMoved=0;
 	BSTR text=NULL;
 	if(initialFormatConfig&formatConfig_reportTables) {
-		neededClosingControlTagCount+=generateTableXML(pDispatchRange,(initialFormatConfig&formatConfig_includeLayoutTables)!=0,args->startOffset,args->endOffset,XMLStream);
+		documentCachesLock.acquire();
+		neededClosingControlTagCount+=generateTableXML(pDispatchRange,documentCachesByWindow[hwnd].tables,(initialFormatConfig&formatConfig_includeLayoutTables)!=0,args->startOffset,args->endOffset,XMLStream);
+		documentCachesLock.release();
 	}
 		IDispatchPtr pDispatchParagraphs=NULL;
 	IDispatchPtr pDispatchParagraph=NULL;
 	IDispatchPtr pDispatchParagraphRange=NULL;
 	if(formatConfig&formatConfig_reportComments||initialFormatConfig&formatConfig_reportHeadings) {
-		if(_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_PARAGRAPHS,VT_DISPATCH,&pDispatchParagraphs)==S_OK&&pDispatchParagraphs) {
-			if(_com_dispatch_raw_method(pDispatchParagraphs,wdDISPID_PARAGRAPHS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchParagraph,L"\x0003",1)==S_OK&&pDispatchParagraph) {
-				_com_dispatch_raw_propget(pDispatchParagraph,wdDISPID_PARAGRAPH_RANGE,VT_DISPATCH,&pDispatchParagraphRange);
+		if(WinWord::propGet(pDispatchRange,wdDISPID_RANGE_PARAGRAPHS,VT_DISPATCH,&pDispatchParagraphs)==S_OK&&pDispatchParagraphs) {
+			if(WinWord::callMethod(pDispatchParagraphs,wdDISPID_PARAGRAPHS_ITEM,DISPATCH_METHOD,VT_DISPATCH,&pDispatchParagraph,L"\x0003",1)==S_OK&&pDispatchParagraph) {
+				WinWord::propGet(pDispatchParagraph,wdDISPID_PARAGRAPH_RANGE,VT_DISPATCH,&pDispatchParagraphRange);
 			}
 		}
 	}
@@ -1062,7 +1189,7 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 	const auto shouldReportSections = (initialFormatConfig&formatConfig_reportPage);
 	if(shouldReportSections) {
 		int sectionNumber = -1;
-		auto res = _com_dispatch_raw_method( pDispatchRange, wdDISPID_RANGE_INFORMATION, DISPATCH_PROPERTYGET, VT_I4, &sectionNumber, L"\x0003", wdActiveEndSectionNumber);
+		auto res = WinWord::callMethod( pDispatchRange, wdDISPID_RANGE_INFORMATION, DISPATCH_PROPERTYGET, VT_I4, &sectionNumber, L"\x0003", wdActiveEndSectionNumber);
 		if( S_OK == res && sectionNumber >= 0) {
 			initialFormatAttribsStream << L"section-number=\""<<sectionNumber << "\" ";
 		}
@@ -1070,7 +1197,22 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 		{
 			LOG_DEBUGWARNING("Error getting the current section number. Res: "<< res <<" SectionNumber: " << sectionNumber);
 		}
-		detectAndGenerateColumnFormatXML(pDispatchRange, initialFormatAttribsStream);
+		// A section's page setup almost never changes while reading, so its column layout is only fetched once per section.
+		SectionColumnLayout uncachedLayout;
+		const SectionColumnLayout* layout = &uncachedLayout;
+		documentCachesLock.acquire();
+		if(sectionNumber >= 0) {
+			auto& columnLayouts = documentCachesByWindow[hwnd].columnLayoutsBySection;
+			auto i = columnLayouts.find(sectionNumber);
+			if(i == columnLayouts.end()) {
+				i = columnLayouts.insert(make_pair(sectionNumber, fetchSectionColumnLayout(pDispatchRange))).first;
+			}
+			layout = &(i->second);
+		} else {
+			uncachedLayout = fetchSectionColumnLayout(pDispatchRange);
+		}
+		detectAndGenerateColumnFormatXML(pDispatchRange, *layout, initialFormatAttribsStream);
+		documentCachesLock.release();
 	}
 
 	bool firstLoop=true;
@@ -1083,20 +1225,20 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 		const bool isFormField = TRUE == generateFormFieldXML(pDispatchRange,paragraphRange,XMLStream,chunkEndOffset);
 		if(!isFormField) {
 			//Move the end by word
-			if(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdWord,1)!=S_OK||unitsMoved<=0) {
+			if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdWord,1)!=S_OK||unitsMoved<=0) {
 				break;
 			}
-			_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
+			WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
 		}
 		const auto pageNumFieldEndIndexOptional = currentFields.getEndOfPageNumberFieldAtIndex(chunkEndOffset);
 		if(pageNumFieldEndIndexOptional){
 			chunkEndOffset = *pageNumFieldEndIndexOptional;
-			_com_dispatch_raw_propput(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEndOffset);
+			WinWord::propPut(pDispatchRange,wdDISPID_RANGE_END,VT_I4,chunkEndOffset);
 		}
 
 		//Make sure  that the end is not past the requested end after the move
 		if(chunkEndOffset>(args->endOffset)) {
-			_com_dispatch_raw_propput(pDispatchRange,wdDISPID_RANGE_END,VT_I4,args->endOffset);
+			WinWord::propPut(pDispatchRange,wdDISPID_RANGE_END,VT_I4,args->endOffset);
 			chunkEndOffset=args->endOffset;
 		}
 		//When using IME, the last moveEnd succeeds but the end does not really move
@@ -1104,7 +1246,7 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 			LOG_DEBUGWARNING(L"moveEnd successfull but range did not expand! chunkStartOffset "<<chunkStartOffset<<L", chunkEndOffset "<<chunkEndOffset);
 			break;
 		}
-		_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_TEXT,VT_BSTR,&text);
+		WinWord::propGet(pDispatchRange,wdDISPID_RANGE_TEXT,VT_BSTR,&text);
 		if(!text) SysAllocString(L"");
 		if(text) {
 			int noteCharOffset=-1;
@@ -1132,11 +1274,11 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 				if(noteCharOffset==0) noteCharOffset=1;
 				if(noteCharOffset>0) {
 					text[noteCharOffset]=L'\0';
-					_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
-					if(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,noteCharOffset)!=S_OK||unitsMoved<=0) {
+					WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
+					if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,noteCharOffset)!=S_OK||unitsMoved<=0) {
 						break;
 					}
-					_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
+					WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
 				}
 			}
 			if(isNoteChar) {
@@ -1147,11 +1289,11 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 			//We also get the over all count of shapes for this word so we know whether we need to check for more within this word
 			int inlineShapesCount=hasInlineShapes?generateInlineShapeXML(pDispatchRange,chunkStartOffset,XMLStream):0;
 			if(inlineShapesCount>1) {
-				_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
-				if(_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,1)!=S_OK||unitsMoved<=0) {
+				WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseStart);
+				if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdCharacter,1)!=S_OK||unitsMoved<=0) {
 					break;
 				}
-				_com_dispatch_raw_propget(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
+				WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&chunkEndOffset);
 			}
 			XMLStream<<L"<text _startOffset=\""<<chunkStartOffset<<L"\" _endOffset=\""<<chunkEndOffset<<L"\" ";
 			XMLStream<<initialFormatAttribsStream.str();
@@ -1209,7 +1351,7 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 			if(isNoteChar) XMLStream<<L"</control>";
 			if(inlineShapesCount>0) XMLStream<<L"</control>";
 		}
-		_com_dispatch_raw_method(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseEnd);
+		WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_COLLAPSE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",wdCollapseEnd);
 		chunkStartOffset=chunkEndOffset;
 	} while(chunkEndOffset<(args->endOffset));
 	for(;neededClosingControlTagCount>0;--neededClosingControlTagCount) {
@@ -1218,6 +1360,138 @@ void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args)
 	args->text=SysAllocString(XMLStream.str().c_str());
 }
 
+UINT wm_winword_prefetchTextInRange=0;
+
+/**
+ * Serves a text request, from text prefetched while NVDA was speaking the previous chunk if possible.
+ * When requests follow on from each other (E.g. say all), generation of the next chunk is scheduled for when the Word thread is idle.
+ */
+void winword_getTextInRange_helper(HWND hwnd, winword_getTextInRange_args* args) {
+	bool isSequential=false;
+	documentCachesLock.acquire();
+	DocumentCaches& caches=documentCachesByWindow[hwnd];
+	PrefetchedText& prefetched=caches.prefetchedText;
+	if(prefetched.isReady&&prefetched.startOffset==args->startOffset&&prefetched.endOffset==args->endOffset&&prefetched.formatConfig==args->formatConfig) {
+		args->text=SysAllocStringLen(prefetched.xml.c_str(),static_cast<UINT>(prefetched.xml.size()));
+	}
+	isSequential=(caches.lastTextRequestEndOffset>=0&&caches.lastTextRequestEndOffset==args->startOffset);
+	prefetched=PrefetchedText();
+	documentCachesLock.release();
+	if(!args->text) {
+		winword_generateTextInRangeXML(hwnd,args);
+	}
+	documentCachesLock.acquire();
+	DocumentCaches& currentCaches=documentCachesByWindow[hwnd];
+	currentCaches.lastTextRequestEndOffset=args->endOffset;
+	if(isSequential&&args->text) {
+		currentCaches.prefetchedText.previousStartOffset=args->startOffset;
+		currentCaches.prefetchedText.startOffset=args->endOffset;
+		currentCaches.prefetchedText.formatConfig=args->formatConfig;
+	}
+	documentCachesLock.release();
+	if(isSequential&&args->text) {
+		// Posted rather than done now, so that the reply to NVDA is not delayed and any pending input is handled first.
+		PostMessage(hwnd,wm_winword_prefetchTextInRange,0,0);
+	}
+}
+
+/**
+ * The most units of the same kind a request may cover for the next request to be expected to cover the same number.
+ */
+const int MAX_PREFETCH_UNIT_COUNT=4;
+
+/**
+ * Counts how many whole units of the given kind a range covers.
+ * @param pDispatchRange a range to use for the calculation, which is moved.
+ * @return the number of units, or 0 if the range does not start and end on boundaries of this unit.
+ */
+int countWholeUnitsInRange(IDispatch* pDispatchRange, int unit, int startOffset, int endOffset) {
+	WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",startOffset,startOffset);
+	if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_EXPAND,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003",unit)!=S_OK) {
+		return 0;
+	}
+	int unitStart=-1;
+	int unitEnd=-1;
+	WinWord::getIntProperties(pDispatchRange,{{wdDISPID_RANGE_START,&unitStart},{wdDISPID_RANGE_END,&unitEnd}});
+	if(unitStart!=startOffset) return 0;
+	int count=1;
+	while(unitEnd<endOffset&&count<MAX_PREFETCH_UNIT_COUNT) {
+		int unitsMoved=0;
+		if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",unit,1)!=S_OK||unitsMoved<=0) {
+			return 0;
+		}
+		WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&unitEnd);
+		++count;
+	}
+	return (unitEnd==endOffset)?count:0;
+}
+
+/**
+ * Works out the range NVDA is expected to ask for after the given one, so that it can be prefetched.
+ * That is the same number of sentences or paragraphs as the given range covers, or failing that, the same number of characters.
+ * Lines are not tried, as they can only be found by moving the selection.
+ * @return the end offset of the next range, which starts at the end of the given one, or -1 if there is no further text.
+ */
+int getNextTextRequestEnd(HWND hwnd, int startOffset, int endOffset) {
+	if(startOffset<0||endOffset<=startOffset) return -1;
+	IDispatchPtr pDispatchWindow=NULL;
+	if(AccessibleObjectFromWindow(hwnd,OBJID_NATIVEOM,IID_IDispatch,(void**)&pDispatchWindow)!=S_OK) {
+		return -1;
+	}
+	IDispatchPtr pDispatchSelection=NULL;
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
+		return -1;
+	}
+	IDispatchPtr pDispatchRange=NULL;
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchRange)!=S_OK||!pDispatchRange) {
+		return -1;
+	}
+	int nextEndOffset=-1;
+	for(int unit: {wdSentence,wdParagraph}) {
+		int count=countWholeUnitsInRange(pDispatchRange,unit,startOffset,endOffset);
+		if(count==0) continue;
+		WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",endOffset,endOffset);
+		int unitsMoved=0;
+		if(WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_MOVEEND,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",unit,count)!=S_OK||unitsMoved<=0) {
+			return -1;
+		}
+		WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&nextEndOffset);
+		return (nextEndOffset>endOffset)?nextEndOffset:-1;
+	}
+	// Word limits the range to the end of the story.
+	WinWord::callMethod(pDispatchRange,wdDISPID_RANGE_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",endOffset,endOffset+(endOffset-startOffset));
+	WinWord::propGet(pDispatchRange,wdDISPID_RANGE_END,VT_I4,&nextEndOffset);
+	return (nextEndOffset>endOffset)?nextEndOffset:-1;
+}
+
+/**
+ * Generates the text scheduled by winword_getTextInRange_helper, unless the user has started doing something else in the meantime.
+ */
+void winword_prefetchTextInRange_helper(HWND hwnd) {
+	if(HIWORD(GetQueueStatus(QS_INPUT))!=0) {
+		// Input is waiting, so this is not idle time, and the input may well change the document or move away.
+		return;
+	}
+	documentCachesLock.acquire();
+	PrefetchedText scheduled=documentCachesByWindow[hwnd].prefetchedText;
+	documentCachesLock.release();
+	if(scheduled.startOffset<0||scheduled.isReady) return;
+	winword_getTextInRange_args args={scheduled.startOffset,getNextTextRequestEnd(hwnd,scheduled.previousStartOffset,scheduled.startOffset),scheduled.formatConfig,NULL};
+	if(args.endOffset<0) return;
+	winword_generateTextInRangeXML(hwnd,&args);
+	if(!args.text) return;
+	documentCachesLock.acquire();
+	PrefetchedText& prefetched=documentCachesByWindow[hwnd].prefetchedText;
+	// The caches may have been cleared, or another request served, while generating.
+	if(prefetched.startOffset==args.startOffset&&prefetched.formatConfig==args.formatConfig&&!prefetched.isReady) {
+		prefetched.endOffset=args.endOffset;
+		prefetched.xml.assign(args.text,SysStringLen(args.text));
+		prefetched.isReady=true;
+	}
+	documentCachesLock.release();
+	SysFreeString(args.text);
+}
+
 UINT wm_winword_moveByLine=0;
 typedef struct {
 	int offset;
@@ -1232,38 +1506,38 @@ void winword_moveByLine_helper(HWND hwnd, winword_moveByLine_args* args) {
 		return;
 	}
 	IDispatchPtr pDispatchApplication=NULL;
-	if(_com_dispatch_raw_propget(pDispatchWindow,wdDISPID_WINDOW_APPLICATION,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_APPLICATION,VT_DISPATCH,&pDispatchApplication)!=S_OK||!pDispatchApplication) {
 		LOG_DEBUGWARNING(L"window.application failed");
 		return;
 	}
 	IDispatchPtr pDispatchSelection=NULL;
-	if(_com_dispatch_raw_propget(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
+	if(WinWord::propGet(pDispatchWindow,wdDISPID_WINDOW_SELECTION,VT_DISPATCH,&pDispatchSelection)!=S_OK||!pDispatchSelection) {
 		LOG_DEBUGWARNING(L"application.selection failed");
 		return;
 	}
 	BOOL startWasActive=false;
-	if(_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,&startWasActive)!=S_OK) {
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,&startWasActive)!=S_OK) {
 		LOG_DEBUGWARNING(L"selection.StartIsActive failed");
 	}
 	IDispatch* pDispatchOldSelRange=NULL;
-	if(_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchOldSelRange)!=S_OK||!pDispatchOldSelRange) {
+	if(WinWord::propGet(pDispatchSelection,wdDISPID_SELECTION_RANGE,VT_DISPATCH,&pDispatchOldSelRange)!=S_OK||!pDispatchOldSelRange) {
 		LOG_DEBUGWARNING(L"selection.range failed");
 		return;
 	}
 	//Disable screen updating as we will be moving the selection temporarily
-	_com_dispatch_raw_propput(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,false);
+	WinWord::propPut(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,false);
 	//Move the selection to the given range
-	_com_dispatch_raw_method(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
+	WinWord::callMethod(pDispatchSelection,wdDISPID_SELECTION_SETRANGE,DISPATCH_METHOD,VT_EMPTY,NULL,L"\x0003\x0003",args->offset,args->offset);
 // Move the selection by 1 line
 	int unitsMoved=0;
-	_com_dispatch_raw_method(pDispatchSelection,wdDISPID_RANGE_MOVE,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdLine,((args->moveBack)?-1:1));
-	_com_dispatch_raw_propget(pDispatchSelection,wdDISPID_RANGE_START,VT_I4,&(args->newOffset));
+	WinWord::callMethod(pDispatchSelection,wdDISPID_RANGE_MOVE,DISPATCH_METHOD,VT_I4,&unitsMoved,L"\x0003\x0003",wdLine,((args->moveBack)?-1:1));
+	WinWord::propGet(pDispatchSelection,wdDISPID_RANGE_START,VT_I4,&(args->newOffset));
 	//Move the selection back to its original location
-	_com_dispatch_raw_method(pDispatchOldSelRange,wdDISPID_RANGE_SELECT,DISPATCH_METHOD,VT_EMPTY,NULL,NULL);
+	WinWord::callMethod(pDispatchOldSelRange,wdDISPID_RANGE_SELECT,DISPATCH_METHOD,VT_EMPTY,NULL,NULL);
 	//Restore the old selection direction
-	_com_dispatch_raw_propput(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,startWasActive);
+	WinWord::propPut(pDispatchSelection,wdDISPID_SELECTION_STARTISACTIVE,VT_BOOL,startWasActive);
 	//Reenable screen updating
-	_com_dispatch_raw_propput(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,true);
+	WinWord::propPut(pDispatchApplication,wdDISPID_APPLICATION_SCREENUPDATING,VT_BOOL,true);
 }
 
 LRESULT CALLBACK winword_callWndProcHook(int code, WPARAM wParam, LPARAM lParam) {
@@ -1274,11 +1548,58 @@ LRESULT CALLBACK winword_callWndProcHook(int code, WPARAM wParam, LPARAM lParam)
 		winword_getTextInRange_helper(pcwp->hwnd,reinterpret_cast<winword_getTextInRange_args*>(pcwp->wParam));
 	} else if(pcwp->message==wm_winword_moveByLine) {
 		winword_moveByLine_helper(pcwp->hwnd,reinterpret_cast<winword_moveByLine_args*>(pcwp->wParam));
+	} else if(pcwp->message==WM_DESTROY) {
+		documentCachesLock.acquire();
+		documentCachesByWindow.erase(pcwp->hwnd);
+		documentCachesLock.release();
+	} else if(pcwp->message==WM_SETFOCUS||pcwp->message==WM_PASTE||pcwp->message==WM_CUT||pcwp->message==WM_CLEAR||pcwp->message==WM_UNDO) {
+		// Focus returning to the document may mean a dialog (E.g. table properties) has changed it.
+		clearDocumentCaches();
+	}
+	return 0;
+}
+
+/**
+ * Checks whether a key only moves the caret or selection, and therefore can't have edited the document.
+ */
+bool isNavigationKey(WPARAM vkCode) {
+	switch(vkCode) {
+		case VK_LEFT:
+		case VK_RIGHT:
+		case VK_UP:
+		case VK_DOWN:
+		case VK_HOME:
+		case VK_END:
+		case VK_PRIOR:
+		case VK_NEXT:
+		case VK_SHIFT:
+		case VK_CONTROL:
+		case VK_MENU:
+		case VK_LWIN:
+		case VK_RWIN:
+		return true;
+		default:
+		return false;
+	}
+}
+
+LRESULT CALLBACK winword_getMessageHook(int code, WPARAM wParam, LPARAM lParam) {
+	// A message that is only peeked at will be seen again when it is removed.
+	if(wParam!=PM_REMOVE) return 0;
+	MSG* pmsg=(MSG*)lParam;
+	if(pmsg->message==wm_winword_prefetchTextInRange) {
+		winword_prefetchTextInRange_helper(pmsg->hwnd);
+	} else if(
+		((pmsg->message==WM_KEYDOWN||pmsg->message==WM_SYSKEYDOWN)&&!isNavigationKey(pmsg->wParam))\
+		||pmsg->message==WM_CHAR||pmsg->message==WM_IME_COMPOSITION||pmsg->message==WM_LBUTTONUP\
+	) {
+		clearDocumentCaches();
 	}
 	return 0;
 }
 
 error_status_t nvdaInProcUtils_winword_expandToLine(handle_t bindingHandle, const unsigned long windowHandle, const int offset, int* lineStart, int* lineEnd) {
+	inProcess_activateSubsystem(inProcessSubsystem_winword);
 	winword_expandToLine_args args={offset,-1,-1};
 	DWORD_PTR wmRes=0;
 	SendMessage((HWND)UlongToHandle(windowHandle),wm_winword_expandToLine,(WPARAM)&args,0);
@@ -1288,6 +1609,7 @@ error_status_t nvdaInProcUtils_winword_expandToLine(handle_t bindingHandle, cons
 }
 
 error_status_t nvdaInProcUtils_winword_getTextInRange(handle_t bindingHandle, const unsigned long windowHandle, const int startOffset, const int endOffset, const long formatConfig, BSTR* text) {
+	inProcess_activateSubsystem(inProcessSubsystem_winword);
 	winword_getTextInRange_args args={startOffset,endOffset,formatConfig,NULL};
 	SendMessage((HWND)UlongToHandle(windowHandle),wm_winword_getTextInRange,(WPARAM)&args,0);
 	*text=args.text;
@@ -1295,6 +1617,7 @@ error_status_t nvdaInProcUtils_winword_getTextInRange(handle_t bindingHandle, co
 }
 
 error_status_t nvdaInProcUtils_winword_moveByLine(handle_t bindingHandle, const unsigned long windowHandle, const int offset, const int moveBack, int* newOffset) {
+	inProcess_activateSubsystem(inProcessSubsystem_winword);
 	winword_moveByLine_args args={offset,moveBack,NULL};
 	SendMessage((HWND)UlongToHandle(windowHandle),wm_winword_moveByLine,(WPARAM)&args,0);
 	*newOffset=args.newOffset;
@@ -1305,9 +1628,17 @@ void winword_inProcess_initialize() {
 	wm_winword_expandToLine=RegisterWindowMessage(L"wm_winword_expandToLine");
 	wm_winword_getTextInRange=RegisterWindowMessage(L"wm_winword_getTextInRange");
 	wm_winword_moveByLine=RegisterWindowMessage(L"wm_winword_moveByLine");
+	wm_winword_prefetchTextInRange=RegisterWindowMessage(L"wm_winword_prefetchTextInRange");
 	registerWindowsHook(WH_CALLWNDPROC,winword_callWndProcHook);
+	registerWindowsHook(WH_GETMESSAGE,winword_getMessageHook);
 }
 
 void winword_inProcess_terminate() {
+	unregisterWindowsHook(WH_GETMESSAGE,winword_getMessageHook);
 	unregisterWindowsHook(WH_CALLWNDPROC,winword_callWndProcHook);
+	documentCachesLock.acquire();
+	documentCachesByWindow.clear();
+	documentCachesLock.release();
+	WinWord::logDispatchStats();
+	WinWord::resetDispatchStats();
 }
@@ -14,11 +14,14 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 
 #include <windows.h>
 #include <set>
+#include <map>
+#include <vector>
 #include <string>
 #include <sstream>
 #include <ia2.h>
 #include <common/ia2utils.h>
 #include <remote/nvdaHelperRemote.h>
+#include <remote/nvdaControllerInternal.h>
 #include <vbufBase/backend.h>
 #include <common/log.h>
 #include <vbufBase/utils.h>
@@ -315,12 +318,38 @@ long getChildCount(const bool isAriaHidden, IAccessible2 * const pacc){
 	return rawChildCount;
 }
 
+/**
+ * Whether the content of an object is rarely read, because it is collapsed or not shown,
+ * and so can be left unrendered until the user reaches it.
+ */
+bool isContentDeferrable(long role, int states) {
+	switch(role) {
+		case ROLE_SYSTEM_OUTLINEITEM:
+		return (states&STATE_SYSTEM_COLLAPSED)!=0;
+		case ROLE_SYSTEM_MENUPOPUP:
+		return (states&(STATE_SYSTEM_INVISIBLE|STATE_SYSTEM_OFFSCREEN))!=0;
+		case ROLE_SYSTEM_PROPERTYPAGE:
+		case ROLE_SYSTEM_GROUPING:
+		case IA2_ROLE_SECTION:
+		// Offscreen alone also means scrolled out of view, which is often read.
+		return (states&STATE_SYSTEM_INVISIBLE)&&(states&STATE_SYSTEM_OFFSCREEN);
+		default:
+		return false;
+	}
+}
+
 bool hasAriaHiddenAttribute(const map<wstring,wstring>& IA2AttribsMap){
 	const auto IA2AttribsMapIt = IA2AttribsMap.find(L"hidden");
 	return (IA2AttribsMapIt != IA2AttribsMap.end() && IA2AttribsMapIt->second == L"true");
 }
 
 const vector<wstring>ATTRLIST_ROLES(1, L"IAccessible2::attribute_xml-roles");
+
+// The IA2 attributes NVDA itself uses from the buffer.
+// When the buffer is over its memory limit, only these are kept.
+const set<wstring> ESSENTIAL_IA2_ATTRIBUTES={
+	L"current", L"dropeffect", L"grabbed", L"level", L"placeholder", L"sort", L"tag", L"xml-roles"
+};
 const wregex REGEX_PRESENTATION_ROLE(L"IAccessible2\\\\:\\\\:attribute_xml-roles:.*\\bpresentation\\b.*;");
 
 VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
@@ -331,6 +360,8 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 	nhAssert(buffer); //buffer can't be NULL
 	nhAssert(!parentNode||buffer->isNodeInBuffer(parentNode)); //parent node must be in buffer
 	nhAssert(!previousNode||buffer->isNodeInBuffer(previousNode)); //Previous node must be in buffer
+	// Whether this is the object being rendered, rather than one of its descendants.
+	const bool isRenderRoot = !parentNode;
 	VBufStorage_fieldNode_t* tempNode;
 	//all IAccessible methods take a variant for childID, get one ready
 	VARIANT varChild;
@@ -447,7 +478,15 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 		IA2AttribsToMap(IA2Attributes,IA2AttribsMap);
 		SysFreeString(IA2Attributes);
 		// Add each IA2 attribute as an attrib.
+		// If the buffer is using too much memory, leave out those NVDA does not use.
+		// The buffer's stats change as queries decompress subtrees, so only read them under the lock.
+		this->lock.acquire();
+		const bool isOverMemoryLimit=this->isOverMemoryLimit((buffer!=this)?buffer->getMemoryUsage():0);
+		this->lock.release();
 		for(map<wstring,wstring>::const_iterator it=IA2AttribsMap.begin();it!=IA2AttribsMap.end();++it) {
+			if(isOverMemoryLimit&&ESSENTIAL_IA2_ATTRIBUTES.count(it->first)==0) {
+				continue;
+			}
 			s<<L"IAccessible2::attribute_"<<it->first;
 			parentNode->addAttribute(s.str(),it->second);
 			s.str(L"");
@@ -471,11 +510,11 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 	} else {
 		isBlockElement=FALSE;
 	}
-	parentNode->isBlock=isBlockElement;
+	parentNode->setBlock(isBlockElement);
 
 	// force   isHidden to True if this has an ARIA role of presentation but its focusble -- Gecko does not hide this itself.
 	if((states&STATE_SYSTEM_FOCUSABLE)&&parentNode->matchAttributes(ATTRLIST_ROLES, REGEX_PRESENTATION_ROLE)) {
-		parentNode->isHidden=true;
+		parentNode->setHidden(true);
 	}
 	BSTR name=NULL;
 	if(pacc->get_accName(varChild,&name)!=S_OK)
@@ -528,13 +567,21 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 			|| (!isRoot && (role == ROLE_SYSTEM_APPLICATION || role == ROLE_SYSTEM_DIALOG));
 	// Whether this node is interactive.
 	// Certain objects are never interactive, even if other checks are true.
-	bool isNeverInteractive = parentNode->isHidden||(!isEditable && (isRoot || role == ROLE_SYSTEM_DOCUMENT || role == IA2_ROLE_INTERNAL_FRAME));
+	bool isNeverInteractive = parentNode->isHidden()||(!isEditable && (isRoot || role == ROLE_SYSTEM_DOCUMENT || role == IA2_ROLE_INTERNAL_FRAME));
 	bool isInteractive = !isNeverInteractive && (isEditable || inLink || states & STATE_SYSTEM_FOCUSABLE || states & STATE_SYSTEM_UNAVAILABLE || isEmbeddedApp || role == ROLE_SYSTEM_EQUATION);
 	// We aren't finished calculating isInteractive yet; actions are handled below.
 
 	const bool isAriaHidden = hasAriaHiddenAttribute(IA2AttribsMap);
 	const long childCount = getChildCount(isAriaHidden, pacc);
 
+	// Content under a table is always rendered, as it depends on the table.
+	if (!isRenderRoot && !paccTable && !paccTable2 && childCount > 0 && isContentDeferrable(role, states)) {
+		tempNode = this->deferContent(buffer, parentNode, name, locale);
+		if(name)
+			SysFreeString(name);
+		return tempNode;
+	}
+
 	const bool isImgMap = role == ROLE_SYSTEM_GRAPHIC && childCount > 0;
 	IA2AttribsMapIt = IA2AttribsMap.find(L"explicit-name");
 	// Whether the name of this node has been explicitly set (as opposed to calculated by descendant)
@@ -725,6 +772,8 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 	//If the name isn't being rendered as the content, then add the name as a field attribute.
 	if (!nameIsContent && name)
 		parentNode->addAttribute(L"name", name);
+	// Count this node's attributes now, so that memory limit checks while rendering its descendants include them.
+	buffer->accountForAttributes(parentNode);
 
 	if (isVisible) {
 		if ( isImgMap && name ) {
@@ -791,6 +840,11 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 					if(!childPacc) {
 						continue;
 					}
+					// Content under a table depends on the table as well as the child, so is always rendered.
+					if (!paccTable && !paccTable2 && !ignoreInteractiveUnlabelledGraphics && (tempNode = this->reuseUnchangedChild(childPacc, buffer, parentNode, previousNode))) {
+						previousNode=tempNode;
+						continue;
+					}
 					if (tempNode = this->fillVBuf(childPacc, buffer, parentNode, previousNode, paccTable, paccTable2, tableID, presentationalRowNumber, ignoreInteractiveUnlabelledGraphics)) {
 						previousNode=tempNode;
 					} else {
@@ -874,7 +928,7 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 			// Always render a space for empty table cells and unknowns.
 			previousNode=buffer->addTextFieldNode(parentNode,previousNode,L" ");
 			if(previousNode&&!locale.empty()) previousNode->addAttribute(L"language",locale);
-			parentNode->isBlock=false;
+			parentNode->setBlock(false);
 		}
 
 		if ((isInteractive || role == ROLE_SYSTEM_SEPARATOR) && parentNode->getLength() == 0) {
@@ -901,6 +955,12 @@ VBufStorage_fieldNode_t* GeckoVBufBackend_t::fillVBuf(IAccessible2* pacc,
 			paccTable->Release();
 	}
 
+	// Count the attributes added since, such as table cell numbers and those of text runs.
+	buffer->accountForAttributes(parentNode);
+	for(VBufStorage_fieldNode_t* child=parentNode->getFirstChild();child;child=child->getNext()) {
+		buffer->accountForAttributes(child);
+	}
+
 	return parentNode;
 }
 
@@ -957,8 +1017,219 @@ bool getDocumentFrame(HWND* hwnd, long* childID) {
 	return true;
 }
 
+/**
+ * Tries to apply a text inserted or removed event straight to the text field node holding the changed text, so that the node does not need to be re-rendered.
+ * This is only done for editable objects whose node's children map exactly on to the object's text: one text field node for each run of text, and a control field node for each embedded object.
+ * @param backend the backend containing the node.
+ * @param node the node for the object that fired the event.
+ * @param docHandle the docHandle of the object.
+ * @param ID the ID of the object.
+ * @param eventID either IA2_EVENT_TEXT_INSERTED or IA2_EVENT_TEXT_REMOVED.
+ * @return true if the change was applied, false if the node should be re-rendered instead.
+ */
+bool applyTextChangeEvent(VBufBackend_t* backend, VBufStorage_controlFieldNode_t* node, int docHandle, int ID, DWORD eventID) {
+	if(node->updateAncestor) {
+		// Some ancestor's rendering depends on this node's content.
+		return false;
+	}
+	const bool isInsert=(eventID==IA2_EVENT_TEXT_INSERTED);
+	IAccessible2* pacc=IAccessible2FromIdentifier(docHandle,ID);
+	if(!pacc) {
+		return false;
+	}
+	AccessibleStates IA2States=0;
+	IAccessibleText* paccText=NULL;
+	if(pacc->get_states(&IA2States)!=S_OK||!(IA2States&IA2_STATE_EDITABLE)||pacc->QueryInterface(IID_IAccessibleText,(void**)&paccText)!=S_OK) {
+		pacc->Release();
+		return false;
+	}
+	pacc->Release();
+	IA2TextSegment segment={0};
+	HRESULT res=isInsert?paccText->get_newText(&segment):paccText->get_oldText(&segment);
+	if(res!=S_OK||!segment.text) {
+		paccText->Release();
+		return false;
+	}
+	const wstring text(segment.text,SysStringLen(segment.text));
+	SysFreeString(segment.text);
+	long changeStart=segment.start;
+	long changeLength=static_cast<long>(text.length());
+	for(wstring::const_iterator i=text.begin();i!=text.end();++i) {
+		if(*i==EMBEDDED_OBJ_CHAR||isPrivateCharacter(*i)) {
+			// The change involves objects or characters the renderer treats specially.
+			changeLength=0;
+			break;
+		}
+	}
+	long textLength=0;
+	long runStart=0, runEnd=0;
+	bool valid=changeLength>0&&segment.end-segment.start==changeLength&&paccText->get_nCharacters(&textLength)==S_OK;
+	if(valid&&isInsert) {
+		// Make sure the text hasn't changed again since this event was fired, and find the attributes run the inserted text is in.
+		BSTR currentText=NULL;
+		valid=(paccText->get_text(changeStart,changeStart+changeLength,&currentText)==S_OK&&currentText&&text.compare(0,wstring::npos,currentText,SysStringLen(currentText))==0);
+		if(currentText) SysFreeString(currentText);
+		BSTR attribs=NULL;
+		valid=valid&&paccText->get_attributes(changeStart,&runStart,&runEnd,&attribs)==S_OK;
+		if(attribs) SysFreeString(attribs);
+		valid=valid&&runStart<=changeStart&&runEnd>=changeStart+changeLength;
+	}
+	paccText->Release();
+	if(!valid) {
+		return false;
+	}
+	// The length of the object's text before this change.
+	long oldTextLength=isInsert?textLength-changeLength:textLength+changeLength;
+	backend->lock.acquire();
+	VBufStorage_textFieldNode_t* target=NULL;
+	long targetStart=0;
+	long offset=0;
+	for(VBufStorage_fieldNode_t* child=node->getFirstChild();child;child=child->getNext()) {
+		if(child->getFirstChild()||child->getLength()==0) {
+			// A control field node for an embedded object.
+			++offset;
+			continue;
+		}
+		long childEnd=offset+child->getLength();
+		if(!target) {
+			if(isInsert) {
+				// After insertion the node and the new text must all be in the one attributes run, otherwise rendering would have split them.
+				if(offset<=changeStart&&changeStart<=childEnd&&runStart<=offset&&childEnd+changeLength<=runEnd) {
+					target=(VBufStorage_textFieldNode_t*)child;
+					targetStart=offset;
+				}
+			} else if(offset<=changeStart&&changeStart+changeLength<=childEnd&&changeLength<child->getLength()) {
+				target=(VBufStorage_textFieldNode_t*)child;
+				targetStart=offset;
+			}
+		}
+		offset=childEnd;
+	}
+	bool applied=false;
+	if(target&&offset==oldTextLength) {
+		if(isInsert) {
+			applied=backend->insertText(target,changeStart-targetStart,text);
+		} else {
+			wstring removedText;
+			target->getText().appendTo(removedText,changeStart-targetStart,changeLength);
+			if(removedText==text) {
+				applied=backend->removeText(target,changeStart-targetStart,changeLength);
+			}
+		}
+	}
+	backend->lock.release();
+	if(applied) {
+		LOG_DEBUG(L"Applied text change of "<<changeLength<<L" characters at "<<changeStart<<L" without re-rendering");
+		nvdaControllerInternal_vbufChangeNotify(backend->rootDocHandle,backend->rootID);
+	}
+	return applied;
+}
+
+map<HWND,vector<GeckoVBufBackend_t*> > GeckoVBufBackend_t::backendsByWindow;
+LockableObject GeckoVBufBackend_t::backendsByWindowLock;
+
+vector<GeckoVBufBackend_t*> GeckoVBufBackend_t::getBackendsForWindow(HWND hwnd) {
+	backendsByWindowLock.acquire();
+	map<HWND,vector<GeckoVBufBackend_t*> >::iterator i=backendsByWindow.find(hwnd);
+	if(i==backendsByWindow.end()) {
+		vector<GeckoVBufBackend_t*> backends;
+		for(VBufBackendSet_t::iterator j=runningBackends.begin();j!=runningBackends.end();++j) {
+			HWND rootWindow=(HWND)UlongToHandle(((*j)->rootDocHandle));
+			if(rootWindow==hwnd||IsChild(rootWindow,hwnd)) {
+				// runningBackends in this module only ever contains Gecko backends.
+				backends.push_back(static_cast<GeckoVBufBackend_t*>(*j));
+			}
+		}
+		LOG_DEBUG(L"Window "<<hwnd<<L" belongs to "<<backends.size()<<L" backends");
+		i=backendsByWindow.insert(make_pair(hwnd,backends)).first;
+	}
+	vector<GeckoVBufBackend_t*> res=i->second;
+	backendsByWindowLock.release();
+	return res;
+}
+
+void GeckoVBufBackend_t::clearBackendsByWindow() {
+	backendsByWindowLock.acquire();
+	backendsByWindow.clear();
+	backendsByWindowLock.release();
+}
+
+void GeckoVBufBackend_t::countEvent(DWORD time) {
+	++(this->eventCount);
+	if((time-this->eventRateStartTime)>=1000) {
+		if(this->eventRateCount>this->peakEventRate) {
+			this->peakEventRate=this->eventRateCount;
+			LOG_DEBUG(L"New peak of "<<this->peakEventRate<<L" events per second for backend at "<<this);
+		}
+		this->eventRateStartTime=time;
+		this->eventRateCount=0;
+	}
+	++(this->eventRateCount);
+}
+
+VBufStorage_fieldNode_t* GeckoVBufBackend_t::reuseUnchangedChild(IAccessible2* childPacc, VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, VBufStorage_fieldNode_t* previousNode) {
+	if(!this->rerenderingNode) {
+		return NULL;
+	}
+	HWND childHwnd;
+	int childID;
+	if(childPacc->get_windowHandle(&childHwnd)!=S_OK||childPacc->get_uniqueID((long*)&childID)!=S_OK) {
+		return NULL;
+	}
+	const int childDocHandle=HandleToUlong(findRealMozillaWindow(childHwnd));
+	// Queries can decompress parts of the buffer at any time, so it can only be read with the lock held.
+	this->lock.acquire();
+	VBufStorage_controlFieldNode_t* oldChild=this->getControlFieldNodeWithIdentifier(childDocHandle,childID);
+	// Only content being replaced can be copied, otherwise it would end up in the buffer twice.
+	if(!oldChild||oldChild==this->rerenderingNode||!this->isDescendantNode(this->rerenderingNode,oldChild)) {
+		this->lock.release();
+		return NULL;
+	}
+	// Rendering also depends on the parent, so the child must not have moved.
+	int oldParentDocHandle=0, oldParentID=0, parentDocHandle=0, parentID=0;
+	if(!oldChild->getParent()||!oldChild->getParent()->getIdentifier(&oldParentDocHandle,&oldParentID)||!parentNode->getIdentifier(&parentDocHandle,&parentID)||oldParentDocHandle!=parentDocHandle||oldParentID!=parentID) {
+		this->lock.release();
+		return NULL;
+	}
+	if(!this->isSubtreeUnchanged(oldChild)) {
+		this->lock.release();
+		return NULL;
+	}
+	VBufStorage_fieldNode_t* copy=buffer->copySubtree(parentNode,previousNode,oldChild);
+	this->lock.release();
+	if(copy) {
+		++(this->reusedChildCount);
+	}
+	return copy;
+}
+
+VBufStorage_fieldNode_t* GeckoVBufBackend_t::deferContent(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* node, const wchar_t* name, const wstring& locale) {
+	VBufStorage_deferredFieldNode_t* deferredNode=buffer->deferControlFieldNode(node);
+	if(!deferredNode) {
+		return NULL;
+	}
+	// The name is all that is rendered, so the user can still find the object and move in to it.
+	VBufStorage_fieldNode_t* textNode=buffer->addTextFieldNode(deferredNode,NULL,(name&&name[0])?name:L" ");
+	if(textNode&&!locale.empty()) textNode->addAttribute(L"language",locale);
+	++(this->deferredNodeCount);
+	return deferredNode;
+}
+
+wstring GeckoVBufBackend_t::getDebugInfo() const {
+	wostringstream s;
+	s<<VBufBackend_t::getDebugInfo()<<L", "<<this->eventCount<<L" events, peak "<<((this->eventRateCount>this->peakEventRate)?this->eventRateCount:this->peakEventRate)<<L" events per second, "<<this->reusedChildCount<<L" children reused, "<<this->deferredNodeCount<<L" deferred";
+	return s.str();
+}
+
 void CALLBACK GeckoVBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK hookID, DWORD eventID, HWND hwnd, long objectID, long childID, DWORD threadID, DWORD time) {
 	switch(eventID) {
+		case EVENT_OBJECT_DESTROY:
+		if(objectID==OBJID_WINDOW&&childID==CHILDID_SELF) {
+			backendsByWindowLock.acquire();
+			backendsByWindow.erase(hwnd);
+			backendsByWindowLock.release();
+		}
+		return;
 		case EVENT_OBJECT_FOCUS:
 		case EVENT_SYSTEM_ALERT:
 		case IA2_EVENT_TEXT_UPDATED:
@@ -984,14 +1255,11 @@ void CALLBACK GeckoVBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK ho
 	}
 	int docHandle=HandleToUlong(hwnd);
 	int ID=childID;
-	VBufBackend_t* backend=NULL;
-	for(VBufBackendSet_t::iterator i=runningBackends.begin();i!=runningBackends.end();++i) {
-		HWND rootWindow=(HWND)UlongToHandle(((*i)->rootDocHandle));
-		if(rootWindow==hwnd||IsChild(rootWindow,hwnd))
-			backend=(*i);
-		else
-			continue;
+	vector<GeckoVBufBackend_t*> backends=getBackendsForWindow(hwnd);
+	for(vector<GeckoVBufBackend_t*>::iterator i=backends.begin();i!=backends.end();++i) {
+		GeckoVBufBackend_t* backend=(*i);
 		LOG_DEBUG(L"found active backend for this window at "<<backend);
+		backend->countEvent(time);
 
 		//For focus and alert events, force any invalid nodes to be updated right now
 		if(eventID==EVENT_OBJECT_FOCUS||eventID==EVENT_SYSTEM_ALERT) {
@@ -1020,6 +1288,8 @@ void CALLBACK GeckoVBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK ho
 		}
 		if(!node)
 			continue;
+		if((eventID==IA2_EVENT_TEXT_INSERTED||eventID==IA2_EVENT_TEXT_REMOVED)&&applyTextChangeEvent(backend,node,docHandle,ID,eventID))
+			continue;
 		backend->invalidateSubtree(node);
 	}
 }
@@ -1027,11 +1297,15 @@ void CALLBACK GeckoVBufBackend_t::renderThread_winEventProcHook(HWINEVENTHOOK ho
 void GeckoVBufBackend_t::renderThread_initialize() {
 	registerWinEventHook(renderThread_winEventProcHook);
 	VBufBackend_t::renderThread_initialize();
+	// A new backend may own windows which already have cached backends.
+	clearBackendsByWindow();
 }
 
 void GeckoVBufBackend_t::renderThread_terminate() {
 	unregisterWinEventHook(renderThread_winEventProcHook);
 	VBufBackend_t::renderThread_terminate();
+	clearBackendsByWindow();
+	LOG_DEBUG(L"Backend at "<<this<<L" handled "<<this->eventCount<<L" events, peak "<<this->peakEventRate<<L" events per second");
 }
 
 void GeckoVBufBackend_t::render(VBufStorage_buffer_t* buffer, int docHandle, int ID, VBufStorage_controlFieldNode_t* oldNode) {
@@ -1044,11 +1318,13 @@ void GeckoVBufBackend_t::render(VBufStorage_buffer_t* buffer, int docHandle, int
 		// This is the root node.
 		this->versionSpecificInit(pacc);
 	}
+	this->rerenderingNode=oldNode;
 	this->fillVBuf(pacc, buffer, NULL, NULL);
+	this->rerenderingNode=NULL;
 	pacc->Release();
 }
 
-GeckoVBufBackend_t::GeckoVBufBackend_t(int docHandle, int ID): VBufBackend_t(docHandle,ID) {
+GeckoVBufBackend_t::GeckoVBufBackend_t(int docHandle, int ID): VBufBackend_t(docHandle,ID), rerenderingNode(NULL), reusedChildCount(0), deferredNodeCount(0), eventCount(0), eventRateCount(0), eventRateStartTime(0), peakEventRate(0) {
 }
 
 GeckoVBufBackend_t::~GeckoVBufBackend_t() {
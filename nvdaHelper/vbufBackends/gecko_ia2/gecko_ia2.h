@@ -15,6 +15,8 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #ifndef VIRTUALBUFFER_BACKENDS_EXAMPLE_H
 #define VIRTUALBUFFER_BACKENDS_EXAMPLE_H
 
+#include <map>
+#include <vector>
 #include <vbufBase/backend.h>
 
 class GeckoVBufBackend_t: public VBufBackend_t {
@@ -30,10 +32,76 @@ class GeckoVBufBackend_t: public VBufBackend_t {
 
 	void fillTableCellInfo_IATable2(VBufStorage_controlFieldNode_t* node, IAccessibleTableCell* paccTableCell);
 
+/**
+ * While re-rendering an invalidated subtree, copies the content already rendered for an embedded child if nothing in it has changed, saving fetching it all again.
+ * @return the copied node, or NULL if the child needs to be rendered.
+ */
+	VBufStorage_fieldNode_t* reuseUnchangedChild(IAccessible2* childPacc, VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parentNode, VBufStorage_fieldNode_t* previousNode);
+
+/**
+ * The invalidated node currently being re-rendered, or NULL during an initial render.
+ */
+	VBufStorage_controlFieldNode_t* rerenderingNode;
+
+/**
+ * The number of embedded children copied rather than rendered by reuseUnchangedChild.
+ */
+	unsigned long reusedChildCount;
+
+/**
+ * Renders a placeholder in place of an object's content, to be rendered once the user reaches it.
+ * @param node the node just added for the object, which must have no children yet.
+ * @param name the object's name, used as the placeholder text.
+ * @return the deferred node now representing the object, or NULL on failure.
+ */
+	VBufStorage_fieldNode_t* deferContent(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* node, const wchar_t* name, const std::wstring& locale);
+
+/**
+ * The number of objects whose content was deferred by deferContent.
+ */
+	unsigned long deferredNodeCount;
+
 	bool shouldDisableTableHeaders;
 	bool hasEncodedAccDescription;
 	bool canDetectLabelVisibility;
 
+/**
+ * The running backends that each window which has fired events belongs to,
+ * I.e. the backends whose root window is that window or one of its ancestors.
+ * Saves asking about the window hierarchy of every running backend on every event.
+ * Cleared when backends start or stop, and entries are removed when their window is destroyed.
+ */
+	static std::map<HWND,std::vector<GeckoVBufBackend_t*> > backendsByWindow;
+	static LockableObject backendsByWindowLock;
+
+/**
+ * Fetches the running backends a window belongs to, from backendsByWindow if possible, otherwise by checking the window hierarchy and caching the result.
+ */
+	static std::vector<GeckoVBufBackend_t*> getBackendsForWindow(HWND hwnd);
+
+/**
+ * Forgets the backends for all windows, E.g. when backends start or stop.
+ */
+	static void clearBackendsByWindow();
+
+/**
+ * The number of events handled for this backend, used to find documents causing a lot of work.
+ */
+	unsigned long eventCount;
+
+/**
+ * The number of events handled in the second starting at eventRateStartTime, and the most handled in any one second.
+ */
+	unsigned int eventRateCount;
+	DWORD eventRateStartTime;
+	unsigned int peakEventRate;
+
+/**
+ * Counts an event handled for this backend.
+ * @param time the time the event was fired, as given to the winEvent callback.
+ */
+	void countEvent(DWORD time);
+
 	protected:
 
 	static void CALLBACK renderThread_winEventProcHook(HWINEVENTHOOK hookID, DWORD eventID, HWND hwnd, long objectID, long childID, DWORD threadID, DWORD time);
@@ -50,6 +118,8 @@ class GeckoVBufBackend_t: public VBufBackend_t {
 
 	GeckoVBufBackend_t(int docHandle, int ID);
 
+	virtual std::wstring getDebugInfo() const;
+
 };
 
 #endif
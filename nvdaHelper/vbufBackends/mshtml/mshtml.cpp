@@ -760,7 +760,7 @@ VBufStorage_fieldNode_t* MshtmlVBufBackend_t::fillVBuf(VBufStorage_buffer_t* buf
 
 	//Handle text nodes
 	if(!shouldSkipText) { 
-		wstring s=getTextFromHTMLDOMNode(pHTMLDOMNode,allowPreformattedText,(parentNode&&parentNode->isBlock&&!previousNode));
+		wstring s=getTextFromHTMLDOMNode(pHTMLDOMNode,allowPreformattedText,(parentNode&&parentNode->isBlock()&&!previousNode));
 		if(!s.empty()) {
 			LOG_DEBUG(L"Got text from node");
 			VBufStorage_textFieldNode_t* textNode=buffer->addTextFieldNode(parentNode,previousNode,s);
@@ -904,7 +904,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 	bool wasInNewSubtree=inNewSubtree;
 	if(!wasInNewSubtree&&!oldNode) {
 		oldNode=this->getControlFieldNodeWithIdentifier(docHandle,ID);
-		if(oldNode&&oldNode->isHidden) oldNode=NULL;
+		if(oldNode&&oldNode->isHidden()) oldNode=NULL;
 		inNewSubtree=!oldNode;
 	}
 	//Add the node to the buffer
@@ -920,7 +920,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 
 	//We do not want to render any content for dontRender nodes
 	if(dontRender) {
-		parentNode->isHidden=true;
+		parentNode->setHidden(true);
 		return parentNode;
 	}
 
@@ -1012,7 +1012,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 		LIIndexPtr=NULL;
 	}
 
-	parentNode->isHidden=hidden;
+	parentNode->setHidden(hidden);
 
 	if(!hidden) {
 		//Collect and update table information
@@ -1286,7 +1286,7 @@ if(!(formatState&FORMATSTATE_INSERTED)&&nodeName.compare(L"INS")==0) {
 	}
 
 	//Update block setting on node
-	parentNode->isBlock=isBlock;
+	parentNode->setBlock(isBlock);
 
 	//Add all the collected attributes to the node
 	for(tempIter=attribsMap.begin();tempIter!=attribsMap.end();++tempIter) {
@@ -428,7 +428,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldStart=oldStart->getNext();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldStart)->text.compare(((VBufStorage_textFieldNode_t*)newStart)->text)!=0) {
+			if(((VBufStorage_textFieldNode_t*)oldStart)->getText().compare(((VBufStorage_textFieldNode_t*)newStart)->getText())!=0) {
 				break;
 			}
 			oldStart=oldStart->getNext();
@@ -446,7 +446,7 @@ void MshtmlVBufStorage_controlFieldNode_t::postProcessLiveRegion(VBufStorage_con
 				oldEnd=oldEnd->getPrevious();
 				continue;
 			}
-			if(((VBufStorage_textFieldNode_t*)oldEnd)->text.compare(((VBufStorage_textFieldNode_t*)newEnd)->text)!=0) {
+			if(((VBufStorage_textFieldNode_t*)oldEnd)->getText().compare(((VBufStorage_textFieldNode_t*)newEnd)->getText())!=0) {
 				break;
 			}
 			oldEnd=oldEnd->getPrevious();
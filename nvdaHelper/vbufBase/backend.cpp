@@ -13,6 +13,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
 #include <map>
+#include <vector>
 #define WIN32_LEAN_AND_MEAN 
 #include <windows.h>
 #include <remote/nvdaHelperRemote.h>
@@ -20,6 +21,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <remote/nvdaControllerInternal.h>
 #include <remote/inProcess.h>
 #include "storage.h"
+#include "changeLog.h"
 #include "backend.h"
 
 using namespace std;
@@ -134,18 +136,24 @@ void VBufBackend_t::renderThread_terminate() {
 	unregisterWinEventHook(renderThread_winEventProcHook);
 	LOG_DEBUG(L"Unregistered winEvent hook for window destructions");
 	LOG_DEBUG(L"Calling clearBuffer on backend at "<<this);
+	this->changedNodes.clear();
 	this->clearBuffer();
 	runningBackends.erase(this);
 }
 
 bool VBufBackend_t::invalidateSubtree(VBufStorage_controlFieldNode_t* node) {
+	VBufStorage_controlFieldNode_t* changedNode=node;
 	if(node->updateAncestor) node=node->updateAncestor;
+	//Queries from other threads can decompress nodes in to the buffer, so even checking the node must be done with the lock held.
+	this->lock.acquire();
 	if(!isNodeInBuffer(node)) {
+		this->lock.release();
 		LOG_DEBUGWARNING(L"Node at "<<node<<L" not in buffer at "<<this);
 		return false;
 	}
 	LOG_DEBUG(L"Invalidating node "<<node->getDebugInfo());
-	this->lock.acquire();
+	this->changedNodes.insert(changedNode);
+	if(node!=changedNode) this->changedNodes.insert(node);
 	bool needsInsert=true;
 	for(VBufStorage_controlFieldNodeList_t::iterator i=invalidSubtreeList.begin();i!=invalidSubtreeList.end();) {
 		VBufStorage_fieldNode_t* existingNode=*i;
@@ -205,21 +213,100 @@ void VBufBackend_t::update() {
 			replacementSubtreeMap.insert(make_pair(node,tempBuf));
 		}
 		this->lock.acquire();
+		//Forget the changed nodes that are about to be replaced, while they can still be compared.
+		//Nodes invalidated since the list was taken are still waiting to be re-rendered, so they stay changed.
+		for(std::set<VBufStorage_controlFieldNode_t*>::iterator i=this->changedNodes.begin();i!=this->changedNodes.end();) {
+			bool replaced=false;
+			for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator j=replacementSubtreeMap.begin();j!=replacementSubtreeMap.end();++j) {
+				if(*i==j->first||isDescendantNode(j->first,*i)) {
+					replaced=true;
+					break;
+				}
+			}
+			if(replaced) {
+				this->changedNodes.erase(i++);
+			} else {
+				++i;
+			}
+		}
 		LOG_DEBUG(L"Replacing nodes with content of temp buffers");
 		if(!this->replaceSubtrees(replacementSubtreeMap)) {
 			LOG_DEBUGWARNING(L"Error replacing one or more subtrees");
 		}
+		//Only compress once nothing is waiting to be re-rendered, as invalidated nodes must stay where they are until then.
+		if(this->invalidSubtreeList.empty()) this->compressColdSubtrees();
+		//Queries decompress subtrees under the lock, so the stats can only be read while holding it.
+		if(this->isOverMemoryLimit()) {
+			LOG_DEBUGWARNING(L"Over memory limit: "<<this->getDebugInfo());
+		}
 		this->lock.release();
 		nvdaControllerInternal_vbufChangeNotify(this->rootDocHandle,this->rootID);
 	} else {
 		LOG_DEBUG(L"Initial render");
 		this->lock.acquire();
 		render(this,rootDocHandle,rootID);
+		//Attributes were added after nodes were inserted, so count everything again now rendering is finished.
+		this->recalculateMemoryStats();
+		if(this->invalidSubtreeList.empty()) this->compressColdSubtrees();
+		//The first render is not made of replacements, so any mirror needs the whole buffer.
+		if(this->changeLog) this->changeLog->recordReset(this);
+		if(this->isOverMemoryLimit()) {
+			LOG_DEBUGWARNING(L"Over memory limit: "<<this->getDebugInfo());
+		}
 		this->lock.release();
 	}
 	LOG_DEBUG(L"Update complete");
 }
 
+VBufStorage_controlFieldNode_t* VBufBackend_t::getControlFieldNodeWithIdentifier(int docHandle, int ID) {
+	this->lock.acquire();
+	VBufStorage_controlFieldNode_t* node=this->VBufStorage_buffer_t::getControlFieldNodeWithIdentifier(docHandle,ID);
+	this->lock.release();
+	return node;
+}
+
+bool VBufBackend_t::isSubtreeUnchanged(VBufStorage_controlFieldNode_t* node) {
+	this->lock.acquire();
+	bool unchanged=true;
+	for(auto changedNode: this->changedNodes) {
+		if(changedNode==node||isDescendantNode(node,changedNode)) {
+			unchanged=false;
+			break;
+		}
+	}
+	this->lock.release();
+	return unchanged;
+}
+
+void VBufBackend_t::renderDeferredContentInRange(int startOffset, int endOffset) {
+	vector<VBufStorage_deferredFieldNode_t*> deferredNodes;
+	vector<VBufStorage_controlFieldNodeIdentifier_t> identifiers;
+	this->lock.acquire();
+	this->getDeferredFieldNodesInRange(startOffset,endOffset,deferredNodes);
+	for(auto node: deferredNodes) {
+		int docHandle=0, ID=0;
+		node->getIdentifier(&docHandle,&ID);
+		identifiers.push_back(VBufStorage_controlFieldNodeIdentifier_t(docHandle,ID));
+	}
+	this->lock.release();
+	if(identifiers.empty()) {
+		return;
+	}
+	LOG_DEBUG(L"Rendering content of "<<identifiers.size()<<L" deferred nodes");
+	// The nodes may have been replaced by the time the render thread gets to them, so look them up again there.
+	auto func = [&] {
+		for(auto& identifier: identifiers) {
+			VBufStorage_controlFieldNode_t* node=this->getControlFieldNodeWithIdentifier(identifier.docHandle,identifier.ID);
+			if(node&&node->isDeferred()) {
+				this->invalidateSubtree(node);
+			}
+		}
+	};
+	if(!execInThread(this->renderThreadID,func)) {
+		LOG_DEBUGWARNING(L"Could not invalidate deferred nodes in render thread");
+	}
+}
+
 void VBufBackend_t::terminate() {
 	if(runningBackends.count(this)>0) {
 		LOG_DEBUG(L"Render thread not terminated yet");
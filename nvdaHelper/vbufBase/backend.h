@@ -57,6 +57,12 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	VBufStorage_controlFieldNodeList_t invalidSubtreeList;
 
+/**
+ * Every node invalidated and not yet re-rendered, including those merged in to an invalidated ancestor in invalidSubtreeList.
+ * Entries are removed as the subtrees containing them are replaced.
+ */
+	std::set<VBufStorage_controlFieldNode_t*> changedNodes;
+
 	protected:
 
 /**
@@ -105,6 +111,14 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	void update();
 
+/**
+ * Works out whether anything in a subtree has been invalidated since the last update.
+ * While an invalid ancestor is being re-rendered, such a subtree can be copied in to the new content with copySubtree instead of being rendered again.
+ * @param node the root of the subtree, which must be in this buffer.
+ * @return true if neither the node nor any of its descendants was invalidated.
+ */
+	bool isSubtreeUnchanged(VBufStorage_controlFieldNode_t* node);
+
 /**
  * Destructor, (protected as you must use the destroy method).
  */
@@ -146,6 +160,23 @@ static LRESULT CALLBACK destroy_callWndProcHook(int code, WPARAM wParam, LPARAM
  */
 	virtual void forceUpdate();
 
+/**
+ * Finds a control field node by its identifier while holding the lock.
+ * Finding a node can decompress the subtree it is in, which changes the buffer, so backends must use this rather than the unlocked lookup of the storage buffer.
+ * @param docHandle the docHandle of the node.
+ * @param ID the ID of the node.
+ * @return the node, or NULL if there is no node with the identifier.
+ */
+	VBufStorage_controlFieldNode_t* getControlFieldNodeWithIdentifier(int docHandle, int ID);
+
+/**
+ * Requests that the content of any deferred field nodes containing text between the given offsets be rendered, E.g. because the user has reached them.
+ * The nodes are invalidated in the render thread, so this must be called without holding the lock.
+ * @param startOffset the offset to start from.
+ * @param endOffset the offset to end at. Use -1 to mean end of buffer.
+ */
+	void renderDeferredContentInRange(int startOffset, int endOffset);
+
 /**
  * Clears the content of the backend and terminates any code used for rendering.
  */
@@ -0,0 +1,353 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include <common/log.h>
+#include "encoding.h"
+#include "storage.h"
+#include "changeLog.h"
+
+using namespace std;
+
+/**
+ * Each record starts with a byte holding its kind.
+ * A subtree is written in the binary node format (see VBufStorage_buffer_t::encodeNode) as a list of at most one node, ended by an end byte.
+ * VBUFSTORAGE_CHANGE_RESET: the selection start and length, then the subtree of the root node.
+ * VBUFSTORAGE_CHANGE_REPLACE: the number of nodes replaced, then for each, its docHandle and ID followed by the subtree replacing it.
+ * VBUFSTORAGE_CHANGE_INSERTTEXT: the position of the text field node (its parent's docHandle and ID and its index among its parent's children), the offset in the node and the text.
+ * VBUFSTORAGE_CHANGE_REMOVETEXT: the position of the text field node, the offset in the node and the number of characters.
+ * VBUFSTORAGE_CHANGE_CLEAR: nothing more.
+ */
+#define VBUFSTORAGE_CHANGE_RESET 1
+#define VBUFSTORAGE_CHANGE_REPLACE 2
+#define VBUFSTORAGE_CHANGE_INSERTTEXT 3
+#define VBUFSTORAGE_CHANGE_REMOVETEXT 4
+#define VBUFSTORAGE_CHANGE_CLEAR 5
+
+/**
+ * Writes the position of a text field node in a way which can be found again in a replica.
+ * @return true if successful, false if the node has no parent to find it by.
+ */
+bool encodeTextFieldNodePosition(VBufStorage_textFieldNode_t* node, VBufStorage_encoder_t& encoder) {
+	VBufStorage_controlFieldNode_t* parent=node->getParent();
+	int docHandle=0, ID=0;
+	if(!parent||!parent->getIdentifier(&docHandle,&ID)) return false;
+	unsigned int index=0;
+	for(VBufStorage_fieldNode_t* child=parent->getFirstChild();child!=node;child=child->getNext()) {
+		if(!child) return false;
+		++index;
+	}
+	encoder.writeSigned(docHandle);
+	encoder.writeSigned(ID);
+	encoder.writeUnsigned(index);
+	return true;
+}
+
+/**
+ * Finds a text field node in a replica from the position written by encodeTextFieldNodePosition.
+ * @return the node, or NULL if the position is damaged or there is no text field node there.
+ */
+VBufStorage_textFieldNode_t* decodeTextFieldNodePosition(VBufStorage_buffer_t* replica, VBufStorage_decoder_t& decoder) {
+	int docHandle, ID;
+	unsigned int index;
+	if(!decoder.readSigned(&docHandle)||!decoder.readSigned(&ID)||!decoder.readUnsigned(&index)) return NULL;
+	VBufStorage_controlFieldNode_t* parent=replica->getControlFieldNodeWithIdentifier(docHandle,ID);
+	if(!parent) return NULL;
+	VBufStorage_fieldNode_t* child=parent->getFirstChild();
+	for(;child!=NULL&&index>0;--index) child=child->getNext();
+	return dynamic_cast<VBufStorage_textFieldNode_t*>(child);
+}
+
+VBufStorage_buffer_t* VBufStorage_changeLog_t::decodeSubtree(VBufStorage_decoder_t& decoder) {
+	VBufStorage_buffer_t* buffer=new VBufStorage_buffer_t();
+	if(!buffer->decodeNodes(decoder,NULL,NULL)) {
+		delete buffer;
+		return NULL;
+	}
+	return buffer;
+}
+
+void VBufStorage_changeLog_t::writeRecord(const VBufStorage_encoder_t& encoder) {
+	if(!this->write(encoder.bytes)) {
+		LOG_DEBUG(L"Change of "<<encoder.bytes.size()<<L" bytes dropped, change log now out of sync");
+		this->desync();
+	}
+}
+
+void VBufStorage_changeLog_t::recordReplace(VBufStorage_buffer_t* buffer, const map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m) {
+	if(!this->isInSync()) return;
+	//replaceSubtrees skips a node which is not in the buffer, so the replica must too.
+	vector<pair<VBufStorage_controlFieldNode_t*,VBufStorage_buffer_t*> > replacements;
+	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::const_iterator i=m.begin();i!=m.end();++i) {
+		if(i->second==buffer||!buffer->isNodeInBuffer(i->first)) continue;
+		VBufStorage_controlFieldNode_t* node=dynamic_cast<VBufStorage_controlFieldNode_t*>(i->first);
+		if(!node) {
+			LOG_DEBUGWARNING(L"Can not record the replacement of node "<<i->first->getDebugInfo());
+			this->desync();
+			return;
+		}
+		replacements.push_back(make_pair(node,i->second));
+	}
+	VBufStorage_encoder_t encoder;
+	encoder.writeByte(VBUFSTORAGE_CHANGE_REPLACE);
+	encoder.writeUnsigned(static_cast<unsigned int>(replacements.size()));
+	for(vector<pair<VBufStorage_controlFieldNode_t*,VBufStorage_buffer_t*> >::iterator i=replacements.begin();i!=replacements.end();++i) {
+		int docHandle=0, ID=0;
+		i->first->getIdentifier(&docHandle,&ID);
+		encoder.writeSigned(docHandle);
+		encoder.writeSigned(ID);
+		VBufStorage_buffer_t* newBuffer=i->second;
+		size_t freedBytes=0;
+		if(newBuffer->rootNode&&!newBuffer->encodeNode(newBuffer->rootNode,encoder,NULL,freedBytes)) {
+			this->desync();
+			return;
+		}
+		encoder.writeByte(VBUFSTORAGE_NODEKIND_END);
+	}
+	this->writeRecord(encoder);
+}
+
+void VBufStorage_changeLog_t::recordInsertText(VBufStorage_textFieldNode_t* node, int offset, const wstring& text) {
+	if(!this->isInSync()) return;
+	VBufStorage_encoder_t encoder;
+	encoder.writeByte(VBUFSTORAGE_CHANGE_INSERTTEXT);
+	if(!encodeTextFieldNodePosition(node,encoder)) {
+		this->desync();
+		return;
+	}
+	encoder.writeUnsigned(offset);
+	encoder.writeString(text);
+	this->writeRecord(encoder);
+}
+
+void VBufStorage_changeLog_t::recordRemoveText(VBufStorage_textFieldNode_t* node, int offset, int count) {
+	if(!this->isInSync()) return;
+	VBufStorage_encoder_t encoder;
+	encoder.writeByte(VBUFSTORAGE_CHANGE_REMOVETEXT);
+	if(!encodeTextFieldNodePosition(node,encoder)) {
+		this->desync();
+		return;
+	}
+	encoder.writeUnsigned(offset);
+	encoder.writeUnsigned(count);
+	this->writeRecord(encoder);
+}
+
+void VBufStorage_changeLog_t::recordClear() {
+	if(!this->isInSync()) return;
+	VBufStorage_encoder_t encoder;
+	encoder.writeByte(VBUFSTORAGE_CHANGE_CLEAR);
+	this->writeRecord(encoder);
+}
+
+void VBufStorage_changeLog_t::recordReset(VBufStorage_buffer_t* buffer) {
+	if(!this->isInSync()) return;
+	VBufStorage_encoder_t encoder;
+	if(!encodeReset(buffer,encoder)) {
+		this->desync();
+		return;
+	}
+	this->writeRecord(encoder);
+}
+
+bool VBufStorage_changeLog_t::encodeReset(VBufStorage_buffer_t* buffer, VBufStorage_encoder_t& encoder) {
+	encoder.writeByte(VBUFSTORAGE_CHANGE_RESET);
+	encoder.writeSigned(buffer->selectionStart);
+	encoder.writeSigned(buffer->selectionLength);
+	size_t freedBytes=0;
+	if(buffer->rootNode&&!buffer->encodeNode(buffer->rootNode,encoder,NULL,freedBytes)) {
+		return false;
+	}
+	encoder.writeByte(VBUFSTORAGE_NODEKIND_END);
+	return true;
+}
+
+bool VBufStorage_changeLog_t::apply(VBufStorage_buffer_t* replica, const unsigned char* record, size_t size) {
+	VBufStorage_decoder_t decoder(record,size);
+	unsigned char kind;
+	if(!decoder.readByte(&kind)) return false;
+	if(kind==VBUFSTORAGE_CHANGE_RESET) {
+		int selectionStart, selectionLength;
+		if(!decoder.readSigned(&selectionStart)||!decoder.readSigned(&selectionLength)) return false;
+		if(!replica->rootNode) {
+			if(!replica->decodeNodes(decoder,NULL,NULL)||!decoder.atEnd()) {
+				replica->clearBuffer();
+				return false;
+			}
+			replica->setSelectionOffsets(selectionStart,selectionStart+selectionLength);
+			return true;
+		}
+		VBufStorage_buffer_t* newBuffer=decodeSubtree(decoder);
+		if(!newBuffer||!decoder.atEnd()) {
+			delete newBuffer;
+			return false;
+		}
+		if(!newBuffer->rootNode) {
+			delete newBuffer;
+			replica->clearBuffer();
+			return true;
+		}
+		//Replace the whole tree as an update would, so that the replica's selection and pinned offsets stay where they were.
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		m.insert(make_pair(replica->rootNode,newBuffer));
+		replica->replaceSubtrees(m);
+		return true;
+	} else if(kind==VBUFSTORAGE_CHANGE_REPLACE) {
+		unsigned int count;
+		if(!decoder.readUnsigned(&count)) return false;
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		bool valid=true;
+		for(unsigned int i=0;i<count&&valid;++i) {
+			int docHandle, ID;
+			valid=decoder.readSigned(&docHandle)&&decoder.readSigned(&ID);
+			VBufStorage_controlFieldNode_t* node=valid?replica->findControlFieldNode(VBufStorage_controlFieldNodeIdentifier_t(docHandle,ID)):NULL;
+			VBufStorage_buffer_t* newBuffer=valid?decodeSubtree(decoder):NULL;
+			valid=node&&newBuffer&&m.insert(make_pair(node,newBuffer)).second;
+			if(!valid) delete newBuffer;
+		}
+		if(!valid||!decoder.atEnd()) {
+			for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) delete i->second;
+			return false;
+		}
+		//As in the recorded buffer, any nodes which could not be replaced or duplicate identifiers are dealt with by replaceSubtrees, so the replica still matches.
+		replica->replaceSubtrees(m);
+		return true;
+	} else if(kind==VBUFSTORAGE_CHANGE_INSERTTEXT) {
+		VBufStorage_textFieldNode_t* node=decodeTextFieldNodePosition(replica,decoder);
+		unsigned int offset;
+		wstring text;
+		if(!node||!decoder.readUnsigned(&offset)||!decoder.readString(text)||!decoder.atEnd()) return false;
+		return replica->insertText(node,offset,text);
+	} else if(kind==VBUFSTORAGE_CHANGE_REMOVETEXT) {
+		VBufStorage_textFieldNode_t* node=decodeTextFieldNodePosition(replica,decoder);
+		unsigned int offset, count;
+		if(!node||!decoder.readUnsigned(&offset)||!decoder.readUnsigned(&count)||!decoder.atEnd()) return false;
+		return replica->removeText(node,offset,count);
+	} else if(kind==VBUFSTORAGE_CHANGE_CLEAR) {
+		if(!decoder.atEnd()) return false;
+		replica->clearBuffer();
+		return true;
+	}
+	LOG_DEBUGWARNING(L"Unknown change kind "<<static_cast<int>(kind));
+	return false;
+}
+
+//channel implementation
+
+size_t VBufStorage_changeLogChannel_t::getMemorySize(unsigned int capacity) {
+	return sizeof(VBufStorage_changeLogChannelHeader_t)+capacity;
+}
+
+VBufStorage_changeLogChannel_t::VBufStorage_changeLogChannel_t(void* memory, size_t size, bool create): header(NULL), data(NULL), capacity(0) {
+	if(size<=sizeof(VBufStorage_changeLogChannelHeader_t)) return;
+	size_t available=size-sizeof(VBufStorage_changeLogChannelHeader_t);
+	VBufStorage_changeLogChannelHeader_t* header=static_cast<VBufStorage_changeLogChannelHeader_t*>(memory);
+	unsigned int capacity=1;
+	if(create) {
+		//Use the largest power of 2 which fits, up to half of the range of a position, so that a full ring can be told from an empty one.
+		while(capacity<=0x40000000u&&static_cast<size_t>(capacity)*2<=available) capacity*=2;
+		header=new(memory) VBufStorage_changeLogChannelHeader_t();
+		header->version=VBUFSTORAGE_CHANGELOGCHANNEL_VERSION;
+		header->capacity=capacity;
+		header->writePosition.store(0);
+		header->readPosition.store(0);
+		header->outOfSync.store(0);
+	} else {
+		capacity=header->capacity;
+		if(header->version!=VBUFSTORAGE_CHANGELOGCHANNEL_VERSION||capacity==0||capacity>available||capacity>0x80000000u||(capacity&(capacity-1))!=0) {
+			LOG_DEBUGWARNING(L"Memory at "<<memory<<L" does not hold a change log channel of this version");
+			return;
+		}
+	}
+	this->header=header;
+	this->capacity=capacity;
+	this->data=static_cast<unsigned char*>(memory)+sizeof(VBufStorage_changeLogChannelHeader_t);
+}
+
+bool VBufStorage_changeLogChannel_t::isValid() const {
+	return this->header!=NULL;
+}
+
+void VBufStorage_changeLogChannel_t::copyIn(unsigned int position, const unsigned char* bytes, size_t count) {
+	size_t start=position&(this->capacity-1);
+	size_t firstPart=min(count,this->capacity-start);
+	memcpy(this->data+start,bytes,firstPart);
+	memcpy(this->data,bytes+firstPart,count-firstPart);
+}
+
+void VBufStorage_changeLogChannel_t::copyOut(unsigned int position, unsigned char* bytes, size_t count) const {
+	size_t start=position&(this->capacity-1);
+	size_t firstPart=min(count,this->capacity-start);
+	memcpy(bytes,this->data+start,firstPart);
+	memcpy(bytes+firstPart,this->data,count-firstPart);
+}
+
+bool VBufStorage_changeLogChannel_t::write(const vector<unsigned char>& record) {
+	if(!this->header||this->header->outOfSync.load()) return false;
+	unsigned int writePosition=this->header->writePosition.load(memory_order_relaxed);
+	unsigned int used=writePosition-this->header->readPosition.load(memory_order_acquire);
+	if(used>this->capacity||record.size()>this->capacity||4+record.size()>this->capacity-used) {
+		return false;
+	}
+	unsigned int length=static_cast<unsigned int>(record.size());
+	unsigned char lengthBytes[4]={static_cast<unsigned char>(length),static_cast<unsigned char>(length>>8),static_cast<unsigned char>(length>>16),static_cast<unsigned char>(length>>24)};
+	this->copyIn(writePosition,lengthBytes,4);
+	if(length>0) this->copyIn(writePosition+4,record.data(),length);
+	//Only make the record visible once all of it is there.
+	this->header->writePosition.store(writePosition+4+length,memory_order_release);
+	return true;
+}
+
+bool VBufStorage_changeLogChannel_t::isInSync() {
+	return this->header&&!this->header->outOfSync.load();
+}
+
+void VBufStorage_changeLogChannel_t::desync() {
+	if(this->header) this->header->outOfSync.store(1);
+}
+
+bool VBufStorage_changeLogChannel_t::read(vector<unsigned char>& record) {
+	if(!this->header) return false;
+	unsigned int readPosition=this->header->readPosition.load(memory_order_relaxed);
+	unsigned int writePosition=this->header->writePosition.load(memory_order_acquire);
+	unsigned int available=writePosition-readPosition;
+	if(available==0) return false;
+	unsigned char lengthBytes[4]={0};
+	if(available>=4) this->copyOut(readPosition,lengthBytes,4);
+	unsigned int length=lengthBytes[0]|(lengthBytes[1]<<8)|(lengthBytes[2]<<16)|(static_cast<unsigned int>(lengthBytes[3])<<24);
+	if(available<4||available>this->capacity||length>available-4) {
+		//The other process must have written something other than records.
+		LOG_ERROR(L"Change log channel damaged, skipping "<<available<<L" bytes");
+		this->header->readPosition.store(writePosition,memory_order_release);
+		this->desync();
+		return false;
+	}
+	record.resize(length);
+	if(length>0) this->copyOut(readPosition+4,record.data(),length);
+	//Only let the writer reuse the space once the record has been copied out.
+	this->header->readPosition.store(readPosition+4+length,memory_order_release);
+	return true;
+}
+
+void VBufStorage_changeLogChannel_t::reset() {
+	if(!this->header) return;
+	this->header->readPosition.store(this->header->writePosition.load());
+	this->header->outOfSync.store(0);
+}
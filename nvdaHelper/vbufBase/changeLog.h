@@ -0,0 +1,215 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_CHANGELOG_H
+#define VIRTUALBUFFER_CHANGELOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include "storage.h"
+
+/**
+ * Records the changes made to a buffer, so that a replica of the buffer, such as one in another process, can be kept up to date with VBufStorage_changeLog_t::apply.
+ * Each change is encoded as a record which does not depend on the platform or on where nodes are in memory: nodes are found by their identifiers, and new content is written in the binary node format.
+ * Subclasses decide where records are kept. See VBufStorage_buffer_t::setChangeLog.
+ * If a record is dropped, or a change can not be recorded, the log is out of sync and records no more changes until its owner has reset the replica from a snapshot of the whole buffer (see encodeReset) and marked the log in sync again.
+ */
+class VBufStorage_changeLog_t {
+	private:
+
+/**
+ * Keeps an encoded record if the log is in sync, marking the log out of sync if the record could not be kept.
+ */
+	void writeRecord(const VBufStorage_encoder_t& encoder);
+
+/**
+ * Reads a subtree written in the binary node format in to a new buffer.
+ * @return the buffer, which has no root node if the subtree was empty, or NULL if the subtree was damaged.
+ */
+	static VBufStorage_buffer_t* decodeSubtree(VBufStorage_decoder_t& decoder);
+
+	public:
+
+	virtual ~VBufStorage_changeLog_t() {}
+
+/**
+ * Keeps a record. Records are written in the order the changes were made.
+ * @param record the encoded change.
+ * @return true if the record was kept, false if it was dropped.
+ */
+	virtual bool write(const std::vector<unsigned char>& record)=0;
+
+/**
+ * @return false if a record has been dropped or a change could not be recorded since the log was last in sync, true otherwise.
+ */
+	virtual bool isInSync()=0;
+
+/**
+ * Marks the log as out of sync.
+ */
+	virtual void desync()=0;
+
+/**
+ * Records that subtrees of a buffer are being replaced. Called by VBufStorage_buffer_t::replaceSubtrees before it replaces them.
+ * @param buffer the buffer whose subtrees are being replaced.
+ * @param m the nodes being replaced, each with the buffer holding its replacement.
+ */
+	void recordReplace(VBufStorage_buffer_t* buffer, const std::map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m);
+
+/**
+ * Records that text was inserted in to a text field node. Called by VBufStorage_buffer_t::insertText.
+ */
+	void recordInsertText(VBufStorage_textFieldNode_t* node, int offset, const std::wstring& text);
+
+/**
+ * Records that text was removed from a text field node. Called by VBufStorage_buffer_t::removeText.
+ */
+	void recordRemoveText(VBufStorage_textFieldNode_t* node, int offset, int count);
+
+/**
+ * Records that a buffer was cleared. Called by VBufStorage_buffer_t::clearBuffer.
+ */
+	void recordClear();
+
+/**
+ * Records the whole content of a buffer, for when it has changed in a way which can not be recorded otherwise.
+ * Such a record is usually large, so the log may well drop it and so go out of sync.
+ * @param buffer the buffer.
+ */
+	void recordReset(VBufStorage_buffer_t* buffer);
+
+/**
+ * Encodes the whole content of a buffer as a record, which brings a replica up to date however far out of sync it is.
+ * The replica keeps its own selection and pinned offsets, anchored as for VBufStorage_buffer_t::replaceSubtrees, unless it was empty, in which case it takes the buffer's selection.
+ * @param buffer the buffer.
+ * @param encoder where to write the record.
+ * @return true if successful, false if the content could not be encoded.
+ */
+	static bool encodeReset(VBufStorage_buffer_t* buffer, VBufStorage_encoder_t& encoder);
+
+/**
+ * Applies a record to a replica of the buffer it was recorded from.
+ * @param replica the replica, which must have had every earlier record applied to it since it was last reset.
+ * @param record the encoded change.
+ * @param size the size of the record in bytes.
+ * @return true if successful, false if the record was damaged or did not match the replica, in which case the replica needs to be reset.
+ */
+	static bool apply(VBufStorage_buffer_t* replica, const unsigned char* record, size_t size);
+
+};
+
+/**
+ * The start of the memory shared by the writer and reader of a change log channel, which the records follow.
+ * Every field is 32 bits, so that the layout is the same for 32 and 64 bit processes.
+ * Positions count bytes since the channel was set up, wrapping around at 2^32, so the capacity must be a power of 2.
+ */
+typedef struct {
+/**
+ * The version of the channel layout and record format, VBUFSTORAGE_CHANGELOGCHANNEL_VERSION.
+ */
+	unsigned int version;
+/**
+ * The number of bytes available for records after the header.
+ */
+	unsigned int capacity;
+/**
+ * The position after the last record written, only changed by the writer.
+ */
+	std::atomic<unsigned int> writePosition;
+/**
+ * The position of the next record to read, only changed by the reader, or by VBufStorage_changeLogChannel_t::reset.
+ */
+	std::atomic<unsigned int> readPosition;
+/**
+ * Non-zero if a record has been dropped, in which case the writer writes no more until the channel is reset.
+ */
+	std::atomic<unsigned int> outOfSync;
+} VBufStorage_changeLogChannelHeader_t;
+
+#define VBUFSTORAGE_CHANGELOGCHANNEL_VERSION 1
+
+/**
+ * A change log which passes records from one process to another through a block of shared memory, used as a ring of length-prefixed records.
+ * There must be only one writer and one reader, and neither ever waits for the other: if there is no room for a record, it is dropped and the channel is out of sync.
+ * The reader can tell, and brings its replica back in sync by having the writer's process reset the channel and encode a snapshot of the buffer (see VBufStorage_changeLog_t::encodeReset) while it waits.
+ */
+class VBufStorage_changeLogChannel_t: public VBufStorage_changeLog_t {
+	private:
+
+	VBufStorage_changeLogChannelHeader_t* header;
+
+	unsigned char* data;
+
+/**
+ * The capacity from the header, kept here once checked, as the other process could change the header afterwards.
+ */
+	unsigned int capacity;
+
+/**
+ * Copies bytes in to the ring at the given position, wrapping around at the end.
+ */
+	void copyIn(unsigned int position, const unsigned char* bytes, size_t count);
+
+/**
+ * Copies bytes out of the ring from the given position, wrapping around at the end.
+ */
+	void copyOut(unsigned int position, unsigned char* bytes, size_t count) const;
+
+	public:
+
+/**
+ * @param capacity the number of bytes available for records, which must be a power of 2.
+ * @return the number of bytes of shared memory needed for a channel.
+ */
+	static size_t getMemorySize(unsigned int capacity);
+
+/**
+ * constructor.
+ * @param memory the shared memory, aligned for 32 bit values (as mapped memory always is). It must outlive the channel.
+ * @param size the size of the memory in bytes.
+ * @param create true to set up a new channel using all of the memory, which should be done by the reader before the writer is told about it, false to use a channel already set up.
+ */
+	VBufStorage_changeLogChannel_t(void* memory, size_t size, bool create);
+
+/**
+ * @return false if the memory was too small or did not hold a channel of this version, in which case nothing can be written or read.
+ */
+	bool isValid() const;
+
+	virtual bool write(const std::vector<unsigned char>& record);
+
+	virtual bool isInSync();
+
+	virtual void desync();
+
+/**
+ * Reads the next record, for the reader.
+ * If the records in the channel are found to be damaged, they are skipped and the channel is marked out of sync.
+ * @param record where to place the record. It is replaced.
+ * @return true if a record was read, false if there are none.
+ */
+	bool read(std::vector<unsigned char>& record);
+
+/**
+ * Discards any unread records and marks the channel in sync, for when a snapshot of the buffer is taken.
+ * This moves the read position, so it must only be done while the reader is waiting for the snapshot, and while nothing is being written.
+ */
+	void reset();
+
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#include <cwchar>
+#include <string>
+#include <vector>
+#include "encoding.h"
+
+using namespace std;
+
+//encoder implementation
+
+void VBufStorage_encoder_t::writeByte(unsigned char value) {
+	this->bytes.push_back(value);
+}
+
+void VBufStorage_encoder_t::writeUnsigned(unsigned int value) {
+	while(value>=0x80) {
+		this->bytes.push_back(static_cast<unsigned char>((value&0x7f)|0x80));
+		value>>=7;
+	}
+	this->bytes.push_back(static_cast<unsigned char>(value));
+}
+
+void VBufStorage_encoder_t::writeSigned(int value) {
+	unsigned int bits=static_cast<unsigned int>(value);
+	this->writeUnsigned((bits<<1)^((value<0)?0xffffffffu:0));
+}
+
+void VBufStorage_encoder_t::writeCharacters(const wchar_t* characters, size_t count) {
+	for(size_t i=0;i<count;++i) {
+		this->writeUnsigned(static_cast<unsigned int>(characters[i]));
+	}
+}
+
+void VBufStorage_encoder_t::writeString(const wstring& str) {
+	this->writeUnsigned(static_cast<unsigned int>(str.length()));
+	this->writeCharacters(str.data(),str.length());
+}
+
+//decoder implementation
+
+VBufStorage_decoder_t::VBufStorage_decoder_t(const unsigned char* bytes, size_t size): position(bytes), end(bytes+size) {}
+
+bool VBufStorage_decoder_t::readByte(unsigned char* value) {
+	if(this->position==this->end) return false;
+	*value=*(this->position++);
+	return true;
+}
+
+bool VBufStorage_decoder_t::readUnsigned(unsigned int* value) {
+	unsigned int result=0;
+	for(int shift=0;shift<32;shift+=7) {
+		if(this->position==this->end) return false;
+		unsigned char byte=*(this->position++);
+		if(shift==28&&byte>0x0f) return false;
+		result|=static_cast<unsigned int>(byte&0x7f)<<shift;
+		if(!(byte&0x80)) {
+			*value=result;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool VBufStorage_decoder_t::readSigned(int* value) {
+	unsigned int bits;
+	if(!this->readUnsigned(&bits)) return false;
+	*value=static_cast<int>((bits>>1)^(0u-(bits&1)));
+	return true;
+}
+
+bool VBufStorage_decoder_t::readString(wstring& str) {
+	unsigned int length;
+	//Every character takes at least one byte, so a longer length can only come from damaged data.
+	if(!this->readUnsigned(&length)||length>static_cast<size_t>(this->end-this->position)) return false;
+	str.resize(length);
+	for(unsigned int i=0;i<length;++i) {
+		unsigned int character;
+		if(!this->readUnsigned(&character)||character>static_cast<unsigned int>(WCHAR_MAX)) return false;
+		str[i]=static_cast<wchar_t>(character);
+	}
+	return true;
+}
+
+//block compression
+
+/**
+ * The shortest copy the compressor will use.
+ */
+#define LZ4_MINMATCH 4
+
+/**
+ * The block format requires the last 5 bytes to be literals, and the last copy to start at least 12 bytes before the end.
+ */
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+
+/**
+ * The furthest back a copy can come from.
+ */
+#define LZ4_MAXDISTANCE 65535
+
+/**
+ * The number of bits used to index the table of recently seen positions.
+ */
+#define LZ4_HASHLOG 12
+
+inline unsigned int readUint32(const unsigned char* p) {
+	return static_cast<unsigned int>(p[0])|(static_cast<unsigned int>(p[1])<<8)|(static_cast<unsigned int>(p[2])<<16)|(static_cast<unsigned int>(p[3])<<24);
+}
+
+inline unsigned int hashUint32(unsigned int value) {
+	return (value*2654435761u)>>(32-LZ4_HASHLOG);
+}
+
+/**
+ * Writes the part of a length which did not fit in its 4 bit field of the token, as a run of 255s ending with a smaller byte.
+ */
+inline void writeExtendedLength(vector<unsigned char>& output, size_t length) {
+	for(;length>=255;length-=255) output.push_back(255);
+	output.push_back(static_cast<unsigned char>(length));
+}
+
+/**
+ * Writes literal bytes followed by a copy, or just literal bytes if matchLength is 0 (only used for the last sequence).
+ */
+void writeSequence(vector<unsigned char>& output, const unsigned char* literals, size_t literalLength, size_t distance, size_t matchLength) {
+	size_t matchCode=(matchLength>0)?matchLength-LZ4_MINMATCH:0;
+	output.push_back(static_cast<unsigned char>(((literalLength<15?literalLength:15)<<4)|(matchCode<15?matchCode:15)));
+	if(literalLength>=15) writeExtendedLength(output,literalLength-15);
+	output.insert(output.end(),literals,literals+literalLength);
+	if(matchLength==0) return;
+	output.push_back(static_cast<unsigned char>(distance&0xff));
+	output.push_back(static_cast<unsigned char>(distance>>8));
+	if(matchCode>=15) writeExtendedLength(output,matchCode-15);
+}
+
+void VBufStorage_compressBlock(const vector<unsigned char>& input, vector<unsigned char>& output) {
+	output.clear();
+	const unsigned char* data=input.data();
+	size_t size=input.size();
+	size_t anchor=0;
+	if(size>LZ4_MFLIMIT) {
+		//The last position seen with each hash, plus 1 so that 0 means none.
+		vector<size_t> table(1<<LZ4_HASHLOG,0);
+		size_t matchStartLimit=size-LZ4_MFLIMIT;
+		size_t matchEndLimit=size-LZ4_LASTLITERALS;
+		for(size_t position=0;position<matchStartLimit;) {
+			unsigned int sequence=readUint32(data+position);
+			size_t& entry=table[hashUint32(sequence)];
+			size_t candidate=entry;
+			entry=position+1;
+			if(candidate==0||position-(candidate-1)>LZ4_MAXDISTANCE||readUint32(data+candidate-1)!=sequence) {
+				++position;
+				continue;
+			}
+			--candidate;
+			size_t matchLength=LZ4_MINMATCH;
+			while(position+matchLength<matchEndLimit&&data[candidate+matchLength]==data[position+matchLength]) ++matchLength;
+			writeSequence(output,data+anchor,position-anchor,position-candidate,matchLength);
+			position+=matchLength;
+			anchor=position;
+		}
+	}
+	writeSequence(output,data+anchor,size-anchor,0,0);
+}
+
+/**
+ * Reads the part of a length which did not fit in its 4 bit field of the token.
+ */
+inline bool readExtendedLength(const unsigned char*& position, const unsigned char* end, size_t& length) {
+	unsigned char byte;
+	do {
+		if(position==end) return false;
+		byte=*(position++);
+		length+=byte;
+	} while(byte==255);
+	return true;
+}
+
+bool VBufStorage_decompressBlock(const unsigned char* input, size_t inputSize, size_t outputSize, vector<unsigned char>& output) {
+	output.clear();
+	output.reserve(outputSize);
+	const unsigned char* position=input;
+	const unsigned char* end=input+inputSize;
+	while(position<end) {
+		unsigned char token=*(position++);
+		size_t literalLength=token>>4;
+		if(literalLength==15&&!readExtendedLength(position,end,literalLength)) return false;
+		if(literalLength>static_cast<size_t>(end-position)||literalLength>outputSize-output.size()) return false;
+		output.insert(output.end(),position,position+literalLength);
+		position+=literalLength;
+		//The last sequence has only literals.
+		if(position==end) break;
+		if(end-position<2) return false;
+		size_t distance=position[0]|(position[1]<<8);
+		position+=2;
+		if(distance==0||distance>output.size()) return false;
+		size_t matchLength=token&0x0f;
+		if(matchLength==15&&!readExtendedLength(position,end,matchLength)) return false;
+		matchLength+=LZ4_MINMATCH;
+		if(matchLength>outputSize-output.size()) return false;
+		//Copies can overlap the bytes they produce, so copy a byte at a time.
+		size_t start=output.size();
+		output.resize(start+matchLength);
+		for(size_t i=0;i<matchLength;++i) {
+			output[start+i]=output[start-distance+i];
+		}
+	}
+	return output.size()==outputSize;
+}
@@ -0,0 +1,104 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+#ifndef VIRTUALBUFFER_ENCODING_H
+#define VIRTUALBUFFER_ENCODING_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Writes values as a compact sequence of bytes which does not depend on the platform's integer sizes or byte order.
+ * Unsigned integers are written 7 bits a byte, lowest bits first, with the top bit set on every byte but the last.
+ * Signed integers are zigzag encoded first, so that small negative values are also short.
+ * Strings are written as their length followed by each character as an unsigned integer.
+ */
+class VBufStorage_encoder_t {
+	public:
+
+/**
+ * The bytes written so far.
+ */
+	std::vector<unsigned char> bytes;
+
+	void writeByte(unsigned char value);
+
+	void writeUnsigned(unsigned int value);
+
+	void writeSigned(int value);
+
+/**
+ * Writes characters without their length, for when the length has already been written.
+ */
+	void writeCharacters(const wchar_t* characters, size_t count);
+
+	void writeString(const std::wstring& str);
+
+};
+
+/**
+ * Reads values written by VBufStorage_encoder_t.
+ * Each read fails rather than reading past the end of the bytes or producing a value which does not fit its type, so that damaged data can not cause a crash.
+ */
+class VBufStorage_decoder_t {
+	private:
+
+	const unsigned char* position;
+
+	const unsigned char* end;
+
+	public:
+
+/**
+ * constructor.
+ * @param bytes the bytes to read. They must outlive the decoder.
+ * @param size the number of bytes.
+ */
+	VBufStorage_decoder_t(const unsigned char* bytes, size_t size);
+
+	bool readByte(unsigned char* value);
+
+	bool readUnsigned(unsigned int* value);
+
+	bool readSigned(int* value);
+
+	bool readString(std::wstring& str);
+
+/**
+ * @return true if all of the bytes have been read.
+ */
+	inline bool atEnd() const { return this->position==this->end; }
+
+};
+
+/**
+ * Compresses a block of bytes in the LZ4 block format: runs of literal bytes alternate with copies of up to 64 KB back in the output.
+ * Encoded nodes repeat the same attribute names and values a great deal, so they compress well.
+ * @param input the bytes to compress.
+ * @param output where to place the compressed bytes. It is replaced.
+ */
+void VBufStorage_compressBlock(const std::vector<unsigned char>& input, std::vector<unsigned char>& output);
+
+/**
+ * Decompresses a block compressed with VBufStorage_compressBlock.
+ * @param input the compressed bytes.
+ * @param inputSize the number of compressed bytes.
+ * @param outputSize the exact size of the block before it was compressed.
+ * @param output where to place the decompressed bytes. It is replaced.
+ * @return true if successful, false if the compressed bytes are damaged or do not decompress to exactly outputSize bytes.
+ */
+bool VBufStorage_decompressBlock(const unsigned char* input, size_t inputSize, size_t outputSize, std::vector<unsigned char>& output);
+
+#endif
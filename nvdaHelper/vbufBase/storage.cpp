@@ -23,13 +23,40 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <typeinfo>
 #include <common/xml.h>
 #include <common/log.h>
+#include <common/textScan.h>
 #include "utils.h"
+#include "encoding.h"
 #include "storage.h"
+#include "changeLog.h"
 
 using namespace std;
 
+/**
+ * Estimated bytes used by each element of a std::set or std::map on top of the element itself (links to other elements and colour).
+ */
+#define VBUFSTORAGE_TREENODEOVERHEAD (4*sizeof(void*))
+
+/**
+ * Estimates the bytes allocated on the heap for the content of a string.
+ * Short strings are held within the string object itself, so use no extra memory.
+ */
+inline size_t stringHeapBytes(const wstring& str) {
+	size_t bytes=(str.capacity()+1)*sizeof(wchar_t);
+	return (bytes>sizeof(wstring)-2*sizeof(size_t))?bytes:0;
+}
+
+/**
+ * Bytes used by the compressed descendants of a node, including the list of their identifiers.
+ */
+inline size_t compressedSubtreeBytes(const VBufStorage_compressedSubtree_t& subtree) {
+	return sizeof(VBufStorage_compressedSubtree_t)+subtree.data.capacity()+subtree.identifiers.capacity()*sizeof(VBufStorage_controlFieldNodeIdentifier_t);
+}
+
 VBufStorage_textContainer_t::VBufStorage_textContainer_t(wstring str): wstring(str) {}
 
 VBufStorage_textContainer_t::~VBufStorage_textContainer_t() {}
@@ -42,6 +69,167 @@ void VBufStorage_textContainer_t::destroy() {
 	delete this;
 }
 
+//text implementation
+
+/**
+ * The number of pieces a text can have before they are joined back in to one chunk.
+ */
+#define VBUFSTORAGE_TEXT_MAXPIECES 64
+
+/**
+ * The length a text must have before edits to it are made with pieces rather than by editing the plain string.
+ */
+#define VBUFSTORAGE_TEXT_MINPIECESLENGTH 256
+
+VBufStorage_text_t::VBufStorage_text_t(const wstring& text): plain(text), pieces(), pieceEnds() {
+}
+
+size_t VBufStorage_text_t::findPiece(size_t offset, size_t* pieceStart) const {
+	nhAssert(offset<this->length());
+	size_t index=upper_bound(this->pieceEnds.begin(),this->pieceEnds.end(),offset)-this->pieceEnds.begin();
+	*pieceStart=(index>0)?this->pieceEnds[index-1]:0;
+	return index;
+}
+
+size_t VBufStorage_text_t::splitAt(size_t offset) {
+	if(offset==this->length()) return this->pieces.size();
+	size_t pieceStart;
+	size_t index=this->findPiece(offset,&pieceStart);
+	if(offset==pieceStart) return index;
+	piece_t second=this->pieces[index];
+	size_t firstLength=offset-pieceStart;
+	this->pieces[index].length=firstLength;
+	second.start+=firstLength;
+	second.length-=firstLength;
+	this->pieces.insert(this->pieces.begin()+index+1,second);
+	this->pieceEnds.insert(this->pieceEnds.begin()+index,offset);
+	return index+1;
+}
+
+void VBufStorage_text_t::usePieces() {
+	if(!this->pieces.empty()||this->plain.empty()) return;
+	shared_ptr<wstring> chunk=make_shared<wstring>();
+	chunk->swap(this->plain);
+	piece_t piece={chunk,0,chunk->length()};
+	this->pieces.push_back(piece);
+	this->pieceEnds.push_back(piece.length);
+}
+
+void VBufStorage_text_t::updatePieces() {
+	size_t length=0;
+	for(vector<piece_t>::const_iterator i=this->pieces.begin();i!=this->pieces.end();++i) {
+		length+=i->length;
+	}
+	if(length<VBUFSTORAGE_TEXT_MINPIECESLENGTH) {
+		wstring text;
+		text.reserve(length);
+		for(vector<piece_t>::const_iterator i=this->pieces.begin();i!=this->pieces.end();++i) {
+			text.append(*(i->chunk),i->start,i->length);
+		}
+		this->plain.swap(text);
+		this->pieces=vector<piece_t>();
+		this->pieceEnds=vector<size_t>();
+		return;
+	}
+	if(this->pieces.size()>VBUFSTORAGE_TEXT_MAXPIECES) {
+		LOG_DEBUG(L"Joining "<<this->pieces.size()<<L" pieces");
+		piece_t piece={make_shared<const wstring>(this->str()),0,0};
+		piece.length=piece.chunk->length();
+		this->pieces.clear();
+		this->pieces.push_back(piece);
+	}
+	this->pieceEnds.resize(this->pieces.size());
+	size_t end=0;
+	for(size_t i=0;i<this->pieces.size();++i) {
+		end+=this->pieces[i].length;
+		this->pieceEnds[i]=end;
+	}
+}
+
+wchar_t VBufStorage_text_t::operator[](size_t offset) const {
+	if(this->pieces.empty()) {
+		nhAssert(offset<this->plain.length());
+		return this->plain[offset];
+	}
+	if(this->pieces.size()==1) {
+		nhAssert(offset<this->pieces[0].length);
+		return (*(this->pieces[0].chunk))[this->pieces[0].start+offset];
+	}
+	size_t pieceStart;
+	const piece_t& piece=this->pieces[this->findPiece(offset,&pieceStart)];
+	return (*(piece.chunk))[piece.start+(offset-pieceStart)];
+}
+
+void VBufStorage_text_t::appendTo(wstring& text, size_t start, size_t count) const {
+	this->forEachSegment(start,count,[&text](const wchar_t* segment, size_t segmentLength) {
+		text.append(segment,segmentLength);
+	});
+}
+
+wstring VBufStorage_text_t::str() const {
+	if(this->pieces.empty()) return this->plain;
+	wstring text;
+	text.reserve(this->length());
+	this->appendTo(text,0,this->length());
+	return text;
+}
+
+void VBufStorage_text_t::insert(size_t offset, const wstring& text) {
+	nhAssert(offset<=this->length());
+	if(text.empty()) return;
+	if(this->pieces.empty()&&this->plain.length()<VBUFSTORAGE_TEXT_MINPIECESLENGTH) {
+		this->plain.insert(offset,text);
+		return;
+	}
+	this->usePieces();
+	size_t index=this->splitAt(offset);
+	piece_t piece={make_shared<const wstring>(text),0,text.length()};
+	this->pieces.insert(this->pieces.begin()+index,piece);
+	this->updatePieces();
+}
+
+void VBufStorage_text_t::erase(size_t offset, size_t count) {
+	nhAssert(offset+count<=this->length());
+	if(count==0) return;
+	if(this->pieces.empty()&&this->plain.length()<VBUFSTORAGE_TEXT_MINPIECESLENGTH) {
+		this->plain.erase(offset,count);
+		return;
+	}
+	this->usePieces();
+	size_t first=this->splitAt(offset);
+	size_t last=this->splitAt(offset+count);
+	this->pieces.erase(this->pieces.begin()+first,this->pieces.begin()+last);
+	this->updatePieces();
+}
+
+int VBufStorage_text_t::compare(const VBufStorage_text_t& other) const {
+	if(this->pieces.empty()&&other.pieces.empty()) {
+		int res=this->plain.compare(other.plain);
+		return (res==0)?0:((res<0)?-1:1);
+	}
+	size_t length=this->length();
+	size_t otherLength=other.length();
+	for(size_t i=0;i<length&&i<otherLength;++i) {
+		wchar_t c=(*this)[i];
+		wchar_t otherC=other[i];
+		if(c!=otherC) return (c<otherC)?-1:1;
+	}
+	if(length==otherLength) return 0;
+	return (length<otherLength)?-1:1;
+}
+
+size_t VBufStorage_text_t::getMemoryUsage() const {
+	size_t bytes=stringHeapBytes(this->plain)+this->pieces.capacity()*sizeof(piece_t)+this->pieceEnds.capacity()*sizeof(size_t);
+	const wstring* lastChunk=NULL;
+	for(vector<piece_t>::const_iterator i=this->pieces.begin();i!=this->pieces.end();++i) {
+		//Pieces split from the same chunk are next to each other, so only count each run of them once
+		if(i->chunk.get()==lastChunk) continue;
+		lastChunk=i->chunk.get();
+		bytes+=sizeof(wstring)+stringHeapBytes(*lastChunk);
+	}
+	return bytes;
+}
+
 //controlFieldNodeIdentifier implementation
 
 VBufStorage_controlFieldNodeIdentifier_t::VBufStorage_controlFieldNodeIdentifier_t(int docHandleArg, int IDArg) : docHandle(docHandleArg), ID(IDArg) {
@@ -65,12 +253,14 @@ bool VBufStorage_controlFieldNodeIdentifier_t::operator==(const VBufStorage_cont
 
 //field  node implementation
 
-VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset) {
+VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset, bool(*skipDescendants)(const VBufStorage_fieldNode_t*)) {
 	int relativeOffset=0;
 	VBufStorage_fieldNode_t* tempNode=this;
 	if(direction==TREEDIRECTION_FORWARD) {
 		LOG_DEBUG(L"moving forward");
-		if(tempNode->firstChild!=NULL) {
+		bool descend=!(skipDescendants&&skipDescendants(tempNode));
+		if(descend) tempNode->ensureExpanded();
+		if(descend&&tempNode->firstChild!=NULL) {
 			LOG_DEBUG(L"Moving to first child");
 			tempNode=tempNode->firstChild;
 		} else {
@@ -93,7 +283,9 @@ VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction,
 			if(tempNode->previous==limitNode) return NULL;
 			LOG_DEBUG(L"Using previous node");
 			tempNode=tempNode->previous;
-			while(tempNode->lastChild!=NULL&&tempNode->lastChild!=limitNode) {
+			while(!(skipDescendants&&skipDescendants(tempNode))) {
+				tempNode->ensureExpanded();
+				if(tempNode->lastChild==NULL||tempNode->lastChild==limitNode) break;
 				LOG_DEBUG(L"Using lastChild");
 				tempNode=tempNode->lastChild;
 			}
@@ -107,7 +299,9 @@ VBufStorage_fieldNode_t* VBufStorage_fieldNode_t::nextNodeInTree(int direction,
 		}
 	} else if(direction==TREEDIRECTION_SYMMETRICAL_BACK) {
 		LOG_DEBUG(L"Moving symmetrical backwards");
-		if(tempNode->lastChild!=NULL) {
+		bool descend=!(skipDescendants&&skipDescendants(tempNode));
+		if(descend) tempNode->ensureExpanded();
+		if(descend&&tempNode->lastChild!=NULL) {
 			LOG_DEBUG(L"Moving to last child");
 			tempNode=tempNode->lastChild;
 			relativeOffset=this->length-tempNode->length;
@@ -190,6 +384,7 @@ int VBufStorage_fieldNode_t::calculateOffsetInTree() const {
 
 VBufStorage_textFieldNode_t* VBufStorage_fieldNode_t::locateTextFieldNodeAtOffset(int offset, int *relativeOffset) {
 	LOG_DEBUG(L"Searching through children to reach offset "<<offset);
+	this->ensureExpanded();
 	int tempOffset=0;
 	nhAssert(this->firstChild!=NULL||this->length==0); //Length of a node with out children can not be greater than 0
 	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
@@ -210,13 +405,13 @@ void VBufStorage_fieldNode_t::generateAttributesForMarkupOpeningTag(std::wstring
 	wostringstream s;
 	s<<L"_startOfNode=\""<<(startOffset==0?1:0)<<L"\" ";
 	s<<L"_endOfNode=\""<<(endOffset>=this->length?1:0)<<L"\" ";
-	s<<L"isBlock=\""<<this->isBlock<<L"\" ";
-	s<<L"isHidden=\""<<this->isHidden<<L"\" ";
+	s<<L"isBlock=\""<<this->block<<L"\" ";
+	s<<L"isHidden=\""<<this->hidden<<L"\" ";
 	int childCount=0;
 	int childControlCount=0;
-	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
+	for(VBufStorage_fieldNode_t* child=this->getFirstChild();child!=NULL;child=child->next) {
 		++childCount;
-		if((child->length)>0&&child->firstChild) ++childControlCount;
+		if((child->length)>0&&child->hasChildren()) ++childControlCount;
 	}
 	int parentChildCount=1;
 	int indexInParent=0;
@@ -262,6 +457,7 @@ void VBufStorage_fieldNode_t::getTextInRange(int startOffset, int endOffset, std
 	nhAssert(startOffset>=0); //startOffset can't be negative
 	nhAssert(startOffset<endOffset); //startOffset must be before endOffset
 	nhAssert(endOffset<=this->length); //endOffset can't be bigger than node length
+	this->ensureExpanded();
 	if(useMarkup) {
 		this->generateMarkupOpeningTag(text,startOffset,endOffset);
 	}
@@ -292,7 +488,13 @@ void VBufStorage_fieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t* buffe
 	LOG_DEBUG(L"Disassociating fieldNode from buffer");
 }
 
-VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), isBlock(isBlockArg), isHidden(false), updateAncestor(NULL), attributes() {
+void VBufStorage_fieldNode_t::expand() {
+	nhAssert(this->compressed);
+	VBufStorage_controlFieldNode_t* node=static_cast<VBufStorage_controlFieldNode_t*>(this);
+	node->compressedSubtree->buffer->expandSubtree(node);
+}
+
+VBufStorage_fieldNode_t::VBufStorage_fieldNode_t(int lengthArg, bool isBlockArg): parent(NULL), previous(NULL), next(NULL), firstChild(NULL), lastChild(NULL), length(lengthArg), accountedAttributeBytes(0), block(isBlockArg), hidden(false), compressed(false), visibleNodeCount(1), blockNodeCount(isBlockArg?1:0), lastAccessTime(0), updateAncestor(NULL), attributes() {
 	LOG_DEBUG(L"field node initialization at "<<this<<L"length is "<<length);
 }
 
@@ -300,6 +502,31 @@ VBufStorage_fieldNode_t::~VBufStorage_fieldNode_t() {
 	LOG_DEBUG(L"fieldNode being destroied");
 }
 
+void VBufStorage_fieldNode_t::copyPropertiesFrom(const VBufStorage_fieldNode_t* source) {
+	this->attributes=source->attributes;
+	this->setHidden(source->hidden);
+}
+
+void VBufStorage_fieldNode_t::adjustSubtreeCounts(int visibleDelta, int blockDelta) {
+	for(VBufStorage_fieldNode_t* node=this;node!=NULL;node=node->parent) {
+		node->visibleNodeCount+=visibleDelta;
+		node->blockNodeCount+=blockDelta;
+		nhAssert(node->visibleNodeCount>=0&&node->blockNodeCount>=0);
+	}
+}
+
+void VBufStorage_fieldNode_t::setBlock(bool blockArg) {
+	if(blockArg==this->block) return;
+	this->block=blockArg;
+	this->adjustSubtreeCounts(0,blockArg?1:-1);
+}
+
+void VBufStorage_fieldNode_t::setHidden(bool hiddenArg) {
+	if(hiddenArg==this->hidden) return;
+	this->hidden=hiddenArg;
+	this->adjustSubtreeCounts(hiddenArg?-1:1,0);
+}
+
 bool VBufStorage_fieldNode_t::addAttribute(const std::wstring& name, const std::wstring& value) {
 	LOG_DEBUG(L"Adding attribute "<<name<<L" with value "<<value);
 	this->attributes[name]=value;
@@ -317,6 +544,16 @@ std::wstring VBufStorage_fieldNode_t::getAttributesString() const {
 	return attributesString;
 }
 
+void VBufStorage_fieldNode_t::calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const {
+	for(VBufStorage_attributeMap_t::const_iterator i=attributes.begin();i!=attributes.end();++i) {
+		stats.attributeBytes+=VBUFSTORAGE_TREENODEOVERHEAD+sizeof(VBufStorage_attributeMap_t::value_type)+stringHeapBytes(i->first)+stringHeapBytes(i->second);
+	}
+}
+
+bool VBufStorage_fieldNode_t::isDeferred() const {
+	return false;
+}
+
 std::wstring VBufStorage_fieldNode_t::getDebugInfo() const {
 	std::wostringstream s;
 	s<<L"field node at "<<this<<L", parent at "<<parent<<L", previous at "<<previous<<L", next at "<<next<<L", firstChild at "<<firstChild<<L", lastChild at "<<lastChild<<L", length is "<<length<<L", attributes are "<<getAttributesString();
@@ -340,13 +577,62 @@ void VBufStorage_controlFieldNode_t::disassociateFromBuffer(VBufStorage_buffer_t
 	nhAssert(buffer); //Must be associated with a buffer
 	LOG_DEBUG(L"Disassociating controlFieldNode from buffer");
 	buffer->forgetControlFieldNode(this);
+	if(this->compressed) buffer->forgetCompressedSubtree(this);
 	this->VBufStorage_fieldNode_t::disassociateFromBuffer(buffer);
 }
 
-VBufStorage_controlFieldNode_t::VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlockArg): VBufStorage_fieldNode_t(0,isBlockArg), identifier(docHandle,ID) {  
+VBufStorage_controlFieldNode_t::VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlockArg): VBufStorage_fieldNode_t(0,isBlockArg), identifier(docHandle,ID), compressedSubtree(NULL) {  
 	LOG_DEBUG(L"controlFieldNode initialization at "<<this<<L", with docHandle of "<<identifier.docHandle<<L" and ID of "<<identifier.ID); 
 }
 
+VBufStorage_controlFieldNode_t::~VBufStorage_controlFieldNode_t() {
+	delete this->compressedSubtree;
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_controlFieldNode_t::createCopy() const {
+	return new VBufStorage_controlFieldNode_t(this->identifier.docHandle,this->identifier.ID,this->block);
+}
+
+VBufStorage_fieldNode_t* VBufStorage_controlFieldNode_t::copyToBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous) {
+	VBufStorage_controlFieldNode_t* copy=this->createCopy();
+	copy->copyPropertiesFrom(this);
+	if(this->updateAncestor) {
+		int docHandle=0, ID=0;
+		this->updateAncestor->getIdentifier(&docHandle,&ID);
+		VBufStorage_controlFieldNode_t* newUpdateAncestor=buffer->getControlFieldNodeWithIdentifier(docHandle,ID);
+		copy->updateAncestor=newUpdateAncestor?newUpdateAncestor:this->updateAncestor;
+	}
+	if(buffer->addControlFieldNode(parent,previous,copy)!=copy) {
+		LOG_DEBUGWARNING(L"Could not add copy of node "<<this->getDebugInfo());
+		delete copy;
+		return NULL;
+	}
+	if(this->compressed) {
+		//Decode the descendants straight in to the copy rather than decompressing them in this buffer as well.
+		if(!buffer->decodeSubtree(*(this->compressedSubtree),this,copy)) {
+			LOG_ERROR(L"Could not copy compressed descendants of node "<<this->getDebugInfo());
+		}
+		return copy;
+	}
+	VBufStorage_fieldNode_t* previousCopy=NULL;
+	for(VBufStorage_fieldNode_t* child=this->firstChild;child!=NULL;child=child->next) {
+		VBufStorage_fieldNode_t* childCopy=child->copyToBuffer(buffer,copy,previousCopy);
+		if(childCopy) previousCopy=childCopy;
+	}
+	return copy;
+}
+
+void VBufStorage_controlFieldNode_t::calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const {
+	VBufStorage_fieldNode_t::calculateMemoryUsage(stats);
+	++(stats.controlFieldNodeCount);
+	stats.nodeBytes+=sizeof(VBufStorage_controlFieldNode_t);
+	if(this->compressedSubtree) {
+		++(stats.compressedSubtreeCount);
+		stats.compressedNodeCount+=this->compressedSubtree->nodeCount;
+		stats.compressedBytes+=compressedSubtreeBytes(*(this->compressedSubtree));
+	}
+}
+
 bool VBufStorage_controlFieldNode_t::getIdentifier(int* docHandle, int* ID) {
 	*docHandle=this->identifier.docHandle;
 	*ID=this->identifier.ID;
@@ -359,6 +645,24 @@ std::wstring VBufStorage_controlFieldNode_t::getDebugInfo() const {
 	return s.str();
 }
 
+//deferredFieldNode implementation
+
+VBufStorage_deferredFieldNode_t::VBufStorage_deferredFieldNode_t(int docHandle, int ID, bool isBlockArg): VBufStorage_controlFieldNode_t(docHandle,ID,isBlockArg) {
+	LOG_DEBUG(L"deferredFieldNode initialization at "<<this);
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_deferredFieldNode_t::createCopy() const {
+	return new VBufStorage_deferredFieldNode_t(this->identifier.docHandle,this->identifier.ID,this->block);
+}
+
+bool VBufStorage_deferredFieldNode_t::isDeferred() const {
+	return true;
+}
+
+std::wstring VBufStorage_deferredFieldNode_t::getDebugInfo() const {
+	return L"deferred "+this->VBufStorage_controlFieldNode_t::getDebugInfo();
+}
+
 //textFieldNode implementation
 
 VBufStorage_textFieldNode_t* VBufStorage_textFieldNode_t::locateTextFieldNodeAtOffset(int offset, int *relativeOffset) {
@@ -373,6 +677,10 @@ void VBufStorage_textFieldNode_t::generateMarkupTagName(std::wstring& text) {
 }
 
 void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup, bool(*filter)(VBufStorage_fieldNode_t*)) {
+	if(this->length==0) {
+		LOG_DEBUG(L"node has 0 length, not collecting text");
+		return;
+	}
 	LOG_DEBUG(L"getting text between offsets "<<startOffset<<L" and "<<endOffset);
 	if(useMarkup) {
 		this->generateMarkupOpeningTag(text,startOffset,endOffset);
@@ -381,13 +689,13 @@ void VBufStorage_textFieldNode_t::getTextInRange(int startOffset, int endOffset,
 	nhAssert(startOffset<endOffset); //StartOffset must be less than endOffset
 	nhAssert(endOffset<=this->length); //endOffset can't be greater than node length
 	if(useMarkup) {
-		wchar_t c;
-		for(int offset=startOffset;offset<endOffset;++offset) {
-			c=this->text[offset];
-			appendCharToXML(c,text);
-		}
+		this->text.forEachSegment(startOffset,endOffset-startOffset,[&text](const wchar_t* segment, size_t segmentLength) {
+			for(size_t i=0;i<segmentLength;++i) {
+				appendCharToXML(segment[i],text);
+			}
+		});
 	} else {
-		text.append(this->text,startOffset,endOffset-startOffset);
+		this->text.appendTo(text,startOffset,endOffset-startOffset);
 	}
 	if(useMarkup) {
 		this->generateMarkupClosingTag(text);
@@ -399,6 +707,39 @@ VBufStorage_textFieldNode_t::VBufStorage_textFieldNode_t(const std::wstring& tex
 	LOG_DEBUG(L"textFieldNode initialization, with text of length "<<length);
 }
 
+VBufStorage_fieldNode_t* VBufStorage_textFieldNode_t::copyToBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous) {
+	VBufStorage_textFieldNode_t* copy=new VBufStorage_textFieldNode_t(std::wstring());
+	//The text shares its chunks with this node's text rather than copying the characters.
+	copy->text=this->text;
+	copy->length=this->length;
+	copy->copyPropertiesFrom(this);
+	if(buffer->addTextFieldNode(parent,previous,copy)!=copy) {
+		LOG_DEBUGWARNING(L"Could not add copy of node "<<this->getDebugInfo());
+		delete copy;
+		return NULL;
+	}
+	return copy;
+}
+
+void VBufStorage_textFieldNode_t::insertText(int offset, const std::wstring& text) {
+	nhAssert(offset>=0&&offset<=this->length);
+	this->text.insert(offset,text);
+	this->length=static_cast<int>(this->text.length());
+}
+
+void VBufStorage_textFieldNode_t::removeText(int offset, int count) {
+	nhAssert(offset>=0&&count>=0&&offset+count<=this->length);
+	this->text.erase(offset,count);
+	this->length=static_cast<int>(this->text.length());
+}
+
+void VBufStorage_textFieldNode_t::calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const {
+	VBufStorage_fieldNode_t::calculateMemoryUsage(stats);
+	++(stats.textFieldNodeCount);
+	stats.nodeBytes+=sizeof(VBufStorage_textFieldNode_t);
+	stats.textBytes+=text.getMemoryUsage();
+}
+
 std::wstring VBufStorage_textFieldNode_t::getDebugInfo() const {
 	std::wostringstream s;
 	s<<L"text "<<this->VBufStorage_fieldNode_t::getDebugInfo();
@@ -407,6 +748,47 @@ std::wstring VBufStorage_textFieldNode_t::getDebugInfo() const {
 
 //buffer implementation
 
+void VBufStorage_buffer_t::accountForNode(VBufStorage_fieldNode_t* node, bool remove) {
+	nhAssert(node);
+	VBufStorage_memoryStats_t usage={0};
+	node->calculateMemoryUsage(usage);
+	if(remove) {
+		//Only remove the attribute bytes that were actually added for this node
+		usage.attributeBytes=node->accountedAttributeBytes;
+		nhAssert(this->memoryStats.controlFieldNodeCount>=usage.controlFieldNodeCount);
+		nhAssert(this->memoryStats.textFieldNodeCount>=usage.textFieldNodeCount);
+		nhAssert(this->memoryStats.attributeBytes>=usage.attributeBytes);
+		nhAssert(this->memoryStats.compressedSubtreeCount>=usage.compressedSubtreeCount);
+		nhAssert(this->memoryStats.compressedBytes>=usage.compressedBytes);
+		this->memoryStats.controlFieldNodeCount-=usage.controlFieldNodeCount;
+		this->memoryStats.textFieldNodeCount-=usage.textFieldNodeCount;
+		this->memoryStats.nodeBytes-=usage.nodeBytes;
+		this->memoryStats.attributeBytes-=usage.attributeBytes;
+		this->memoryStats.textBytes-=usage.textBytes;
+		this->memoryStats.compressedSubtreeCount-=usage.compressedSubtreeCount;
+		this->memoryStats.compressedNodeCount-=usage.compressedNodeCount;
+		this->memoryStats.compressedBytes-=usage.compressedBytes;
+		node->accountedAttributeBytes=0;
+	} else {
+		this->memoryStats.controlFieldNodeCount+=usage.controlFieldNodeCount;
+		this->memoryStats.textFieldNodeCount+=usage.textFieldNodeCount;
+		this->memoryStats.nodeBytes+=usage.nodeBytes;
+		this->memoryStats.attributeBytes+=usage.attributeBytes;
+		this->memoryStats.textBytes+=usage.textBytes;
+		this->memoryStats.compressedSubtreeCount+=usage.compressedSubtreeCount;
+		this->memoryStats.compressedNodeCount+=usage.compressedNodeCount;
+		this->memoryStats.compressedBytes+=usage.compressedBytes;
+		node->accountedAttributeBytes=static_cast<unsigned int>(usage.attributeBytes);
+	}
+}
+
+void VBufStorage_buffer_t::updatePeakMemoryUsage(size_t extraBytes) {
+	size_t usage=this->getMemoryUsage()+extraBytes;
+	if(usage>this->memoryStats.peakBytes) {
+		this->memoryStats.peakBytes=usage;
+	}
+}
+
 void VBufStorage_buffer_t::forgetControlFieldNode(VBufStorage_controlFieldNode_t* node) {
 	nhAssert(node); //Node can't be NULL
 	map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=controlFieldNodesByIdentifier.find(node->identifier);
@@ -415,6 +797,33 @@ void VBufStorage_buffer_t::forgetControlFieldNode(VBufStorage_controlFieldNode_t
 	controlFieldNodesByIdentifier.erase(i);
 }
 
+void VBufStorage_buffer_t::forgetCompressedSubtree(VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node&&node->compressedSubtree);
+	for(vector<VBufStorage_controlFieldNodeIdentifier_t>::const_iterator i=node->compressedSubtree->identifiers.begin();i!=node->compressedSubtree->identifiers.end();++i) {
+		map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator j=compressedNodesByIdentifier.find(*i);
+		//An identifier can only be missing if decoding would have left its node out as a duplicate.
+		if(j!=compressedNodesByIdentifier.end()&&j->second==node) compressedNodesByIdentifier.erase(j);
+	}
+}
+
+VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::findControlFieldNode(const VBufStorage_controlFieldNodeIdentifier_t& identifier) {
+	map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=this->controlFieldNodesByIdentifier.find(identifier);
+	if(i!=this->controlFieldNodesByIdentifier.end()) return i->second;
+	i=this->compressedNodesByIdentifier.find(identifier);
+	if(i==this->compressedNodesByIdentifier.end()) return NULL;
+	LOG_DEBUG(L"Node with docHandle "<<identifier.docHandle<<L" and ID "<<identifier.ID<<L" is compressed");
+	this->expandSubtree(i->second);
+	i=this->controlFieldNodesByIdentifier.find(identifier);
+	return (i!=this->controlFieldNodesByIdentifier.end())?i->second:NULL;
+}
+
+void VBufStorage_buffer_t::markAccessed(VBufStorage_fieldNode_t* node) {
+	++(this->accessTime);
+	for(;node!=NULL;node=node->parent) {
+		node->lastAccessTime=this->accessTime;
+	}
+}
+
 bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* node) {
 	if(!node) {
 		LOG_DEBUGWARNING(L"Cannot insert a NULL node. Returning false");
@@ -443,6 +852,7 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 	VBufStorage_fieldNode_t* next=NULL;
 	//make sure we have a good parent, previous and next
 	if(previous!=NULL) parent=previous->parent;
+	if(parent) parent->ensureExpanded();
 	next=(previous?previous->next:(parent?parent->firstChild:NULL));
 	LOG_DEBUG(L"using parent: "<<(parent?parent->getDebugInfo():L"NULL"));
 	LOG_DEBUG(L"Using previous: "<<(previous?previous->getDebugInfo():L"NULL"));
@@ -481,9 +891,12 @@ bool VBufStorage_buffer_t::insertNode(VBufStorage_controlFieldNode_t* parent, VB
 			LOG_DEBUG(L"Ancestor length now"<<ancestor->length);
 		}
 	}
+	if(parent) parent->adjustSubtreeCounts(node->visibleNodeCount,node->blockNodeCount);
 	LOG_DEBUG(L"Inserted subtree");
 	nhAssert(this->nodes.count(node)==0);
 	this->nodes.insert(node);
+	this->accountForNode(node,false);
+	this->updatePeakMemoryUsage();
 	return true;
 }
 
@@ -492,6 +905,7 @@ void VBufStorage_buffer_t::deleteNode(VBufStorage_fieldNode_t* node) {
 	node->disassociateFromBuffer(this);
 	nhAssert(this->nodes.count(node)==1);
 	this->nodes.erase(node);
+	this->accountForNode(node,true);
 	LOG_DEBUG(L"deleting node at "<<node);
 	delete node;
 }
@@ -509,7 +923,7 @@ void VBufStorage_buffer_t::deleteSubtree(VBufStorage_fieldNode_t* node) {
 	LOG_DEBUG(L"Deleted subtree");
 }
 
-VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodes(), controlFieldNodesByIdentifier(), selectionStart(0), selectionLength(0) {
+VBufStorage_buffer_t::VBufStorage_buffer_t(): rootNode(NULL), nodes(), controlFieldNodesByIdentifier(), compressedNodesByIdentifier(), accessTime(0), compressionBudget(0), selectionStart(0), selectionLength(0), pinnedOffsets(), nextPinID(1), memoryStats(), memoryLimit(0), changeLog(NULL) {
 	LOG_DEBUG(L"buffer initializing");
 }
 
@@ -537,7 +951,7 @@ VBufStorage_controlFieldNode_t*  VBufStorage_buffer_t::addControlFieldNode(VBufS
 		return NULL;
 	}
 	LOG_DEBUG(L"Add controlFieldNode using parent at "<<parent<<L", previous at "<<previous<<L", node at "<<controlFieldNode);
-	if(controlFieldNodesByIdentifier.count(controlFieldNode->identifier)>0) {
+	if(controlFieldNodesByIdentifier.count(controlFieldNode->identifier)>0||compressedNodesByIdentifier.count(controlFieldNode->identifier)>0) {
 		LOG_DEBUGWARNING(L"Buffer at "<<this<<L" already has a node with the same identifier as node "<<controlFieldNode->getDebugInfo()<<L". Returning NULL"); 
 		return NULL;
 	}
@@ -601,21 +1015,87 @@ VBufStorage_textFieldNode_t*  VBufStorage_buffer_t::addTextFieldNode(VBufStorage
 	return textFieldNode;
 }
 
+VBufStorage_fieldNode_t* VBufStorage_buffer_t::copySubtree(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* source) {
+	if(!source) {
+		LOG_DEBUGWARNING(L"Source is NULL. Returning NULL");
+		return NULL;
+	}
+	if(isNodeInBuffer(source)) {
+		LOG_DEBUGWARNING(L"Source at "<<source<<L" is already in this buffer. Returning NULL");
+		return NULL;
+	}
+	LOG_DEBUG(L"Copying subtree at "<<source->getDebugInfo()<<L" using parent at "<<parent<<L", previous at "<<previous);
+	return source->copyToBuffer(this,parent,previous);
+}
+
+VBufStorage_deferredFieldNode_t* VBufStorage_buffer_t::deferControlFieldNode(VBufStorage_controlFieldNode_t* node) {
+	if(!isNodeInBuffer(node)) {
+		LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returning NULL");
+		return NULL;
+	}
+	if(node==this->rootNode||node->hasChildren()) {
+		LOG_DEBUGWARNING(L"Can not defer the root node or a node with children. Returning NULL");
+		return NULL;
+	}
+	VBufStorage_controlFieldNode_t* parent=node->parent;
+	VBufStorage_fieldNode_t* previous=node->previous;
+	VBufStorage_deferredFieldNode_t* deferredNode=new VBufStorage_deferredFieldNode_t(node->identifier.docHandle,node->identifier.ID,node->block);
+	deferredNode->copyPropertiesFrom(node);
+	deferredNode->updateAncestor=node->updateAncestor;
+	//The node has no children or length, so removing it leaves all offsets as they were.
+	removeFieldNode(node);
+	if(addControlFieldNode(parent,previous,deferredNode)!=deferredNode) {
+		LOG_DEBUGWARNING(L"Could not add deferred node "<<deferredNode->getDebugInfo());
+		delete deferredNode;
+		return NULL;
+	}
+	return deferredNode;
+}
+
+/**
+ * Adds the deferred field nodes in a subtree which contain text in a range to a list.
+ * @param nodeStart the offset at which node starts.
+ */
+void collectDeferredFieldNodes(VBufStorage_fieldNode_t* node, int nodeStart, int startOffset, int endOffset, vector<VBufStorage_deferredFieldNode_t*>& nodes) {
+	if(nodeStart>=endOffset||nodeStart+node->getLength()<=startOffset) return;
+	if(node->isDeferred()) nodes.push_back(static_cast<VBufStorage_deferredFieldNode_t*>(node));
+	int childStart=nodeStart;
+	for(VBufStorage_fieldNode_t* child=node->getFirstChild();child!=NULL&&childStart<endOffset;child=child->getNext()) {
+		collectDeferredFieldNodes(child,childStart,startOffset,endOffset,nodes);
+		childStart+=child->getLength();
+	}
+}
+
+void VBufStorage_buffer_t::getDeferredFieldNodesInRange(int startOffset, int endOffset, vector<VBufStorage_deferredFieldNode_t*>& nodes) {
+	if(!this->rootNode) return;
+	if(endOffset==-1) endOffset=this->rootNode->length;
+	collectDeferredFieldNodes(this->rootNode,0,startOffset,endOffset,nodes);
+}
+
 bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m) {
 	VBufStorage_controlFieldNode_t* parent=NULL;
 	VBufStorage_fieldNode_t* previous=NULL;
-	//Using the current selection start, record a list of ancestor fields by their identifier, 
-	//and a relative offset of the selection start to those fields, so that the selection can be corrected after the replacement.
-	list<pair<VBufStorage_controlFieldNodeIdentifier_t,int>> identifierList;
-	if(this->getTextLength()>0) {
-		int controlDocHandle, controlID, controlNodeStart, controlNodeEnd;
-		parent=this->locateControlFieldNodeAtOffset(this->selectionStart,&controlNodeStart,&controlNodeEnd,&controlDocHandle,&controlID);
-		int relativeSelectionStart=this->selectionStart-controlNodeStart;
-		for(;parent!=NULL;parent=parent->parent) {
-			identifierList.push_front(pair<VBufStorage_controlFieldNodeIdentifier_t,int>(parent->identifier,relativeSelectionStart));
-			for(previous=parent->previous;previous!=NULL;relativeSelectionStart+=previous->length,previous=previous->previous);
+	//The replaced nodes and the new buffers are both gone afterwards, so record the change first.
+	if(this->changeLog) this->changeLog->recordReplace(this,m);
+	//Anchor the selection start and any pinned offsets to their ancestor fields, so that they can be corrected after the replacement.
+	VBufStorage_anchor_t selectionAnchor;
+	bool haveSelectionAnchor=this->createAnchor(this->selectionStart,selectionAnchor);
+	map<int,VBufStorage_anchor_t> pinnedAnchors;
+	for(map<int,int>::iterator i=this->pinnedOffsets.begin();i!=this->pinnedOffsets.end();++i) {
+		VBufStorage_anchor_t anchor;
+		if(this->createAnchor(i->second,anchor)) {
+			pinnedAnchors.insert(make_pair(i->first,anchor));
 		}
 	}
+	//Both the old and new content exist at this point, so this is when the most memory is being used.
+	//The new buffers' attributes were added after their nodes were inserted, so have them count their nodes again first.
+	size_t newContentBytes=0;
+	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) {
+		if(i->second==this) continue;
+		i->second->recalculateMemoryStats();
+		newContentBytes+=i->second->getMemoryUsage();
+	}
+	this->updatePeakMemoryUsage(newContentBytes);
 	//For each node in the map,
 	//Replace the node on this buffer, with the content of the buffer in the map for that node
 	//Note that controlField info will automatically be removed, but not added again
@@ -649,6 +1129,9 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 		}
 		buffer->nodes.erase(buffer->rootNode);
 		this->nodes.insert(buffer->nodes.begin(),buffer->nodes.end());
+		for(set<VBufStorage_fieldNode_t*>::iterator j=buffer->nodes.begin();j!=buffer->nodes.end();++j) {
+			this->accountForNode(*j,false);
+		}
 		buffer->nodes.clear();
 		buffer->rootNode=NULL;
 		++i;
@@ -656,6 +1139,14 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 	//Update the controlField info on this buffer using all the buffers in the map
 	//We do this all in one go instead of for each replacement in case there are issues with ordering
 	//e.g. an identifier appears in one place before its removed in another
+	//Old nodes with the new identifiers must be found to be removed, so first decompress any of them that are compressed.
+	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) {
+		nhAssert(i->second->compressedNodesByIdentifier.empty());
+		for(map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator j=i->second->controlFieldNodesByIdentifier.begin();j!=i->second->controlFieldNodesByIdentifier.end();++j) {
+			map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator compressed=this->compressedNodesByIdentifier.find(j->first);
+			if(compressed!=this->compressedNodesByIdentifier.end()) this->expandSubtree(compressed->second);
+		}
+	}
 	for(map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>::iterator i=m.begin();i!=m.end();++i) {
 		VBufStorage_buffer_t* buffer=i->second;
 		int failedIDs=0;
@@ -679,30 +1170,86 @@ bool VBufStorage_buffer_t::replaceSubtrees(map<VBufStorage_fieldNode_t*,VBufStor
 		}
 	}
 	m.clear();
-	//Find the deepest field the selection started in that still exists, 
-	//and correct the selection so its still positioned accurately relative to that field. 
-	if(!identifierList.empty()) {
-		VBufStorage_controlFieldNode_t* lastAncestorNode=NULL;
-		int lastRelativeSelectionStart=0;
-		for(list<pair<VBufStorage_controlFieldNodeIdentifier_t,int> >::iterator i=identifierList.begin();i!=identifierList.end();++i) {
-			VBufStorage_controlFieldNode_t* currentAncestorNode=this->getControlFieldNodeWithIdentifier(i->first.docHandle,i->first.ID);
-			if(currentAncestorNode==NULL) break;
-			if(currentAncestorNode->parent!=lastAncestorNode) break;
-			lastAncestorNode=currentAncestorNode;
-			lastRelativeSelectionStart=i->second;
-		}
-		if(lastAncestorNode!=NULL) {
-			int lastAncestorStartOffset, lastAncestorEndOffset;
-			if(!this->getFieldNodeOffsets(lastAncestorNode,&lastAncestorStartOffset,&lastAncestorEndOffset)) {
-				LOG_DEBUGWARNING(L"Error getting offsets for last ancestor node. Returnning false");
-				return false;
-			}
-			this->selectionStart=lastAncestorStartOffset+min(lastRelativeSelectionStart,max(lastAncestorNode->length-1,0));
-		}
+	//Correct the selection and pinned offsets so they are still positioned accurately relative to the deepest field they were in that still exists.
+	if(haveSelectionAnchor) {
+		this->resolveAnchor(selectionAnchor,&(this->selectionStart));
+	}
+	for(map<int,VBufStorage_anchor_t>::iterator i=pinnedAnchors.begin();i!=pinnedAnchors.end();++i) {
+		this->resolveAnchor(i->second,&(this->pinnedOffsets[i->first]));
 	}
 	return !failedBuffers;
 }
 
+bool VBufStorage_buffer_t::insertText(VBufStorage_textFieldNode_t* node, int offset, const std::wstring& text) {
+	if(!isNodeInBuffer(node)) {
+		LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returnning false");
+		return false;
+	}
+	if(offset<0||offset>node->length) {
+		LOG_DEBUGWARNING(L"Offset "<<offset<<L" out of range for node "<<node->getDebugInfo()<<L". Returning false");
+		return false;
+	}
+	if(text.empty()) {
+		return true;
+	}
+	int length=static_cast<int>(text.length());
+	int bufferOffset=node->calculateOffsetInTree()+offset;
+	LOG_DEBUG(L"Inserting "<<length<<L" characters at offset "<<bufferOffset);
+	this->accountForNode(node,true);
+	node->insertText(offset,text);
+	this->accountForNode(node,false);
+	for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
+		ancestor->length+=length;
+	}
+	//Positions at or after the insertion point move along with the text after it.
+	int selectionEnd=this->selectionStart+this->selectionLength;
+	if(this->selectionStart>=bufferOffset) this->selectionStart+=length;
+	if(selectionEnd>=bufferOffset) selectionEnd+=length;
+	this->selectionLength=selectionEnd-this->selectionStart;
+	for(map<int,int>::iterator i=this->pinnedOffsets.begin();i!=this->pinnedOffsets.end();++i) {
+		if(i->second>=bufferOffset) i->second+=length;
+	}
+	this->updatePeakMemoryUsage();
+	if(this->changeLog) this->changeLog->recordInsertText(node,offset,text);
+	return true;
+}
+
+bool VBufStorage_buffer_t::removeText(VBufStorage_textFieldNode_t* node, int offset, int count) {
+	if(!isNodeInBuffer(node)) {
+		LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returnning false");
+		return false;
+	}
+	if(offset<0||count<0||offset+count>node->length) {
+		LOG_DEBUGWARNING(L"Range "<<offset<<L" to "<<offset+count<<L" out of range for node "<<node->getDebugInfo()<<L". Returning false");
+		return false;
+	}
+	if(count==0) {
+		return true;
+	}
+	int bufferOffset=node->calculateOffsetInTree()+offset;
+	LOG_DEBUG(L"Removing "<<count<<L" characters at offset "<<bufferOffset);
+	this->accountForNode(node,true);
+	node->removeText(offset,count);
+	this->accountForNode(node,false);
+	for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
+		ancestor->length-=count;
+		nhAssert(ancestor->length>=0); //ancestor length can't be negative
+	}
+	//Positions after the removed text move back, those within it collapse to its start.
+	auto adjust=[bufferOffset,count](int position) {
+		if(position<=bufferOffset) return position;
+		return (position<bufferOffset+count)?bufferOffset:position-count;
+	};
+	int selectionEnd=adjust(this->selectionStart+this->selectionLength);
+	this->selectionStart=adjust(this->selectionStart);
+	this->selectionLength=selectionEnd-this->selectionStart;
+	for(map<int,int>::iterator i=this->pinnedOffsets.begin();i!=this->pinnedOffsets.end();++i) {
+		i->second=adjust(i->second);
+	}
+	if(this->changeLog) this->changeLog->recordRemoveText(node,offset,count);
+	return true;
+}
+
 bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool removeDescendants) {
 	if(!isNodeInBuffer(node)) {
 		LOG_DEBUGWARNING(L"Node at "<<node<<L" is not in buffer at "<<this<<L". Returnning false");
@@ -712,6 +1259,7 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 		LOG_DEBUGWARNING(L"Cannot remove the rootNode without removing its descedants. Returnning false");
 		return false;
 	}
+	if(!removeDescendants) node->ensureExpanded();
 	if((removeDescendants||!node->firstChild)&&node->length>0) {
 		LOG_DEBUG(L"collapsing length of ancestors by "<<node->length);
 		for(VBufStorage_fieldNode_t* ancestor=node->parent;ancestor!=NULL;ancestor=ancestor->parent) {
@@ -721,6 +1269,14 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 			LOG_DEBUG(L"Ancestor length now"<<ancestor->length);
 		}
 	}
+	if(node->parent) {
+		//Without its descendants, only the node itself leaves the parent's subtree.
+		if(removeDescendants) {
+			node->parent->adjustSubtreeCounts(-node->visibleNodeCount,-node->blockNodeCount);
+		} else {
+			node->parent->adjustSubtreeCounts(node->hidden?0:-1,node->block?-1:0);
+		}
+	}
 	LOG_DEBUG(L"Disconnecting node from its siblings and or parent");
 	if(node->next!=NULL) {
 		node->next->previous=(!removeDescendants&&node->lastChild)?node->lastChild:node->previous;
@@ -750,13 +1306,21 @@ bool VBufStorage_buffer_t::removeFieldNode(VBufStorage_fieldNode_t* node,bool re
 }
 
 void VBufStorage_buffer_t::clearBuffer() {
+	if(this->changeLog) this->changeLog->recordClear();
 	for(set<VBufStorage_fieldNode_t*>::iterator i=nodes.begin();i!=nodes.end();++i) {
 		nhAssert(*i);
 		delete *i;
 	}
 	nodes.clear();
 	controlFieldNodesByIdentifier.clear();
+	compressedNodesByIdentifier.clear();
+	size_t peakBytes=memoryStats.peakBytes;
+	memset(&memoryStats,0,sizeof(memoryStats));
+	memoryStats.peakBytes=peakBytes;
 	selectionStart=selectionLength=0;
+	for(map<int,int>::iterator i=pinnedOffsets.begin();i!=pinnedOffsets.end();++i) {
+		i->second=0;
+	}
 	this->rootNode=NULL;
 }
 
@@ -808,6 +1372,7 @@ VBufStorage_textFieldNode_t* VBufStorage_buffer_t::locateTextFieldNodeAtOffset(i
 		LOG_DEBUGWARNING(L"Could not locate node, returning NULL");
 		return NULL;
 	}
+	this->markAccessed(node);
 	int startOffset=offset-relativeOffset;
 	if(nodeStartOffset) *nodeStartOffset=startOffset;
 	if(nodeEndOffset) *nodeEndOffset=startOffset+node->length;
@@ -839,13 +1404,11 @@ VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::locateControlFieldNodeAtOf
 
 VBufStorage_controlFieldNode_t* VBufStorage_buffer_t::getControlFieldNodeWithIdentifier(int docHandle, int ID) {
 	VBufStorage_controlFieldNodeIdentifier_t identifier(docHandle, ID);
-	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=this->controlFieldNodesByIdentifier.find(identifier);
-	if(i==this->controlFieldNodesByIdentifier.end()) {
+	VBufStorage_controlFieldNode_t* node=this->findControlFieldNode(identifier);
+	if(node==NULL) {
 		LOG_DEBUG(L"No controlFieldNode with identifier, returning NULL");
 		return NULL;
 	}
-	VBufStorage_controlFieldNode_t* node=i->second;
-	nhAssert(node); //Node can not be NULL
 	LOG_DEBUG(L"returning node at "<<node);
 	return node;
 }
@@ -881,6 +1444,72 @@ bool VBufStorage_buffer_t::setSelectionOffsets(int startOffset, int endOffset) {
 	return true;
 }
 
+bool VBufStorage_buffer_t::createAnchor(int offset, VBufStorage_anchor_t& anchor) {
+	if(offset<0||offset>=this->getTextLength()) {
+		LOG_DEBUGWARNING(L"Offset "<<offset<<L" out of range. Returnning false");
+		return false;
+	}
+	anchor.ancestors.clear();
+	//Descend from the root to the text field node at the offset, recording each control field node passed through.
+	int relativeOffset=offset;
+	for(VBufStorage_fieldNode_t* node=this->rootNode;node!=NULL&&node->hasChildren();) {
+		anchor.ancestors.push_back(make_pair(static_cast<VBufStorage_controlFieldNode_t*>(node)->identifier,relativeOffset));
+		for(node=node->getFirstChild();node!=NULL&&relativeOffset>=node->length;node=node->next) {
+			relativeOffset-=node->length;
+		}
+	}
+	nhAssert(!anchor.ancestors.empty());
+	LOG_DEBUG(L"Anchored offset "<<offset<<L" with "<<anchor.ancestors.size()<<L" ancestors");
+	return true;
+}
+
+bool VBufStorage_buffer_t::resolveAnchor(const VBufStorage_anchor_t& anchor, int* offset) {
+	//Try the deepest recorded node first, as it will usually still exist.
+	//A node is only used if its ancestors are still exactly those recorded for it.
+	for(int i=static_cast<int>(anchor.ancestors.size())-1;i>=0;--i) {
+		VBufStorage_controlFieldNode_t* node=this->findControlFieldNode(anchor.ancestors[i].first);
+		if(node==NULL) continue;
+		VBufStorage_controlFieldNode_t* ancestor=node->parent;
+		int j=i-1;
+		for(;j>=0&&ancestor!=NULL&&ancestor->identifier==anchor.ancestors[j].first;--j,ancestor=ancestor->parent);
+		if(j>=0||ancestor!=NULL) continue;
+		*offset=node->calculateOffsetInTree()+min(anchor.ancestors[i].second,max(node->length-1,0));
+		LOG_DEBUG(L"Resolved anchor to offset "<<*offset<<L" using ancestor "<<i);
+		return true;
+	}
+	LOG_DEBUG(L"No anchored nodes remain, returning false");
+	return false;
+}
+
+int VBufStorage_buffer_t::pinOffset(int offset) {
+	if(offset<0) {
+		LOG_DEBUGWARNING(L"invalid offset of "<<offset<<L", returning 0");
+		return 0;
+	}
+	int pinID=this->nextPinID++;
+	this->pinnedOffsets[pinID]=offset;
+	LOG_DEBUG(L"Pinned offset "<<offset<<L" with ID "<<pinID);
+	return pinID;
+}
+
+bool VBufStorage_buffer_t::getPinnedOffset(int pinID, int* offset) {
+	map<int,int>::const_iterator i=this->pinnedOffsets.find(pinID);
+	if(i==this->pinnedOffsets.end()) {
+		LOG_DEBUGWARNING(L"No pinned offset with ID "<<pinID<<L", returning false");
+		return false;
+	}
+	*offset=i->second;
+	return true;
+}
+
+bool VBufStorage_buffer_t::unpinOffset(int pinID) {
+	if(this->pinnedOffsets.erase(pinID)==0) {
+		LOG_DEBUGWARNING(L"No pinned offset with ID "<<pinID<<L", returning false");
+		return false;
+	}
+	return true;
+}
+
 int VBufStorage_buffer_t::getTextLength() const {
 	int length=(this->rootNode)?this->rootNode->length:0;
 	LOG_DEBUG(L"Returning length of "<<length);
@@ -902,6 +1531,13 @@ VBufStorage_textContainer_t*  VBufStorage_buffer_t::getTextInRange(int startOffs
 	return new VBufStorage_textContainer_t(text);
 }
 
+/**
+ * True if nothing below this node could match a search: either there is no text below it or every descendant is hidden.
+ */
+inline bool hasNoSearchableDescendants(const VBufStorage_fieldNode_t* node) {
+	return node->getLength()==0||node->getVisibleNodeCount()==(node->isHidden()?0:1);
+}
+
 VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset, VBufStorage_findDirection_t direction, const std::wstring& attribs, const std::wstring &regexp, int *startOffset, int *endOffset) {
 	if(this->rootNode==NULL) {
 		LOG_DEBUGWARNING(L"buffer empty, returning NULL");
@@ -930,7 +1566,8 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	}
 	// Split attribs at spaces.
 	vector<wstring> attribsList;
-	copy(istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(wistringstream(attribs)),
+	wistringstream attribsStream(attribs);
+	copy(istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(attribsStream),
 		istream_iterator<wstring, wchar_t, std::char_traits<wchar_t>>(),
 		back_inserter<vector<wstring> >(attribsList));
 	wregex regexObj;
@@ -944,12 +1581,12 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	LOG_DEBUG(L"initial start is "<<bufferStart<<L" and initial end is "<<bufferEnd);
 	if(direction==VBufStorage_findDirection_forward) {
 		LOG_DEBUG(L"searching forward");
-		for(node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart)) {
+		for(node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart,hasNoSearchableDescendants);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_FORWARD,NULL,&tempRelativeStart,hasNoSearchableDescendants)) {
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
 			LOG_DEBUG(L"Checking node "<<node->getDebugInfo());
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->isHidden())&&node->matchAttributes(attribsList,regexObj)) {
 				LOG_DEBUG(L"found a match");
 				break;
 			}
@@ -957,11 +1594,11 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	} else if(direction==VBufStorage_findDirection_back) {
 		LOG_DEBUG(L"searching back");
 		bool skippedFirstMatch=false;
-		for(node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart)) {
+		for(node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart,hasNoSearchableDescendants);node!=NULL;node=node->nextNodeInTree(TREEDIRECTION_BACK,NULL,&tempRelativeStart,hasNoSearchableDescendants)) {
 			bufferStart+=tempRelativeStart;
 			bufferEnd=bufferStart+node->length;
 			LOG_DEBUG(L"start is now "<<bufferStart<<L" and end is now "<<bufferEnd);
-			if(node->length>0&&!(node->isHidden)&&node->matchAttributes(attribsList,regexObj)) {
+			if(node->length>0&&!(node->isHidden())&&node->matchAttributes(attribsList,regexObj)) {
 				//Skip first containing parent match or parent match where offset hasn't changed 
 				if((bufferStart==offset)||(!skippedFirstMatch&&bufferStart<offset&&bufferEnd>offset)) {
 					LOG_DEBUG(L"skipping initial parent");
@@ -981,7 +1618,7 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 			if(node) {
 				bufferEnd=bufferStart+node->length;
 			}
-		} while(node!=NULL&&(node->isHidden||!node->matchAttributes(attribsList,regexObj)));
+		} while(node!=NULL&&(node->isHidden()||!node->matchAttributes(attribsList,regexObj)));
 		LOG_DEBUG(L"end is now "<<bufferEnd);
 	}
 	if(node==NULL) {
@@ -994,6 +1631,13 @@ VBufStorage_fieldNode_t* VBufStorage_buffer_t::findNodeByAttributes(int offset,
 	return node;
 }
 
+/**
+ * True if walking through the descendants of this node could not change a line calculation: they have no text and none of them are blocks.
+ */
+inline bool hasNoLineContent(const VBufStorage_fieldNode_t* node) {
+	return node->getLength()==0&&node->getBlockNodeCount()==(node->isBlock()?1:0);
+}
+
 bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool useScreenLayout, int *startOffset, int *endOffset) {
 	if(this->rootNode==NULL||offset>=this->rootNode->length) {
 		LOG_DEBUGWARNING(L"Offset of "<<offset<<L" too big for buffer, returning false");
@@ -1003,10 +1647,13 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	int initBufferStart, initBufferEnd;
 	VBufStorage_fieldNode_t* initNode=locateTextFieldNodeAtOffset(offset,&initBufferStart,&initBufferEnd);
 	LOG_DEBUG(L"Starting at node "<<initNode->getDebugInfo());
-	std::set<int> possibleBreaks;
+	//Offsets at which a line may be broken if it is too long, collected unsorted.
+	vector<int> possibleBreaks;
+	//Runs of text read in place when searching back.
+	vector<pair<const wchar_t*,int> > segments;
 	//Find the node at which to limit the search for line endings.
 	VBufStorage_fieldNode_t* limitBlockNode=NULL;
-	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->isBlock;limitBlockNode=limitBlockNode->parent);
+	for(limitBlockNode=initNode->parent;limitBlockNode!=NULL&&!limitBlockNode->isBlock();limitBlockNode=limitBlockNode->parent);
 	//Some needed variables for searching back and forward
 	VBufStorage_fieldNode_t* node=NULL;
 	int relative, bufferStart, bufferEnd, tempRelativeStart;
@@ -1018,39 +1665,36 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	bufferEnd = initBufferEnd;
 	int lineEnd;
 	do {
-	possibleBreaks.insert(bufferStart);
-	possibleBreaks.insert(bufferEnd);
-		if(node->length>0&&node->firstChild==NULL) {
-			std::wstring text;
+		possibleBreaks.push_back(bufferStart);
+		possibleBreaks.push_back(bufferEnd);
+		if(node->length>0&&!node->hasChildren()) {
+			//A node with length but no children must be a text field node, so scan its text in place.
+			//A break is possible at the end of each run of whitespace up to the next hard line break.
+			const VBufStorage_text_t& text=static_cast<VBufStorage_textFieldNode_t*>(node)->text;
 			lineEnd = bufferEnd;
-			node->getTextInRange(0,node->length,text,false);
-			bool lastWasSpace = false;
-			for (int i = relative; i < node->length; ++i) {
-				if ((text[i] == L'\r' && (i + 1 >= node->length || text[i + 1] != L'\n'))
-					|| text[i] == L'\n'
-				) {
-					lineEnd = bufferStart + i + 1;
+			bool precededByWhitespace=false;
+			int segmentStart=relative;
+			text.forEachSegment(relative,node->length-relative,[&](const wchar_t* segment, size_t segmentLength) {
+				if(foundHardBreak) return;
+				int length=static_cast<int>(segmentLength);
+				wchar_t following=(segmentStart+length<node->length)?text[segmentStart+length]:L'\0';
+				int lineBreak=findHardLineBreak(segment,length,following);
+				precededByWhitespace=findWhitespaceRunEnds(segment,lineBreak,precededByWhitespace,bufferStart+segmentStart,possibleBreaks);
+				if(lineBreak<length) {
+					lineEnd=bufferStart+segmentStart+lineBreak+1;
 					foundHardBreak=true;
-					break;
 				}
-				if(iswspace(text[i])) {
-					lastWasSpace = true;
-				} else {
-					if(lastWasSpace) {
-						possibleBreaks.insert(bufferStart + i);
-					}
-					lastWasSpace = false;
-				}
-			}
+				segmentStart+=length;
+			});
 			if (foundHardBreak) {
 				//A hard line break was found.
 				break;
 			}
 		}
 		//Move on to the next node.
-		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart);
+		node = node->nextNodeInTree(TREEDIRECTION_FORWARD,limitBlockNode,&tempRelativeStart,hasNoLineContent);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&((!useScreenLayout&&node->firstChild)||node->isBlock)) {
+		if(node&&((!useScreenLayout&&node->hasChildren())||node->isBlock())) {
 			node=NULL;
 		}
 		if(node) {
@@ -1067,29 +1711,40 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	int lineStart;
 	foundHardBreak=false;
 	do {
-		possibleBreaks.insert(bufferStart);
-		possibleBreaks.insert(bufferEnd);
-		if(node->length>0&&node->firstChild==NULL) {
-			std::wstring text;
+		possibleBreaks.push_back(bufferStart);
+		possibleBreaks.push_back(bufferEnd);
+		if(node->length>0&&!node->hasChildren()) {
+			const VBufStorage_text_t& text=static_cast<VBufStorage_textFieldNode_t*>(node)->text;
 			lineStart = bufferStart;
-			node->getTextInRange(0,node->length,text,false);
-			bool lastWasSpace = false;
-			for (int i = relative - 1; i >= 0; i--) {
-				if ((text[i] == L'\r' && (i + 1 >= node->length || text[i + 1] != L'\n'))
-					|| text[i] == L'\n'
-				) {
-					lineStart = bufferStart + i + 1;
+			//Search the runs of text before the offset, last first, for a hard line break.
+			segments.clear();
+			text.forEachSegment(0,relative,[&segments](const wchar_t* segment, size_t segmentLength) {
+				segments.push_back(make_pair(segment,static_cast<int>(segmentLength)));
+			});
+			int scanStart=0;
+			int segmentEnd=relative;
+			for(vector<pair<const wchar_t*,int> >::reverse_iterator segment=segments.rbegin();segment!=segments.rend();++segment) {
+				int segmentStart=segmentEnd-segment->second;
+				wchar_t following=(segmentEnd<node->length)?text[segmentEnd]:L'\0';
+				int lineBreak=findLastHardLineBreak(segment->first,segment->second,following);
+				if(lineBreak>=0) {
+					scanStart=segmentStart+lineBreak+1;
+					lineStart=bufferStart+scanStart;
 					foundHardBreak=true;
 					break;
 				}
-				if (iswspace(text[i])) {
-					if (!lastWasSpace) {
-						possibleBreaks.insert(bufferStart + i + 1);
-					}
-					lastWasSpace = true;
-				} else {
-					lastWasSpace = false;
-				}
+				segmentEnd=segmentStart;
+			}
+			//A break is possible at the end of each run of whitespace between the line break and the offset, including one ending at the offset.
+			bool precededByWhitespace=false;
+			int segmentStart=scanStart;
+			text.forEachSegment(scanStart,relative-scanStart,[&](const wchar_t* segment, size_t segmentLength) {
+				int length=static_cast<int>(segmentLength);
+				precededByWhitespace=findWhitespaceRunEnds(segment,length,precededByWhitespace,bufferStart+segmentStart,possibleBreaks);
+				segmentStart+=length;
+			});
+			if(precededByWhitespace) {
+				possibleBreaks.push_back(bufferStart+relative);
 			}
 			if (foundHardBreak) {
 				//A hard line break was found.
@@ -1097,9 +1752,10 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 			}
 		}
 		//Move on to the previous node.
-		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart);
+		//Without screen layout the limit is the parent of the current node, so entering a subtree changes where the search stops and it can not be skipped.
+		node = node->nextNodeInTree(TREEDIRECTION_SYMMETRICAL_BACK,useScreenLayout?limitBlockNode:node->parent,&tempRelativeStart,useScreenLayout?hasNoLineContent:NULL);
 		//If not using screen layout, make sure not to pass in to another control field node
-		if(node&&node->isBlock) {
+		if(node&&node->isBlock()) {
 			node=NULL;
 		}
 		if(node) {
@@ -1111,22 +1767,25 @@ bool VBufStorage_buffer_t::getLineOffsets(int offset, int maxLineLength, bool us
 	LOG_DEBUG(L"line offsets after searching back and forth for line feeds and block edges is "<<lineStart<<L" and "<<lineEnd);
 	//Finally take maxLineLength in to account
 	if(maxLineLength>0) {
-		set<int> realBreaks;
-		realBreaks.insert(lineStart);
-		realBreaks.insert(lineEnd);
+		sort(possibleBreaks.begin(),possibleBreaks.end());
+		possibleBreaks.erase(unique(possibleBreaks.begin(),possibleBreaks.end()),possibleBreaks.end());
+		//Each real break is after the one before it, so these stay sorted.
+		vector<int> realBreaks;
+		realBreaks.push_back(lineStart);
 		for(int i=lineStart,lineCharCounter=0;i<lineEnd;++i,++lineCharCounter) {
 			if(lineCharCounter==maxLineLength) {
 				if(possibleBreaks.size()>0) {
-					set<int>::iterator possible=possibleBreaks.upper_bound(i);
+					vector<int>::iterator possible=upper_bound(possibleBreaks.begin(),possibleBreaks.end(),i);
 					if((possible!=possibleBreaks.begin())&&(*(--possible)>(i-maxLineLength))) {
 												i=*possible;
 					}
 				}
-				realBreaks.insert(i);
+				realBreaks.push_back(i);
 				lineCharCounter=0;
 			}
 		}
-		set<int>::iterator real=realBreaks.upper_bound(offset);
+		realBreaks.push_back(lineEnd);
+		vector<int>::iterator real=upper_bound(realBreaks.begin(),realBreaks.end(),offset);
 		lineEnd=*real;
 		lineStart=*(--real);
 		LOG_DEBUG(L"limits after fixing for maxLineLength %: start "<<lineStart<<L" end "<<lineEnd);
@@ -1159,8 +1818,362 @@ bool VBufStorage_buffer_t::isNodeInBuffer(VBufStorage_fieldNode_t* node) {
 	return this->nodes.count(node)?true:false;
 }
 
+void VBufStorage_buffer_t::getMemoryStats(VBufStorage_memoryStats_t* stats) const {
+	nhAssert(stats);
+	*stats=this->memoryStats;
+	stats->indexBytes=this->nodes.size()*(VBUFSTORAGE_TREENODEOVERHEAD+sizeof(VBufStorage_fieldNode_t*))+(this->controlFieldNodesByIdentifier.size()+this->compressedNodesByIdentifier.size())*(VBUFSTORAGE_TREENODEOVERHEAD+sizeof(pair<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>));
+	stats->totalBytes=stats->nodeBytes+stats->attributeBytes+stats->textBytes+stats->compressedBytes+stats->indexBytes;
+	stats->peakBytes=max(stats->peakBytes,stats->totalBytes);
+}
+
+size_t VBufStorage_buffer_t::getMemoryUsage() const {
+	VBufStorage_memoryStats_t stats;
+	this->getMemoryStats(&stats);
+	return stats.totalBytes;
+}
+
+void VBufStorage_buffer_t::recalculateMemoryStats() {
+	size_t peakBytes=this->memoryStats.peakBytes;
+	memset(&(this->memoryStats),0,sizeof(this->memoryStats));
+	this->memoryStats.peakBytes=peakBytes;
+	for(set<VBufStorage_fieldNode_t*>::iterator i=this->nodes.begin();i!=this->nodes.end();++i) {
+		this->accountForNode(*i,false);
+	}
+	this->updatePeakMemoryUsage();
+}
+
+void VBufStorage_buffer_t::setMemoryLimit(size_t limit) {
+	this->memoryLimit=limit;
+}
+
+void VBufStorage_buffer_t::accountForAttributes(VBufStorage_fieldNode_t* node) {
+	nhAssert(node&&this->isNodeInBuffer(node));
+	VBufStorage_memoryStats_t usage={0};
+	node->calculateMemoryUsage(usage);
+	nhAssert(this->memoryStats.attributeBytes>=node->accountedAttributeBytes);
+	this->memoryStats.attributeBytes-=node->accountedAttributeBytes;
+	this->memoryStats.attributeBytes+=usage.attributeBytes;
+	node->accountedAttributeBytes=static_cast<unsigned int>(usage.attributeBytes);
+	this->updatePeakMemoryUsage();
+}
+
+bool VBufStorage_buffer_t::isOverMemoryLimit(size_t extraBytes) const {
+	return this->memoryLimit>0&&this->getMemoryUsage()+extraBytes>this->memoryLimit;
+}
+
+//compressed subtrees
+
+/**
+ * The most characters a subtree can contain for compressColdSubtrees to compress it in one piece.
+ * Longer subtrees are compressed as several smaller ones, so that using one part of them does not need all of them to be decompressed.
+ */
+#define VBUFSTORAGE_COMPRESSION_MAXLENGTH 4096
+
+bool VBufStorage_buffer_t::encodeNode(VBufStorage_fieldNode_t* node, VBufStorage_encoder_t& encoder, VBufStorage_compressedSubtree_t* subtree, size_t& freedBytes) {
+	unsigned char flags;
+	if(typeid(*node)==typeid(VBufStorage_textFieldNode_t)) {
+		flags=VBUFSTORAGE_NODEKIND_TEXT;
+	} else if(typeid(*node)==typeid(VBufStorage_controlFieldNode_t)) {
+		flags=VBUFSTORAGE_NODEKIND_CONTROL;
+	} else if(typeid(*node)==typeid(VBufStorage_deferredFieldNode_t)) {
+		flags=VBUFSTORAGE_NODEKIND_DEFERRED;
+	} else if(!subtree) {
+		//A replica only needs the content of a backend's own node type, not its state.
+		flags=dynamic_cast<VBufStorage_textFieldNode_t*>(node)?VBUFSTORAGE_NODEKIND_TEXT:(node->isDeferred()?VBUFSTORAGE_NODEKIND_DEFERRED:VBUFSTORAGE_NODEKIND_CONTROL);
+	} else {
+		LOG_DEBUG(L"Can not encode node "<<node->getDebugInfo());
+		return false;
+	}
+	if(node->compressed&&subtree) {
+		LOG_DEBUG(L"Node "<<node->getDebugInfo()<<L" is already compressed");
+		return false;
+	}
+	unsigned int levelsUp=0;
+	if(node->updateAncestor) {
+		VBufStorage_controlFieldNode_t* ancestor=node->parent;
+		for(levelsUp=1;ancestor!=NULL&&ancestor!=node->updateAncestor;++levelsUp) ancestor=ancestor->parent;
+		if(ancestor!=NULL) {
+			flags|=VBUFSTORAGE_NODEFLAG_UPDATEANCESTOR;
+		} else if(subtree) {
+			LOG_DEBUG(L"Update ancestor of node "<<node->getDebugInfo()<<L" is not one of its ancestors");
+			return false;
+		} else {
+			//Such as the root of a temporary buffer, whose update ancestor is in the buffer it will be merged in to.
+			levelsUp=0;
+		}
+	}
+	if(node->block) flags|=VBUFSTORAGE_NODEFLAG_BLOCK;
+	if(node->hidden) flags|=VBUFSTORAGE_NODEFLAG_HIDDEN;
+	encoder.writeByte(flags);
+	if(levelsUp>0) encoder.writeUnsigned(levelsUp);
+	bool isText=(flags&VBUFSTORAGE_NODEKIND_MASK)==VBUFSTORAGE_NODEKIND_TEXT;
+	if(isText) {
+		const VBufStorage_text_t& text=static_cast<VBufStorage_textFieldNode_t*>(node)->text;
+		encoder.writeUnsigned(static_cast<unsigned int>(text.length()));
+		text.forEachSegment(0,text.length(),[&encoder](const wchar_t* segment, size_t segmentLength) {
+			encoder.writeCharacters(segment,segmentLength);
+		});
+	} else {
+		const VBufStorage_controlFieldNodeIdentifier_t& identifier=static_cast<VBufStorage_controlFieldNode_t*>(node)->identifier;
+		encoder.writeSigned(identifier.docHandle);
+		encoder.writeSigned(identifier.ID);
+		if(subtree) subtree->identifiers.push_back(identifier);
+	}
+	encoder.writeUnsigned(static_cast<unsigned int>(node->attributes.size()));
+	for(VBufStorage_attributeMap_t::const_iterator i=node->attributes.begin();i!=node->attributes.end();++i) {
+		encoder.writeString(i->first);
+		encoder.writeString(i->second);
+	}
+	if(!subtree) {
+		if(isText) return true;
+		if(node->compressed) {
+			//The compressed descendants are already in this format, including the end of the list.
+			const VBufStorage_compressedSubtree_t& compressedSubtree=*(static_cast<VBufStorage_controlFieldNode_t*>(node)->compressedSubtree);
+			vector<unsigned char> bytes;
+			if(!VBufStorage_decompressBlock(compressedSubtree.data.data(),compressedSubtree.data.size(),compressedSubtree.encodedSize,bytes)) {
+				LOG_ERROR(L"Compressed descendants of node "<<node->getDebugInfo()<<L" are damaged");
+				return false;
+			}
+			encoder.bytes.insert(encoder.bytes.end(),bytes.begin(),bytes.end());
+			return true;
+		}
+	} else {
+		++(subtree->nodeCount);
+		VBufStorage_memoryStats_t usage={0};
+		node->calculateMemoryUsage(usage);
+		freedBytes+=usage.nodeBytes+node->accountedAttributeBytes+usage.textBytes+VBUFSTORAGE_TREENODEOVERHEAD+sizeof(VBufStorage_fieldNode_t*);
+		if(isText) return true;
+		freedBytes+=VBUFSTORAGE_TREENODEOVERHEAD+sizeof(pair<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>);
+	}
+	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;child=child->next) {
+		if(!this->encodeNode(child,encoder,subtree,freedBytes)) return false;
+	}
+	encoder.writeByte(VBUFSTORAGE_NODEKIND_END);
+	return true;
+}
+
+bool VBufStorage_buffer_t::decodeSubtree(const VBufStorage_compressedSubtree_t& subtree, VBufStorage_controlFieldNode_t* source, VBufStorage_controlFieldNode_t* target) {
+	nhAssert(source&&target&&!target->firstChild);
+	vector<unsigned char> bytes;
+	if(!VBufStorage_decompressBlock(subtree.data.data(),subtree.data.size(),subtree.encodedSize,bytes)) {
+		LOG_ERROR(L"Compressed descendants of node "<<source->getDebugInfo()<<L" are damaged");
+		return false;
+	}
+	VBufStorage_decoder_t decoder(bytes.data(),bytes.size());
+	return this->decodeNodes(decoder,source,target)&&decoder.atEnd();
+}
+
+bool VBufStorage_buffer_t::decodeNodes(VBufStorage_decoder_t& decoder, VBufStorage_controlFieldNode_t* source, VBufStorage_controlFieldNode_t* target) {
+	nhAssert(target?!target->firstChild:!this->rootNode);
+	//The control field nodes being added to, innermost last, with NULL for those that could not be added, and the last child added to each.
+	//When adding a root node, the list of nodes at the top has no parent either, but is only a single node long.
+	vector<VBufStorage_controlFieldNode_t*> parents(1,target);
+	vector<VBufStorage_fieldNode_t*> previousNodes(1,NULL);
+	while(!parents.empty()) {
+		unsigned char flags;
+		if(!decoder.readByte(&flags)) return false;
+		unsigned char kind=flags&VBUFSTORAGE_NODEKIND_MASK;
+		if(kind==VBUFSTORAGE_NODEKIND_END) {
+			parents.pop_back();
+			previousNodes.pop_back();
+			continue;
+		}
+		unsigned int levelsUp=0;
+		if((flags&VBUFSTORAGE_NODEFLAG_UPDATEANCESTOR)&&(!decoder.readUnsigned(&levelsUp)||levelsUp==0)) return false;
+		wstring text;
+		int docHandle=0, ID=0;
+		if(kind==VBUFSTORAGE_NODEKIND_TEXT) {
+			if(!decoder.readString(text)) return false;
+		} else if(!decoder.readSigned(&docHandle)||!decoder.readSigned(&ID)) {
+			return false;
+		}
+		unsigned int attributeCount;
+		if(!decoder.readUnsigned(&attributeCount)) return false;
+		VBufStorage_attributeMap_t attributes;
+		for(unsigned int i=0;i<attributeCount;++i) {
+			wstring name, value;
+			if(!decoder.readString(name)||!decoder.readString(value)) return false;
+			attributes[name]=value;
+		}
+		VBufStorage_controlFieldNode_t* parent=parents.back();
+		VBufStorage_textFieldNode_t* textFieldNode=NULL;
+		VBufStorage_controlFieldNode_t* controlFieldNode=NULL;
+		VBufStorage_fieldNode_t* node=NULL;
+		if(kind==VBUFSTORAGE_NODEKIND_TEXT) {
+			node=textFieldNode=new VBufStorage_textFieldNode_t(text);
+			node->setBlock((flags&VBUFSTORAGE_NODEFLAG_BLOCK)!=0);
+		} else if(kind==VBUFSTORAGE_NODEKIND_DEFERRED) {
+			node=controlFieldNode=new VBufStorage_deferredFieldNode_t(docHandle,ID,(flags&VBUFSTORAGE_NODEFLAG_BLOCK)!=0);
+		} else {
+			node=controlFieldNode=new VBufStorage_controlFieldNode_t(docHandle,ID,(flags&VBUFSTORAGE_NODEFLAG_BLOCK)!=0);
+		}
+		node->setHidden((flags&VBUFSTORAGE_NODEFLAG_HIDDEN)!=0);
+		node->attributes.swap(attributes);
+		if(levelsUp>0&&levelsUp<=parents.size()) {
+			node->updateAncestor=parents[parents.size()-levelsUp];
+		} else if(levelsUp>0) {
+			//The update ancestor is above the compressed subtree.
+			VBufStorage_controlFieldNode_t* updateAncestor=source;
+			for(size_t i=parents.size();i<levelsUp&&updateAncestor!=NULL;++i) updateAncestor=updateAncestor->parent;
+			if(updateAncestor&&source!=target) {
+				//As for copySubtree, use the node with the same identifier in this buffer if there is one.
+				map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>::iterator i=this->controlFieldNodesByIdentifier.find(updateAncestor->identifier);
+				if(i!=this->controlFieldNodesByIdentifier.end()) updateAncestor=i->second;
+			}
+			node->updateAncestor=updateAncestor;
+		}
+		bool added=false;
+		if(parent||(!target&&parents.size()==1&&!this->rootNode)) {
+			added=textFieldNode?(this->addTextFieldNode(parent,previousNodes.back(),textFieldNode)==textFieldNode):(this->addControlFieldNode(parent,previousNodes.back(),controlFieldNode)==controlFieldNode);
+		}
+		if(added) {
+			previousNodes.back()=node;
+		} else {
+			if(parent) LOG_DEBUGWARNING(L"Could not add decoded node "<<node->getDebugInfo());
+			delete node;
+			controlFieldNode=NULL;
+		}
+		if(kind!=VBUFSTORAGE_NODEKIND_TEXT) {
+			parents.push_back(controlFieldNode);
+			previousNodes.push_back(NULL);
+		}
+	}
+	return true;
+}
+
+bool VBufStorage_buffer_t::compressSubtree(VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node&&!node->compressed&&this->isNodeInBuffer(node));
+	if(typeid(*node)!=typeid(VBufStorage_controlFieldNode_t)||!node->firstChild) {
+		return false;
+	}
+	VBufStorage_compressedSubtree_t* subtree=new VBufStorage_compressedSubtree_t();
+	subtree->buffer=this;
+	subtree->nodeCount=0;
+	VBufStorage_encoder_t encoder;
+	size_t freedBytes=0;
+	bool encoded=true;
+	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL&&encoded;child=child->next) {
+		encoded=this->encodeNode(child,encoder,subtree,freedBytes);
+	}
+	if(!encoded) {
+		delete subtree;
+		return false;
+	}
+	encoder.writeByte(VBUFSTORAGE_NODEKIND_END);
+	subtree->encodedSize=encoder.bytes.size();
+	VBufStorage_compressBlock(encoder.bytes,subtree->data);
+	subtree->data.shrink_to_fit();
+	subtree->identifiers.shrink_to_fit();
+	size_t compressedBytes=compressedSubtreeBytes(*subtree)+subtree->identifiers.size()*(VBUFSTORAGE_TREENODEOVERHEAD+sizeof(pair<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*>));
+	if(compressedBytes>=freedBytes) {
+		LOG_DEBUG(L"Compressing "<<subtree->nodeCount<<L" nodes would not save any memory");
+		delete subtree;
+		return false;
+	}
+	LOG_DEBUG(L"Compressing "<<subtree->nodeCount<<L" nodes of "<<node->getDebugInfo()<<L" from "<<freedBytes<<L" to "<<compressedBytes<<L" bytes");
+	this->accountForNode(node,true);
+	for(VBufStorage_fieldNode_t* child=node->firstChild;child!=NULL;) {
+		VBufStorage_fieldNode_t* next=child->next;
+		this->deleteSubtree(child);
+		child=next;
+	}
+	//The node keeps its length and subtree counts, as its descendants are still there as far as the rest of the buffer is concerned.
+	node->firstChild=node->lastChild=NULL;
+	node->compressed=true;
+	node->compressedSubtree=subtree;
+	for(vector<VBufStorage_controlFieldNodeIdentifier_t>::const_iterator i=subtree->identifiers.begin();i!=subtree->identifiers.end();++i) {
+		this->compressedNodesByIdentifier.insert(make_pair(*i,node));
+	}
+	this->accountForNode(node,false);
+	return true;
+}
+
+void VBufStorage_buffer_t::expandSubtree(VBufStorage_controlFieldNode_t* node) {
+	nhAssert(node&&node->compressed&&this->isNodeInBuffer(node));
+	VBufStorage_compressedSubtree_t* subtree=node->compressedSubtree;
+	LOG_DEBUG(L"Decompressing "<<subtree->nodeCount<<L" nodes of "<<node->getDebugInfo());
+	this->accountForNode(node,true);
+	this->forgetCompressedSubtree(node);
+	node->compressed=false;
+	node->compressedSubtree=NULL;
+	this->accountForNode(node,false);
+	//The descendants are added back one at a time, so first take away what they contribute to the node and its ancestors.
+	int length=node->length;
+	for(VBufStorage_fieldNode_t* ancestor=node;ancestor!=NULL;ancestor=ancestor->parent) {
+		ancestor->length-=length;
+	}
+	node->adjustSubtreeCounts(-(node->visibleNodeCount-(node->hidden?0:1)),-(node->blockNodeCount-(node->block?1:0)));
+	if(!this->decodeSubtree(*subtree,node,node)) {
+		LOG_ERROR(L"Could not decompress all descendants of node "<<node->getDebugInfo());
+	}
+	delete subtree;
+	this->markAccessed(node);
+	this->updatePeakMemoryUsage();
+}
+
+void VBufStorage_buffer_t::setChangeLog(VBufStorage_changeLog_t* changeLog) {
+	this->changeLog=changeLog;
+}
+
+void VBufStorage_buffer_t::setCompressionBudget(size_t budget) {
+	this->compressionBudget=budget;
+}
+
+/**
+ * Adds the largest subtrees below a node which are short enough to be compressed to a list, along with the offsets at which they start.
+ * Subtrees containing any of the excluded offsets are not added, though smaller subtrees within them may be.
+ * @param nodeStart the offset at which node starts.
+ */
+void collectCompressibleSubtrees(VBufStorage_fieldNode_t* node, int nodeStart, const vector<int>& excludedOffsets, vector<pair<VBufStorage_controlFieldNode_t*,int> >& subtrees) {
+	int childStart=nodeStart;
+	for(VBufStorage_fieldNode_t* child=node->getFirstChild();child!=NULL;childStart+=child->getLength(),child=child->getNext()) {
+		if(child->isCompressed()||!child->hasChildren()) continue;
+		int childEnd=childStart+child->getLength();
+		bool excluded=false;
+		for(vector<int>::const_iterator i=excludedOffsets.begin();i!=excludedOffsets.end()&&!excluded;++i) {
+			excluded=(*i>=childStart&&*i<childEnd);
+		}
+		if(!excluded&&child->getLength()<=VBUFSTORAGE_COMPRESSION_MAXLENGTH) {
+			subtrees.push_back(make_pair(static_cast<VBufStorage_controlFieldNode_t*>(child),childStart));
+		} else {
+			collectCompressibleSubtrees(child,childStart,excludedOffsets,subtrees);
+		}
+	}
+}
+
+int VBufStorage_buffer_t::compressColdSubtrees() {
+	if(!this->rootNode||this->compressionBudget==0||this->getMemoryUsage()<=this->compressionBudget) {
+		return 0;
+	}
+	vector<int> excludedOffsets;
+	excludedOffsets.push_back(this->selectionStart);
+	for(map<int,int>::iterator i=this->pinnedOffsets.begin();i!=this->pinnedOffsets.end();++i) {
+		excludedOffsets.push_back(i->second);
+	}
+	vector<pair<VBufStorage_controlFieldNode_t*,int> > subtrees;
+	collectCompressibleSubtrees(this->rootNode,0,excludedOffsets,subtrees);
+	//Compress the subtrees which have gone longest without being used first, and of those, the ones furthest from the selection.
+	int selection=this->selectionStart;
+	auto distanceFromSelection=[selection](const pair<VBufStorage_controlFieldNode_t*,int>& subtree) {
+		return (subtree.second>selection)?subtree.second-selection:selection-(subtree.second+subtree.first->getLength());
+	};
+	sort(subtrees.begin(),subtrees.end(),[&distanceFromSelection](const pair<VBufStorage_controlFieldNode_t*,int>& a, const pair<VBufStorage_controlFieldNode_t*,int>& b) {
+		if(a.first->lastAccessTime!=b.first->lastAccessTime) return a.first->lastAccessTime<b.first->lastAccessTime;
+		return distanceFromSelection(a)>distanceFromSelection(b);
+	});
+	int compressedCount=0;
+	for(vector<pair<VBufStorage_controlFieldNode_t*,int> >::iterator i=subtrees.begin();i!=subtrees.end()&&this->getMemoryUsage()>this->compressionBudget;++i) {
+		if(this->compressSubtree(i->first)) ++compressedCount;
+	}
+	LOG_DEBUG(L"Compressed "<<compressedCount<<L" of "<<subtrees.size()<<L" subtrees, now using "<<this->getMemoryUsage()<<L" bytes");
+	return compressedCount;
+}
+
 std::wstring VBufStorage_buffer_t::getDebugInfo() const {
+	VBufStorage_memoryStats_t stats;
+	this->getMemoryStats(&stats);
 	std::wostringstream s;
 	s<<L"buffer at "<<this<<L", selectionStart is "<<selectionStart<<L", selectionEnd is "<<selectionLength+selectionStart;
+	s<<L", "<<stats.controlFieldNodeCount<<L" control fields, "<<stats.textFieldNodeCount<<L" text fields, using "<<stats.totalBytes<<L" bytes (nodes "<<stats.nodeBytes<<L", attributes "<<stats.attributeBytes<<L", text "<<stats.textBytes<<L", compressed "<<stats.compressedBytes<<L" in "<<stats.compressedSubtreeCount<<L" subtrees, index "<<stats.indexBytes<<L"), peak "<<stats.peakBytes<<L" bytes";
 	return s.str();
 }
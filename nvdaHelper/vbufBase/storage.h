@@ -20,6 +20,7 @@ http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 #include <set>
 #include <list>
 #include <vector>
+#include <memory>
 #include <regex>
 
 /**
@@ -51,11 +52,156 @@ class VBufStorage_textContainer_t: protected std::wstring {
 
 };
 
+/**
+ * Text stored as a plain string until it is long and gets edited, and from then on as a sequence of pieces, each of which is a range within a shared, immutable chunk of text.
+ * Inserting or removing text only adds or splits pieces, so the rest of the text is not copied, and copying the text only copies the pieces, not the chunks.
+ * Most text is short and never edited, so it does not pay for the pieces.
+ * Ranges of the text can be read in place with forEachSegment.
+ */
+class VBufStorage_text_t {
+	private:
+
+/**
+ * A range within a chunk.
+ */
+	typedef struct {
+		std::shared_ptr<const std::wstring> chunk;
+		size_t start;
+		size_t length;
+	} piece_t;
+
+/**
+ * The text, while it is stored as a plain string. Empty whenever there are pieces.
+ */
+	std::wstring plain;
+
+/**
+ * The pieces making up the text, in order, or empty if the text is stored in plain.
+ */
+	std::vector<piece_t> pieces;
+
+/**
+ * The offset in the text at which each piece ends, so that the piece at an offset can be found with a binary search.
+ */
+	std::vector<size_t> pieceEnds;
+
+/**
+ * Finds the piece containing the given offset.
+ * @param offset the offset, which must be less than the length of the text.
+ * @param pieceStart memory where the offset at which the found piece starts will be placed.
+ * @return the index of the piece.
+ */
+	size_t findPiece(size_t offset, size_t* pieceStart) const;
+
+/**
+ * Splits the piece containing the given offset so that a piece starts exactly at the offset.
+ * @param offset the offset to split at, which can be the length of the text.
+ * @return the index of the piece starting at the offset, or the number of pieces if the offset is the end of the text.
+ */
+	size_t splitAt(size_t offset);
+
+/**
+ * Moves the plain text in to a single piece, so that it can be edited without copying it.
+ */
+	void usePieces();
+
+/**
+ * Recalculates pieceEnds, and joins all pieces in to one new chunk if there are too many of them.
+ * Text that has become short is moved back in to plain.
+ */
+	void updatePieces();
+
+	public:
+
+/**
+ * constructor.
+ * @param text the initial text.
+ */
+	VBufStorage_text_t(const std::wstring& text=std::wstring());
+
+/**
+ * @return the length of the text in characters.
+ */
+	inline size_t length() const { return this->pieceEnds.empty()?this->plain.length():this->pieceEnds.back(); }
+
+/**
+ * Retreaves the character at the given offset.
+ * @param offset the offset, which must be less than the length of the text.
+ */
+	wchar_t operator[](size_t offset) const;
+
+/**
+ * Calls a function for each contiguous run of characters in a range of the text, without copying.
+ * @param start the offset at which the range starts.
+ * @param count the number of characters in the range.
+ * @param visitor called with a pointer to the characters and the number of characters in each run.
+ */
+	template<typename visitor_t> void forEachSegment(size_t start, size_t count, visitor_t visitor) const {
+		if(count==0) return;
+		if(this->pieces.empty()) {
+			visitor(this->plain.data()+start,count);
+			return;
+		}
+		size_t pieceStart;
+		for(size_t i=this->findPiece(start,&pieceStart);i<this->pieces.size()&&count>0;++i) {
+			const piece_t& piece=this->pieces[i];
+			size_t offsetInPiece=start-pieceStart;
+			size_t segmentLength=(piece.length-offsetInPiece<count)?(piece.length-offsetInPiece):count;
+			visitor(piece.chunk->data()+piece.start+offsetInPiece,segmentLength);
+			start+=segmentLength;
+			count-=segmentLength;
+			pieceStart+=piece.length;
+		}
+	}
+
+/**
+ * Appends a range of the text to a string.
+ * @param text the string to append to.
+ * @param start the offset at which the range starts.
+ * @param count the number of characters in the range.
+ */
+	void appendTo(std::wstring& text, size_t start, size_t count) const;
+
+/**
+ * @return the whole text as a string.
+ */
+	std::wstring str() const;
+
+/**
+ * Inserts text.
+ * @param offset the offset at which to insert, which can be the length of the text.
+ * @param text the text to insert.
+ */
+	void insert(size_t offset, const std::wstring& text);
+
+/**
+ * Removes text.
+ * @param offset the offset at which to start removing.
+ * @param count the number of characters to remove.
+ */
+	void erase(size_t offset, size_t count);
+
+/**
+ * Compares this text with another, in the same way as std::wstring::compare.
+ */
+	int compare(const VBufStorage_text_t& other) const;
+
+/**
+ * @return an estimate of the bytes used by the pieces and chunks of this text. Chunks shared with other texts are counted in full.
+ */
+	size_t getMemoryUsage() const;
+
+};
+
 class VBufStorage_buffer_t;
 class VBufStorage_fieldNode_t;
 class VBufStorage_controlFieldNode_t;
+class VBufStorage_deferredFieldNode_t;
 class VBufStorage_textFieldNode_t;
 class VBufStorage_controlFieldNodeIdentifier_t;
+class VBufStorage_encoder_t;
+class VBufStorage_decoder_t;
+class VBufStorage_changeLog_t;
 
 /**
  * a list of control field nodes.
@@ -92,11 +238,120 @@ class VBufStorage_controlFieldNodeIdentifier_t {
 
 };
 
+/**
+ * A position in a buffer that can be recovered after parts of the buffer have been replaced.
+ * It records the identifiers of the control field nodes containing the position, from the root down to the deepest, along with the position's offset relative to the start of each of those nodes.
+ * Anchors are created and resolved by a buffer. See VBufStorage_buffer_t::createAnchor and VBufStorage_buffer_t::resolveAnchor.
+ */
+class VBufStorage_anchor_t {
+	public:
+
+/**
+ * The identifiers of the control field nodes containing the position, root first, each paired with the position's offset relative to that node.
+ */
+	std::vector<std::pair<VBufStorage_controlFieldNodeIdentifier_t,int>> ancestors;
+
+};
+
+/**
+ * The memory used by a buffer, as estimated by the buffer's own accounting.
+ * See VBufStorage_buffer_t::getMemoryStats.
+ */
+typedef struct {
+/**
+ * The number of control field nodes in the buffer.
+ */
+	int controlFieldNodeCount;
+/**
+ * The number of text field nodes in the buffer.
+ */
+	int textFieldNodeCount;
+/**
+ * Bytes used by the node objects themselves.
+ */
+	size_t nodeBytes;
+/**
+ * Bytes used by the nodes' attribute maps, including the attribute names and values.
+ */
+	size_t attributeBytes;
+/**
+ * Bytes used by the text of text field nodes.
+ */
+	size_t textBytes;
+/**
+ * The number of control field nodes whose descendants are compressed.
+ */
+	int compressedSubtreeCount;
+/**
+ * The number of nodes held in compressed form. These are not included in controlFieldNodeCount or textFieldNodeCount.
+ */
+	int compressedNodeCount;
+/**
+ * Bytes used by compressed descendants, including the identifiers kept so that they can still be found.
+ */
+	size_t compressedBytes;
+/**
+ * Bytes used by the buffer's node set and identifier maps.
+ */
+	size_t indexBytes;
+/**
+ * The sum of all of the above byte counts.
+ */
+	size_t totalBytes;
+/**
+ * The highest totalBytes seen since the buffer was created, including any temporary buffers that were being merged in at the time.
+ */
+	size_t peakBytes;
+} VBufStorage_memoryStats_t;
+
 /**
  * A type  for a map that can hold a set of name,value attributes.
  */
 typedef std::map<std::wstring,std::wstring> VBufStorage_attributeMap_t;
 
+/**
+ * In the binary node format, each node starts with a byte holding its kind in the lowest 2 bits and flags in the bits above.
+ * If VBUFSTORAGE_NODEFLAG_UPDATEANCESTOR is set, the number of levels up to the node's update ancestor follows.
+ * A text field node then has its text, and a control field node its docHandle and ID.
+ * Every node then has its number of attributes followed by the name and value of each.
+ * A control field node's children follow it and are ended by a VBUFSTORAGE_NODEKIND_END byte, as is the list of nodes at the top.
+ */
+#define VBUFSTORAGE_NODEKIND_END 0
+#define VBUFSTORAGE_NODEKIND_CONTROL 1
+#define VBUFSTORAGE_NODEKIND_DEFERRED 2
+#define VBUFSTORAGE_NODEKIND_TEXT 3
+#define VBUFSTORAGE_NODEKIND_MASK 3
+#define VBUFSTORAGE_NODEFLAG_BLOCK 4
+#define VBUFSTORAGE_NODEFLAG_HIDDEN 8
+#define VBUFSTORAGE_NODEFLAG_UPDATEANCESTOR 16
+
+/**
+ * The descendants of a control field node, encoded in the binary node format and compressed while they are not being used.
+ * See VBufStorage_buffer_t::compressColdSubtrees.
+ */
+typedef struct {
+/**
+ * The buffer the node is in, so that the descendants can be decompressed when a walk of the tree reaches the node.
+ */
+	VBufStorage_buffer_t* buffer;
+/**
+ * The encoded descendants, compressed with VBufStorage_compressBlock.
+ */
+	std::vector<unsigned char> data;
+/**
+ * The size of the encoded descendants before compression.
+ */
+	size_t encodedSize;
+/**
+ * The number of nodes encoded.
+ */
+	int nodeCount;
+/**
+ * The identifiers of the control field nodes encoded, so that they can still be found by identifier.
+ */
+	std::vector<VBufStorage_controlFieldNodeIdentifier_t> identifiers;
+} VBufStorage_compressedSubtree_t;
+
 /**
  * a node that represents a field in a buffer.
  * Nodes have relationships with other nodes (giving the ability to form a tree structure), they have a length in characters (how many characters they span in the buffer), and they can hold name value attribute paires. Their constructor is protected and their only friend is a buffer, thus they can only be created by a buffer. 
@@ -138,6 +393,57 @@ class VBufStorage_fieldNode_t {
  */
 	int length;
 
+/**
+ * The attribute bytes the node's buffer has accounted for this node, so that exactly the same amount can be removed again when the node is deleted.
+ */
+	unsigned int accountedAttributeBytes;
+
+/**
+ * true if this field should cause a line break at its start and end when a buffer is calculating lines.
+ */
+	bool block;
+
+/**
+ * True if this node is hidden - searches will not locate this node.
+ */
+	bool hidden;
+
+/**
+ * True if this node's descendants are compressed, in which case it has no children until they are decompressed.
+ * Its length and subtree counts stay those of its descendants. Only control field nodes can be compressed.
+ */
+	bool compressed;
+
+/**
+ * The number of nodes in this subtree (including this node) which are not hidden.
+ * Kept up to date as nodes are inserted, removed, hidden and shown, so that searches can skip subtrees with nothing to find.
+ */
+	int visibleNodeCount;
+
+/**
+ * The number of block nodes in this subtree (including this node).
+ * Kept up to date like visibleNodeCount, so that line calculations can skip empty subtrees which can not end a line.
+ */
+	int blockNodeCount;
+
+/**
+ * The buffer's access time when this node was last passed through by a query, or decompressed.
+ * Subtrees which have gone longest without being used are compressed first.
+ */
+	unsigned int lastAccessTime;
+
+/**
+ * Decompresses this node's descendants. See VBufStorage_buffer_t::expandSubtree.
+ */
+	void expand();
+
+/**
+ * Adds to the subtree counts of this node and all of its ancestors.
+ * @param visibleDelta the amount to add to visibleNodeCount.
+ * @param blockDelta the amount to add to blockNodeCount.
+ */
+	void adjustSubtreeCounts(int visibleDelta, int blockDelta);
+
 /**
  * a map to hold attributes for this field.
  */
@@ -148,9 +454,10 @@ class VBufStorage_fieldNode_t {
 * @param direction the direction to walk
  * @param limitNode the node which can not be passed
  * @param relativeStartOffset memory to place the start offset of the next node relative to the start offset of the original node
+ * @param skipDescendants an optional function that takes a node and returns true if its descendants should be passed over without being visited.
  * @return the next node.
  */
-	VBufStorage_fieldNode_t* nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset);
+	VBufStorage_fieldNode_t* nextNodeInTree(int direction, VBufStorage_fieldNode_t* limitNode, int *relativeStartOffset, bool(*skipDescendants)(const VBufStorage_fieldNode_t*)=NULL);
 
 /**
  * Calculates the offset for this node relative to the surrounding tree. 
@@ -200,6 +507,26 @@ class VBufStorage_fieldNode_t {
  */
 	virtual void disassociateFromBuffer(VBufStorage_buffer_t* buffer);
 
+/**
+ * Adds the memory used by this node to the given stats.
+ * @param stats the stats to add to.
+ */
+	virtual void calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const;
+
+/**
+ * Adds a copy of this node, and of all its descendants, to a buffer.
+ * @param buffer the buffer to add the copy to.
+ * @param parent the parent for the copy in that buffer.
+ * @param previous the node the copy should come directly after in that buffer.
+ * @return the copy, or NULL if it could not be added.
+ */
+	virtual VBufStorage_fieldNode_t* copyToBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous)=0;
+
+/**
+ * Copies the attributes and flags shared by all node types from another node.
+ */
+	void copyPropertiesFrom(const VBufStorage_fieldNode_t* source);
+
 /**
  * constructor.
  * @param length the length in characters this node should be, usually left as  its default.
@@ -213,13 +540,54 @@ class VBufStorage_fieldNode_t {
 	virtual ~VBufStorage_fieldNode_t();
 
 	friend class VBufStorage_buffer_t;
+	friend class VBufStorage_controlFieldNode_t;
 
 	public:
 
 /**
  * true if this field should cause a line break at its start and end when a buffer is calculating lines.
  */
-	bool isBlock;
+	inline bool isBlock() const { return this->block; }
+
+/**
+ * Sets whether this field should cause a line break at its start and end, updating the block counts of its ancestors.
+ */
+	void setBlock(bool block);
+
+/**
+ * True if this node is hidden - searches will not locate this node.
+ */
+	inline bool isHidden() const { return this->hidden; }
+
+/**
+ * Sets whether this node is hidden, updating the visible node counts of its ancestors.
+ */
+	void setHidden(bool hidden);
+
+/**
+ * @return the number of nodes in this subtree (including this node) which are not hidden.
+ */
+	inline int getVisibleNodeCount() const { return this->visibleNodeCount; }
+
+/**
+ * @return the number of block nodes in this subtree (including this node).
+ */
+	inline int getBlockNodeCount() const { return this->blockNodeCount; }
+
+/**
+ * @return true if this node's descendants are compressed. They are decompressed as soon as anything walks in to them.
+ */
+	inline bool isCompressed() const { return this->compressed; }
+
+/**
+ * Decompresses this node's descendants if they are compressed.
+ */
+	inline void ensureExpanded() { if(this->compressed) this->expand(); }
+
+/**
+ * @return true if this node has children, including compressed ones, without decompressing them.
+ */
+	inline bool hasChildren() const { return this->firstChild!=NULL||this->compressed; }
 
 	/**
  * work out if the attributes in the given string exist on this node.
@@ -228,11 +596,6 @@ class VBufStorage_fieldNode_t {
  */
 	bool matchAttributes(const std::vector<std::wstring>& attribs, const std::wregex& regexp);
 
-	/**
-	* True if this node his hidden - searches will not locate this node.
-	*/
-	bool isHidden;
-
 /**
  * points to an optional ancestor node which should be re-rendered instead of this node, if this node changes.
  */
@@ -256,16 +619,16 @@ class VBufStorage_fieldNode_t {
 
 
 /**
- * points to this node's first child. 
+ * points to this node's first child, decompressing this node's descendants if needed.
  * The child will have no previous node, and it will have this node as its parent.
  */
-	inline VBufStorage_fieldNode_t* getFirstChild() { return this->firstChild; }
+	inline VBufStorage_fieldNode_t* getFirstChild() { this->ensureExpanded(); return this->firstChild; }
 
 /**
- * points to this node's last child.
+ * points to this node's last child, decompressing this node's descendants if needed.
  * the child will have no next node, and it will have this node as its parent.
  */
-	inline VBufStorage_fieldNode_t* getLastChild() { return this->lastChild; }
+	inline VBufStorage_fieldNode_t* getLastChild() { this->ensureExpanded(); return this->lastChild; }
 
 /**
  * Adds an attribute to this field.
@@ -299,7 +662,12 @@ class VBufStorage_fieldNode_t {
 /**
  * Retreave the length of this node.
  */
-	inline int getLength() { return this->length; }
+	inline int getLength() const { return this->length; }
+
+/**
+ * @return true if this node stands in for content that has not been rendered yet. See VBufStorage_deferredFieldNode_t.
+ */
+	virtual bool isDeferred() const;
 
 };
 
@@ -315,12 +683,26 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
  */
 	VBufStorage_controlFieldNodeIdentifier_t identifier;
 
+/**
+ * This node's descendants while they are compressed, or NULL.
+ */
+	VBufStorage_compressedSubtree_t* compressedSubtree;
+
 	virtual void generateMarkupTagName(std::wstring& text);
 
 	virtual void generateAttributesForMarkupOpeningTag(std::wstring& text, int startOffset, int endOffset);
 
 	virtual void disassociateFromBuffer(VBufStorage_buffer_t* buffer);
 
+	virtual void calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const;
+
+	virtual VBufStorage_fieldNode_t* copyToBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous);
+
+/**
+ * Creates a node of the same type as this one, with the same identifier and isBlock, but with no attributes and not in any buffer.
+ */
+	virtual VBufStorage_controlFieldNode_t* createCopy() const;
+
 /**
  * constructor.
  * @param docHandle the docHandle of the control
@@ -329,7 +711,13 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
  */
 	VBufStorage_controlFieldNode_t(int docHandle, int ID, bool isBlock);
 
+/**
+ * destructor
+ */
+	virtual ~VBufStorage_controlFieldNode_t();
+
 	friend class VBufStorage_buffer_t;
+	friend class VBufStorage_fieldNode_t;
 
 	public:
 
@@ -344,6 +732,34 @@ class VBufStorage_controlFieldNode_t : public VBufStorage_fieldNode_t {
 
 };
 
+/**
+ * A control field node that stands in for content which has not been rendered yet, such as the items under a collapsed tree item or a menu which is not shown.
+ * Backends give it the attributes needed to find and announce the control (such as role, states and name) and some placeholder text, and render the real content once the user reaches it or the control changes.
+ * See VBufStorage_buffer_t::deferControlFieldNode.
+ */
+class VBufStorage_deferredFieldNode_t : public VBufStorage_controlFieldNode_t {
+	protected:
+
+	virtual VBufStorage_controlFieldNode_t* createCopy() const;
+
+/**
+ * constructor.
+ * @param docHandle the docHandle of the control
+ * @param ID the ID of the control
+ * @param isBlock lines lines should always break at the start and end of this control in a buffer.
+ */
+	VBufStorage_deferredFieldNode_t(int docHandle, int ID, bool isBlock);
+
+	friend class VBufStorage_buffer_t;
+
+	public:
+
+	virtual bool isDeferred() const;
+
+	virtual std::wstring getDebugInfo() const;
+
+};
+
 /**
  * a node that represents a field of text in a buffer.
  * It holds the actual text it represents, and also sets its length accordingly. 
@@ -357,6 +773,29 @@ class VBufStorage_textFieldNode_t : public VBufStorage_fieldNode_t {
 
 	virtual void getTextInRange(int startOffset, int endOffset, std::wstring& text, bool useMarkup=false,bool(*filter)(VBufStorage_fieldNode_t*)=NULL);
 
+	virtual void calculateMemoryUsage(VBufStorage_memoryStats_t& stats) const;
+
+/**
+ * The text this field contains.
+ */
+	VBufStorage_text_t text;
+
+/**
+ * Inserts text in to this field, and updates its length. The lengths of ancestors are not updated.
+ * @param offset the offset within this field at which to insert the text.
+ * @param text the text to insert.
+ */
+	void insertText(int offset, const std::wstring& text);
+
+/**
+ * Removes text from this field, and updates its length. The lengths of ancestors are not updated.
+ * @param offset the offset within this field at which to start removing.
+ * @param count the number of characters to remove.
+ */
+	void removeText(int offset, int count);
+
+	virtual VBufStorage_fieldNode_t* copyToBuffer(VBufStorage_buffer_t* buffer, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous);
+
 /**
  * constructor.
  * @param text the text this field should contain.
@@ -367,10 +806,10 @@ class VBufStorage_textFieldNode_t : public VBufStorage_fieldNode_t {
 
 	public:
 
-	/**
+/**
  * The text this field contains.
  */
-	const std::wstring text;
+	inline const VBufStorage_text_t& getText() const { return this->text; }
 
 	virtual std::wstring getDebugInfo() const;
 
@@ -398,6 +837,22 @@ class VBufStorage_buffer_t {
  */
 	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> controlFieldNodesByIdentifier;
 
+/**
+ * Maps the identifier of each control field node held in compressed form to the node whose descendants hold it.
+ * An identifier is never in both this and controlFieldNodesByIdentifier.
+ */
+	std::map<VBufStorage_controlFieldNodeIdentifier_t,VBufStorage_controlFieldNode_t*> compressedNodesByIdentifier;
+
+/**
+ * Counts queries, so that the nodes they pass through can be stamped with the time of their last use.
+ */
+	unsigned int accessTime;
+
+/**
+ * The memory usage in bytes above which compressColdSubtrees compresses subtrees, or 0 to never compress.
+ */
+	size_t compressionBudget;
+
 /**
  * the offset at where the current selection starts.
  */ 
@@ -408,11 +863,113 @@ class VBufStorage_buffer_t {
  */
 	int selectionLength;
 
+/**
+ * Offsets pinned by clients, by pin ID. They are kept relative to their containing control field nodes when subtrees are replaced, just like the selection.
+ */
+	std::map<int,int> pinnedOffsets;
+
+/**
+ * The ID to give the next pinned offset.
+ */
+	int nextPinID;
+
+/**
+ * The memory currently used by this buffer.
+ * Node, attribute and text usage is kept up to date as nodes are inserted and deleted. Index usage and the total are filled in by getMemoryStats.
+ * Attributes added to a node after it was inserted are not accounted for until accountForAttributes or recalculateMemoryStats is called, or the node is merged into another buffer.
+ */
+	VBufStorage_memoryStats_t memoryStats;
+
+/**
+ * The soft limit on memory usage in bytes, or 0 for no limit.
+ */
+	size_t memoryLimit;
+
+/**
+ * Where changes to this buffer are recorded, or NULL if they are not. See setChangeLog.
+ */
+	VBufStorage_changeLog_t* changeLog;
+
+/**
+ * Adds or removes the memory used by the given node to or from this buffer's memory stats.
+ * @param node the node being inserted in to or deleted from this buffer.
+ * @param remove true if the node is being deleted, false if it is being inserted.
+ */
+	void accountForNode(VBufStorage_fieldNode_t* node, bool remove);
+
+/**
+ * Records the current memory usage, plus any given extra usage, as the peak usage if it is higher than the existing peak.
+ * @param extraBytes memory used outside of this buffer that should be counted, such as temporary buffers being merged in.
+ */
+	void updatePeakMemoryUsage(size_t extraBytes=0);
+
 /**
  * removes the controlFieldNode from the buffer's controlFieldNodesByIdentifier set.
  */
 	void forgetControlFieldNode(VBufStorage_controlFieldNode_t* node);
 
+/**
+ * Finds the control field node with the given identifier, decompressing the subtree holding it if it is compressed.
+ * @return the node, or NULL if there is no node with the identifier.
+ */
+	VBufStorage_controlFieldNode_t* findControlFieldNode(const VBufStorage_controlFieldNodeIdentifier_t& identifier);
+
+/**
+ * Stamps the given node and its ancestors as used just now.
+ */
+	void markAccessed(VBufStorage_fieldNode_t* node);
+
+/**
+ * Writes a node and its descendants in the binary node format, for compressSubtree or for a change log.
+ * For compressSubtree, only nodes of the types defined here can be encoded, as backends' own node types hold state which the format can not.
+ * For a change log, backends' own node types are written as the type they are derived from, compressed descendants are copied without being decompressed, and an update ancestor which is not an ancestor of the node in this buffer is left out.
+ * @param node the node to encode.
+ * @param encoder where to write the node.
+ * @param subtree where to record the number of nodes and the identifiers encoded, or NULL if encoding for a change log.
+ * @param freedBytes incremented by the memory the nodes use now, which deleting them would free. Not used when encoding for a change log.
+ * @return true if successful, false if a node could not be encoded.
+ */
+	bool encodeNode(VBufStorage_fieldNode_t* node, VBufStorage_encoder_t& encoder, VBufStorage_compressedSubtree_t* subtree, size_t& freedBytes);
+
+/**
+ * Adds the nodes held by compressed descendants to this buffer.
+ * Nodes are added in the same way as by copySubtree, so that a control field whose identifier is already in this buffer is left out along with its descendants.
+ * @param subtree the compressed descendants.
+ * @param source the node the descendants belong to, which may be in another buffer.
+ * @param target the node in this buffer to add the descendants to. It must have no children.
+ * @return true if successful, false if the compressed data was damaged, in which case only the nodes before the damage are added.
+ */
+	bool decodeSubtree(const VBufStorage_compressedSubtree_t& subtree, VBufStorage_controlFieldNode_t* source, VBufStorage_controlFieldNode_t* target);
+
+/**
+ * Adds nodes written in the binary node format to this buffer, up to and including the end of the list of nodes they start with.
+ * Nodes are added as for decodeSubtree.
+ * @param decoder where to read the nodes.
+ * @param source the node the nodes were encoded from the descendants of, used to find update ancestors above them, or NULL if there is none.
+ * @param target the node in this buffer to add the nodes to, which must have no children, or NULL to add the first node as the root node of this buffer, which must be empty.
+ * @return true if successful, false if the data was damaged, in which case only the nodes before the damage are added.
+ */
+	bool decodeNodes(VBufStorage_decoder_t& decoder, VBufStorage_controlFieldNode_t* source, VBufStorage_controlFieldNode_t* target);
+
+/**
+ * Replaces the descendants of a control field node with a compressed encoding of them.
+ * The node keeps its length and subtree counts, so offsets elsewhere in the buffer are unchanged.
+ * @param node the node whose descendants should be compressed.
+ * @return true if they were compressed, false if they could not be encoded or would not use less memory compressed.
+ */
+	bool compressSubtree(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Decompresses the descendants of a node compressed with compressSubtree back in to nodes.
+ * @param node the compressed node.
+ */
+	void expandSubtree(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Removes the identifiers of a compressed node's descendants from compressedNodesByIdentifier, for when the node is being deleted.
+ */
+	void forgetCompressedSubtree(VBufStorage_controlFieldNode_t* node);
+
 /**
  * Inserts the given fieldNode in to the buffer's tree of nodes. Makes all needed connections with other nodes in the buffer's node tree.
  * @param parent a control field already in the buffer that should be the inserted node's parent, note if also specifying previous then parent can be NULL.
@@ -436,6 +993,7 @@ class VBufStorage_buffer_t {
 	friend class VBufStorage_fieldNode_t;
 	friend class VBufStorage_controlFieldNode_t;
 	friend class VBufStorage_textFieldNode_t;
+	friend class VBufStorage_changeLog_t;
 
 	public:
 
@@ -473,6 +1031,32 @@ class VBufStorage_buffer_t {
 
 	VBufStorage_textFieldNode_t* addTextFieldNode(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_textFieldNode_t* node);
 
+/**
+ * Adds a copy of a subtree from another buffer, so that content which has not changed can be reused rather than rendered again.
+ * Attributes, flags and text are copied. Control fields whose identifier is already in this buffer are left out, along with their descendants.
+ * A copied node's updateAncestor is pointed at the node with the same identifier in this buffer if there is one; otherwise it is left pointing at the original ancestor, which the caller must make sure outlives the copy.
+ * @param parent the control field which should be the copy's parent.
+ * @param previous the field which the copy should come directly after.
+ * @param source the root of the subtree to copy. It is not modified.
+ * @return the copy of source, or NULL if it could not be added.
+ */
+	VBufStorage_fieldNode_t* copySubtree(VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, VBufStorage_fieldNode_t* source);
+
+/**
+ * Replaces a control field node with a deferred field node that has the same identifier, attributes and position, for when a backend decides not to render the control's content yet.
+ * @param node the node to replace. It must have no children and must not be the root node. It is deleted.
+ * @return the deferred field node, or NULL if the node could not be replaced.
+ */
+	VBufStorage_deferredFieldNode_t* deferControlFieldNode(VBufStorage_controlFieldNode_t* node);
+
+/**
+ * Finds the deferred field nodes containing text between the given offsets, so that their content can be rendered once the user reaches them.
+ * @param startOffset the offset to start from.
+ * @param endOffset the offset to end at. Use -1 to mean end of buffer.
+ * @param nodes where to place the found nodes, in the order they appear in the buffer.
+ */
+	void getDeferredFieldNodesInRange(int startOffset, int endOffset, std::vector<VBufStorage_deferredFieldNode_t*>& nodes);
+
 /**
  * finds out if the given node exists in this buffer.
  * @param node the node you wish to check.
@@ -481,11 +1065,31 @@ class VBufStorage_buffer_t {
 	virtual bool isNodeInBuffer(VBufStorage_fieldNode_t* node);
 
 /**
- * Removes the given nodes from the buffer and then merges the content of the new buffers in the removed node's position. It also tries to keep the selection relative to the control field it was in before the replacement.
+ * Removes the given nodes from the buffer and then merges the content of the new buffers in the removed node's position. It also tries to keep the selection and any pinned offsets relative to the control fields they were in before the replacement.
  * @param m the map of nodes to buffers 
  */
 	bool replaceSubtrees(std::map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*>& m);
 
+/**
+ * Inserts text in to a text field node already in this buffer, without re-rendering it.
+ * The lengths of the node's ancestors are updated, and the selection and pinned offsets at or after the insertion point are moved along by the length of the text. No control field nodes are added or removed, so the identifier map is unchanged.
+ * @param node the text field node to insert in to.
+ * @param offset the offset within the node at which to insert the text.
+ * @param text the text to insert.
+ * @return true if the text was inserted, false otherwise.
+ */
+	virtual bool insertText(VBufStorage_textFieldNode_t* node, int offset, const std::wstring& text);
+
+/**
+ * Removes text from a text field node already in this buffer, without re-rendering it.
+ * The lengths of the node's ancestors are updated, the selection and pinned offsets after the removed text are moved back, and any within it are moved to its start.
+ * @param node the text field node to remove text from.
+ * @param offset the offset within the node at which to start removing.
+ * @param count the number of characters to remove.
+ * @return true if the text was removed, false otherwise.
+ */
+	virtual bool removeText(VBufStorage_textFieldNode_t* node, int offset, int count);
+
 /**
  * disassociates from this buffer, and deletes, the given field and its descendants.
  * @param node the node you wish to remove.
@@ -581,6 +1185,48 @@ class VBufStorage_buffer_t {
  */
 	virtual bool setSelectionOffsets(int startOffset, int endOffset);
 
+/**
+ * Creates an anchor for the given offset, so that it can be found again after subtrees have been replaced.
+ * This descends from the root in the same way as locating the text field node at the offset, passing over the earlier siblings of each node on the way.
+ * @param offset the offset to anchor.
+ * @param anchor where to place the anchor.
+ * @return true if successfull, false if the offset is not in the buffer.
+ */
+	virtual bool createAnchor(int offset, VBufStorage_anchor_t& anchor);
+
+/**
+ * Finds the current offset of a position previously anchored with createAnchor.
+ * The offset is taken relative to the deepest recorded control field node that still exists with all of the same ancestors.
+ * Nodes are found by identifier and checked against the recorded ancestors by walking up their parents.
+ * Calculating the offset of the chosen node still walks the earlier siblings of each of its ancestors, so this costs about as much as locating a node by offset.
+ * @param anchor the anchor to resolve.
+ * @param offset memory where the resolved offset will be placed.
+ * @return true if successfull, false if none of the anchor's nodes are still in the buffer.
+ */
+	virtual bool resolveAnchor(const VBufStorage_anchor_t& anchor, int* offset);
+
+/**
+ * Pins an offset so that it is kept relative to its containing control field nodes across subtree replacements, in the same way as the selection.
+ * @param offset the offset to pin.
+ * @return an ID for the pinned offset (greater than 0), or 0 if the offset is invalid.
+ */
+	virtual int pinOffset(int offset);
+
+/**
+ * Retreaves the current value of a pinned offset.
+ * @param pinID the ID returned by pinOffset.
+ * @param offset memory where the offset will be placed.
+ * @return true if successfull, false if there is no such pinned offset.
+ */
+	virtual bool getPinnedOffset(int pinID, int* offset);
+
+/**
+ * Stops tracking a pinned offset.
+ * @param pinID the ID returned by pinOffset.
+ * @return true if successfull, false if there is no such pinned offset.
+ */
+	virtual bool unpinOffset(int pinID);
+
 /**
  * retreaves the length of all the text in the buffer.
  * @return the length in characters of the text
@@ -622,6 +1268,66 @@ class VBufStorage_buffer_t {
  */
 	virtual bool isDescendantNode(VBufStorage_fieldNode_t* parent, VBufStorage_fieldNode_t* descendant);
 
+/**
+ * Retreaves the memory used by this buffer.
+ * @param stats memory where the stats will be placed.
+ */
+	virtual void getMemoryStats(VBufStorage_memoryStats_t* stats) const;
+
+/**
+ * Retreaves the total number of bytes used by this buffer.
+ */
+	size_t getMemoryUsage() const;
+
+/**
+ * Recounts the memory used by all nodes in this buffer, picking up any attributes added since the nodes were inserted.
+ * This walks the entire buffer, so should only be used after content has been rendered directly in to this buffer.
+ */
+	void recalculateMemoryStats();
+
+/**
+ * Counts any attributes added to a node since it was inserted or last counted.
+ * Unlike recalculateMemoryStats this only looks at the one node, so backends can call it while rendering, keeping isOverMemoryLimit accurate as content is added.
+ * @param node the node, which must be in this buffer.
+ */
+	void accountForAttributes(VBufStorage_fieldNode_t* node);
+
+/**
+ * Sets a soft limit on the memory this buffer should use.
+ * The buffer does not enforce the limit itself; those adding content should check isOverMemoryLimit and leave out optional content when it returns true.
+ * @param limit the limit in bytes, or 0 for no limit.
+ */
+	void setMemoryLimit(size_t limit);
+
+/**
+ * Is this buffer using more memory than its soft limit?
+ * @param extraBytes memory that will soon be added to this buffer that should also be counted, such as the usage of a temporary buffer being rendered.
+ * @return true if there is a limit and it is exceeded, false otherwise.
+ */
+	bool isOverMemoryLimit(size_t extraBytes=0) const;
+
+/**
+ * Sets the memory usage above which compressColdSubtrees should compress subtrees.
+ * @param budget the budget in bytes, or 0 to never compress.
+ */
+	void setCompressionBudget(size_t budget);
+
+/**
+ * Compresses the descendants of control field nodes which have not been used for the longest, until this buffer's memory usage is within its compression budget.
+ * Each compressed subtree is the largest one containing at most VBUFSTORAGE_COMPRESSION_MAXLENGTH characters, so that only a little content needs to be decompressed when it is used again.
+ * Subtrees containing the selection or a pinned offset are left alone, as are subtrees containing nodes of backends' own types.
+ * Compressed descendants are decompressed transparently whenever a query, walk or identifier lookup reaches them.
+ * @return the number of subtrees compressed.
+ */
+	int compressColdSubtrees();
+
+/**
+ * Starts or stops recording changes to this buffer in a change log, so that a replica of the buffer can be kept up to date. See VBufStorage_changeLog_t.
+ * Changes made by replaceSubtrees, insertText, removeText and clearBuffer are recorded. After changing the buffer in any other way, such as rendering in to it directly, record a reset with VBufStorage_changeLog_t::recordReset.
+ * @param changeLog the change log, which must outlive its use by this buffer, or NULL to stop recording.
+ */
+	void setChangeLog(VBufStorage_changeLog_t* changeLog);
+
 	virtual std::wstring getDebugInfo() const;
 
 };
@@ -12,9 +12,11 @@ This license can be found at:
 http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
 */
 
+#include <cwchar>
 #include <cwctype>
 #include <string>
 #include <map>
+#include <common/textScan.h>
 #include "utils.h"
 
 using namespace std;
@@ -106,11 +108,8 @@ wstring getNameForURL(const wstring &url) {
 }
 
 bool isWhitespace(const wchar_t *str) {
-	for (const wchar_t *c = str; *c; ++c) {
-		if (!iswspace(*c))
-			return false;
-	}
-	return true;
+	int length=static_cast<int>(wcslen(str));
+	return findNonWhitespaceChar(str,length)==length;
 }
 
 void multiValueAttribsStringToMap(const wstring &attribsString, multiValueAttribsMap &attribsMap) {
@@ -153,8 +152,9 @@ bool nodeHasUsefulContent(VBufStorage_fieldNode_t* node) {
 		return true;
 	wstring content;
 	node->getTextInRange(0, length, content, false);
-	for(wstring::iterator i=content.begin();i!=content.end();++i) {
-		if(!iswspace(*i)&&!isPrivateCharacter(*i)) {
+	const wchar_t* text=content.c_str();
+	for(int i=findNonWhitespaceChar(text,length);i<length;i+=1+findNonWhitespaceChar(text+i+1,length-i-1)) {
+		if(!isPrivateCharacter(text[i])) {
 			return true;
 		}
 	}
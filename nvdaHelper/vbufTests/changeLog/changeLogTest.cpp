@@ -0,0 +1,525 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+/**
+ * Tests for VBufStorage_changeLog_t and VBufStorage_changeLogChannel_t.
+ * Random updates (replaced subtrees, inserted and removed text, compression, clearing and rendering again) are made to a buffer with a change log, and after each one the records are applied to a replica, which must then produce the same text and markup as the buffer.
+ * Records are also dropped to make the log go out of sync, and damaged before being applied, after which a replica must come back in sync from a snapshot.
+ * The records of a run can be written to a file and replayed against a fresh replica later, such as one built by another compiler.
+ * The channel is tested with a writer and reader thread sharing a small ring, so that records overflow it and the reader must resync.
+ * See GNUmakefile in this directory for how to build and run it.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vbufBase/encoding.h>
+#include <vbufBase/storage.h>
+#include <vbufBase/changeLog.h>
+
+using namespace std;
+
+#define TEST_DOCHANDLE 1
+#define DEFAULT_OP_COUNT 150
+#define CHANNEL_CAPACITY 4096
+#define CHANNEL_RECORD_COUNT 20000
+
+/**
+ * A change log which keeps its records in memory, and can be made to drop records over a given size.
+ */
+class RecordingChangeLog: public VBufStorage_changeLog_t {
+	public:
+	vector<vector<unsigned char> > records;
+	bool inSync;
+	size_t maxRecordSize;
+
+	RecordingChangeLog(): records(), inSync(true), maxRecordSize(0) {}
+
+	virtual bool write(const vector<unsigned char>& record) {
+		if(this->maxRecordSize>0&&record.size()>this->maxRecordSize) return false;
+		this->records.push_back(record);
+		return true;
+	}
+
+	virtual bool isInSync() { return this->inSync; }
+
+	virtual void desync() { this->inSync=false; }
+
+};
+
+wstring getMarkup(VBufStorage_buffer_t& buffer) {
+	VBufStorage_textContainer_t* textContainer=buffer.getTextInRange(0,-1,true);
+	if(!textContainer) return L"";
+	wstring text=textContainer->getString();
+	textContainer->destroy();
+	return text;
+}
+
+size_t getDeferredCount(VBufStorage_buffer_t& buffer) {
+	vector<VBufStorage_deferredFieldNode_t*> nodes;
+	buffer.getDeferredFieldNodesInRange(0,-1,nodes);
+	return nodes.size();
+}
+
+/**
+ * Writes a tagged, length-prefixed entry to a record file: 'R' for a record to apply, 'T' for the markup the replica should then have.
+ */
+void writeEntry(ostream& out, char tag, const vector<unsigned char>& bytes) {
+	unsigned int length=static_cast<unsigned int>(bytes.size());
+	unsigned char lengthBytes[4]={static_cast<unsigned char>(length),static_cast<unsigned char>(length>>8),static_cast<unsigned char>(length>>16),static_cast<unsigned char>(length>>24)};
+	out.put(tag);
+	out.write(reinterpret_cast<const char*>(lengthBytes),4);
+	if(length>0) out.write(reinterpret_cast<const char*>(bytes.data()),length);
+}
+
+bool readEntry(istream& in, char& tag, vector<unsigned char>& bytes) {
+	unsigned char lengthBytes[4];
+	if(!in.get(tag)||!in.read(reinterpret_cast<char*>(lengthBytes),4)) return false;
+	unsigned int length=lengthBytes[0]|(lengthBytes[1]<<8)|(lengthBytes[2]<<16)|(static_cast<unsigned int>(lengthBytes[3])<<24);
+	bytes.resize(length);
+	return length==0||static_cast<bool>(in.read(reinterpret_cast<char*>(bytes.data()),length));
+}
+
+class ChangeLogTester {
+	private:
+	mt19937 engine;
+	VBufStorage_buffer_t buffer;
+	RecordingChangeLog changeLog;
+	VBufStorage_buffer_t replica;
+	VBufStorage_buffer_t scratch;
+	int rootID;
+	int nextID;
+	ostream* recordFile;
+	wstring failure;
+
+	unsigned int next(unsigned int bound) {
+		if(bound<=1) return 0;
+		return uniform_int_distribution<unsigned int>(0,bound-1)(this->engine);
+	}
+
+	bool chance(unsigned int oneIn) { return this->next(oneIn)==0; }
+
+	bool fail(const wstring& message) {
+		this->failure=message;
+		return false;
+	}
+
+	wstring randomText() {
+		static const wchar_t characters[]={L'a',L'b',L' ',L'\n',L'.',0xe9,0x4e2d,0xffff};
+		wstring text;
+		unsigned int length=1+this->next(12);
+		for(unsigned int i=0;i<length;++i) text+=characters[this->next(sizeof(characters)/sizeof(characters[0]))];
+		return text;
+	}
+
+	void addRandomAttributes(VBufStorage_fieldNode_t* node) {
+		if(this->chance(2)) node->addAttribute(L"role",this->chance(2)?L"heading":L"link");
+		if(this->chance(4)) node->addAttribute(L"level",to_wstring(this->next(7)));
+		if(this->chance(8)) node->addAttribute(L"odd name",L"a:b;c\\\"<");
+	}
+
+/**
+ * Renders a random subtree in to a buffer, as a backend would.
+ */
+	VBufStorage_controlFieldNode_t* renderSubtree(VBufStorage_buffer_t* target, VBufStorage_controlFieldNode_t* parent, VBufStorage_fieldNode_t* previous, int ID, int depth) {
+		VBufStorage_controlFieldNode_t* node=target->addControlFieldNode(parent,previous,TEST_DOCHANDLE,ID,this->chance(3));
+		if(!node) return NULL;
+		this->addRandomAttributes(node);
+		if(this->chance(10)) node->setHidden(true);
+		unsigned int childCount=this->next(5);
+		VBufStorage_fieldNode_t* child=NULL;
+		for(unsigned int i=0;i<childCount;++i) {
+			if(depth>0&&this->chance(2)) {
+				VBufStorage_controlFieldNode_t* control=this->renderSubtree(target,node,child,this->nextID++,depth-1);
+				if(!control) continue;
+				child=control;
+				if(this->chance(6)) {
+					// As gecko_ia2 does, defer the control's content and render just its name.
+					VBufStorage_deferredFieldNode_t* deferred=target->deferControlFieldNode(control);
+					if(deferred) {
+						child=deferred;
+						target->addTextFieldNode(deferred,NULL,L"name");
+					}
+				}
+			} else {
+				VBufStorage_textFieldNode_t* text=target->addTextFieldNode(node,child,this->randomText());
+				if(!text) continue;
+				if(this->chance(3)) this->addRandomAttributes(text);
+				child=text;
+			}
+		}
+		return node;
+	}
+
+	void collectNodes(VBufStorage_fieldNode_t* node, vector<VBufStorage_controlFieldNode_t*>& controls, vector<VBufStorage_textFieldNode_t*>& texts) {
+		if(VBufStorage_textFieldNode_t* text=dynamic_cast<VBufStorage_textFieldNode_t*>(node)) {
+			texts.push_back(text);
+			return;
+		}
+		controls.push_back(static_cast<VBufStorage_controlFieldNode_t*>(node));
+		for(VBufStorage_fieldNode_t* child=node->getFirstChild();child;child=child->getNext()) this->collectNodes(child,controls,texts);
+	}
+
+	void collectNodes(vector<VBufStorage_controlFieldNode_t*>& controls, vector<VBufStorage_textFieldNode_t*>& texts) {
+		VBufStorage_controlFieldNode_t* root=this->buffer.getControlFieldNodeWithIdentifier(TEST_DOCHANDLE,this->rootID);
+		if(root) this->collectNodes(root,controls,texts);
+	}
+
+	bool isAncestor(VBufStorage_fieldNode_t* ancestor, VBufStorage_fieldNode_t* node) {
+		for(;node;node=node->getParent()) {
+			if(node==ancestor) return true;
+		}
+		return false;
+	}
+
+/**
+ * Renders the whole buffer again, as the initial render does, recording it as a reset.
+ */
+	void opRender() {
+		this->buffer.clearBuffer();
+		this->rootID=this->nextID++;
+		this->renderSubtree(&this->buffer,NULL,NULL,this->rootID,4);
+		this->changeLog.recordReset(&this->buffer);
+	}
+
+	void opReplace() {
+		vector<VBufStorage_controlFieldNode_t*> controls;
+		vector<VBufStorage_textFieldNode_t*> texts;
+		this->collectNodes(controls,texts);
+		if(controls.empty()) return;
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		unsigned int count=1+this->next(3);
+		for(unsigned int i=0;i<count;++i) {
+			VBufStorage_controlFieldNode_t* node=controls[this->next(static_cast<unsigned int>(controls.size()))];
+			bool related=false;
+			for(auto& entry: m) related=related||this->isAncestor(entry.first,node)||this->isAncestor(node,entry.first);
+			if(related) continue;
+			int docHandle=0, ID=0;
+			node->getIdentifier(&docHandle,&ID);
+			VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+			this->renderSubtree(tempBuffer,NULL,NULL,ID,this->next(3));
+			m.insert(make_pair(node,tempBuffer));
+		}
+		this->buffer.replaceSubtrees(m);
+	}
+
+	void opInsertText() {
+		vector<VBufStorage_controlFieldNode_t*> controls;
+		vector<VBufStorage_textFieldNode_t*> texts;
+		this->collectNodes(controls,texts);
+		if(texts.empty()) return;
+		VBufStorage_textFieldNode_t* node=texts[this->next(static_cast<unsigned int>(texts.size()))];
+		int start=0, end=0;
+		this->buffer.getFieldNodeOffsets(node,&start,&end);
+		this->buffer.insertText(node,this->next(end-start+1),this->randomText());
+	}
+
+	void opRemoveText() {
+		vector<VBufStorage_controlFieldNode_t*> controls;
+		vector<VBufStorage_textFieldNode_t*> texts;
+		this->collectNodes(controls,texts);
+		if(texts.empty()) return;
+		VBufStorage_textFieldNode_t* node=texts[this->next(static_cast<unsigned int>(texts.size()))];
+		int start=0, end=0;
+		this->buffer.getFieldNodeOffsets(node,&start,&end);
+		if(end-start<2) return;
+		int offset=this->next(end-start-1);
+		this->buffer.removeText(node,offset,1+this->next(end-start-offset-1));
+	}
+
+	void opCompress() {
+		VBufStorage_memoryStats_t stats;
+		this->buffer.getMemoryStats(&stats);
+		this->buffer.setCompressionBudget(1+this->next(static_cast<unsigned int>(stats.totalBytes)));
+		this->buffer.compressColdSubtrees();
+		this->buffer.setCompressionBudget(0);
+	}
+
+	bool applyRecord(VBufStorage_buffer_t& target, const vector<unsigned char>& record) {
+		if(this->recordFile&&&target==&this->replica) writeEntry(*(this->recordFile),'R',record);
+		return VBufStorage_changeLog_t::apply(&target,record.data(),record.size());
+	}
+
+/**
+ * Brings a replica back in sync from a snapshot of the buffer.
+ */
+	bool resync(VBufStorage_buffer_t& target) {
+		VBufStorage_encoder_t encoder;
+		if(!VBufStorage_changeLog_t::encodeReset(&this->buffer,encoder)) return this->fail(L"encodeReset failed");
+		if(!this->applyRecord(target,encoder.bytes)) return this->fail(L"could not apply snapshot");
+		return true;
+	}
+
+/**
+ * Applies a damaged copy of a record to the scratch replica, which must not crash, then brings it back in sync.
+ */
+	bool checkDamagedRecord(const vector<unsigned char>& record) {
+		vector<unsigned char> damaged=record;
+		if(damaged.empty()||this->chance(3)) {
+			damaged.resize(this->next(static_cast<unsigned int>(damaged.size()+1)));
+		} else {
+			unsigned int flips=1+this->next(4);
+			for(unsigned int i=0;i<flips;++i) damaged[this->next(static_cast<unsigned int>(damaged.size()))]^=static_cast<unsigned char>(1+this->next(255));
+		}
+		VBufStorage_changeLog_t::apply(&this->scratch,damaged.data(),damaged.size());
+		if(!this->resync(this->scratch)) return false;
+		if(getMarkup(this->scratch)!=getMarkup(this->buffer)) return this->fail(L"scratch replica differs after resync");
+		return true;
+	}
+
+	bool check() {
+		vector<vector<unsigned char> > records;
+		records.swap(this->changeLog.records);
+		for(auto& record: records) {
+			if(!this->applyRecord(this->replica,record)) return this->fail(L"could not apply record");
+			if(this->chance(10)&&!this->checkDamagedRecord(record)) return false;
+		}
+		if(!this->changeLog.inSync) {
+			if(!this->resync(this->replica)) return false;
+			this->changeLog.inSync=true;
+		}
+		if(this->chance(20)&&!this->resync(this->replica)) return false;
+		wstring markup=getMarkup(this->buffer);
+		if(this->recordFile) {
+			VBufStorage_encoder_t encoder;
+			encoder.writeString(markup);
+			writeEntry(*(this->recordFile),'T',encoder.bytes);
+		}
+		if(getMarkup(this->replica)!=markup) return this->fail(L"replica markup differs");
+		if(this->replica.getTextLength()!=this->buffer.getTextLength()) return this->fail(L"replica length differs");
+		if(getDeferredCount(this->replica)!=getDeferredCount(this->buffer)) return this->fail(L"replica deferred node count differs");
+		return true;
+	}
+
+	public:
+	ChangeLogTester(unsigned int seed, ostream* recordFileArg): engine(seed), buffer(), changeLog(), replica(), scratch(), rootID(0), nextID(1), recordFile(recordFileArg), failure() {}
+
+	~ChangeLogTester() {
+		this->buffer.setChangeLog(NULL);
+	}
+
+	bool run(int opCount) {
+		this->buffer.setChangeLog(&this->changeLog);
+		this->opRender();
+		if(!this->resync(this->scratch)) return false;
+		for(int i=0;i<opCount;++i) {
+			// Sometimes drop any record which is not tiny, so that the log goes out of sync.
+			this->changeLog.maxRecordSize=this->chance(15)?8:0;
+			unsigned int op=this->next(20);
+			if(op<8) {
+				this->opReplace();
+			} else if(op<12) {
+				this->opInsertText();
+			} else if(op<16) {
+				this->opRemoveText();
+			} else if(op<18) {
+				this->opCompress();
+			} else if(op<19) {
+				this->buffer.setSelectionOffsets(this->next(this->buffer.getTextLength()+1),this->buffer.getTextLength());
+			} else {
+				this->opRender();
+			}
+			if(!this->check()) {
+				wcerr<<L"op "<<i<<L": "<<this->failure<<endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+};
+
+/**
+ * Applies the records in a file written by a recording run to a fresh replica, checking its markup wherever the run did.
+ */
+bool replay(const char* fileName) {
+	ifstream in(fileName,ios::binary);
+	if(!in) {
+		wcerr<<L"Could not open "<<fileName<<endl;
+		return false;
+	}
+	VBufStorage_buffer_t replica;
+	char tag;
+	vector<unsigned char> bytes;
+	int recordCount=0, checkCount=0;
+	while(readEntry(in,tag,bytes)) {
+		if(tag=='R') {
+			if(!VBufStorage_changeLog_t::apply(&replica,bytes.data(),bytes.size())) {
+				wcerr<<L"Could not apply record "<<recordCount<<endl;
+				return false;
+			}
+			++recordCount;
+		} else if(tag=='T') {
+			VBufStorage_decoder_t decoder(bytes.data(),bytes.size());
+			wstring markup;
+			if(!decoder.readString(markup)||getMarkup(replica)!=markup) {
+				wcerr<<L"Replica differs after record "<<recordCount<<endl;
+				return false;
+			}
+			++checkCount;
+		}
+	}
+	wcout<<L"replayed "<<recordCount<<L" records, "<<checkCount<<L" checks"<<endl;
+	return true;
+}
+
+/**
+ * The bytes of the channel test's record with the given sequence number. Some are too big for the channel, so that it must drop them.
+ */
+vector<unsigned char> makeChannelRecord(unsigned int sequence) {
+	size_t size=(sequence%1000==999)?CHANNEL_CAPACITY+1:4+(sequence*7919)%600;
+	vector<unsigned char> record(size);
+	for(size_t i=0;i<size;++i) record[i]=static_cast<unsigned char>((sequence>>((i%4)*8))+i/4);
+	return record;
+}
+
+bool testChannelThreads() {
+	vector<unsigned int> memory((VBufStorage_changeLogChannel_t::getMemorySize(CHANNEL_CAPACITY)+3)/4);
+	size_t size=memory.size()*4;
+	VBufStorage_changeLogChannel_t reader(memory.data(),size,true);
+	VBufStorage_changeLogChannel_t writer(memory.data(),size,false);
+	if(!reader.isValid()||!writer.isValid()) {
+		wcerr<<L"channel not valid"<<endl;
+		return false;
+	}
+	// Stands in for the backend lock, which the writer holds while recording and the application holds while taking a snapshot.
+	mutex backendLock;
+	unsigned int nextSequence=0;
+	atomic<bool> writerDone(false);
+	thread writerThread([&] {
+		for(unsigned int sequence=0;sequence<CHANNEL_RECORD_COUNT;++sequence) {
+			// Give the reader a chance to resync, as the time between updates would, so that most records get through.
+			while(!writer.isInSync()) this_thread::yield();
+			lock_guard<mutex> guard(backendLock);
+			if(writer.isInSync()&&!writer.write(makeChannelRecord(sequence))) writer.desync();
+			nextSequence=sequence+1;
+		}
+		writerDone=true;
+	});
+	unsigned int expected=0;
+	int resyncCount=0, readCount=0;
+	bool ok=true;
+	vector<unsigned char> record;
+	while(ok) {
+		bool finished=writerDone.load();
+		if(reader.read(record)) {
+			if(record!=makeChannelRecord(expected)) {
+				wcerr<<L"channel record "<<expected<<L" missing or damaged"<<endl;
+				ok=false;
+			}
+			++expected;
+			if(++readCount%64==0) this_thread::yield();
+		} else if(!reader.isInSync()) {
+			lock_guard<mutex> guard(backendLock);
+			reader.reset();
+			expected=nextSequence;
+			++resyncCount;
+		} else if(finished) {
+			break;
+		}
+	}
+	writerThread.join();
+	if(ok&&expected!=CHANNEL_RECORD_COUNT) {
+		wcerr<<L"channel ended at record "<<expected<<endl;
+		ok=false;
+	}
+	if(ok&&(resyncCount==0||readCount<CHANNEL_RECORD_COUNT/10)) {
+		wcerr<<L"channel did not pass enough records or never went out of sync"<<endl;
+		ok=false;
+	}
+	wcout<<L"channel: "<<readCount<<L" records read, "<<resyncCount<<L" resyncs"<<endl;
+	return ok;
+}
+
+bool testDamagedChannel() {
+	vector<unsigned int> memory((VBufStorage_changeLogChannel_t::getMemorySize(256)+3)/4);
+	size_t size=memory.size()*4;
+	VBufStorage_changeLogChannel_t reader(memory.data(),size,true);
+	VBufStorage_changeLogChannelHeader_t* header=reinterpret_cast<VBufStorage_changeLogChannelHeader_t*>(memory.data());
+	unsigned char* data=reinterpret_cast<unsigned char*>(memory.data())+sizeof(VBufStorage_changeLogChannelHeader_t);
+	vector<unsigned char> record(10,1);
+	if(!reader.write(record)) return false;
+	// A length longer than what was written.
+	data[0]=200;
+	if(reader.read(record)||reader.isInSync()) {
+		wcerr<<L"damaged record length accepted"<<endl;
+		return false;
+	}
+	if(reader.read(record)) return false;
+	reader.reset();
+	// A write position further ahead than the ring is long.
+	header->writePosition.store(header->readPosition.load()+header->capacity+8);
+	if(reader.read(record)||reader.isInSync()) {
+		wcerr<<L"damaged write position accepted"<<endl;
+		return false;
+	}
+	reader.reset();
+	// Changing the capacity after the channel was opened must not make the reader go past the ring.
+	header->capacity=0x80000000u;
+	vector<unsigned char> big(300,2);
+	if(reader.write(big)) {
+		wcerr<<L"changed capacity used"<<endl;
+		return false;
+	}
+	// Headers which do not describe a channel.
+	unsigned int badCapacities[]={0,3,256*4};
+	for(unsigned int capacity: badCapacities) {
+		header->capacity=capacity;
+		if(VBufStorage_changeLogChannel_t(memory.data(),size,false).isValid()) {
+			wcerr<<L"channel with capacity "<<capacity<<L" accepted"<<endl;
+			return false;
+		}
+	}
+	header->capacity=256;
+	header->version=VBUFSTORAGE_CHANGELOGCHANNEL_VERSION+1;
+	if(VBufStorage_changeLogChannel_t(memory.data(),size,false).isValid()) {
+		wcerr<<L"channel with another version accepted"<<endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	string mode=(argc>1)?argv[1]:"";
+	if(mode=="record"&&argc>3) {
+		ofstream out(argv[3],ios::binary);
+		ChangeLogTester tester(strtoul(argv[2],NULL,10),&out);
+		return tester.run(DEFAULT_OP_COUNT)?0:1;
+	} else if(mode=="replay"&&argc>2) {
+		return replay(argv[2])?0:1;
+	}
+	unsigned int seedCount=(argc>1)?strtoul(argv[1],NULL,10):100;
+	int opCount=(argc>2)?atoi(argv[2]):DEFAULT_OP_COUNT;
+	int failCount=0;
+	for(unsigned int seed=1;seed<=seedCount;++seed) {
+		ChangeLogTester tester(seed,NULL);
+		if(!tester.run(opCount)) {
+			wcerr<<L"seed "<<seed<<L" failed"<<endl;
+			failCount++;
+		}
+	}
+	if(!testDamagedChannel()) {
+		wcerr<<L"damaged channel test failed"<<endl;
+		failCount++;
+	}
+	if(!testChannelThreads()) failCount++;
+	wcout<<seedCount<<L" seeds, "<<failCount<<L" failures"<<endl;
+	return failCount?1:0;
+}
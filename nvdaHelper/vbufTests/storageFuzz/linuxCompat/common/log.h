@@ -0,0 +1,37 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+/**
+ * Stand-in for common/log.h so that vbufBase/storage.cpp can be built outside of Windows for testing.
+ * It is placed earlier on the include path than the real header.
+ * Assertions are real, logging is compiled out just as it is for release builds (LOGLEVEL_NONE).
+ */
+
+#ifndef NVDAHELPER_LOG_H
+#define NVDAHELPER_LOG_H
+
+#include <cassert>
+#include <string>
+#include <sstream>
+
+#define nhAssert assert
+
+#define LOG_CRITICAL(message)
+#define LOG_ERROR(message)
+#define LOG_WARNING(message)
+#define LOG_INFO(message)
+#define LOG_DEBUGWARNING(message)
+#define LOG_DEBUG(message)
+
+#endif
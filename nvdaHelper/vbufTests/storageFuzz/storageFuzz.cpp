@@ -0,0 +1,1444 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+/**
+ * Randomized differential tests for VBufStorage_buffer_t.
+ * Random sequences of add, remove, replaceSubtrees, copySubtree, deferControlFieldNode, compressColdSubtrees, selection and pinned offset operations are applied both to a real buffer and to a deliberately naive reference model.
+ * After every operation the buffer's internal invariants are checked and the results of a random set of queries are compared against the model.
+ * Queries decompress whichever compressed subtrees they reach, so the model binds to the decompressed nodes as it comes across them.
+ * The same operations can be driven either by a seeded PRNG (the default main) or by libFuzzer input (build with VBUF_LIBFUZZER defined).
+ * See GNUmakefile in this directory for how to build and run it.
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <random>
+#include <regex>
+#include <algorithm>
+#include <common/xml.h>
+#include <vbufBase/utils.h>
+#include <vbufBase/storage.h>
+
+using namespace std;
+
+#define TEST_DOCHANDLE 1
+#define MAX_NODES 400
+#define DEFAULT_OP_COUNT 300
+#define FUZZER_MAX_OP_COUNT 2000
+
+/**
+ * Supplies the choices that drive a test run.
+ */
+class OpSource {
+	public:
+	virtual ~OpSource() {}
+
+/**
+ * @param bound the exclusive upper bound of the choice.
+ * @return a number between 0 and bound-1, or 0 if bound is 0.
+ */
+	virtual unsigned int next(unsigned int bound)=0;
+
+/**
+ * @return true if this source has no more choices to give, in which case a run should stop.
+ */
+	virtual bool isExhausted() const { return false; }
+
+	bool chance(unsigned int oneIn) { return this->next(oneIn)==0; }
+
+};
+
+class RandomOpSource: public OpSource {
+	private:
+	mt19937 engine;
+
+	public:
+	RandomOpSource(unsigned int seed): engine(seed) {}
+
+	virtual unsigned int next(unsigned int bound) {
+		if(bound<=1) return 0;
+		return uniform_int_distribution<unsigned int>(0,bound-1)(engine);
+	}
+
+};
+
+class ByteOpSource: public OpSource {
+	private:
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+
+	public:
+	ByteOpSource(const uint8_t* dataArg, size_t sizeArg): data(dataArg), size(sizeArg), pos(0) {}
+
+	virtual unsigned int next(unsigned int bound) {
+		if(bound<=1||pos>=size) return 0;
+		unsigned int value=data[pos++];
+		if(bound>256&&pos<size) value=(value<<8)|data[pos++];
+		return value%bound;
+	}
+
+	virtual bool isExhausted() const { return pos>=size; }
+
+};
+
+/**
+ * A node in the reference model.
+ * The model stores plain text and children and computes everything else (lengths, offsets) naively on demand.
+ */
+struct RefNode {
+	bool isControl;
+	int ID;
+	bool isBlock;
+	bool isHidden;
+	bool isDeferred;
+	wstring text;
+	VBufStorage_attributeMap_t attributes;
+	RefNode* parent;
+	vector<RefNode*> children;
+	VBufStorage_fieldNode_t* real;
+
+	RefNode(bool isControlArg, int IDArg, bool isBlockArg, const wstring& textArg): isControl(isControlArg), ID(IDArg), isBlock(isBlockArg), isHidden(false), isDeferred(false), text(textArg), attributes(), parent(NULL), children(), real(NULL) {}
+
+};
+
+void deleteRefSubtree(RefNode* node) {
+	for(auto child: node->children) deleteRefSubtree(child);
+	delete node;
+}
+
+RefNode* cloneRefSubtree(const RefNode* node, RefNode* parent) {
+	RefNode* clone=new RefNode(node->isControl,node->ID,node->isBlock,node->text);
+	clone->isHidden=node->isHidden;
+	clone->isDeferred=node->isDeferred;
+	clone->attributes=node->attributes;
+	clone->parent=parent;
+	for(auto child: node->children) clone->children.push_back(cloneRefSubtree(child,clone));
+	return clone;
+}
+
+/**
+ * Points the model nodes of a subtree at the real nodes of a subtree with the same shape.
+ * @return false if the shapes differ.
+ */
+bool bindRefSubtree(RefNode* node, VBufStorage_fieldNode_t* real) {
+	if(!real) return false;
+	node->real=real;
+	VBufStorage_fieldNode_t* realChild=real->getFirstChild();
+	for(auto child: node->children) {
+		if(!bindRefSubtree(child,realChild)) return false;
+		realChild=realChild->getNext();
+	}
+	return realChild==NULL;
+}
+
+/**
+ * Forgets the real nodes of a subtree, for when they have been compressed away.
+ */
+void unbindRefSubtree(RefNode* node) {
+	node->real=NULL;
+	for(auto child: node->children) unbindRefSubtree(child);
+}
+
+/**
+ * Forgets the real nodes below any compressed node in a subtree.
+ */
+void unbindCompressedRefSubtrees(RefNode* node) {
+	if(!node->real) return;
+	for(auto child: node->children) {
+		if(node->real->isCompressed()) {
+			unbindRefSubtree(child);
+		} else {
+			unbindCompressedRefSubtrees(child);
+		}
+	}
+}
+
+int refLength(const RefNode* node) {
+	if(!node->isControl) return static_cast<int>(node->text.length());
+	int length=0;
+	for(auto child: node->children) length+=refLength(child);
+	return length;
+}
+
+int refVisibleNodeCount(const RefNode* node) {
+	int count=node->isHidden?0:1;
+	for(auto child: node->children) count+=refVisibleNodeCount(child);
+	return count;
+}
+
+int refBlockNodeCount(const RefNode* node) {
+	int count=node->isBlock?1:0;
+	for(auto child: node->children) count+=refBlockNodeCount(child);
+	return count;
+}
+
+void refText(const RefNode* node, wstring& text) {
+	if(!node->isControl) {
+		text+=node->text;
+		return;
+	}
+	for(auto child: node->children) refText(child,text);
+}
+
+size_t refIndexInParent(const RefNode* node) {
+	return find(node->parent->children.begin(),node->parent->children.end(),node)-node->parent->children.begin();
+}
+
+int refStartOffset(const RefNode* node) {
+	int offset=0;
+	for(;node->parent;node=node->parent) {
+		for(auto sibling: node->parent->children) {
+			if(sibling==node) break;
+			offset+=refLength(sibling);
+		}
+	}
+	return offset;
+}
+
+/**
+ * Collects the given subtree in depth-first (document) order.
+ */
+void collectRefNodes(RefNode* node, vector<RefNode*>& nodes) {
+	nodes.push_back(node);
+	for(auto child: node->children) collectRefNodes(child,nodes);
+}
+
+RefNode* refLocateTextNode(RefNode* node, int offset, int* relativeOffset) {
+	if(!node->isControl) {
+		*relativeOffset=offset;
+		return node;
+	}
+	int childStart=0;
+	for(auto child: node->children) {
+		int childLength=refLength(child);
+		if(offset<childStart+childLength) return refLocateTextNode(child,offset-childStart,relativeOffset);
+		childStart+=childLength;
+	}
+	return NULL;
+}
+
+wstring stripPrivateCharacters(const wstring& text) {
+	size_t start=0;
+	while(start<text.length()&&isPrivateCharacter(text[start])) ++start;
+	size_t end=text.length();
+	while(end>start&&isPrivateCharacter(text[end-1])) --end;
+	return text.substr(start,end-start);
+}
+
+void escapeRefAttribute(wostringstream& out, const wstring& text) {
+	for(auto c: text) {
+		if(c==L':'||c==L';'||c==L'\\') out<<L"\\";
+		out<<c;
+	}
+}
+
+bool refMatchAttributes(const RefNode* node, const vector<wstring>& attribs, const wregex& regexp) {
+	const wstring parentPrefix=L"parent::";
+	wostringstream input;
+	for(auto& name: attribs) {
+		escapeRefAttribute(input,name);
+		input<<L":";
+		const RefNode* source=node;
+		wstring realName=name;
+		if(node->parent&&name.compare(0,parentPrefix.length(),parentPrefix)==0) {
+			source=node->parent;
+			realName=name.substr(parentPrefix.length());
+		}
+		auto i=source->attributes.find(realName);
+		if(i!=source->attributes.end()) escapeRefAttribute(input,i->second);
+		input<<L";";
+	}
+	return regex_match(input.str(),regexp);
+}
+
+void refMarkupOpeningTagAttributes(const RefNode* node, int startOffset, int endOffset, wstring& text) {
+	wostringstream s;
+	if(node->isControl) {
+		s<<L"controlIdentifier_docHandle=\""<<TEST_DOCHANDLE<<L"\" controlIdentifier_ID=\""<<node->ID<<L"\" ";
+	}
+	s<<L"_startOfNode=\""<<(startOffset==0?1:0)<<L"\" ";
+	s<<L"_endOfNode=\""<<(endOffset>=refLength(node)?1:0)<<L"\" ";
+	s<<L"isBlock=\""<<node->isBlock<<L"\" ";
+	s<<L"isHidden=\""<<node->isHidden<<L"\" ";
+	int childControlCount=0;
+	for(auto child: node->children) {
+		if(refLength(child)>0&&!child->children.empty()) ++childControlCount;
+	}
+	size_t indexInParent=node->parent?refIndexInParent(node):0;
+	size_t parentChildCount=node->parent?node->parent->children.size():1;
+	s<<L"_childcount=\""<<node->children.size()<<L"\" _childcontrolcount=\""<<childControlCount<<L"\" _indexInParent=\""<<indexInParent<<L"\" _parentChildCount=\""<<parentChildCount<<L"\" ";
+	text+=s.str();
+	for(auto& attrib: node->attributes) {
+		text+=sanitizeXMLAttribName(attrib.first);
+		text+=L"=\"";
+		for(auto c: attrib.second) appendCharToXML(c,text,true);
+		text+=L"\" ";
+	}
+}
+
+void refTextInRange(const RefNode* node, int startOffset, int endOffset, wstring& text, bool useMarkup) {
+	int length=refLength(node);
+	if(length==0) return;
+	const wchar_t* tagName=node->isControl?L"control":L"text";
+	if(useMarkup) {
+		text+=L"<";
+		text+=tagName;
+		text+=L" ";
+		refMarkupOpeningTagAttributes(node,startOffset,endOffset,text);
+		text+=L">";
+	}
+	if(node->isControl) {
+		int childStart=0;
+		for(auto child: node->children) {
+			int childLength=refLength(child);
+			int childEnd=childStart+childLength;
+			if(childEnd>startOffset&&endOffset>childStart) {
+				refTextInRange(child,max(startOffset,childStart)-childStart,min(endOffset-childStart,childLength),text,useMarkup);
+			}
+			childStart=childEnd;
+		}
+	} else if(useMarkup) {
+		for(int i=startOffset;i<endOffset;++i) appendCharToXML(node->text[i],text);
+	} else {
+		text.append(node->text,startOffset,endOffset-startOffset);
+	}
+	if(useMarkup) {
+		text+=L"</";
+		text+=tagName;
+		text+=L">";
+	}
+}
+
+/**
+ * Exposes the protected state of a buffer so that its invariants can be checked.
+ */
+class TestBuffer: public VBufStorage_buffer_t {
+	private:
+
+	bool checkSubtreeCounts(VBufStorage_fieldNode_t* node, int visibleNodeCount, int blockNodeCount, wostringstream& error) {
+		if(node->getVisibleNodeCount()!=visibleNodeCount) {
+			error<<L"node "<<node<<L" has visibleNodeCount "<<node->getVisibleNodeCount()<<L" instead of "<<visibleNodeCount;
+			return false;
+		}
+		if(node->getBlockNodeCount()!=blockNodeCount) {
+			error<<L"node "<<node<<L" has blockNodeCount "<<node->getBlockNodeCount()<<L" instead of "<<blockNodeCount;
+			return false;
+		}
+		return true;
+	}
+
+	bool checkSubtree(VBufStorage_fieldNode_t* node, size_t& nodeCount, size_t& controlCount, set<VBufStorage_controlFieldNode_t*>& compressedNodes, wostringstream& error) {
+		++nodeCount;
+		if(this->nodes.count(node)==0) {
+			error<<L"node "<<node<<L" reachable from the root but not in nodes";
+			return false;
+		}
+		VBufStorage_textFieldNode_t* textNode=dynamic_cast<VBufStorage_textFieldNode_t*>(node);
+		if(textNode) {
+			if(node->getFirstChild()||node->getLastChild()) {
+				error<<L"text node "<<node<<L" has children";
+				return false;
+			}
+			if(node->getLength()!=static_cast<int>(textNode->getText().length())) {
+				error<<L"text node "<<node<<L" length "<<node->getLength()<<L" but text length "<<textNode->getText().length();
+				return false;
+			}
+			return this->checkSubtreeCounts(node,node->isHidden()?0:1,node->isBlock()?1:0,error);
+		}
+		VBufStorage_controlFieldNode_t* controlNode=dynamic_cast<VBufStorage_controlFieldNode_t*>(node);
+		if(!controlNode) {
+			error<<L"node "<<node<<L" is neither a text nor a control field node";
+			return false;
+		}
+		++controlCount;
+		int docHandle, ID;
+		controlNode->getIdentifier(&docHandle,&ID);
+		auto i=this->controlFieldNodesByIdentifier.find(VBufStorage_controlFieldNodeIdentifier_t(docHandle,ID));
+		if(i==this->controlFieldNodesByIdentifier.end()||i->second!=controlNode) {
+			error<<L"control node "<<node<<L" with ID "<<ID<<L" not mapped by its identifier";
+			return false;
+		}
+		//The descendants of a compressed node can only be checked against the model, as looking at them would decompress them.
+		if(node->isCompressed()) {
+			compressedNodes.insert(controlNode);
+			return true;
+		}
+		int childLengths=0;
+		int visibleNodeCount=node->isHidden()?0:1;
+		int blockNodeCount=node->isBlock()?1:0;
+		VBufStorage_fieldNode_t* previous=NULL;
+		for(VBufStorage_fieldNode_t* child=node->getFirstChild();child!=NULL;child=child->getNext()) {
+			if(child->getParent()!=controlNode) {
+				error<<L"child "<<child<<L" of "<<node<<L" has parent "<<child->getParent();
+				return false;
+			}
+			if(child->getPrevious()!=previous) {
+				error<<L"child "<<child<<L" of "<<node<<L" has previous "<<child->getPrevious()<<L" instead of "<<previous;
+				return false;
+			}
+			if(child->getLength()<0) {
+				error<<L"child "<<child<<L" has negative length";
+				return false;
+			}
+			if(!this->checkSubtree(child,nodeCount,controlCount,compressedNodes,error)) return false;
+			childLengths+=child->getLength();
+			visibleNodeCount+=child->getVisibleNodeCount();
+			blockNodeCount+=child->getBlockNodeCount();
+			previous=child;
+		}
+		if(node->getLastChild()!=previous) {
+			error<<L"node "<<node<<L" has lastChild "<<node->getLastChild()<<L" instead of "<<previous;
+			return false;
+		}
+		if(node->getLength()!=childLengths) {
+			error<<L"node "<<node<<L" has length "<<node->getLength()<<L" but its children sum to "<<childLengths;
+			return false;
+		}
+		return this->checkSubtreeCounts(node,visibleNodeCount,blockNodeCount,error);
+	}
+
+	public:
+
+	VBufStorage_fieldNode_t* getRootNode() { return this->rootNode; }
+
+	int getRawSelectionStart() const { return this->selectionStart; }
+
+	int getRawSelectionLength() const { return this->selectionLength; }
+
+/**
+ * Checks the structural invariants of this buffer.
+ * @param error where to place a description of the first broken invariant.
+ * @return true if all invariants hold, false otherwise.
+ */
+	bool checkInvariants(wstring& error) {
+		wostringstream s;
+		size_t nodeCount=0;
+		size_t controlCount=0;
+		set<VBufStorage_controlFieldNode_t*> compressedNodes;
+		bool ok=true;
+		if(this->rootNode) {
+			if(this->rootNode->getParent()||this->rootNode->getPrevious()||this->rootNode->getNext()) {
+				s<<L"root node has a parent or siblings";
+				ok=false;
+			} else {
+				ok=this->checkSubtree(this->rootNode,nodeCount,controlCount,compressedNodes,s);
+			}
+		}
+		if(ok&&this->nodes.size()!=nodeCount) {
+			s<<L"nodes holds "<<this->nodes.size()<<L" nodes but "<<nodeCount<<L" are reachable";
+			ok=false;
+		}
+		if(ok&&this->controlFieldNodesByIdentifier.size()!=controlCount) {
+			s<<L"controlFieldNodesByIdentifier holds "<<this->controlFieldNodesByIdentifier.size()<<L" entries but "<<controlCount<<L" control nodes are reachable";
+			ok=false;
+		}
+		for(auto i=this->compressedNodesByIdentifier.begin();ok&&i!=this->compressedNodesByIdentifier.end();++i) {
+			if(compressedNodes.count(i->second)==0) {
+				s<<L"compressedNodesByIdentifier maps ID "<<i->first.ID<<L" to "<<i->second<<L" which is not a reachable compressed node";
+				ok=false;
+			} else if(this->controlFieldNodesByIdentifier.count(i->first)) {
+				s<<L"ID "<<i->first.ID<<L" is mapped both to a node and to a compressed node";
+				ok=false;
+			}
+		}
+		if(ok&&(this->selectionStart<0||this->selectionLength<0)) {
+			s<<L"negative selection "<<this->selectionStart<<L", "<<this->selectionLength;
+			ok=false;
+		}
+		VBufStorage_memoryStats_t stats;
+		this->getMemoryStats(&stats);
+		if(ok&&(static_cast<size_t>(stats.controlFieldNodeCount)!=controlCount||static_cast<size_t>(stats.textFieldNodeCount)!=nodeCount-controlCount)) {
+			s<<L"memory stats count "<<stats.controlFieldNodeCount<<L" control and "<<stats.textFieldNodeCount<<L" text nodes but "<<controlCount<<L" and "<<nodeCount-controlCount<<L" are reachable";
+			ok=false;
+		}
+		if(ok&&static_cast<size_t>(stats.compressedSubtreeCount)!=compressedNodes.size()) {
+			s<<L"memory stats count "<<stats.compressedSubtreeCount<<L" compressed subtrees but "<<compressedNodes.size()<<L" are reachable";
+			ok=false;
+		}
+		if(ok&&(stats.totalBytes!=stats.nodeBytes+stats.attributeBytes+stats.textBytes+stats.compressedBytes+stats.indexBytes||stats.peakBytes<stats.totalBytes||(nodeCount==0&&stats.totalBytes!=0))) {
+			s<<L"inconsistent memory stats: "<<this->getDebugInfo();
+			ok=false;
+		}
+		error=s.str();
+		return ok;
+	}
+
+};
+
+/**
+ * Applies the same random operations to a TestBuffer and a reference model, comparing them as it goes.
+ */
+class StorageFuzzer {
+	private:
+	OpSource& source;
+	TestBuffer buffer;
+	RefNode* root;
+	int selectionStart;
+	int selectionLength;
+	int nextID;
+	map<int,int> pinnedOffsets;
+	vector<wstring> opLog;
+	wstring failure;
+	VBufStorage_text_t text;
+	wstring textModel;
+	VBufStorage_text_t textCopy;
+	wstring textCopyModel;
+
+	bool fail(const wstring& message) {
+		if(this->failure.empty()) this->failure=message;
+		return false;
+	}
+
+	void log(const wstring& message) {
+		this->opLog.push_back(message);
+	}
+
+	vector<RefNode*> liveNodes() {
+		vector<RefNode*> nodes;
+		if(this->root) collectRefNodes(this->root,nodes);
+		return nodes;
+	}
+
+	vector<RefNode*> liveControlNodes() {
+		vector<RefNode*> controls;
+		for(auto node: this->liveNodes()) {
+			if(node->isControl) controls.push_back(node);
+		}
+		return controls;
+	}
+
+	RefNode* findRefControl(int ID) {
+		for(auto node: this->liveNodes()) {
+			if(node->isControl&&node->ID==ID) return node;
+		}
+		return NULL;
+	}
+
+/**
+ * Records the identifiers of the controls containing an offset, root first, with the offset relative to each.
+ */
+	list<pair<int,int>> refAnchor(int offset) {
+		list<pair<int,int>> identifierList;
+		int length=this->root?refLength(this->root):0;
+		if(offset<0||offset>=length) return identifierList;
+		int relativeOffset;
+		RefNode* textNode=refLocateTextNode(this->root,offset,&relativeOffset);
+		for(RefNode* parent=textNode->parent;parent;parent=parent->parent) {
+			identifierList.push_front(make_pair(parent->ID,offset-refStartOffset(parent)));
+		}
+		return identifierList;
+	}
+
+/**
+ * Moves an offset relative to the deepest anchored control which still exists with the same ancestors.
+ */
+	void refResolveAnchor(const list<pair<int,int>>& identifierList, int& offset) {
+		RefNode* lastAncestor=NULL;
+		int lastRelativeOffset=0;
+		for(auto& i: identifierList) {
+			RefNode* current=this->findRefControl(i.first);
+			if(!current||current->parent!=lastAncestor) break;
+			lastAncestor=current;
+			lastRelativeOffset=i.second;
+		}
+		if(lastAncestor) {
+			offset=refStartOffset(lastAncestor)+min(lastRelativeOffset,max(refLength(lastAncestor)-1,0));
+		}
+	}
+
+/**
+ * @return the real node of a model node, first binding it if it was below a compressed node, which decompresses it.
+ */
+	VBufStorage_fieldNode_t* realOf(RefNode* node) {
+		if(!node||node->real) return node?node->real:NULL;
+		RefNode* bound=node->parent;
+		while(bound&&!bound->real) bound=bound->parent;
+		if(!bound||!bindRefSubtree(bound,bound->real)||!node->real) {
+			this->fail(L"decompressed subtree differs from the model");
+		}
+		return node->real;
+	}
+
+	VBufStorage_controlFieldNode_t* asControl(RefNode* node) {
+		return static_cast<VBufStorage_controlFieldNode_t*>(this->realOf(node));
+	}
+
+	wstring randomText() {
+		static const wchar_t alphabet[]=L"ab cd.\t\n\r\xe000\x200b<&";
+		wstring text;
+		unsigned int length=this->source.next(10);
+		for(unsigned int i=0;i<length;++i) text+=alphabet[this->source.next(sizeof(alphabet)/sizeof(wchar_t)-1)];
+		return text;
+	}
+
+	void addRandomAttributes(RefNode* node) {
+		static const wchar_t* roles[]={L"heading",L"link",L"paragraph",L"list"};
+		if(!this->source.chance(4)) {
+			wstring role=roles[this->source.next(4)];
+			node->attributes[L"role"]=role;
+			node->real->addAttribute(L"role",role);
+		}
+		if(this->source.chance(3)) {
+			wstring level(1,static_cast<wchar_t>(L'1'+this->source.next(3)));
+			node->attributes[L"level"]=level;
+			node->real->addAttribute(L"level",level);
+		}
+		if(this->source.chance(6)) {
+			node->attributes[L"odd name"]=L"a:b;c\\\"<";
+			node->real->addAttribute(L"odd name",L"a:b;c\\\"<");
+		}
+	}
+
+/**
+ * Builds a random subtree both in the given buffer and in the model.
+ * @param IDs identifiers to use for new control nodes before inventing fresh ones; used identifiers are removed.
+ */
+	RefNode* buildRandomSubtree(VBufStorage_buffer_t* target, RefNode* parent, RefNode* previous, int depth, vector<int>& IDs, set<RefNode*>& built) {
+		RefNode* node=NULL;
+		if(parent&&(depth>=3||this->source.chance(2))) {
+			wstring text=this->randomText();
+			node=new RefNode(false,0,false,stripPrivateCharacters(text));
+			node->real=target->addTextFieldNode(asControl(parent),this->realOf(previous),text);
+		} else {
+			int ID;
+			if(!IDs.empty()&&!this->source.chance(3)) {
+				ID=IDs.back();
+				IDs.pop_back();
+			} else {
+				ID=this->nextID++;
+			}
+			node=new RefNode(true,ID,this->source.chance(2),L"");
+			node->real=target->addControlFieldNode(asControl(parent),this->realOf(previous),TEST_DOCHANDLE,ID,node->isBlock);
+		}
+		if(!node->real) {
+			delete node;
+			return NULL;
+		}
+		node->parent=parent;
+		if(parent) parent->children.push_back(node);
+		built.insert(node);
+		if(node->isControl) {
+			this->addRandomAttributes(node);
+			unsigned int childCount=this->source.next(depth==0?5:4);
+			RefNode* child=NULL;
+			for(unsigned int i=0;i<childCount;++i) {
+				RefNode* newChild=this->buildRandomSubtree(target,node,child,depth+1,IDs,built);
+				if(!newChild) break;
+				child=newChild;
+			}
+		}
+		return node;
+	}
+
+/**
+ * Removes a node from the model, either with its descendants or moving its children up in to its place.
+ */
+	void refRemove(RefNode* node, bool removeDescendants) {
+		if(!node->parent) {
+			assert(removeDescendants);
+			this->root=NULL;
+			deleteRefSubtree(node);
+			return;
+		}
+		vector<RefNode*>& siblings=node->parent->children;
+		auto pos=siblings.erase(siblings.begin()+refIndexInParent(node));
+		if(removeDescendants) {
+			deleteRefSubtree(node);
+			return;
+		}
+		for(auto child: node->children) child->parent=node->parent;
+		siblings.insert(pos,node->children.begin(),node->children.end());
+		delete node;
+	}
+
+	bool opAddControl() {
+		RefNode* parent=NULL;
+		RefNode* previous=NULL;
+		size_t index=0;
+		vector<RefNode*> controls=this->liveControlNodes();
+		if(!controls.empty()) {
+			parent=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+			index=this->source.next(static_cast<unsigned int>(parent->children.size()+1));
+			if(index>0) previous=parent->children[index-1];
+		}
+		bool expectFailure=false;
+		int ID=this->nextID;
+		if(!controls.empty()&&this->source.chance(8)) {
+			ID=controls[this->source.next(static_cast<unsigned int>(controls.size()))]->ID;
+			expectFailure=true;
+		} else if(this->root&&this->source.chance(16)) {
+			parent=previous=NULL;
+			expectFailure=true;
+		}
+		bool isBlock=this->source.chance(2);
+		wostringstream s;
+		s<<L"addControlFieldNode parent "<<(parent?parent->ID:-1)<<L" index "<<index<<L" ID "<<ID<<L" isBlock "<<isBlock;
+		this->log(s.str());
+		VBufStorage_controlFieldNode_t* real=this->buffer.addControlFieldNode(asControl(parent),this->realOf(previous),TEST_DOCHANDLE,ID,isBlock);
+		if(expectFailure) {
+			return real?this->fail(L"addControlFieldNode succeeded when it should have failed"):true;
+		}
+		if(!real) return this->fail(L"addControlFieldNode failed");
+		++this->nextID;
+		RefNode* node=new RefNode(true,ID,isBlock,L"");
+		node->real=real;
+		node->parent=parent;
+		if(parent) {
+			parent->children.insert(parent->children.begin()+index,node);
+		} else {
+			this->root=node;
+		}
+		this->addRandomAttributes(node);
+		return true;
+	}
+
+	bool opAddText() {
+		vector<RefNode*> controls=this->liveControlNodes();
+		if(controls.empty()) return true;
+		RefNode* parent=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+		size_t index=this->source.next(static_cast<unsigned int>(parent->children.size()+1));
+		RefNode* previous=index>0?parent->children[index-1]:NULL;
+		wstring text=this->randomText();
+		wostringstream s;
+		s<<L"addTextFieldNode parent "<<parent->ID<<L" index "<<index<<L" length "<<text.length();
+		this->log(s.str());
+		VBufStorage_textFieldNode_t* real=this->buffer.addTextFieldNode(asControl(parent),this->realOf(previous),text);
+		if(!real) return this->fail(L"addTextFieldNode failed");
+		RefNode* node=new RefNode(false,0,false,stripPrivateCharacters(text));
+		node->real=real;
+		node->parent=parent;
+		parent->children.insert(parent->children.begin()+index,node);
+		if(this->source.chance(4)) {
+			node->attributes[L"role"]=L"heading";
+			real->addAttribute(L"role",L"heading");
+			if(this->source.chance(2)) {
+				VBufStorage_memoryStats_t before, after, again;
+				this->buffer.getMemoryStats(&before);
+				this->buffer.accountForAttributes(real);
+				this->buffer.getMemoryStats(&after);
+				this->buffer.accountForAttributes(real);
+				this->buffer.getMemoryStats(&again);
+				if(after.attributeBytes<=before.attributeBytes||again.attributeBytes!=after.attributeBytes) return this->fail(L"accountForAttributes did not count the new attribute once");
+			}
+		}
+		return true;
+	}
+
+	bool opEditText() {
+		vector<RefNode*> textNodes;
+		for(auto node: this->liveNodes()) {
+			if(!node->isControl) textNodes.push_back(node);
+		}
+		if(textNodes.empty()) return true;
+		RefNode* node=textNodes[this->source.next(static_cast<unsigned int>(textNodes.size()))];
+		VBufStorage_textFieldNode_t* real=static_cast<VBufStorage_textFieldNode_t*>(this->realOf(node));
+		int nodeLength=refLength(node);
+		int nodeStart=refStartOffset(node);
+		wostringstream s;
+		if(this->source.chance(2)) {
+			int offset=static_cast<int>(this->source.next(nodeLength+3))-1;
+			wstring text=this->randomText();
+			s<<L"insertText at "<<offset<<L" in node at "<<nodeStart<<L" length "<<text.length();
+			this->log(s.str());
+			bool expected=offset>=0&&offset<=nodeLength;
+			if(this->buffer.insertText(real,offset,text)!=expected) return this->fail(L"unexpected result from insertText");
+			if(!expected||text.empty()) return true;
+			node->text.insert(offset,text);
+			int position=nodeStart+offset;
+			int length=static_cast<int>(text.length());
+			int selectionEnd=this->selectionStart+this->selectionLength;
+			if(this->selectionStart>=position) this->selectionStart+=length;
+			if(selectionEnd>=position) selectionEnd+=length;
+			this->selectionLength=selectionEnd-this->selectionStart;
+			for(auto& pin: this->pinnedOffsets) {
+				if(pin.second>=position) pin.second+=length;
+			}
+		} else {
+			int offset=static_cast<int>(this->source.next(nodeLength+2))-1;
+			int count=static_cast<int>(this->source.next(nodeLength+2));
+			s<<L"removeText "<<count<<L" at "<<offset<<L" in node at "<<nodeStart;
+			this->log(s.str());
+			bool expected=offset>=0&&offset+count<=nodeLength;
+			if(this->buffer.removeText(real,offset,count)!=expected) return this->fail(L"unexpected result from removeText");
+			if(!expected) return true;
+			node->text.erase(offset,count);
+			int position=nodeStart+offset;
+			auto adjust=[position,count](int& p) {
+				if(p>=position+count) p-=count;
+				else if(p>position) p=position;
+			};
+			int selectionEnd=this->selectionStart+this->selectionLength;
+			adjust(this->selectionStart);
+			adjust(selectionEnd);
+			this->selectionLength=selectionEnd-this->selectionStart;
+			for(auto& pin: this->pinnedOffsets) adjust(pin.second);
+		}
+		return true;
+	}
+
+	bool opRemove() {
+		vector<RefNode*> nodes=this->liveNodes();
+		if(nodes.empty()) return true;
+		RefNode* node=nodes[this->source.next(static_cast<unsigned int>(nodes.size()))];
+		bool removeDescendants=!this->source.chance(3);
+		bool expected=node->parent||removeDescendants;
+		wostringstream s;
+		s<<L"removeFieldNode "<<(node->isControl?node->ID:-1)<<L" removeDescendants "<<removeDescendants;
+		this->log(s.str());
+		if(this->buffer.removeFieldNode(this->realOf(node),removeDescendants)!=expected) return this->fail(L"unexpected result from removeFieldNode");
+		if(expected) this->refRemove(node,removeDescendants);
+		return true;
+	}
+
+	bool opReplaceSubtrees() {
+		vector<RefNode*> nodes=this->liveNodes();
+		if(nodes.empty()) return true;
+		// Choose up to two unrelated nodes to replace. The root can only be replaced on its own.
+		vector<RefNode*> targets;
+		targets.push_back(nodes[this->source.next(static_cast<unsigned int>(nodes.size()))]);
+		if(targets[0]->parent&&this->source.chance(2)) {
+			RefNode* candidate=nodes[this->source.next(static_cast<unsigned int>(nodes.size()))];
+			bool related=!candidate->parent;
+			for(RefNode* a=candidate;a&&!related;a=a->parent) related=(a==targets[0]);
+			for(RefNode* a=targets[0];a&&!related;a=a->parent) related=(a==candidate);
+			if(!related) targets.push_back(candidate);
+		}
+		// Replacements usually reuse identifiers from the subtrees they replace, as a re-render would.
+		// Occasionally they reuse one from elsewhere in the buffer which must be treated as a clash.
+		vector<int> IDs;
+		set<int> replacedIDs;
+		for(auto target: targets) {
+			vector<RefNode*> subtree;
+			collectRefNodes(target,subtree);
+			for(auto node: subtree) {
+				if(node->isControl) replacedIDs.insert(node->ID);
+			}
+		}
+		IDs.insert(IDs.end(),replacedIDs.begin(),replacedIDs.end());
+		set<int> clashIDs;
+		if(this->source.chance(5)) {
+			vector<RefNode*> controls=this->liveControlNodes();
+			RefNode* other=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+			if(other!=this->root&&replacedIDs.count(other->ID)==0) {
+				clashIDs.insert(other->ID);
+				IDs.push_back(other->ID);
+			}
+		}
+		for(size_t i=IDs.size();i>1;--i) swap(IDs[i-1],IDs[this->source.next(static_cast<unsigned int>(i))]);
+		wostringstream s;
+		s<<L"replaceSubtrees";
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		vector<RefNode*> replacements;
+		set<RefNode*> built;
+		for(auto target: targets) {
+			VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+			RefNode* replacement=this->buildRandomSubtree(tempBuffer,NULL,NULL,0,IDs,built);
+			assert(replacement);
+			m[this->realOf(target)]=tempBuffer;
+			replacements.push_back(replacement);
+			s<<L" "<<(target->isControl?target->ID:-1)<<L"->"<<replacement->ID;
+		}
+		// Any clash identifiers which were not consumed were never used.
+		for(auto ID: IDs) clashIDs.erase(ID);
+		this->log(s.str());
+		// Anchor the selection and pinned offsets the same way the buffer does, but naively.
+		list<pair<int,int>> selectionAnchor=this->refAnchor(this->selectionStart);
+		map<int,list<pair<int,int>>> pinnedAnchors;
+		for(auto& pin: this->pinnedOffsets) pinnedAnchors[pin.first]=this->refAnchor(pin.second);
+		bool result=this->buffer.replaceSubtrees(m);
+		for(size_t i=0;i<targets.size();++i) {
+			RefNode* target=targets[i];
+			RefNode* replacement=replacements[i];
+			if(target->parent) {
+				replacement->parent=target->parent;
+				target->parent->children[refIndexInParent(target)]=replacement;
+			} else {
+				this->root=replacement;
+			}
+			target->parent=NULL;
+			deleteRefSubtree(target);
+		}
+		for(auto ID: clashIDs) {
+			for(auto node: this->liveNodes()) {
+				if(node->isControl&&node->ID==ID&&built.count(node)==0) {
+					this->refRemove(node,false);
+					break;
+				}
+			}
+		}
+		this->refResolveAnchor(selectionAnchor,this->selectionStart);
+		for(auto& pin: pinnedAnchors) this->refResolveAnchor(pin.second,this->pinnedOffsets[pin.first]);
+		if(result!=clashIDs.empty()) return this->fail(L"unexpected result from replaceSubtrees");
+		return true;
+	}
+
+/**
+ * Re-renders a control the way a backend does when only the control itself changed: the control is added afresh to a temporary buffer, its children are copied in from the buffer with copySubtree, and the result replaces the control.
+ */
+	bool opRerenderReusingChildren() {
+		vector<RefNode*> controls=this->liveControlNodes();
+		if(controls.empty()) return true;
+		RefNode* target=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+		wostringstream s;
+		s<<L"rerenderReusingChildren "<<target->ID;
+		this->log(s.str());
+		VBufStorage_buffer_t* tempBuffer=new VBufStorage_buffer_t();
+		RefNode* replacement=new RefNode(true,target->ID,target->isBlock,L"");
+		replacement->real=tempBuffer->addControlFieldNode(NULL,NULL,TEST_DOCHANDLE,target->ID,target->isBlock);
+		assert(replacement->real);
+		this->addRandomAttributes(replacement);
+		VBufStorage_fieldNode_t* previous=NULL;
+		for(auto child: target->children) {
+			RefNode* clone=cloneRefSubtree(child,replacement);
+			replacement->children.push_back(clone);
+			previous=tempBuffer->copySubtree(asControl(replacement),previous,this->realOf(child));
+			if(!bindRefSubtree(clone,previous)) {
+				deleteRefSubtree(replacement);
+				delete tempBuffer;
+				return this->fail(L"copySubtree did not copy the subtree");
+			}
+		}
+		if(tempBuffer->copySubtree(NULL,NULL,replacement->real)) {
+			deleteRefSubtree(replacement);
+			delete tempBuffer;
+			return this->fail(L"copySubtree copied a node in to its own buffer");
+		}
+		list<pair<int,int>> selectionAnchor=this->refAnchor(this->selectionStart);
+		map<int,list<pair<int,int>>> pinnedAnchors;
+		for(auto& pin: this->pinnedOffsets) pinnedAnchors[pin.first]=this->refAnchor(pin.second);
+		map<VBufStorage_fieldNode_t*,VBufStorage_buffer_t*> m;
+		m[this->realOf(target)]=tempBuffer;
+		if(!this->buffer.replaceSubtrees(m)) return this->fail(L"replaceSubtrees failed with copied children");
+		if(target->parent) {
+			replacement->parent=target->parent;
+			target->parent->children[refIndexInParent(target)]=replacement;
+		} else {
+			this->root=replacement;
+		}
+		target->parent=NULL;
+		deleteRefSubtree(target);
+		this->refResolveAnchor(selectionAnchor,this->selectionStart);
+		for(auto& pin: pinnedAnchors) this->refResolveAnchor(pin.second,this->pinnedOffsets[pin.first]);
+		return true;
+	}
+
+	bool opSetSelection() {
+		int length=this->root?refLength(this->root):0;
+		int start=static_cast<int>(this->source.next(length+3))-1;
+		int end=start+static_cast<int>(this->source.next(6))-1;
+		wostringstream s;
+		s<<L"setSelectionOffsets "<<start<<L", "<<end;
+		this->log(s.str());
+		bool expected=!(start<0||end<0||end<start);
+		if(this->buffer.setSelectionOffsets(start,end)!=expected) return this->fail(L"unexpected result from setSelectionOffsets");
+		if(expected) {
+			this->selectionStart=start;
+			this->selectionLength=end-start;
+		}
+		return true;
+	}
+
+	bool opPin() {
+		if(!this->pinnedOffsets.empty()&&this->source.chance(3)) {
+			auto i=this->pinnedOffsets.begin();
+			advance(i,this->source.next(static_cast<unsigned int>(this->pinnedOffsets.size())));
+			wostringstream s;
+			s<<L"unpinOffset "<<i->first;
+			this->log(s.str());
+			if(!this->buffer.unpinOffset(i->first)) return this->fail(L"unpinOffset failed");
+			if(this->buffer.unpinOffset(i->first)) return this->fail(L"unpinOffset succeeded twice");
+			this->pinnedOffsets.erase(i);
+			return true;
+		}
+		int length=this->root?refLength(this->root):0;
+		int offset=static_cast<int>(this->source.next(length+2))-1;
+		wostringstream s;
+		s<<L"pinOffset "<<offset;
+		this->log(s.str());
+		int pinID=this->buffer.pinOffset(offset);
+		if(offset<0) return pinID==0?true:this->fail(L"pinOffset succeeded with a negative offset");
+		if(pinID<=0||this->pinnedOffsets.count(pinID)) return this->fail(L"pinOffset gave a bad ID");
+		this->pinnedOffsets[pinID]=offset;
+		return true;
+	}
+
+	bool opToggleHidden() {
+		vector<RefNode*> nodes=this->liveNodes();
+		if(nodes.empty()) return true;
+		RefNode* node=nodes[this->source.next(static_cast<unsigned int>(nodes.size()))];
+		this->log(L"toggle isHidden");
+		node->isHidden=!node->isHidden;
+		this->realOf(node)->setHidden(node->isHidden);
+		return true;
+	}
+
+	bool opToggleBlock() {
+		vector<RefNode*> controls=this->liveControlNodes();
+		if(controls.empty()) return true;
+		RefNode* node=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+		this->log(L"toggle isBlock");
+		node->isBlock=!node->isBlock;
+		this->realOf(node)->setBlock(node->isBlock);
+		return true;
+	}
+
+	bool opDefer() {
+		vector<RefNode*> controls=this->liveControlNodes();
+		if(controls.empty()) return true;
+		RefNode* node=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+		bool expected=node->parent&&node->children.empty();
+		wostringstream s;
+		s<<L"deferControlFieldNode "<<node->ID;
+		this->log(s.str());
+		VBufStorage_deferredFieldNode_t* real=this->buffer.deferControlFieldNode(asControl(node));
+		if(!expected) {
+			return real?this->fail(L"deferControlFieldNode succeeded when it should have failed"):true;
+		}
+		if(!real) return this->fail(L"deferControlFieldNode failed");
+		int docHandle=0, ID=0;
+		real->getIdentifier(&docHandle,&ID);
+		wstring attributes;
+		for(auto& attribute: node->attributes) attributes+=attribute.first+L":"+attribute.second+L";";
+		if(ID!=node->ID||real->isBlock()!=node->isBlock||real->isHidden()!=node->isHidden||real->getAttributesString()!=attributes) {
+			return this->fail(L"deferControlFieldNode did not keep the node's properties");
+		}
+		node->real=real;
+		node->isDeferred=true;
+		return true;
+	}
+
+	bool opClear() {
+		this->log(L"clearBuffer");
+		this->buffer.clearBuffer();
+		if(this->root) deleteRefSubtree(this->root);
+		this->root=NULL;
+		this->selectionStart=this->selectionLength=0;
+		for(auto& pin: this->pinnedOffsets) pin.second=0;
+		return true;
+	}
+
+	bool checkText(const VBufStorage_text_t& text, const wstring& expected) {
+		if(text.length()!=expected.length()||text.str()!=expected) return this->fail(L"text differs from the model");
+		if(expected.empty()) return true;
+		size_t start=this->source.next(static_cast<unsigned int>(expected.length()));
+		size_t count=this->source.next(static_cast<unsigned int>(expected.length()-start)+1);
+		if(text[start]!=expected[start]) return this->fail(L"text character differs from the model");
+		wstring range;
+		text.appendTo(range,start,count);
+		wstring segments;
+		text.forEachSegment(start,count,[&segments](const wchar_t* segment, size_t segmentLength) {
+			if(segmentLength==0) segments+=L"<empty segment>";
+			segments.append(segment,segmentLength);
+		});
+		if(range!=expected.substr(start,count)||segments!=range) return this->fail(L"text range differs from the model");
+		return true;
+	}
+
+	bool opTextStorage() {
+		int editCount=1+this->source.next(40);
+		for(int i=0;i<editCount;++i) {
+			size_t offset=this->source.next(static_cast<unsigned int>(this->textModel.length())+1);
+			if(this->source.chance(3)&&offset<this->textModel.length()) {
+				size_t count=this->source.next(static_cast<unsigned int>(this->textModel.length()-offset)+1);
+				this->text.erase(offset,count);
+				this->textModel.erase(offset,count);
+			} else {
+				wstring inserted=this->randomText();
+				this->text.insert(offset,inserted);
+				this->textModel.insert(offset,inserted);
+			}
+		}
+		this->log(L"edit text storage, now "+to_wstring(this->textModel.length())+L" characters");
+		if(!this->checkText(this->text,this->textModel)||!this->checkText(this->textCopy,this->textCopyModel)) return false;
+		int cmp=this->text.compare(this->textCopy);
+		int expectedCmp=this->textModel.compare(this->textCopyModel);
+		if((cmp<0)!=(expectedCmp<0)||(cmp==0)!=(expectedCmp==0)) return this->fail(L"text compare differs from the model");
+		if(this->source.chance(4)) {
+			//Copies share chunks, so later edits to either one must not show through to the other
+			this->log(L"copy text storage");
+			this->textCopy=this->text;
+			this->textCopyModel=this->textModel;
+		}
+		if(this->textModel.length()>2000) {
+			this->text=VBufStorage_text_t();
+			this->textModel.clear();
+		}
+		return true;
+	}
+
+	bool opCompress() {
+		VBufStorage_memoryStats_t before, after;
+		//Attributes added after their nodes were inserted are only counted once recalculated, as a backend does after rendering.
+		this->buffer.recalculateMemoryStats();
+		this->buffer.getMemoryStats(&before);
+		size_t budget=this->source.next(static_cast<unsigned int>(before.totalBytes)+1);
+		wostringstream s;
+		s<<L"compressColdSubtrees with a budget of "<<budget<<L" of "<<before.totalBytes<<L" bytes";
+		this->log(s.str());
+		this->buffer.setCompressionBudget(budget);
+		int compressedCount=this->buffer.compressColdSubtrees();
+		this->buffer.setCompressionBudget(0);
+		if(this->buffer.compressColdSubtrees()!=0) return this->fail(L"compressColdSubtrees compressed with no budget");
+		if(this->root) unbindCompressedRefSubtrees(this->root);
+		this->buffer.getMemoryStats(&after);
+		if(compressedCount>0?(after.totalBytes>=before.totalBytes):(after.totalBytes!=before.totalBytes)) return this->fail(L"compressColdSubtrees did not save memory");
+		if(compressedCount>0&&(budget==0||before.totalBytes<=budget)) return this->fail(L"compressColdSubtrees compressed within the budget");
+		return true;
+	}
+
+	bool compareStructure(RefNode* ref, VBufStorage_fieldNode_t* real) {
+		//Nodes decompressed since the model last looked are bound as they are reached.
+		if(!ref->real) ref->real=real;
+		if(ref->real!=real) return this->fail(L"tree structure differs from the model");
+		if(real->isDeferred()!=ref->isDeferred) return this->fail(L"node type differs from the model");
+		if(real->getLength()!=refLength(ref)) return this->fail(L"node length differs from the model");
+		if(real->getVisibleNodeCount()!=refVisibleNodeCount(ref)||real->getBlockNodeCount()!=refBlockNodeCount(ref)) return this->fail(L"node subtree counts differ from the model");
+		if(real->isCompressed()) {
+			for(auto child: ref->children) {
+				if(child->real) return this->fail(L"model bound to a node below a compressed node");
+			}
+			return true;
+		}
+		VBufStorage_fieldNode_t* realChild=real->getFirstChild();
+		for(auto child: ref->children) {
+			if(!realChild) return this->fail(L"node has fewer children than the model");
+			if(!this->compareStructure(child,realChild)) return false;
+			realChild=realChild->getNext();
+		}
+		if(realChild) return this->fail(L"node has more children than the model");
+		return true;
+	}
+
+	bool queryTextInRange(int length) {
+		int startOffset=this->source.next(length);
+		int endOffset=startOffset+1+this->source.next(length-startOffset);
+		bool useMarkup=this->source.chance(2);
+		wstring expected;
+		refTextInRange(this->root,startOffset,endOffset,expected,useMarkup);
+		VBufStorage_textContainer_t* text=this->buffer.getTextInRange(startOffset,endOffset,useMarkup);
+		if(!text) return this->fail(L"getTextInRange returned NULL");
+		bool matched=(text->getString()==expected);
+		text->destroy();
+		return matched?true:this->fail(L"getTextInRange differs from the model");
+	}
+
+	bool queryLocate(int length) {
+		int offset=this->source.next(length);
+		int relativeOffset;
+		RefNode* expected=refLocateTextNode(this->root,offset,&relativeOffset);
+		int startOffset=-1, endOffset=-1;
+		VBufStorage_textFieldNode_t* textNode=this->buffer.locateTextFieldNodeAtOffset(offset,&startOffset,&endOffset);
+		if(!expected||textNode!=this->realOf(expected)) return this->fail(L"locateTextFieldNodeAtOffset found the wrong node");
+		if(startOffset!=offset-relativeOffset||endOffset!=startOffset+refLength(expected)) return this->fail(L"locateTextFieldNodeAtOffset gave wrong offsets");
+		int docHandle=0, ID=0;
+		VBufStorage_controlFieldNode_t* controlNode=this->buffer.locateControlFieldNodeAtOffset(offset,&startOffset,&endOffset,&docHandle,&ID);
+		RefNode* expectedControl=expected->parent;
+		if(controlNode!=this->realOf(expectedControl)||ID!=expectedControl->ID||docHandle!=TEST_DOCHANDLE) return this->fail(L"locateControlFieldNodeAtOffset found the wrong node");
+		int expectedStart=refStartOffset(expectedControl);
+		if(startOffset!=expectedStart||endOffset!=expectedStart+refLength(expectedControl)) return this->fail(L"locateControlFieldNodeAtOffset gave wrong offsets");
+		if(this->buffer.locateTextFieldNodeAtOffset(length,NULL,NULL)) return this->fail(L"locateTextFieldNodeAtOffset found a node past the end");
+		return true;
+	}
+
+	bool queryNodes(int length) {
+		vector<RefNode*> nodes=this->liveNodes();
+		RefNode* node=nodes[this->source.next(static_cast<unsigned int>(nodes.size()))];
+		int startOffset, endOffset;
+		if(!this->buffer.getFieldNodeOffsets(this->realOf(node),&startOffset,&endOffset)) return this->fail(L"getFieldNodeOffsets failed");
+		int expectedStart=refStartOffset(node);
+		if(startOffset!=expectedStart||endOffset!=expectedStart+refLength(node)) return this->fail(L"getFieldNodeOffsets gave wrong offsets");
+		int offset=static_cast<int>(this->source.next(length+2))-1;
+		bool expectedAtOffset=offset>=0&&offset<length&&offset>=startOffset&&offset<endOffset;
+		if(this->buffer.isFieldNodeAtOffset(this->realOf(node),offset)!=expectedAtOffset) return this->fail(L"isFieldNodeAtOffset differs from the model");
+		vector<RefNode*> controls=this->liveControlNodes();
+		RefNode* control=controls[this->source.next(static_cast<unsigned int>(controls.size()))];
+		VBufStorage_controlFieldNode_t* controlNode=this->buffer.getControlFieldNodeWithIdentifier(TEST_DOCHANDLE,control->ID);
+		if(controlNode!=this->realOf(control)) return this->fail(L"getControlFieldNodeWithIdentifier found the wrong node");
+		if(this->buffer.getControlFieldNodeWithIdentifier(TEST_DOCHANDLE,this->nextID)!=NULL) return this->fail(L"getControlFieldNodeWithIdentifier found a node for an unused identifier");
+		return true;
+	}
+
+	bool queryPinsAndAnchors(int length) {
+		for(auto& pin: this->pinnedOffsets) {
+			int offset=-1;
+			if(!this->buffer.getPinnedOffset(pin.first,&offset)||offset!=pin.second) return this->fail(L"pinned offset differs from the model");
+		}
+		int offset=-1;
+		if(this->buffer.getPinnedOffset(-1,&offset)) return this->fail(L"getPinnedOffset succeeded for an unknown ID");
+		VBufStorage_anchor_t anchor;
+		if(this->buffer.createAnchor(length,anchor)) return this->fail(L"createAnchor succeeded past the end");
+		if(length==0) return true;
+		offset=this->source.next(length);
+		if(!this->buffer.createAnchor(offset,anchor)) return this->fail(L"createAnchor failed");
+		list<pair<int,int>> expected=this->refAnchor(offset);
+		if(anchor.ancestors.size()!=expected.size()) return this->fail(L"createAnchor recorded the wrong number of ancestors");
+		auto i=expected.begin();
+		for(auto& ancestor: anchor.ancestors) {
+			if(ancestor.first.docHandle!=TEST_DOCHANDLE||ancestor.first.ID!=i->first||ancestor.second!=i->second) return this->fail(L"createAnchor recorded the wrong ancestors");
+			++i;
+		}
+		int resolvedOffset=-1;
+		if(!this->buffer.resolveAnchor(anchor,&resolvedOffset)||resolvedOffset!=offset) return this->fail(L"resolveAnchor did not give back the anchored offset");
+		return true;
+	}
+
+	bool queryMemory() {
+		VBufStorage_memoryStats_t before, after;
+		this->buffer.getMemoryStats(&before);
+		this->buffer.recalculateMemoryStats();
+		this->buffer.getMemoryStats(&after);
+		if(after.controlFieldNodeCount!=before.controlFieldNodeCount||after.textFieldNodeCount!=before.textFieldNodeCount||after.nodeBytes!=before.nodeBytes||after.textBytes!=before.textBytes||after.indexBytes!=before.indexBytes) return this->fail(L"recalculated memory stats differ from the kept stats");
+		if(after.compressedSubtreeCount!=before.compressedSubtreeCount||after.compressedNodeCount!=before.compressedNodeCount||after.compressedBytes!=before.compressedBytes) return this->fail(L"recalculated memory stats differ from the kept stats");
+		//Attributes added after insertion are only picked up by recalculating
+		if(after.attributeBytes<before.attributeBytes||after.peakBytes<before.peakBytes) return this->fail(L"recalculated memory stats are lower than the kept stats");
+		if(this->buffer.isOverMemoryLimit(after.totalBytes)) return this->fail(L"isOverMemoryLimit true with no limit");
+		this->buffer.setMemoryLimit(after.totalBytes+1);
+		bool underLimit=!this->buffer.isOverMemoryLimit();
+		bool overLimit=this->buffer.isOverMemoryLimit(2);
+		this->buffer.setMemoryLimit(0);
+		if(!underLimit||!overLimit) return this->fail(L"isOverMemoryLimit wrong around the limit");
+		return true;
+	}
+
+	bool querySelection() {
+		if(this->buffer.getRawSelectionStart()!=this->selectionStart||this->buffer.getRawSelectionLength()!=this->selectionLength) return this->fail(L"selection differs from the model");
+		int length=this->root?refLength(this->root):0;
+		int startOffset, endOffset;
+		this->buffer.getSelectionOffsets(&startOffset,&endOffset);
+		if(startOffset!=max(0,this->selectionStart)||endOffset!=min(this->selectionStart+this->selectionLength,length)) return this->fail(L"getSelectionOffsets differs from the model");
+		return true;
+	}
+
+	bool queryFind(int length) {
+		static const struct {
+			const wchar_t* attribs;
+			const wchar_t* regexp;
+		} searches[]={
+			{L"role",L"role:heading;"},
+			{L"role level",L"role:(heading|link);level:[12]?;"},
+			{L"parent::role",L"parent\\\\:\\\\:role:list;"},
+			{L"level role",L"level:3;role:.*;"},
+		};
+		auto& search=searches[this->source.next(sizeof(searches)/sizeof(searches[0]))];
+		VBufStorage_findDirection_t direction=static_cast<VBufStorage_findDirection_t>(this->source.next(3));
+		int offset=static_cast<int>(this->source.next(length+1))-1;
+		vector<wstring> attribsList;
+		wistringstream attribsStream(search.attribs);
+		for(wstring name;attribsStream>>name;) attribsList.push_back(name);
+		wregex regexp(search.regexp);
+		// Work out the expected result on the model.
+		vector<RefNode*> nodes=this->liveNodes();
+		RefNode* start=this->root;
+		int relativeOffset=0;
+		if(offset>=0) start=refLocateTextNode(this->root,offset,&relativeOffset);
+		RefNode* expected=NULL;
+		if(direction==VBufStorage_findDirection_up) {
+			for(RefNode* node=start->parent;node;node=node->parent) {
+				if(!node->isHidden&&refMatchAttributes(node,attribsList,regexp)) {
+					expected=node;
+					break;
+				}
+			}
+		} else {
+			ptrdiff_t startIndex=find(nodes.begin(),nodes.end(),start)-nodes.begin();
+			ptrdiff_t step=(direction==VBufStorage_findDirection_forward)?1:-1;
+			bool skippedFirstMatch=false;
+			for(ptrdiff_t i=startIndex+step;i>=0&&i<static_cast<ptrdiff_t>(nodes.size());i+=step) {
+				RefNode* node=nodes[i];
+				int nodeLength=refLength(node);
+				if(nodeLength==0||node->isHidden||!refMatchAttributes(node,attribsList,regexp)) continue;
+				if(direction==VBufStorage_findDirection_back) {
+					int nodeStart=refStartOffset(node);
+					if(nodeStart==offset||(!skippedFirstMatch&&nodeStart<offset&&nodeStart+nodeLength>offset)) {
+						skippedFirstMatch=true;
+						continue;
+					}
+				}
+				expected=node;
+				break;
+			}
+		}
+		int startOffset=-1, endOffset=-1;
+		VBufStorage_fieldNode_t* found=this->buffer.findNodeByAttributes(offset,direction,search.attribs,search.regexp,&startOffset,&endOffset);
+		if(found!=this->realOf(expected)) {
+			wostringstream s;
+			s<<L"findNodeByAttributes found the wrong node searching "<<search.attribs<<L" in direction "<<direction<<L" from "<<offset;
+			return this->fail(s.str());
+		}
+		if(expected&&(startOffset!=refStartOffset(expected)||endOffset!=startOffset+refLength(expected))) return this->fail(L"findNodeByAttributes gave wrong offsets");
+		return true;
+	}
+
+	bool queryDeferred(int length) {
+		int startOffset=this->source.next(length);
+		int endOffset=this->source.chance(4)?-1:startOffset+1+this->source.next(length-startOffset);
+		int end=(endOffset==-1)?length:endOffset;
+		vector<VBufStorage_deferredFieldNode_t*> found;
+		this->buffer.getDeferredFieldNodesInRange(startOffset,endOffset,found);
+		vector<VBufStorage_deferredFieldNode_t*> expected;
+		for(auto node: this->liveNodes()) {
+			if(!node->isDeferred) continue;
+			int nodeStart=refStartOffset(node);
+			if(nodeStart<end&&nodeStart+refLength(node)>startOffset) expected.push_back(static_cast<VBufStorage_deferredFieldNode_t*>(this->realOf(node)));
+		}
+		if(found!=expected) return this->fail(L"getDeferredFieldNodesInRange differs from the model");
+		return true;
+	}
+
+	bool queryLineOffsets(int length) {
+		int offset=this->source.next(length);
+		int maxLineLength=this->source.chance(2)?0:1+this->source.next(12);
+		bool useScreenLayout=this->source.chance(2);
+		int startOffset=-1, endOffset=-1;
+		if(!this->buffer.getLineOffsets(offset,maxLineLength,useScreenLayout,&startOffset,&endOffset)) return this->fail(L"getLineOffsets failed");
+		if(startOffset<0||startOffset>offset||endOffset<=offset||endOffset>length) return this->fail(L"getLineOffsets gave a line not containing the offset");
+		if(maxLineLength>0&&endOffset-startOffset>maxLineLength) return this->fail(L"getLineOffsets gave a line longer than maxLineLength");
+		wstring text;
+		refText(this->root,text);
+		if(text.find(L'\n',startOffset)<static_cast<size_t>(endOffset-1)) return this->fail(L"getLineOffsets gave a line spanning a line feed");
+		if(this->buffer.getLineOffsets(length,maxLineLength,useScreenLayout,&startOffset,&endOffset)) return this->fail(L"getLineOffsets succeeded past the end");
+		return true;
+	}
+
+	bool verify() {
+		wstring error;
+		if(!this->buffer.checkInvariants(error)) return this->fail(L"broken invariant: "+error);
+		if(this->buffer.hasContent()!=(this->root!=NULL)) return this->fail(L"hasContent differs from the model");
+		if(!this->querySelection()) return false;
+		if(!this->queryPinsAndAnchors(this->root?refLength(this->root):0)) return false;
+		if(this->source.chance(4)&&!this->queryMemory()) return false;
+		if(!this->root) return true;
+		if(!this->compareStructure(this->root,this->buffer.getRootNode())) return false;
+		int length=refLength(this->root);
+		if(this->buffer.getTextLength()!=length) return this->fail(L"getTextLength differs from the model");
+		if(!this->queryNodes(length)) return false;
+		if(length==0) {
+			VBufStorage_textContainer_t* text=this->buffer.getTextInRange(0,1,false);
+			if(text) {
+				text->destroy();
+				return this->fail(L"getTextInRange succeeded on an empty buffer");
+			}
+			return true;
+		}
+		for(int i=0;i<3;++i) {
+			if(!this->queryTextInRange(length)) return false;
+			if(!this->queryLocate(length)) return false;
+			if(!this->queryFind(length)) return false;
+			if(!this->queryLineOffsets(length)) return false;
+		}
+		if(!this->queryDeferred(length)) return false;
+		return true;
+	}
+
+	public:
+
+	StorageFuzzer(OpSource& sourceArg): source(sourceArg), buffer(), root(NULL), selectionStart(0), selectionLength(0), nextID(1), pinnedOffsets(), opLog(), failure(), text(), textModel(), textCopy(), textCopyModel() {}
+
+	~StorageFuzzer() {
+		if(this->root) deleteRefSubtree(this->root);
+	}
+
+/**
+ * Performs random operations, verifying the buffer against the model after each one.
+ * @param opCount the number of operations to perform, or -1 to continue until the source is exhausted.
+ * @return true if no differences were found, false otherwise.
+ */
+	bool run(int opCount) {
+		for(int i=0;opCount<0?(i<FUZZER_MAX_OP_COUNT&&!this->source.isExhausted()):(i<opCount);++i) {
+			size_t nodeCount=this->liveNodes().size();
+			unsigned int op=this->source.next(20);
+			bool result=true;
+			if(!this->root||op<5) {
+				result=this->opAddControl();
+			} else if(op<9) {
+				result=this->opAddText();
+			} else if(op<10) {
+				result=this->opEditText();
+			} else if(op<12||nodeCount>MAX_NODES) {
+				result=this->opRemove();
+			} else if(op<15) {
+				result=this->opReplaceSubtrees();
+			} else if(op<16) {
+				result=this->opRerenderReusingChildren();
+			} else if(op<17) {
+				result=this->opSetSelection();
+			} else if(op<18) {
+				result=this->opPin();
+			} else if(op<19) {
+				result=this->source.chance(3)?this->opDefer():(this->source.chance(2)?this->opToggleBlock():this->opToggleHidden());
+			} else if(this->source.chance(4)) {
+				result=this->opClear();
+			} else if(this->source.chance(2)) {
+				result=this->opCompress();
+			} else {
+				result=this->opTextStorage();
+			}
+			if(!result||!this->verify()||!this->failure.empty()) return false;
+		}
+		return true;
+	}
+
+	void printFailure(wostream& out) const {
+		out<<L"fail: "<<this->failure<<endl;
+		out<<L"after operations:"<<endl;
+		for(auto& op: this->opLog) out<<L"  "<<op<<endl;
+	}
+
+};
+
+#ifdef VBUF_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	ByteOpSource source(data,size);
+	StorageFuzzer fuzzer(source);
+	if(!fuzzer.run(-1)) {
+		fuzzer.printFailure(wcerr);
+		abort();
+	}
+	return 0;
+}
+
+#else
+
+/**
+ * Usage: storageFuzz [seedCount [opCount [firstSeed]]]
+ */
+int main(int argc, char* argv[]) {
+	unsigned int seedCount=(argc>1)?strtoul(argv[1],NULL,10):200;
+	int opCount=(argc>2)?atoi(argv[2]):DEFAULT_OP_COUNT;
+	unsigned int firstSeed=(argc>3)?strtoul(argv[3],NULL,10):1;
+	int failCount=0;
+	for(unsigned int seed=firstSeed;seed<firstSeed+seedCount;++seed) {
+		RandomOpSource source(seed);
+		StorageFuzzer fuzzer(source);
+		if(!fuzzer.run(opCount)) {
+			wcerr<<L"seed "<<seed<<L" ";
+			fuzzer.printFailure(wcerr);
+			failCount++;
+		}
+	}
+	wcout<<seedCount<<L" seeds, "<<failCount<<L" failures"<<endl;
+	return failCount?1:0;
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+This file is a part of the NVDA project.
+URL: http://www.nvda-project.org/
+Copyright 2006-2018 NVDA contributers.
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2.0, as published by
+    the Free Software Foundation.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+This license can be found at:
+http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+*/
+
+/**
+ * Tests and benchmarks for the text scanning functions in common/textScan.h.
+ * Without arguments, random texts are scanned with each function and the results compared against a plain character by character scan.
+ * With the argument bench, each function and its plain equivalent are timed on a large generated text.
+ * See GNUmakefile in this directory for how to build and run it.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <common/textScan.h>
+
+using namespace std;
+
+//The plain scans which the text scanning functions must agree with.
+
+bool refIsHardLineBreak(const wchar_t* text, int length, wchar_t following, int i) {
+	if(text[i]==L'\n') return true;
+	return text[i]==L'\r'&&((i+1<length)?text[i+1]:following)!=L'\n';
+}
+
+int refFindHardLineBreak(const wchar_t* text, int length, wchar_t following) {
+	for(int i=0;i<length;++i) if(refIsHardLineBreak(text,length,following,i)) return i;
+	return length;
+}
+
+int refFindLastHardLineBreak(const wchar_t* text, int length, wchar_t following) {
+	for(int i=length-1;i>=0;--i) if(refIsHardLineBreak(text,length,following,i)) return i;
+	return -1;
+}
+
+bool refFindWhitespaceRunEnds(const wchar_t* text, int length, bool precededByWhitespace, int base, vector<int>& runEnds) {
+	for(int i=0;i<length;++i) {
+		bool whitespace=iswspace(text[i])!=0;
+		if(precededByWhitespace&&!whitespace) runEnds.push_back(base+i);
+		precededByWhitespace=whitespace;
+	}
+	return precededByWhitespace;
+}
+
+int refFindFirst(const wchar_t* text, int length, bool whitespace) {
+	for(int i=0;i<length;++i) if((iswspace(text[i])!=0)==whitespace) return i;
+	return length;
+}
+
+int refFindLast(const wchar_t* text, int length, bool whitespace) {
+	for(int i=length-1;i>=0;--i) if((iswspace(text[i])!=0)==whitespace) return i;
+	return -1;
+}
+
+//Characters to build random texts from: ASCII and non-ASCII whitespace, line breaks, and characters either side of the ranges the block scans test for.
+const wchar_t testChars[]={L'a',L'.',L' ',L'\t',L'\r',L'\n',L'\x0b',L'\x0c',L'\x08',L'\x0e',L'\x1f',L'!',L'\x7f',L'\x80',L'\xa0',L'\x2028',L'\x3000',L'\x8000',L'\xffff'};
+
+int failCount=0;
+
+void check(bool condition, const char* what, const wstring& text, int offset) {
+	if(condition) return;
+	++failCount;
+	wcerr<<L"fail: "<<what<<L" at offset "<<offset<<L" of text:";
+	for(wstring::const_iterator i=text.begin();i!=text.end();++i) wcerr<<L" "<<hex<<static_cast<unsigned int>(*i)<<dec;
+	wcerr<<endl;
+}
+
+void testText(const wstring& text, mt19937& engine) {
+	//Every offset into the text is tried, so that every alignment and every tail length is covered.
+	for(int offset=0;offset<=static_cast<int>(text.length());++offset) {
+		const wchar_t* start=text.c_str()+offset;
+		int length=static_cast<int>(text.length())-offset;
+		wchar_t following=testChars[engine()%(sizeof(testChars)/sizeof(wchar_t))];
+		bool precededByWhitespace=(engine()%2)==0;
+		check(findHardLineBreak(start,length,following)==refFindHardLineBreak(start,length,following),"findHardLineBreak",text,offset);
+		check(findLastHardLineBreak(start,length,following)==refFindLastHardLineBreak(start,length,following),"findLastHardLineBreak",text,offset);
+		vector<int> runEnds, refRunEnds;
+		bool endsWithWhitespace=findWhitespaceRunEnds(start,length,precededByWhitespace,offset,runEnds);
+		bool refEndsWithWhitespace=refFindWhitespaceRunEnds(start,length,precededByWhitespace,offset,refRunEnds);
+		check(runEnds==refRunEnds&&endsWithWhitespace==refEndsWithWhitespace,"findWhitespaceRunEnds",text,offset);
+		check(findWhitespaceChar(start,length)==refFindFirst(start,length,true),"findWhitespaceChar",text,offset);
+		check(findNonWhitespaceChar(start,length)==refFindFirst(start,length,false),"findNonWhitespaceChar",text,offset);
+		check(findLastWhitespaceChar(start,length)==refFindLast(start,length,true),"findLastWhitespaceChar",text,offset);
+		check(findLastNonWhitespaceChar(start,length)==refFindLast(start,length,false),"findLastNonWhitespaceChar",text,offset);
+	}
+	for(int i=0;i<static_cast<int>(text.length());++i) {
+		check(isWhitespaceChar(text[i])==(iswspace(text[i])!=0),"isWhitespaceChar",text,i);
+	}
+}
+
+int runTests(unsigned int textCount) {
+	mt19937 engine(1);
+	for(unsigned int count=0;count<textCount;++count) {
+		wstring text;
+		size_t length=engine()%80;
+		//Most texts only use a few of the test characters, so that runs of whitespace and non-whitespace are long enough to span blocks.
+		size_t charCount=2+engine()%(sizeof(testChars)/sizeof(wchar_t)-1);
+		for(size_t i=0;i<length;++i) text.push_back(testChars[engine()%charCount]);
+		testText(text,engine);
+	}
+	wcout<<textCount<<L" texts, "<<failCount<<L" failures"<<endl;
+	return failCount?1:0;
+}
+
+/**
+ * Times a function over the benchmark text and prints the rate it scanned at.
+ * The text is read through a volatile pointer and something from each run is added to a result, so that the compiler can not skip runs.
+ */
+template<typename function_t> void time(const char* name, const wstring& text, int runs, function_t function) {
+	const wchar_t* volatile data=text.c_str();
+	long long result=0;
+	chrono::steady_clock::time_point start=chrono::steady_clock::now();
+	for(int run=0;run<runs;++run) result+=function(data,static_cast<int>(text.length()));
+	chrono::duration<double> elapsed=chrono::steady_clock::now()-start;
+	double megachars=static_cast<double>(text.length())*runs/1e6;
+	cout<<"  "<<name<<": "<<(megachars/elapsed.count())<<" million characters per second ("<<result<<")"<<endl;
+}
+
+int runBenchmarks(int megachars) {
+	//Prose-like text: words of a few letters separated by spaces, with a paragraph break now and then and no line breaks in between.
+	mt19937 engine(1);
+	wstring text;
+	while(static_cast<int>(text.length())<megachars*1000000) {
+		for(unsigned int i=1+engine()%9;i>0;--i) text.push_back(static_cast<wchar_t>(L'a'+engine()%26));
+		text.push_back((engine()%400==0)?L'\n':L' ');
+	}
+	//Only the last part has a line break to find, so that finding the first one scans all of the text.
+	wstring noBreaks=text;
+	for(wstring::iterator i=noBreaks.begin();i!=noBreaks.end();++i) if(*i==L'\n') *i=L' ';
+	const int runs=20;
+	vector<int> runEnds;
+	runEnds.reserve(text.length());
+	cout<<"findHardLineBreak:"<<endl;
+	time("textScan",noBreaks,runs,[](const wchar_t* t, int l) { return findHardLineBreak(t,l,0); });
+	time("plain",noBreaks,runs,[](const wchar_t* t, int l) { return refFindHardLineBreak(t,l,0); });
+	cout<<"findLastHardLineBreak:"<<endl;
+	time("textScan",noBreaks,runs,[](const wchar_t* t, int l) { return findLastHardLineBreak(t,l,0); });
+	time("plain",noBreaks,runs,[](const wchar_t* t, int l) { return refFindLastHardLineBreak(t,l,0); });
+	cout<<"findWhitespaceRunEnds:"<<endl;
+	time("textScan",text,runs,[&runEnds](const wchar_t* t, int l) { runEnds.clear(); findWhitespaceRunEnds(t,l,false,0,runEnds); return runEnds.size(); });
+	time("plain",text,runs,[&runEnds](const wchar_t* t, int l) { runEnds.clear(); refFindWhitespaceRunEnds(t,l,false,0,runEnds); return runEnds.size(); });
+	//All whitespace, so that finding the first character which is not whitespace scans all of the text.
+	wstring spaces(text.length(),L' ');
+	cout<<"findNonWhitespaceChar:"<<endl;
+	time("textScan",spaces,runs,[](const wchar_t* t, int l) { return findNonWhitespaceChar(t,l); });
+	time("plain",spaces,runs,[](const wchar_t* t, int l) { return refFindFirst(t,l,false); });
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if(argc>1&&strcmp(argv[1],"bench")==0) {
+		return runBenchmarks((argc>2)?atoi(argv[2]):4);
+	}
+	return runTests((argc>1)?strtoul(argv[1],NULL,10):20000);
+}
@@ -68,6 +68,38 @@ def nvdaController_brailleMessage(text):
 	queueHandler.queueFunction(queueHandler.eventQueue,braille.handler.message,text)
 	return 0
 
+#Values of nvdaController_requestType_t
+CONTROLLER_REQUEST_SPEAKTEXT=1
+CONTROLLER_REQUEST_CANCELSPEECH=2
+CONTROLLER_REQUEST_BRAILLEMESSAGE=3
+
+class ControllerRequest(Structure):
+	_fields_=[
+		('type',c_int),
+		('text',c_wchar_p),
+	]
+
+@WINFUNCTYPE(c_long,c_long,POINTER(ControllerRequest))
+def nvdaController_processRequests(count,requests):
+	focus=api.getFocusObject()
+	if focus.sleepMode==focus.SLEEP_FULL:
+		return -1
+	import queueHandler
+	import speech
+	import braille
+	# Queue in the order given so that a cancel only silences speech sent before it.
+	for index in xrange(count):
+		request=requests[index]
+		if request.type==CONTROLLER_REQUEST_SPEAKTEXT:
+			queueHandler.queueFunction(queueHandler.eventQueue,speech.speakText,request.text)
+		elif request.type==CONTROLLER_REQUEST_CANCELSPEECH:
+			queueHandler.queueFunction(queueHandler.eventQueue,speech.cancelSpeech)
+		elif request.type==CONTROLLER_REQUEST_BRAILLEMESSAGE:
+			queueHandler.queueFunction(queueHandler.eventQueue,braille.handler.message,request.text)
+		else:
+			log.debugWarning("Unknown controller request type %d"%request.type)
+	return 0
+
 def _lookupKeyboardLayoutNameWithHexString(layoutString):
 	buf=create_unicode_buffer(1024)
 	bufSize=c_int(2048)
@@ -430,6 +462,7 @@ def initialize():
 		("nvdaController_speakText",nvdaController_speakText),
 		("nvdaController_cancelSpeech",nvdaController_cancelSpeech),
 		("nvdaController_brailleMessage",nvdaController_brailleMessage),
+		("nvdaController_processRequests",nvdaController_processRequests),
 		("nvdaControllerInternal_requestRegistration",nvdaControllerInternal_requestRegistration),
 		("nvdaControllerInternal_inputLangChangeNotify",nvdaControllerInternal_inputLangChangeNotify),
 		("nvdaControllerInternal_typedCharacterNotify",nvdaControllerInternal_typedCharacterNotify),
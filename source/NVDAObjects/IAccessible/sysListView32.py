@@ -151,8 +151,56 @@ class AutoFreeBSTR(BSTR):
 	"""A BSTR that *always* frees itself on deletion.""" 
 	_needsfree=True
 
+#: The last snapshot fetched. Only one is kept, as only the row being read needs one.
+_lastRowSnapshot=None
+
+class RowSnapshot(object):
+	"""Rows of a list view with the text of all of their subitems, as fetched in-process in one call."""
+
+	def __init__(self,windowHandle,changeStamp,rowsText,groupsText):
+		self.windowHandle=windowHandle
+		self.changeStamp=changeStamp
+		#: Maps row indexes to (state, groupID, list of subitem texts in subitem order).
+		self.rows={}
+		for fields in self._parseRecords(rowsText):
+			self.rows[int(fields[0])]=(int(fields[1]),int(fields[2]),fields[3:])
+		#: Maps group indexes to group info as returned by L{List.getListGroupInfo}.
+		self.groups={}
+		for fields in self._parseRecords(groupsText):
+			groupIndex=int(fields[0])
+			self.groups[groupIndex]=dict(header=fields[3] or None,footer=fields[4] or None,state=int(fields[2]),groupIndex=groupIndex)
+
+	@staticmethod
+	def _parseRecords(text):
+		if not text:
+			return []
+		# Every field and record is terminated by its separator, so drop the empty piece after the last one.
+		return [record.split(u"\x1f")[:-1] for record in text.split(u"\x1e")[:-1]]
+
 class List(List):
 
+	def getRowSnapshot(self,row):
+		"""Fetches a row of this list, with the text of all of its subitems, in one call.
+		The list is always asked, as it gives no reliable notification of changes,
+		but the previous snapshot's content is only transferred again if it has changed.
+		@param row: the index of the row.
+		@type row: int
+		@rtype: L{RowSnapshot} or None
+		"""
+		global _lastRowSnapshot
+		snapshot=_lastRowSnapshot if _lastRowSnapshot and _lastRowSnapshot.windowHandle==self.windowHandle and row in _lastRowSnapshot.rows else None
+		itemCount=c_int()
+		changeStamp=c_long()
+		rows=AutoFreeBSTR()
+		groups=AutoFreeBSTR()
+		lastChangeStamp=snapshot.changeStamp if snapshot else 0
+		if watchdog.cancellableExecute(NVDAHelper.localLib.nvdaInProcUtils_sysListView32_getRows,self.appModule.helperLocalBindingHandle,self.windowHandle,row,1,lastChangeStamp,byref(itemCount),byref(changeStamp),byref(rows),byref(groups))!=0:
+			_lastRowSnapshot=None
+			return None
+		if not snapshot or changeStamp.value!=lastChangeStamp:
+			snapshot=_lastRowSnapshot=RowSnapshot(self.windowHandle,changeStamp.value,rows.value,groups.value)
+		return snapshot
+
 	def getListGroupInfo(self,groupIndex):
 		header=AutoFreeBSTR()
 		footer=AutoFreeBSTR()
@@ -313,7 +361,18 @@ class ListItem(RowWithFakeNavigation, RowWithoutCellObjects, ListItemWithoutColu
 	def _getColumnLocation(self,column):
 		return self._getColumnLocationRaw(self.parent._columnOrderArray[column - 1])
 
+	#: Cached for the core cycle, so that reading every column of this row costs a single in-process call.
+	_cache__rowSnapshot=True
+
+	def _get__rowSnapshot(self):
+		parent=self.parent
+		return parent.getRowSnapshot(self.IAccessibleChildID-1) if isinstance(parent,List) else None
+
 	def _getColumnContentRaw(self, index):
+		snapshot=self._rowSnapshot
+		row=snapshot.rows.get(self.IAccessibleChildID-1) if snapshot else None
+		if row and index<len(row[2]):
+			return row[2][index] or None
 		buffer=None
 		processHandle=self.processHandle
 		internalItem=winKernel.virtualAllocEx(processHandle,None,sizeof(self.LVITEM),winKernel.MEM_COMMIT,winKernel.PAGE_READWRITE)
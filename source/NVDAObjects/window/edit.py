@@ -7,7 +7,7 @@ import locale
 import comtypes.client
 import struct
 import ctypes
-from comtypes import COMError
+from comtypes import COMError, BSTR
 import pythoncom
 import win32clipboard
 import oleTypes
@@ -32,6 +32,7 @@ from .. import NVDAObjectTextInfo
 from ..behaviors import EditableTextWithAutoSelectDetection
 import braille
 import watchdog
+import NVDAHelper
 
 selOffsetsAtLastCaretEvent=None
 
@@ -92,6 +93,16 @@ CFE_SUPERSCRIPT=0x00020000 #  mutually exclusive
 
 SCF_SELECTION=0x1
 
+#Flags for nvdaInProcUtils_edit_getTextInRange
+EDITTEXT_RICHEDIT=0x1
+EDITTEXT_FORMATTING=0x2
+#: The most line starts fetched by one call to nvdaInProcUtils_edit_getTextInRange.
+EDITTEXT_MAX_LINE_STARTS=1024
+
+class AutoFreeBSTR(BSTR):
+	"""A BSTR that *always* frees itself on deletion.""" 
+	_needsfree=True
+
 class CharFormat2WStruct(ctypes.Structure):
 	_fields_=[
 		('cbSize',ctypes.c_uint),
@@ -159,6 +170,46 @@ WB_RIGHTBREAK=7
 
 class EditTextInfo(textInfos.offsets.OffsetsTextInfo):
 
+	def _getInProcTextInRange(self,start,end,formatting=False):
+		"""Fetches the text, line starts and formatting of a range from within the control's process in one call.
+		@return: the text, the start of each line overlapping the range followed by the start of the next line, and the formatting runs as returned by nvdaInProcUtils_edit_getTextInRange; or None if this is not possible.
+		"""
+		bindingHandle=self.obj.appModule.helperLocalBindingHandle
+		# Rich edit messages are not converted for ANSI windows.
+		if not bindingHandle or not self.obj.isWindowUnicode:
+			return None
+		flags=0
+		if self.obj.editAPIVersion>=2:
+			flags|=EDITTEXT_RICHEDIT
+		if formatting:
+			flags|=EDITTEXT_FORMATTING
+		text=AutoFreeBSTR()
+		formatRuns=AutoFreeBSTR()
+		lineStartCount=ctypes.c_int()
+		lineStarts=(ctypes.c_int*EDITTEXT_MAX_LINE_STARTS)()
+		if watchdog.cancellableExecute(NVDAHelper.localLib.nvdaInProcUtils_edit_getTextInRange,bindingHandle,self.obj.windowHandle,start,end,flags,EDITTEXT_MAX_LINE_STARTS,ctypes.byref(text),ctypes.byref(lineStartCount),lineStarts,ctypes.byref(formatRuns))!=0:
+			return None
+		return text.value or u"",lineStarts[:lineStartCount.value],formatRuns.value
+
+	def _getInProcCharFormat(self,offset):
+		res=self._getInProcTextInRange(offset,offset+1,formatting=True)
+		if not res or not res[2]:
+			return None
+		for run in res[2].split(u"\x1e")[:-1]:
+			fields=run.split(u"\x1f")
+			if not int(fields[0])<=offset<int(fields[1]):
+				continue
+			charFormat=CharFormat2WStruct()
+			charFormat.cbSize=ctypes.sizeof(CharFormat2WStruct)
+			charFormat.dwMask=0xffffffff
+			charFormat.szFaceName=fields[2][:LF_FACESIZE-1]
+			charFormat.yHeight=int(fields[3])
+			charFormat.dwEffects=int(fields[4])
+			charFormat.crTextColor=int(fields[5])
+			charFormat.crBackColor=int(fields[6])
+			return charFormat
+		return None
+
 	def _getPointFromOffset(self,offset):
 		if self.obj.editAPIVersion==1 or self.obj.editAPIVersion>=3:
 			processHandle=self.obj.processHandle
@@ -197,6 +248,10 @@ class EditTextInfo(textInfos.offsets.OffsetsTextInfo):
 		return offset
 
 	def _getCharFormat(self,offset):
+		if self.obj.editAPIVersion>=2:
+			charFormat=self._getInProcCharFormat(offset)
+			if charFormat:
+				return charFormat
 		oldSel=self._getSelectionOffsets()
 		if oldSel!=(offset,offset+1):
 			self._setSelectionOffsets(offset,offset+1)
@@ -325,6 +380,12 @@ class EditTextInfo(textInfos.offsets.OffsetsTextInfo):
 		return self.obj.windowTextLineCount
 
 	def _getTextRange(self,start,end):
+		res=self._getInProcTextInRange(start,end)
+		if res is not None:
+			text=res[0]
+			if text and controlTypes.STATE_PROTECTED in self.obj.states:
+				text=u'*'*len(text)
+			return text
 		if self.obj.editAPIVersion>=2:
 			bufLen=((end-start)+1)*2
 			if self.obj.isWindowUnicode:
@@ -383,6 +444,11 @@ class EditTextInfo(textInfos.offsets.OffsetsTextInfo):
 			return watchdog.cancellableSendMessage(self.obj.windowHandle,winUser.EM_LINEFROMCHAR,offset,0)
 
 	def _getLineOffsets(self,offset):
+		res=self._getInProcTextInRange(offset,offset)
+		if res is not None:
+			lineStarts=res[1]
+			if len(lineStarts)>=2 and lineStarts[0]<=offset<lineStarts[1]:
+				return (lineStarts[0],lineStarts[1])
 		lineNum=self._getLineNumFromOffset(offset)
 		start=watchdog.cancellableSendMessage(self.obj.windowHandle,winUser.EM_LINEINDEX,lineNum,0)
 		length=watchdog.cancellableSendMessage(self.obj.windowHandle,winUser.EM_LINELENGTH,offset,0)
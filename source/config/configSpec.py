@@ -136,6 +136,11 @@ schemaVersion = integer(min=0, default={latestSchemaVersion})
 	passThroughAudioIndication = boolean(default=true)
 	autoSayAllOnPageLoad = boolean(default=true)
 	trapNonCommandGestures = boolean(default=true)
+	# Soft limit in megabytes on the memory a buffer should use in the application, 0 for no limit.
+	# When over the limit, content NVDA does not need (such as unused attributes) is left out.
+	memoryLimit = integer(default=512, min=0)
+	# Keep a copy of each buffer in NVDA, updated through shared memory, so that reading it does not wait on the application.
+	mirror = boolean(default=false)
 
 [touch]
 	touchTyping = boolean(default=False)
@@ -42,6 +42,25 @@ VBufStorage_findDirection_back=1
 VBufStorage_findDirection_up=2
 VBufRemote_nodeHandle_t=ctypes.c_ulonglong
 
+class VBufMemoryStats(ctypes.Structure):
+	"""The memory used by a virtual buffer, as returned by VBuf_getMemoryStats."""
+	_fields_=[
+		("controlFieldNodeCount",ctypes.c_int),
+		("textFieldNodeCount",ctypes.c_int),
+		("nodeBytes",ctypes.c_ulonglong),
+		("attributeBytes",ctypes.c_ulonglong),
+		("textBytes",ctypes.c_ulonglong),
+		("indexBytes",ctypes.c_ulonglong),
+		("totalBytes",ctypes.c_ulonglong),
+		("peakBytes",ctypes.c_ulonglong),
+		("compressedBytes",ctypes.c_ulonglong),
+		("compressedSubtreeCount",ctypes.c_int),
+		("compressedNodeCount",ctypes.c_int),
+	]
+
+	def __repr__(self):
+		return ", ".join("%s=%d"%(name,getattr(self,name)) for name,fieldType in self._fields_)
+
 
 class VBufStorage_findMatch_word(unicode):
 	pass
@@ -414,9 +433,11 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 		try:
 			if log.isEnabledFor(log.DEBUG):
 				startTime = time.time()
-			self.VBufHandle=NVDAHelper.localLib.VBuf_createBuffer(self.rootNVDAObject.appModule.helperLocalBindingHandle,self.rootDocHandle,self.rootID,unicode(self.backendName))
+			self.VBufHandle=NVDAHelper.localLib.VBuf_createBuffer(self.rootNVDAObject.appModule.helperLocalBindingHandle,self.rootDocHandle,self.rootID,unicode(self.backendName),config.conf["virtualBuffers"]["memoryLimit"]*1024)
 			if not self.VBufHandle:
 				raise RuntimeError("Could not remotely create virtualBuffer")
+			if config.conf["virtualBuffers"]["mirror"] and not NVDAHelper.localLib.VBuf_enableMirror(self.VBufHandle,self.rootNVDAObject.processID,config.conf["virtualBuffers"]["memoryLimit"]*1024):
+				log.debugWarning("Could not mirror virtualBuffer, querying the application instead")
 		except:
 			log.error("", exc_info=True)
 			queueHandler.queueFunction(queueHandler.eventQueue, self._loadBufferDone, success=False)
@@ -425,6 +446,7 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 			log.debug("Buffer load took %.3f sec, %d chars" % (
 				time.time() - startTime,
 				NVDAHelper.localLib.VBuf_getTextLength(self.VBufHandle)))
+			log.debug("Buffer memory: %s" % self.getMemoryStats())
 		queueHandler.queueFunction(queueHandler.eventQueue, self._loadBufferDone)
 
 	def _loadBufferDone(self, success=True):
@@ -445,6 +467,18 @@ class VirtualBuffer(browseMode.BrowseModeDocumentTreeInterceptor):
 		# Translators: Reported while loading a document.
 		ui.message(_("Loading document..."))
 
+	def getMemoryStats(self):
+		"""Fetches the memory used by this buffer.
+		@return: The memory stats, or C{None} if the buffer isn't loaded.
+		@rtype: L{VBufMemoryStats}
+		"""
+		if not self.VBufHandle:
+			return None
+		stats=VBufMemoryStats()
+		if not NVDAHelper.localLib.VBuf_getMemoryStats(self.VBufHandle,ctypes.byref(stats)):
+			return None
+		return stats
+
 	def unloadBuffer(self):
 		if self.VBufHandle is not None:
 			try: